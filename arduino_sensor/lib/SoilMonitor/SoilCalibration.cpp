@@ -0,0 +1,40 @@
+/*
+ *  SoilCalibration piecewise-linear tables built at compile time
+ *  from calibration points, converted with fixed-point math
+ */
+
+#include "SoilCalibration.h"
+
+uint8_t SoilCalibrationPercent(const SoilCalibrationSegment *segments, uint8_t count, uint16_t raw)  {
+
+    // Readings past either end of the curve are held at that end
+    if(raw <= segments[0].raw)  {
+        return segments[0].percent;
+    }
+    uint8_t index = 0;
+    while(index + 1 < count && raw >= segments[index + 1].raw)  {
+        index++;
+    }
+
+    // A 16x16 bit multiply, then the top half rounded, which the AVR does without a library division
+    const SoilCalibrationSegment &segment = segments[index];
+    uint8_t change = ((uint32_t)(uint16_t)(raw - segment.raw) * segment.percentPerRaw
+                      + (1UL << (SOIL_CALIBRATION_FRACTION_BITS - 1))) >> SOIL_CALIBRATION_FRACTION_BITS;
+    return segment.isRising ? segment.percent + change : segment.percent - change;
+}
+
+uint16_t SoilCalibrationRaw(const SoilCalibrationSegment *segments, uint8_t count, uint8_t percent)  {
+
+    for(uint8_t i=0; i+1<count; i++)    {
+        const SoilCalibrationSegment &from = segments[i];
+        const SoilCalibrationSegment &to = segments[i + 1];
+        if(SoilDistance(percent, from.percent) + SoilDistance(percent, to.percent) == SoilDistance(from.percent, to.percent))   {
+            uint8_t span = SoilDistance(from.percent, to.percent);
+            return from.raw + ((uint32_t)SoilDistance(percent, from.percent) * (to.raw - from.raw) + span / 2) / span;
+        }
+    }
+
+    // Past the curve, the reading at the nearer end
+    return SoilDistance(percent, segments[0].percent) < SoilDistance(percent, segments[count - 1].percent)
+           ? segments[0].raw : segments[count - 1].raw;
+}
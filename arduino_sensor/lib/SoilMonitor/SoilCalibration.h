@@ -0,0 +1,93 @@
+/*
+ *  SoilCalibration piecewise-linear tables built at compile time
+ *  from calibration points, converted with fixed-point math
+ */
+
+#ifndef SOILCALIBRATION_H
+#define SOILCALIBRATION_H
+
+#define SOIL_CALIBRATION_MAX_POINTS         (8)                                             // Most points a curve can have, sets the RAM kept for CalibrateSensor()
+#define SOIL_CALIBRATION_FRACTION_BITS      (16)                                            // percentPerRaw is a fraction of a percent in this many bits
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Raw reading of the sensor at a known moisture, e.g. found by weighing a pot of soil as it dries
+struct SoilCalibrationPoint {
+    uint16_t raw;
+    uint8_t percent;
+};
+
+// A point of the curve with the slope to the next one worked out ahead, so a conversion only multiplies and shifts
+struct SoilCalibrationSegment {
+    uint16_t raw;                                                                           //  Increases from one segment to the next
+    uint8_t percent;                                                                        //  At raw
+    uint8_t isRising;                                                                       //  Percent rises with the reading, 0 for probes that read lower when wet
+    uint16_t percentPerRaw;                                                                 //  Percent change per count in 0.16 fixed point, 0 on the last point
+};
+
+template<size_t Count>
+struct SoilCalibrationTable {
+    SoilCalibrationSegment segments[Count];
+};
+
+// Everything below is constexpr in the single return form of C++11, which is what the AVR core builds with.
+// The divisions run in the compiler, and CalibrateSensor() reuses SoilSegment() at run time when it rescales
+
+constexpr uint8_t SoilDistance(uint8_t from, uint8_t to)   {
+    return from < to ? to - from : from - to;
+}
+
+constexpr uint32_t SoilSlope(uint32_t percentChange, uint32_t rawChange)  {
+    return rawChange == 0 ? 0 : ((percentChange << SOIL_CALIBRATION_FRACTION_BITS) + rawChange / 2) / rawChange;
+}
+
+constexpr SoilCalibrationSegment SoilSegment(SoilCalibrationPoint from, SoilCalibrationPoint to)    {
+    return {from.raw, from.percent, (uint8_t)(to.percent > from.percent),                   //  Held at 0xFFFF if a rescaled curve is 1% per count or steeper
+            (uint16_t)(SoilSlope(SoilDistance(from.percent, to.percent), to.raw - from.raw) > 0xFFFF ? 0xFFFF
+                       : SoilSlope(SoilDistance(from.percent, to.percent), to.raw - from.raw))};
+}
+
+template<uint8_t... Index>
+struct SoilIndexList {};
+
+template<uint8_t Count, uint8_t... Index>
+struct SoilIndexRange : SoilIndexRange<Count - 1, Count - 1, Index...> {};
+
+template<uint8_t... Index>
+struct SoilIndexRange<0, Index...>  {
+    typedef SoilIndexList<Index...> type;
+};
+
+template<size_t Count, uint8_t... Index>
+constexpr SoilCalibrationTable<Count> SoilBuildTable(const SoilCalibrationPoint (&points)[Count], SoilIndexList<Index...>)  {
+    return {{SoilSegment(points[Index], points[Index + 1 < Count ? Index + 1 : Index])...}};
+}
+
+// Builds the table for points in increasing raw order, check them with SoilIsCalibrationValid()
+template<size_t Count>
+constexpr SoilCalibrationTable<Count> SoilCalibrate(const SoilCalibrationPoint (&points)[Count])  {
+    return SoilBuildTable(points, typename SoilIndexRange<Count>::type());
+}
+
+constexpr bool SoilIsStepValid(const SoilCalibrationPoint *points, size_t index) {
+    return points[index].raw > points[index - 1].raw && points[index].percent <= 100        //  Less than 1% per count, going the same way as the first step
+        && SoilDistance(points[index].percent, points[index - 1].percent) < points[index].raw - points[index - 1].raw
+        && (points[index].percent > points[index - 1].percent) == (points[1].percent > points[0].percent)
+        && points[index].percent != points[index - 1].percent;
+}
+
+constexpr bool SoilIsCalibrationValid(const SoilCalibrationPoint *points, size_t count, size_t index = 1)    {
+    return count >= 2 && count <= SOIL_CALIBRATION_MAX_POINTS && points[0].percent <= 100
+        && (index >= count || (SoilIsStepValid(points, index) && SoilIsCalibrationValid(points, count, index + 1)));
+}
+
+template<size_t Count>
+constexpr bool SoilIsCalibrationValid(const SoilCalibrationPoint (&points)[Count])    {
+    return SoilIsCalibrationValid(points, Count);
+}
+
+uint8_t SoilCalibrationPercent(const SoilCalibrationSegment *segments, uint8_t count, uint16_t raw);//  Clamped to the ends of the curve
+uint16_t SoilCalibrationRaw(const SoilCalibrationSegment *segments, uint8_t count, uint8_t percent);//  The other way, for thresholds, uses a division
+
+#endif
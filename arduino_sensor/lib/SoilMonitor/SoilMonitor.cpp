@@ -8,7 +8,14 @@
 
 #include "SoilMonitor.h"
 
-SoilMonitor::SoilMonitor(uint8_t sensorPowerPin, uint8_t sensorDataPin, uint8_t pumpPowerPin, uint8_t floatSensorPin)  {
+static constexpr SoilCalibrationTable<2> linearTable = SoilCalibrate(soilCurveLinear);
+
+// Dividing by SAMPLE_QUANTITY as a multiply and shift, exact for any 16-bit sum since the reciprocal is off by under 2^-18
+static constexpr uint32_t SAMPLE_RECIPROCAL = ((1UL << 18) + SAMPLE_QUANTITY - 1) / SAMPLE_QUANTITY;
+static_assert(SAMPLE_RECIPROCAL * SAMPLE_QUANTITY - (1UL << 18) < SAMPLE_QUANTITY && SAMPLE_RECIPROCAL <= 0xFFFF,
+              "SAMPLE_QUANTITY needs a different shift for its reciprocal");
+
+SoilMonitor::SoilMonitor(uint8_t sensorPowerPin, uint8_t sensorDataPin, uint8_t pumpPowerPin, uint8_t floatSensorPin) : watering(*this)  {
     
     // Set up the pinout
     SOILSENSOR_PWR_PIN  = sensorPowerPin;
@@ -16,30 +23,36 @@ SoilMonitor::SoilMonitor(uint8_t sensorPowerPin, uint8_t sensorDataPin, uint8_t
     PUMP_PWR_PIN        = pumpPowerPin;
     FLOAT_SENSOR_PIN    = floatSensorPin;
     // Configure digital pin modes. Soil data needs no configuration since it is an analog pin
-    pinMode(SOILSENSOR_PWR_PIN, OUTPUT);
-    pinMode(PUMP_PWR_PIN, OUTPUT);
-    pinMode(FLOAT_SENSOR_PIN, INPUT_PULLUP);
+    HalPinMode(SOILSENSOR_PWR_PIN, HAL_OUTPUT);
+    HalPinMode(PUMP_PWR_PIN, HAL_OUTPUT);
+    HalPinMode(FLOAT_SENSOR_PIN, HAL_INPUT_PULLUP);
 
     // Initialize calibration values to default for arduino pro mini
+    SetCalibration(linearTable);
     CalibrateSensor(DEFAULT_MIN_MOISTURE, DEFAULT_MAX_MOISTURE);
     // Initialize pump thresholds to default values
     SetAutoWaterThresholds(DEFAULT_AUTOWATER_START_THRESHOLD, DEFAULT_AUTOWATER_SHUTOFF_THRESHOLD);
     // Enable auto water
     autoWater = true;
+    isReading = false;
+    awakeMicros = 0;
 }
 
-SoilMonitor::SoilMonitor(uint8_t sensorPowerPin, uint8_t sensorDataPin) {
+SoilMonitor::SoilMonitor(uint8_t sensorPowerPin, uint8_t sensorDataPin) : watering(*this) {
     
     // Set up the pinout
     SOILSENSOR_PWR_PIN  = sensorPowerPin;
     SOILSENSOR_DATA_PIN = sensorDataPin;
     // Configure digital pin modes. Soil data needs no configuration since it is an analog pin
-    pinMode(SOILSENSOR_PWR_PIN, OUTPUT);
+    HalPinMode(SOILSENSOR_PWR_PIN, HAL_OUTPUT);
 
     // Initialize calibration values to default for arduino pro mini
+    SetCalibration(linearTable);
     CalibrateSensor(DEFAULT_MIN_MOISTURE, DEFAULT_MAX_MOISTURE);
     // Disable auto water
     autoWater = false;
+    isReading = false;
+    awakeMicros = 0;
 }
 
 SoilMonitor::~SoilMonitor() {
@@ -48,34 +61,106 @@ SoilMonitor::~SoilMonitor() {
 
 void SoilMonitor::ReadSoilLevel()    {
     
-    rawSoilLevel = 0;
-    digitalWrite(SOILSENSOR_PWR_PIN, HIGH);
-    delay(250); // Wait for the sensor to equalize
-
-    // Take a few readings and add them together
-    for(uint8_t i=0; i < SAMPLE_QUANTITY; i++)  {
-        rawSoilLevel += analogRead(SOILSENSOR_DATA_PIN);
-        delay(50);
+    // Blocking version of the reading, just waits out each step
+    for(uint16_t wait = StartSoilReading(); wait > 0; wait = PollSoilReading())  {
+        HalDelay(wait);
     }
-    digitalWrite(SOILSENSOR_PWR_PIN, LOW);
-  
-    // Then divide the readings by SAMPLE_QUANTITY to get the average 
-    rawSoilLevel = rawSoilLevel/SAMPLE_QUANTITY;
-    
-    // Map to a percentage between 0% and 100%
-    percentSoilLevel = map(rawSoilLevel, minMoistureLevel, maxMoistureLevel, 0, 100);
+
+    // Then waits for the pump if the reading started auto watering
+    for(uint16_t wait = WATERING_TICK_MS; IsWatering(); wait = UpdateAutoWatering(wait))  {
+        HalDelay(wait);
+    }
+}
+
+uint16_t SoilMonitor::StartSoilReading()    {
+
+    uint32_t start = HalMicros();
+
+    sampleSum = 0;
+    samplesTaken = 0;
+    isReading = true;
+    HalDigitalWrite(SOILSENSOR_PWR_PIN, HAL_HIGH);
+
+    awakeMicros = HalMicros() - start;
+    return SETTLE_TIME_MS; // Wait for the sensor to equalize
+}
+
+uint16_t SoilMonitor::PollSoilReading()    {
+
+    if(!isReading)  {
+        return 0;
+    }
+
+    uint32_t start = HalMicros();
+
+    // Take a few readings and add them together, one per poll
+    sampleSum += HalAnalogRead(SOILSENSOR_DATA_PIN);
+    samplesTaken++;
+    if(samplesTaken < SAMPLE_QUANTITY)  {
+        awakeMicros += HalMicros() - start;
+        return SAMPLE_INTERVAL_MS;
+    }
+    HalDigitalWrite(SOILSENSOR_PWR_PIN, HAL_LOW);
+    isReading = false;
+    ConvertSoilLevel(sampleSum);
+    awakeMicros += HalMicros() - start;
     
     // Jump to auto watering function if enabled and current moisture level is below the threshold
     if(autoWater && percentSoilLevel < autoWaterStartThreshold)   {
         BeginAutoWatering();
     }
+    return 0;
+}
+
+void SoilMonitor::ConvertSoilLevel(uint16_t sum)    {
+  
+    // Divide the readings by SAMPLE_QUANTITY to get the average 
+    rawSoilLevel = ((uint32_t)sum * (uint16_t)SAMPLE_RECIPROCAL) >> 18;
+    
+    // Interpolate the calibration curve for a percentage between 0% and 100%
+    percentSoilLevel = SoilCalibrationPercent(calibration, curveCount, rawSoilLevel);
+}
+
+bool SoilMonitor::IsReading()    {
+
+    return isReading;
 }
 
 void SoilMonitor::CalibrateSensor(uint16_t minLevel, uint16_t maxLevel) {
     
-    // Calibrate sensor specific values to be used with the map function   
-    minMoistureLevel = minLevel;
-    maxMoistureLevel = maxLevel;
+    // The driest and wettest ends of the curve, at opposite ends of its raw range
+    bool isRising = curve[0].isRising;
+    int32_t curveMin = isRising ? curve[0].raw : curve[curveCount - 1].raw;
+    int32_t curveMax = isRising ? curve[curveCount - 1].raw : curve[0].raw;
+
+    if(minLevel == curveMin && maxLevel == curveMax)    {
+        calibration = curve;
+        return;
+    }
+    if(minLevel == maxLevel)    {
+        return;
+    }
+
+    // Move every point in proportion, this runs once per config so it can divide. A sensor that now reads
+    // the other way round comes out in decreasing raw order, so its points are taken from the far end
+    bool isReversed = (maxLevel > minLevel) != (curveMax > curveMin);
+    SoilCalibrationPoint points[SOIL_CALIBRATION_MAX_POINTS];
+    for(uint8_t i=0; i<curveCount; i++) {
+        const SoilCalibrationSegment &point = curve[isReversed ? curveCount - 1 - i : i];
+        points[i].raw = minLevel + ((int32_t)point.raw - curveMin) * ((int32_t)maxLevel - minLevel) / (curveMax - curveMin);
+        points[i].percent = point.percent;
+    }
+    for(uint8_t i=0; i<curveCount; i++) {
+        scaled[i] = SoilSegment(points[i], points[i + 1 < curveCount ? i + 1 : i]);
+    }
+    calibration = scaled;
+}
+
+void SoilMonitor::SetCalibration(const SoilCalibrationSegment *segments, uint8_t count)    {
+
+    curve = segments;
+    curveCount = count < SOIL_CALIBRATION_MAX_POINTS ? count : SOIL_CALIBRATION_MAX_POINTS;
+    calibration = curve;
 }
 
 void SoilMonitor::SetAutoWaterThresholds(uint8_t start, uint8_t shutoff) {
@@ -87,34 +172,48 @@ void SoilMonitor::SetAutoWaterThresholds(uint8_t start, uint8_t shutoff) {
 
 void SoilMonitor::BeginAutoWatering()   {
 
-    // Turn on soil sensor and pump power
-    digitalWrite(SOILSENSOR_PWR_PIN, HIGH);
-    digitalWrite(PUMP_PWR_PIN, HIGH);
-
     // Map the shutoff threshold to a raw value from its percentage so that it only needs to be calculated once
-    int16_t rawShutoffThreshold = map(autoWaterShutoffThreshold,0,100,minMoistureLevel,maxMoistureLevel);
-    Serial.println(rawShutoffThreshold);
-    // The reading value will decrease as the soil becomes more saturated, loop until shutoff threshold is reached
-    while(analogRead(SOILSENSOR_DATA_PIN) > rawShutoffThreshold)    {
-        
-        // Drop into another loop to shut off pump and wait if the water level is too high
-        if(IsPumpOverflowing())    {
-            digitalWrite(PUMP_PWR_PIN,LOW);
-            
-            while(IsPumpOverflowing())  {
-                delay(500);
-            }
-
-            // Resume pumping once overflow has stopped
-            digitalWrite(PUMP_PWR_PIN, HIGH);
-        }
-    }
+    uint16_t rawShutoffThreshold = SoilCalibrationRaw(calibration, curveCount, autoWaterShutoffThreshold);
+
+    // The reading value will decrease as the soil becomes more saturated, the controller pumps until the shutoff
+    // threshold is reached, pausing while the pot overflows and giving up if the pump runs too long
+    watering.Start(rawShutoffThreshold);
+}
+
+uint16_t SoilMonitor::UpdateAutoWatering(uint16_t elapsedMs)  {
+
+    return watering.Tick(elapsedMs);
+}
+
+bool SoilMonitor::IsWatering()  {
+
+    return watering.IsRunning();
+}
+
+uint16_t SoilMonitor::ReadMoisture()    {
+
+    return HalAnalogRead(SOILSENSOR_DATA_PIN);
+}
+
+bool SoilMonitor::IsOverflowing()   {
+
+    return IsPumpOverflowing();
+}
+
+void SoilMonitor::SetPump(bool isOn)    {
+
+    HalDigitalWrite(PUMP_PWR_PIN, isOn ? HAL_HIGH : HAL_LOW);
+}
+
+void SoilMonitor::SetSensorPower(bool isOn) {
+
+    HalDigitalWrite(SOILSENSOR_PWR_PIN, isOn ? HAL_HIGH : HAL_LOW);
 }
 
 bool SoilMonitor::IsPumpOverflowing()   {
 
     // By default the float sensor will be on a pullup input and will be pulled low when overflowing (normally open circuit)
-    if(digitalRead(FLOAT_SENSOR_PIN)==HIGH) {
+    if(HalDigitalRead(FLOAT_SENSOR_PIN)==HAL_HIGH) {
         return false;
     }
     else    {
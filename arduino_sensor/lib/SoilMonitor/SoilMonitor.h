@@ -14,10 +14,23 @@
 #define DEFAULT_AUTOWATER_START_THRESHOLD   (35)                                            // Default value can be changed with SetPumpThresholds()
 #define DEFAULT_AUTOWATER_SHUTOFF_THRESHOLD (85)                                            // Default value can be changed with SetPumpThresholds()
 #define SAMPLE_QUANTITY                     (5)                                             // Number of sensor readings to average together
+#define SETTLE_TIME_MS                      (250)                                           // Time for the sensor to equalize after power up
+#define SAMPLE_INTERVAL_MS                  (50)                                            // Time between sensor readings
 
-#include <Arduino.h>                                                                        // Required for pin read/write functions
+#include "Hal.h"                                                                            // Pin, ADC and clock functions for the board or a host build
+#include "WateringController.h"                                                             // Runs the pump while auto watering
+#include "SoilCalibration.h"                                                                // Turns raw readings into percent with a curve built at compile time
 
-class SoilMonitor   {
+// Straight line between the defaults, the same conversion map() used to give
+constexpr SoilCalibrationPoint soilCurveLinear[] = {{DEFAULT_MAX_MOISTURE, 100}, {DEFAULT_MIN_MOISTURE, 0}};
+// Typical capacitive v1.2 probe, which reads lower quickly as the first water goes in and then flattens out.
+// Sampled from percent = 100 * (1 - x)^1.8 across the defaults, points measured for the probe in use fit better
+constexpr SoilCalibrationPoint soilCurveCapacitive[] = {{490, 100}, {522, 85}, {556, 70}, {593, 55},
+                                                        {636, 40}, {686, 25}, {753, 10}, {855, 0}};
+static_assert(SoilIsCalibrationValid(soilCurveLinear), "soilCurveLinear is not a valid calibration");
+static_assert(SoilIsCalibrationValid(soilCurveCapacitive), "soilCurveCapacitive is not a valid calibration");
+
+class SoilMonitor : public WateringHardware   {
     public:
         SoilMonitor(uint8_t sensorPowerPin,                                                 //  Overloaded constructor will configure pinouts 
                     uint8_t sensorDataPin,                                                  //  when using soil sensor and autowater
@@ -26,14 +39,33 @@ class SoilMonitor   {
         SoilMonitor(uint8_t sensorPowerPin,                                                 //  This constructor can be used when only using a soil sensor 
                     uint8_t sensorDataPin);                                               
         ~SoilMonitor();                                                                     //  Not doing anything currently
-        void ReadSoilLevel();                                                               //  Reads value and stores a percent value in percentSoilLevel
-        void CalibrateSensor(uint16_t minLevel, uint16_t maxLevel);                         //  Calibrates sensor with the min/max for different ADC/sensor/boards
+        void ReadSoilLevel();                                                               //  Reads value and stores a percent value in percentSoilLevel, waits with delay()
+        uint16_t StartSoilReading();                                                        //  Powers the sensor and returns the ms to wait before calling PollSoilReading(),
+        uint16_t PollSoilReading();                                                         //  which returns the ms until the next poll or 0 once percentSoilLevel is ready.
+                                                                                            //  The caller can sleep or do other work while waiting
+        bool IsReading();                                                                   //  True between StartSoilReading() and the final poll
+        void ConvertSoilLevel(uint16_t sampleSum);                                          //  Averages SAMPLE_QUANTITY summed readings into rawSoilLevel and percentSoilLevel
+        void CalibrateSensor(uint16_t minLevel, uint16_t maxLevel);                         //  Stretches the curve so its driest point reads minLevel and its wettest maxLevel
+        template<size_t Count>
+        void SetCalibration(const SoilCalibrationTable<Count> &table)   {                   //  Converts with a table from SoilCalibrate(), used as is until CalibrateSensor()
+            static_assert(Count <= SOIL_CALIBRATION_MAX_POINTS, "Calibration has too many points");
+            SetCalibration(table.segments, Count);
+        }
+        void SetCalibration(const SoilCalibrationSegment *segments, uint8_t count);         //  The table must outlive the SoilMonitor
         void SetAutoWaterThresholds(uint8_t start, uint8_t shutoff);                        //  Sets when to turn the pump on and off
-        void BeginAutoWatering();                                                           //  Called by ReadSoilLevel if auto watering is enabled, handles running the pump until the shutoff threshold is reached
-        bool IsPumpOverflowing();                                                           //  Called during autowater function to determine if pot is overflowing
+        void BeginAutoWatering();                                                           //  Called by PollSoilReading if auto watering is enabled, starts the pump and returns straight away
+        uint16_t UpdateAutoWatering(uint16_t elapsedMs);                                    //  Call while IsWatering(), returns the ms until the next call or 0 once the pump is off
+        bool IsWatering();
+        bool IsPumpOverflowing();                                                           //  Checked by the watering controller to determine if pot is overflowing
+        uint16_t ReadMoisture() override;                                                   //  WateringHardware used by the watering controller
+        bool IsOverflowing() override;
+        void SetPump(bool isOn) override;
+        void SetSensorPower(bool isOn) override;
         uint16_t rawSoilLevel;                                                              //  Soil level before conversion to %
         uint8_t percentSoilLevel;                                                           //  Soil level mapped to a percentage
         bool autoWater;                                                                     //  Indicates whether or not to use the auto watering feature
+        uint32_t awakeMicros;                                                               //  Time spent in StartSoilReading() and PollSoilReading() for the last reading
+        WateringController watering;                                                        //  Pump limits can be changed with watering.Configure(), results are in watering.stats
     
     private:
         uint8_t SOILSENSOR_PWR_PIN;                                                         //  Set by constructor
@@ -41,10 +73,15 @@ class SoilMonitor   {
         uint8_t PUMP_PWR_PIN;                                                               //  Set by constructor
         uint8_t OVERFLOW_SENSOR_PIN;                                                        //  Set by constructor
         uint8_t FLOAT_SENSOR_PIN;                                                           //  Set by constructor
-        uint16_t minMoistureLevel;                                                          //  Sensor calibration min value
-        uint16_t maxMoistureLevel;                                                          //  Sensor calibration max value
+        const SoilCalibrationSegment *curve;                                                //  Table given to SetCalibration(), kept as the shape to stretch
+        uint8_t curveCount;
+        const SoilCalibrationSegment *calibration;                                          //  Table readings are converted with, curve or scaled
+        SoilCalibrationSegment scaled[SOIL_CALIBRATION_MAX_POINTS];                         //  Curve stretched by CalibrateSensor()
         uint8_t autoWaterStartThreshold;                                                    //  Moisture level at which the pump turns on
         uint8_t autoWaterShutoffThreshold;                                                  //  Moisture level at which the pump turns off
+        uint16_t sampleSum;                                                                 //  Readings added together so far
+        uint8_t samplesTaken;                                                               //  Readings taken so far
+        bool isReading;                                                                     //  Set while a reading is in progress
 
 };
 
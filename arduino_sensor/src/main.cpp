@@ -12,10 +12,20 @@
 #include <RF24.h>
 // LowPower library for sleeping functionality
 #include <LowPower.h>
+// EEPROM keeps the config pushed by the base station across resets
+#include <EEPROM.h>
 // SoilMonitor.h has the functions to read soil sensor and use autowater
 #include "SoilMonitor.h"
 // PlantPacket.h has the functions to make packets for sending wirelessly
 #include "PlantPacket.h"
+// SampleScheduler.h picks how long to sleep from how fast the soil is drying
+#include "SampleScheduler.h"
+// AddressPlan.h picks the base station pipe this node writes to
+#include "AddressPlan.h"
+// HalRadio.h is the transmit interface, so the send path can run against SimRadio on a host
+#include "HalRadio.h"
+// WakeTrace.h times each phase of a wake so the summary can go out with the readings
+#include "WakeTrace.h"
 
 #define SOIL_SENSOR_PWR_PIN   (5)
 #define SOIL_SENSOR_DATA_PIN  (A0)
@@ -27,24 +37,116 @@
 #define PUMP_PWR_PIN          (3)
 #define FLOAT_SENSOR_PIN      (4)
 
-#define TIME_TO_SLEEP_SECONDS 14400   // 3,600s in one hour
-#define BUFFER_LENGTH         16
+#define SLEEP_FLOOR_SECONDS   1800    // Shortest sleep, used after watering or when the soil is dry
+#define SLEEP_CEILING_SECONDS 28800   // Longest sleep while the soil is stable, 3,600s in one hour
+#define FIRST_SLEEP_SECONDS   14400   // Used as the time since the last reading on the first wake
+#define BUFFER_LENGTH         PLANT_PACKET_LENGTH
+#define BANDGAP_SCALE         1125300L  // 1.1V bandgap * 1023 * 1000, used to work out Vcc in mV
+
+#define BURST_CYCLES          4         // Readings gathered before the radio is powered up
+#define BURST_CAPACITY        (PLANT_PACKET_BURST_ENTRIES + 1)  // Newest reading goes in a reading packet, the rest in one burst
+#define ALERT_THRESHOLD       40        // A reading below this percentage is sent right away
+#define MAX_AGE_SECONDS       65535     // Oldest age a burst entry can carry
+#define CONFIG_EEPROM_ADDRESS 0         // Last config frame applied, checked by its CRC on boot
+#define CHANNEL_EEPROM_ADDRESS (CONFIG_EEPROM_ADDRESS + PLANT_PACKET_LENGTH)  // Channel the base station was last found on
+#define SEQUENCE_EEPROM_ADDRESS (CHANNEL_EEPROM_ADDRESS + 1)  // Boot count, picks where this boot's sequence numbers start
+#define SEQUENCE_EPOCH_SHIFT  12
+#define MAX_RADIO_CHANNEL     125
+#define LOST_CONTACT_FAILURES 2         // Failed transmissions in a row before listening for the base station's beacon
+#define DISCOVERY_LISTEN_MS   2500      // Covers the base station's beacon period even when it runs late
+#define DISCOVERY_POLL_MS     60
+
+#ifndef NODE_ID
+#define NODE_ID               1         // Unique per sensor, can be set with a build flag
+#endif
+static_assert(NODE_ID != 0, "Node 0 is sent to the base station's legacy pipe, which only takes 16 byte payloads");
+#ifndef SEND_WAKE_TRACE
+#define SEND_WAKE_TRACE       1         // Set to 0 with a build flag to keep the trace summary off the air
+#endif
+#ifndef SOIL_CURVE_CAPACITIVE
+#define SOIL_CURVE_CAPACITIVE 0         // Set to 1 with a build flag to convert with the capacitive probe curve instead of a straight line
+#endif
+
+// Sends through the nRF24, setup stays in InitializeRadio() since it is specific to this board
+class RF24Radio : public HalRadio  {
+  public:
+    RF24Radio(RF24 &rf24) : radio(rf24) {}
+    void PowerUp() override   { radio.powerUp(); }
+    void PowerDown() override { radio.powerDown(); }
+    bool Write(const void *data, uint8_t length) override  { return radio.write(data, length); }
+    uint8_t LastRetries() override  { return radio.getARC(); }
+    uint8_t ReadAckPayload(uint8_t *data, uint8_t length) override  {
+      // Ack payloads land in the RX FIFO while the radio is still in TX mode
+      if(!radio.available())  {
+        return 0;
+      }
+      uint8_t payloadLength = radio.getDynamicPayloadSize();
+      payloadLength = payloadLength < length ? payloadLength : length;
+      radio.read(data, payloadLength);
+      return payloadLength;
+    }
+  private:
+    RF24 &radio;
+};
 
 // Objects
 RF24 radio(NRF24L01_CE_PIN, NRF24L01_CSN_PIN);
+RF24Radio radioLink(radio);
 SoilMonitor soilMonitor(SOIL_SENSOR_PWR_PIN,SOIL_SENSOR_DATA_PIN, PUMP_PWR_PIN, FLOAT_SENSOR_PIN);
 PlantPacket packet;
+SampleSchedulerState schedulerState;
+SampleScheduler scheduler(schedulerState);
+WakeTraceState traceState;
+WakeTrace wakeTrace(traceState);
+// Built by the compiler, swap the points in for ones measured on this sensor
+constexpr auto soilCalibration = SoilCalibrate(soilCurveCapacitive);
 
 // Variables and constants
 uint8_t radioAddress[6] = {"ollie"};
-uint8_t baseStationAddress[5] = {'b','a','s','e','\0'};
+AddressPlan addressPlan;
 char plantName[15] = {'o','l','i','v','e','r','\0','\0','\0','\0','\0','\0','\0','\0','\0'};
-char buffer[BUFFER_LENGTH]    = {"\0"};
+uint8_t buffer[BUFFER_LENGTH] = {0};
+uint16_t sequence             = 0;
+uint16_t secondsSlept         = FIRST_SLEEP_SECONDS;
+uint8_t alertPercent          = ALERT_THRESHOLD;
+uint8_t radioChannel          = ADDRESS_PLAN_DISCOVERY_CHANNEL;
+uint8_t failedTransmissions   = 0;
+
+// Settings the base station can change, a field it leaves at 0 keeps the value here
+PlantPacketConfig sensorConfig = {SLEEP_FLOOR_SECONDS, SLEEP_CEILING_SECONDS,
+                                  DEFAULT_MIN_MOISTURE, DEFAULT_MAX_MOISTURE,
+                                  DEFAULT_AUTOWATER_START_THRESHOLD, DEFAULT_AUTOWATER_SHUTOFF_THRESHOLD,
+                                  ALERT_THRESHOLD};
+
+// Readings kept in RAM across sleeps until the next transmission, oldest first. RAM survives
+// LowPower.powerDown() so nothing needs to be saved
+struct StoredReading {
+  uint16_t sequence;                    // Numbered when taken so a resend can be recognised by the base station
+  uint16_t rawSoilLevel;
+  uint8_t percentSoilLevel;
+  uint32_t ageSeconds;
+};
+StoredReading readings[BURST_CAPACITY];
+uint8_t readingCount          = 0;
 
 // Functions
 bool InitializeRadio();
-void ClearBuffer(char *buffer, int bufferLength);
-void EnterSleepMode(uint16_t timeToSleepSeconds);
+void ReadSoilLevel();
+void SleepMilliseconds(uint16_t milliseconds);
+uint16_t NextSleepSeconds();
+uint16_t EnterSleepMode(uint16_t timeToSleepSeconds);
+uint16_t ReadBatteryMillivolts();
+void StoreReading(uint16_t rawSoilLevel, uint8_t percentSoilLevel);
+void AgeReadings(uint16_t seconds);
+bool IsTransmitDue(uint16_t nextSleepSeconds);
+bool TransmitReadings();
+bool TransmitBuffer(uint8_t length);
+void TransmitTrace();
+void ReceiveConfig();
+void MergeConfig(const PlantPacketConfig &config);
+void ApplyConfig();
+void LoadConfig();
+bool FindBaseStation();
 
 //
 // 
@@ -53,38 +155,349 @@ void setup() {
     // put your setup code here, to run once:
     Serial.begin(115200);
     soilMonitor.autoWater = false;
+    if(SOIL_CURVE_CAPACITIVE)  {
+        soilMonitor.SetCalibration(soilCalibration);
+    }
 
     if(!InitializeRadio())  {
       Serial.println(F("Failed to initialize radio"));
     }
     
     packet.SetPlantPacketName(&plantName[0]);
+    packet.nodeId = NODE_ID;
+    packet.configVersion = 0;
+
+    // Start 4096 on from the last boot, so the base station sees a restart rather than readings it already has
+    uint8_t epoch = EEPROM.read(SEQUENCE_EEPROM_ADDRESS) + 1;
+    EEPROM.update(SEQUENCE_EEPROM_ADDRESS, epoch);
+    sequence = (uint16_t)epoch << SEQUENCE_EPOCH_SHIFT;
+
+    LoadConfig();
+    ApplyConfig();
+    radioLink.PowerDown();
 }
 
 void loop() {
+    wakeTrace.BeginWake();
+
     // Read soil level
-    soilMonitor.ReadSoilLevel();
-    packet.percentSoilLevel = soilMonitor.percentSoilLevel;
-    ClearBuffer(&buffer[0], BUFFER_LENGTH);
-    packet.CreatePlantPacket(&buffer[0]);
+    ReadSoilLevel();
+    StoreReading(soilMonitor.rawSoilLevel, soilMonitor.percentSoilLevel);
+    uint16_t timeToSleepSeconds = NextSleepSeconds();
+
+    // The radio is only powered up every BURST_CYCLES wakes, or straight away for a dry reading
+    if(IsTransmitDue(timeToSleepSeconds))  {
+      if(TransmitReadings())  {
+        readingCount = 0;
+      }
+    }
+    
+    // Go to sleep
+    wakeTrace.EndWake();
+    secondsSlept = EnterSleepMode(timeToSleepSeconds);
+    AgeReadings(secondsSlept);
+}
+
+void ReadSoilLevel()  {
+
+  wakeTrace.Begin(WAKE_PHASE_SENSOR);
+  uint16_t wait = soilMonitor.StartSoilReading();
+
+  // If this wake will fill the burst, start the radio oscillator while the sensor settles
+  if(readingCount + 1 >= BURST_CYCLES)  {
+    wakeTrace.Begin(WAKE_PHASE_RADIO_UP);
+    radioLink.PowerUp();
+    wakeTrace.Begin(WAKE_PHASE_SENSOR);
+  }
+
+  // Sleep through the sensor settling and the gaps between ADC readings. micros() stops while
+  // powered down, so the trace only counts the time spent awake
+  while(wait > 0)  {
+    SleepMilliseconds(wait);
+    wait = soilMonitor.PollSoilReading();
+  }
+  wakeTrace.End();
+
+  Serial.print(F("Awake for "));
+  Serial.print(soilMonitor.awakeMicros);
+  Serial.println(F("us while sampling"));
+
+  // Run the pump if the reading started auto watering, sleeping between controller ticks
+  if(soilMonitor.IsWatering())  {
+    wakeTrace.Begin(WAKE_PHASE_WATERING);
+    for(uint16_t wait = WATERING_TICK_MS; wait > 0; wait = soilMonitor.UpdateAutoWatering(wait))  {
+      SleepMilliseconds(wait);
+    }
+    wakeTrace.End();
+
+    const WateringStats &stats = soilMonitor.watering.stats;
+    Serial.print(F("Watering result "));
+    Serial.print(stats.lastResult);
+    Serial.print(F(", pump ran "));
+    Serial.print(stats.lastPumpMs);
+    Serial.print(F("ms, about "));
+    Serial.print(stats.lastMillilitres);
+    Serial.print(F("ml, "));
+    Serial.print(stats.lastOverflowPauses);
+    Serial.println(F(" overflow pauses"));
+  }
+}
+
+void SleepMilliseconds(uint16_t milliseconds)  {
+
+  // The watchdog only has fixed periods, so use the largest ones that fit and round the rest up to 15ms.
+  // LowPower restores the ADC after each sleep so the next analogRead works as normal
+  while(milliseconds >= 250)  {
+    LowPower.powerDown(SLEEP_250MS, ADC_OFF, BOD_OFF);
+    milliseconds -= 250;
+  }
+  while(milliseconds >= 60)  {
+    LowPower.powerDown(SLEEP_60MS, ADC_OFF, BOD_OFF);
+    milliseconds -= 60;
+  }
+  while(milliseconds > 0)  {
+    LowPower.powerDown(SLEEP_15MS, ADC_OFF, BOD_OFF);
+    milliseconds = milliseconds > 15 ? milliseconds - 15 : 0;
+  }
+}
+
+void StoreReading(uint16_t rawSoilLevel, uint8_t percentSoilLevel)  {
+
+  // Drop the oldest reading if transmissions have been failing
+  if(readingCount == BURST_CAPACITY)  {
+    memmove(&readings[0], &readings[1], (BURST_CAPACITY - 1) * sizeof(StoredReading));
+    readingCount--;
+  }
+
+  readings[readingCount].sequence = sequence++;
+  readings[readingCount].rawSoilLevel = rawSoilLevel;
+  readings[readingCount].percentSoilLevel = percentSoilLevel;
+  readings[readingCount].ageSeconds = 0;
+  readingCount++;
+}
+
+void AgeReadings(uint16_t seconds)  {
+
+  for(uint8_t i=0; i<readingCount; i++) {
+    readings[i].ageSeconds += seconds;
+  }
+}
+
+bool IsTransmitDue(uint16_t nextSleepSeconds)  {
+
+  // Also send before the oldest reading gets too old for a burst entry to carry
+  return readingCount >= BURST_CYCLES
+      || readingCount == BURST_CAPACITY
+      || readings[readingCount - 1].percentSoilLevel < alertPercent
+      || readings[0].ageSeconds + nextSleepSeconds > MAX_AGE_SECONDS;
+}
+
+bool TransmitReadings()  {
+
+  PlantPacketBurstEntry entries[PLANT_PACKET_BURST_ENTRIES];
+  uint8_t olderCount = readingCount - 1;
+  const StoredReading &newest = readings[olderCount];
+
+  wakeTrace.Begin(WAKE_PHASE_RADIO_UP);
+  radioLink.PowerUp();
+  wakeTrace.End();
+
+  // The newest reading goes out as a full reading packet so the base station learns the name
+  packet.percentSoilLevel = newest.percentSoilLevel;
+  packet.rawSoilLevel = newest.rawSoilLevel;
+  packet.batteryMillivolts = ReadBatteryMillivolts();
+  packet.sequence = newest.sequence;
+  bool isSent = TransmitBuffer(packet.CreatePlantPacket(&buffer[0]));
+
+  // Older readings follow in one burst, each with its age so the base station can rebuild its time
+  if(isSent && olderCount > 0)  {
+    for(uint8_t i=0; i<olderCount; i++)  {
+      entries[i].ageSeconds = (uint16_t)readings[i].ageSeconds;
+      entries[i].rawSoilLevel = readings[i].rawSoilLevel;
+      entries[i].percentSoilLevel = readings[i].percentSoilLevel;
+    }
+    // Stored readings are numbered in order, so the burst only needs the first one's sequence
+    packet.sequence = readings[0].sequence;
+    isSent = TransmitBuffer(packet.CreateBurstPacket(&buffer[0], entries, olderCount));
+  }
+
+  // A run of failures usually means the base station has moved channel, its beacon says where to
+  if(isSent)  {
+    failedTransmissions = 0;
+    TransmitTrace();
+  }
+  else if(++failedTransmissions >= LOST_CONTACT_FAILURES)  {
+    wakeTrace.Begin(WAKE_PHASE_DISCOVERY);
+    (void) FindBaseStation();
+    wakeTrace.End();
+    failedTransmissions = 0;
+  }
+
+  radioLink.PowerDown();
+
+  Serial.print(readingCount);
+  Serial.println(isSent ? F(" readings sent") : F(" readings kept for the next attempt"));
+  return isSent;
+}
+
+bool TransmitBuffer(uint8_t length)  {
     
     // Ouput buffer contents for packet debugging
-    Serial.print("Buffer contents: ");
-    for(int i=0;i<16;i++)  {
-      Serial.print(buffer[i]);
+    Serial.print(F("Buffer contents: "));
+    for(uint8_t i=0;i<length;i++)  {
+      Serial.print(buffer[i], HEX);
+      Serial.print(' ');
     }
     Serial.println();
     
     // Attempt to transmit the soil level
-    if(!radio.write(&buffer[0], sizeof(buffer)))  {
+    wakeTrace.Begin(WAKE_PHASE_RADIO_TX);
+    bool isWritten = radioLink.Write(&buffer[0], length);
+    wakeTrace.End();
+    wakeTrace.AddRetries(radioLink.LastRetries());
+    if(!isWritten)  {
       Serial.println(F("Transmission failed"));
-    }
-    else  {
-      Serial.println(F("Transmission successful"));
+      return false;
     }
     
-    // Go to sleep
-    EnterSleepMode(TIME_TO_SLEEP_SECONDS);
+    Serial.println(F("Transmission successful"));
+    ReceiveConfig();
+    return true;
+}
+
+void TransmitTrace()  {
+
+  PlantPacketTrace summary;
+
+  if(!SEND_WAKE_TRACE)  {
+    return;
+  }
+
+  // Rides on the same radio wake as the readings. An undelivered summary keeps adding up for the next one
+  wakeTrace.Summarize(summary);
+  if(TransmitBuffer(packet.CreateTracePacket(&buffer[0], summary)))  {
+    wakeTrace.Clear(summary);
+  }
+}
+
+void ReceiveConfig()  {
+
+  PlantPacketConfig config;
+  uint8_t version;
+
+  // The base station only attaches a config to the ack when it has one waiting for this node.
+  // The payload has been sent by now so buffer is free to hold it
+  uint8_t length = radioLink.ReadAckPayload(&buffer[0], BUFFER_LENGTH);
+  if(length == 0 || !PlantPacket::ParseConfigPacket(&buffer[0], length, NODE_ID, version, config)
+     || version == packet.configVersion)  {
+    return;
+  }
+
+  // Fields the config leaves at 0 keep this sensor's values, so the merged settings are checked again.
+  // A rejected config is not confirmed and stays queued on the base station until it is replaced
+  PlantPacketConfig previous = sensorConfig;
+  MergeConfig(config);
+  if(!PlantPacket::IsConfigValid(sensorConfig))  {
+    sensorConfig = previous;
+    Serial.print(F("Rejected config version "));
+    Serial.println(version);
+    return;
+  }
+  packet.configVersion = version;
+  ApplyConfig();
+
+  // Store the merged settings rather than the frame received, so fields it left at 0 are kept too.
+  // The next packet carries the new version back to the base station as confirmation
+  packet.CreateConfigPacket(&buffer[0], sensorConfig);
+  EEPROM.put(CONFIG_EEPROM_ADDRESS, buffer);
+
+  Serial.print(F("Applied config version "));
+  Serial.println(version);
+}
+
+void MergeConfig(const PlantPacketConfig &config)  {
+
+  if(config.sleepFloorSeconds != 0)  {
+    sensorConfig.sleepFloorSeconds = config.sleepFloorSeconds;
+  }
+  if(config.sleepCeilingSeconds != 0)  {
+    sensorConfig.sleepCeilingSeconds = config.sleepCeilingSeconds;
+  }
+  if(config.minMoisture != 0)  {
+    sensorConfig.minMoisture = config.minMoisture;
+  }
+  if(config.maxMoisture != 0)  {
+    sensorConfig.maxMoisture = config.maxMoisture;
+  }
+  if(config.autoWaterStart != 0)  {
+    sensorConfig.autoWaterStart = config.autoWaterStart;
+  }
+  if(config.autoWaterShutoff != 0)  {
+    sensorConfig.autoWaterShutoff = config.autoWaterShutoff;
+  }
+  if(config.alertPercent != 0)  {
+    sensorConfig.alertPercent = config.alertPercent;
+  }
+}
+
+bool FindBaseStation()  {
+
+  uint8_t address[ADDRESS_WIDTH];
+  uint8_t channel = radioChannel;
+  bool isFound = false;
+
+  // Listen on the discovery channel, the radio keeps receiving while the MCU sleeps between checks.
+  // The beacon address is also pipe 0's, which sensors still on this channel send their readings to.
+  // Acking those would make their senders drop readings the base station never got
+  addressPlan.AddressForBeacon(address);
+  radio.setChannel(ADDRESS_PLAN_DISCOVERY_CHANNEL);
+  radio.setAutoAck(1, false);
+  radio.openReadingPipe(1, address);
+  radio.startListening();
+  for(uint16_t waited = 0; waited < DISCOVERY_LISTEN_MS && !isFound; waited += DISCOVERY_POLL_MS)  {
+    SleepMilliseconds(DISCOVERY_POLL_MS);
+    while(radio.available() && !isFound)  {
+      uint8_t length = radio.getDynamicPayloadSize();
+      length = length < BUFFER_LENGTH ? length : BUFFER_LENGTH;
+      radio.read(&buffer[0], length);
+      isFound = PlantPacket::ParseBeaconPacket(&buffer[0], length, channel) && channel <= MAX_RADIO_CHANNEL;
+    }
+  }
+  radio.stopListening();
+  radio.closeReadingPipe(1);
+  radio.setAutoAck(1, true);
+
+  if(isFound && channel != radioChannel)  {
+    radioChannel = channel;
+    EEPROM.update(CHANNEL_EEPROM_ADDRESS, radioChannel);
+  }
+  radio.setChannel(radioChannel);
+
+  Serial.print(isFound ? F("Base station found on channel ") : F("No beacon heard, staying on channel "));
+  Serial.println(radioChannel);
+  return isFound;
+}
+
+void ApplyConfig()  {
+
+  alertPercent = sensorConfig.alertPercent;
+  scheduler.Configure(sensorConfig.sleepFloorSeconds, sensorConfig.sleepCeilingSeconds, alertPercent,
+                      DEFAULT_TARGET_CHANGE_PERCENT, DEFAULT_WATERING_JUMP_PERCENT);
+  soilMonitor.CalibrateSensor(sensorConfig.minMoisture, sensorConfig.maxMoisture);
+  soilMonitor.SetAutoWaterThresholds(sensorConfig.autoWaterStart, sensorConfig.autoWaterShutoff);
+}
+
+void LoadConfig()  {
+
+  PlantPacketConfig config;
+  uint8_t version;
+
+  // A blank or worn EEPROM fails the CRC and the defaults are kept
+  EEPROM.get(CONFIG_EEPROM_ADDRESS, buffer);
+  if(PlantPacket::ParseConfigPacket(&buffer[0], BUFFER_LENGTH, NODE_ID, version, config))  {
+    MergeConfig(config);
+    packet.configVersion = version;
+  }
 }
 
 bool InitializeRadio()  {
@@ -100,35 +513,63 @@ bool InitializeRadio()  {
     // Initialize radio settings
     radio.setPALevel(RF24_PA_MAX);
     radio.setDataRate(RF24_250KBPS);
-    radio.setPayloadSize(sizeof(buffer));
+    // Every pipe but the legacy one takes dynamic payloads on the base station, see AddressPlan
+    radio.enableDynamicPayloads();
+    // The base station answers with a config in the ack when it has one for this node
+    radio.enableAckPayload();
+    // The channel the base station was last found on, blank EEPROM reads 0xFF and starts at discovery
+    uint8_t channel = EEPROM.read(CHANNEL_EEPROM_ADDRESS);
+    radioChannel = channel <= MAX_RADIO_CHANNEL ? channel : ADDRESS_PLAN_DISCOVERY_CHANNEL;
+    radio.setChannel(radioChannel);
+    // Nodes are spread over the base station's six pipes by node id
+    uint8_t baseStationAddress[ADDRESS_WIDTH];
+    addressPlan.AddressForNode(NODE_ID, baseStationAddress);
     radio.openWritingPipe(baseStationAddress);
     radio.stopListening();
 
     return true;
 }
 
-void ClearBuffer(char *buffer, int bufferLength) {
+uint16_t ReadBatteryMillivolts()  {
 
-  for(int i=0; i<bufferLength; i++) {
-    buffer[i] = '\0';
-  }
+  // Measure the internal 1.1V bandgap against AVcc, the supply voltage falls out of the ratio
+  ADMUX = _BV(REFS0) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1);
+  delay(2); // Wait for the reference to settle
+  ADCSRA |= _BV(ADSC);
+  while(bit_is_set(ADCSRA, ADSC));
 
-  return;
+  // ADCL must be read first, reading ADCH releases the result register
+  uint8_t low = ADCL;
+  uint8_t high = ADCH;
+  uint16_t reading = (high << 8) | low;
+
+  return reading > 0 ? (uint16_t)(BANDGAP_SCALE / reading) : 0;
 }
 
-void EnterSleepMode(uint16_t timeToSleepSeconds) {
+uint16_t NextSleepSeconds()  {
+
+  // Sleep longer while the soil is stable and shorter while it is changing quickly
+  uint32_t seconds = scheduler.NextInterval(soilMonitor.percentSoilLevel, secondsSlept);
+
+  Serial.print(F("Sleeping for "));
+  Serial.print(seconds);
+  Serial.println(F("s"));
+  return seconds > UINT16_MAX ? UINT16_MAX : (uint16_t)seconds;
+}
 
-  // Put radio into powerdown mode
-  radio.powerDown();
+uint16_t EnterSleepMode(uint16_t timeToSleepSeconds) {
+
+  uint16_t i = 0;
+
+  // Put radio into powerdown mode, it is only powered up again when there is something to send
+  radioLink.PowerDown();
   
   // Loop through sleeping 8s at a time until its time to wake up
-  for (uint16_t i = 0; (timeToSleepSeconds-i) >= 8; i+=8)
+  for (i = 0; (timeToSleepSeconds-i) >= 8; i+=8)
   {
     // Put arduino into power down mode
     LowPower.powerDown(SLEEP_8S, ADC_OFF, BOD_OFF);
   }
   
-  // Turn radio back on
-  radio.powerUp();
-  
+  return i;
 }
@@ -18,10 +18,40 @@
 // wifiFix needed to fix a bug with the WiFi library
 #include "WiFiType.h"
 #include "wifiFix.h"    
+// UplinkConnection keeps keep-alive connections open to the database and ntfy
+#include "UplinkConnection.h"
+// UplinkEncoder builds request bodies in a fixed buffer
+#include "UplinkEncoder.h"
 // FastLED for onboard RGB LED control
 #include <FastLED.h>
 // PlantPacket for using ParsePlantPacket()
 #include "PlantPacket.h"
+// UploadQueue for batching readings into one database request
+#include "UploadQueue.h"
+// PacketRing hands packets from the radio task to the upload task
+#include "PacketRing.h"
+// RadioReceiver drains the radio FIFO when the radio interrupts
+#include "RadioReceiver.h"
+// ReadingLog keeps readings on flash until the database can take them
+#include "ReadingLog.h"
+// AddressPlan gives each of the six reading pipes its address
+#include "AddressPlan.h"
+// ConfigQueue holds settings for sensors until they are sent back in an ack
+#include "ConfigQueue.h"
+// ChannelSurvey scores channels by carrier detect to find one clear of WiFi
+#include "ChannelSurvey.h"
+// NotificationEngine decides which readings are worth a push notification
+#include "NotificationEngine.h"
+// WakeTrace turns the trace summaries sensors send into a breakdown of their awake time
+#include "WakeTrace.h"
+// Metrics keeps lock-free counters and histograms, StationMetrics writes them as the /metrics page
+#include "Metrics.h"
+#include "StationMetrics.h"
+// ReadingHistory keeps days of compressed readings per plant to serve without the database
+#include "ReadingHistory.h"
+#include "esp_partition.h"
+#include "esp_http_server.h"
+#include <time.h>
 // serverName, ssid, password, ntfyServer, and apiKey are all defined in credentials.h
 #include "credentials.h"
 
@@ -30,35 +60,197 @@
 #define NRF24L01_SCK_PIN        (4)
 #define NRF24L01_CSN_PIN        (10)
 #define NRF24L01_CE_PIN         (7)
+#define NRF24L01_IRQ_PIN        (3)
 #define LED_PIN                 (8)
 
-#define BUFFER_LENGTH           (16)
 #define NUM_LEDS                (1)
 #define UPDATE_PERIOD_MS        (30000)
 #define WIFI_TIMEOUT_MS         (10000)
 #define MS_PER_S                (1000)
+#define UPLOAD_BATCH_SIZE       (8)
+#define UPLOAD_WINDOW_MS        (5000)
+#define NTFY_PORT               (8080)
+#define RADIO_IRQ_TIMEOUT_MS    (1000)
+#define READING_LOG_MAX_SIZE    (64 * 1024)
+#define REPLAY_BATCH_SIZE       (8)
+#define REPLAY_INTERVAL_MS      (10000)
+#define REPLAY_MAX_WAIT_MS      (60000)         // Replay at least this often even while live readings keep the queue busy
+#define NTP_SERVER              "pool.ntp.org"
+#define UPLOAD_POLL_MS          (100)
+#define RECEIVE_TASK_STACK      (4096)
+#define UPLOAD_TASK_STACK       (8192)
+#define RECEIVE_TASK_PRIORITY   (3)
+#define UPLOAD_TASK_PRIORITY    (1)
+#define CONSOLE_LINE_LENGTH     (80)
+#define CHANNEL_SURVEY_PASSES   (40)
+#define CHANNEL_SETTLE_US       (200)           // Carrier detect needs the receiver on the channel for 170us
+#define BEACON_PERIOD_MS        (1000)          // Up to RADIO_IRQ_TIMEOUT_MS later if the receive task is asleep
+
+#define HTTP_SERVER_STACK       (4096)
+#define HTTP_SERVER_PRIORITY    (1)             // Below the receive task, so a request never holds up the radio
+#define HISTORY_BLOCKS          (768)           // 44 bytes each, about 9 days of 16 plants reporting every half hour
+#define HISTORY_PLANTS          (16)            // Plants with a history, the least recently heard is forgotten
+#define HISTORY_PAGE            (32)            // Readings decoded per lock, each page goes out as one chunk
+#define HISTORY_MAX_POINTS      (288)           // Most points in a downsampled view, a day at 5 minutes
+#define HISTORY_QUERY_LENGTH    (96)
+#define HISTORY_CHUNK_LENGTH    (1024)          // A page of readings at up to 24 characters each
+
+#define NOTIFY_PLANTS           (32)            // Plants whose alert state is remembered, the least recently heard is forgotten
+#define NTFY_DIGEST_TOPIC       "plants"
+
+#ifndef NOTIFY_DIGEST_S
+#define NOTIFY_DIGEST_S         (0)             // Set with a build flag to send one digest at most this often instead of one notification per plant
+#endif
+#ifndef HTTP_SERVER_PORT
+#define HTTP_SERVER_PORT        (80)            // Serves /metrics and /history
+#endif
+#ifndef HISTORY_SPILL_SIZE
+#define HISTORY_SPILL_SIZE      (64 * 1024)     // Flash after the reading log for history blocks evicted from RAM, 0 turns it off
+#endif
+#ifndef CHANNEL_SURVEY_AT_BOOT
+#define CHANNEL_SURVEY_AT_BOOT  (1)             // Set to 0 with a build flag to stay on the discovery channel for legacy sensors
+#endif
+
+// RF24 only turns dynamic payloads on or off for every pipe at once. Legacy sensors send fixed
+// 16 byte payloads with no length in the header, which a pipe with dynamic payloads does not receive
+class StationRadio : public RF24    {
+    public:
+        StationRadio(uint16_t cePin, uint16_t csnPin) : RF24(cePin, csnPin) {}
+        void SetStaticPipe(uint8_t pipe, uint8_t width) {
+            write_register(DYNPD, read_register(DYNPD) & ~_BV(DPL_P0 + pipe));
+            write_register(RX_PW_P0 + pipe, width);
+        }
+};
+
+// Adapts RF24 to the receive path so it can be swapped for a simulated radio
+class RF24Source : public RadioSource  {
+    public:
+        RF24Source(RF24 &rf24) : radio(rf24) {}
+        bool Available() override   { return radio.available(); }
+        uint8_t Read(uint8_t *buffer, uint8_t length, uint8_t &pipe) override  {
+            // available() reports the pipe of the payload at the top of the FIFO
+            (void) radio.available(&pipe);
+            // getDynamicPayloadSize() flushes the FIFO and returns 0 if the length is corrupt, the legacy pipe has a fixed width
+            uint8_t payloadLength = pipe == ADDRESS_PLAN_LEGACY_PIPE ? PLANT_PACKET_LEGACY_LENGTH : radio.getDynamicPayloadSize();
+            payloadLength = payloadLength < length ? payloadLength : length;
+            radio.read(buffer, payloadLength);
+            return payloadLength;
+        }
+        void ClearInterrupt() override  {
+            bool txOk, txFail, rxReady;
+            radio.whatHappened(txOk, txFail, rxReady);
+        }
+        bool WriteAckPayload(uint8_t pipe, const uint8_t *payload, uint8_t length) override    {
+            // False once the 3 entry TX FIFO is full of payloads for other pipes
+            return radio.writeAckPayload(pipe, payload, length);
+        }
+    private:
+        RF24 &radio;
+};
+
+// Uses part of the otherwise unused spiffs partition as raw flash, the reading log at the start and the history spill after it
+class PartitionFlashStore : public FlashStore  {
+    public:
+        bool Begin(uint32_t offset, uint32_t maxSize)   {
+            partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, NULL);
+            if(partition == NULL || partition->size <= offset)  {
+                return false;
+            }
+            start = offset;
+            size = (partition->size - offset < maxSize ? partition->size - offset : maxSize) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+            return size > 0;
+        }
+        uint32_t Size() override        { return size; }
+        uint32_t SectorSize() override  { return SPI_FLASH_SEC_SIZE; }
+        bool Read(uint32_t address, void *data, size_t length) override {
+            return esp_partition_read(partition, start + address, data, length) == ESP_OK;
+        }
+        bool Write(uint32_t address, const void *data, size_t length) override  {
+            return esp_partition_write(partition, start + address, data, length) == ESP_OK;
+        }
+        bool EraseSector(uint32_t address) override {
+            return esp_partition_erase_range(partition, start + address, SPI_FLASH_SEC_SIZE) == ESP_OK;
+        }
+    private:
+        const esp_partition_t *partition = NULL;
+        uint32_t start = 0;
+        uint32_t size = 0;
+};
 
 // Objects
-RF24 radio(NRF24L01_CE_PIN, NRF24L01_CSN_PIN);
-PlantPacket packet;
-WiFiClient* client              = new WiFiClientFixed();
+StationRadio radio(NRF24L01_CE_PIN, NRF24L01_CSN_PIN);
+UploadQueue uploadQueue(UPLOAD_BATCH_SIZE, UPLOAD_WINDOW_MS);
+PacketRing packetRing;
+RF24Source radioSource(radio);
+RadioReceiver receiver(radioSource, packetRing);
+ConfigQueue configQueue;
+ChannelSurvey channelSurvey;
+PlantPacket beaconPacket;
+PartitionFlashStore logFlash;
+ReadingLog readingLog(logFlash);
+// The upload task adds to the history and the HTTP server reads it, historyLock is held by both
+PartitionFlashStore historyFlash;
+ReadingHistoryBlock historyBlocks[HISTORY_BLOCKS];
+ReadingHistorySeries historyPlants[HISTORY_PLANTS];
+ReadingHistory history(historyBlocks, HISTORY_BLOCKS, historyPlants, HISTORY_PLANTS);
+SemaphoreHandle_t historyLock;
+bool isReadingLogReady          = false;
+UplinkConnection databaseLink(serverName);
+UplinkConnection ntfyLink(ntfyServer, NTFY_PORT);
+char requestBody[UPLINK_BODY_LENGTH];
+static_assert(UPLINK_BATCH_READINGS >= UPLOAD_QUEUE_CAPACITY, "A full upload queue must fit one request body");
+UplinkEncoder uplinkEncoder(requestBody, sizeof(requestBody));
+NotifyPlantState notifyPlants[NOTIFY_PLANTS];
+NotificationEngine notifications(notifyPlants, NOTIFY_PLANTS);
 CRGB led[NUM_LEDS]              = {0};
 
+StationMetrics metrics;
+char metricsPage[STATION_METRICS_PAGE_LENGTH];
+httpd_handle_t httpServer       = NULL;
+
 // Variables
-uint8_t baseStationAddress[5]   = {'b','a','s','e','\0'};
-uint8_t buffer[BUFFER_LENGTH]   = {"\0"};
+AddressPlan addressPlan;
+uint8_t radioChannel            = ADDRESS_PLAN_DISCOVERY_CHANNEL;
+unsigned long lastBeaconMs      = 0;
+unsigned long lastReplayMs      = 0;
 unsigned long timer             = 0;
+TaskHandle_t receiveTaskHandle  = NULL;
+TaskHandle_t uploadTaskHandle   = NULL;
 
 // Functions
 bool InitializeRadio();
 bool InitializeWifi();
 bool IsWiFiReady();  
-void UpdateMoistureDatabase(const char* plantName, int percentMoisture);
+void UpdateMoistureDatabase();
+int PostReadings(const PlantPacket *readings, uint8_t count);
+bool IsDelivered(int httpResponseCode);
+void StoreReadings(const PlantPacket *readings, uint8_t count);
+void ReplayReadingLog();
+void ReadConsoleCommand();
+void ParseConfigCommand(const char *line);
+void RestartStation();
+void SurveyChannels();
+void SendBeacon();
+void PrintNodeTable();
+void PrintUploadStats();
+void PrintConnectionStats(const char* name, UplinkConnection &link);
 void SendPushNotification(const char* notification, const char* topic);
-void UpdatePushNotifications(const char* plantName, int percentMoisture);
-void GetPlantPacket();
-void ClearBuffer(uint8_t *buffer, int bufferLength);
+void UpdatePushNotifications(const char* plantName, int percentMoisture, uint32_t receivedTime);
+void SendNotificationDigest();
+void IRAM_ATTR OnRadioInterrupt();
 void SetLEDColor(CRGB color);
+bool StartHttpServer();
+esp_err_t HandleMetrics(httpd_req_t *request);
+esp_err_t HandleHistory(httpd_req_t *request);
+esp_err_t SendHistoryPlants(httpd_req_t *request);
+esp_err_t SendHistoryRange(httpd_req_t *request, const char *plantName, uint32_t from, uint32_t to);
+esp_err_t SendHistoryView(httpd_req_t *request, const char *plantName, uint32_t from, uint32_t to, uint32_t step);
+void DecodeQueryValue(char *text);
+void CopyJsonString(char *json, uint16_t size, const char *text);
+void PublishReceiveMetrics();
+void PublishUploadMetrics();
+void ReceiveTask(void *parameter);
+void UploadTask(void *parameter);
 
 //
 //
@@ -91,30 +283,363 @@ void setup() {
         setup();
     }
 
+    // Configs typed on the serial console go out with the acks to their sensors
+    receiver.SetConfigQueue(&configQueue);
+
+    notifications.Configure(DEFAULT_WARN_PERCENT, DEFAULT_CRITICAL_PERCENT, DEFAULT_HYSTERESIS_PERCENT,
+                            DEFAULT_RENOTIFY_SECONDS, NOTIFY_DIGEST_S);
+
+    // Move off the default channel to the quietest one clear of the WiFi network just joined
+    if(CHANNEL_SURVEY_AT_BOOT)  {
+        SurveyChannels();
+    }
+
+    // Readings are timestamped on arrival so replayed ones keep their real time
+    configTime(0, 0, NTP_SERVER);
+
+    isReadingLogReady = logFlash.Begin(0, READING_LOG_MAX_SIZE) && readingLog.Begin();
+    if(isReadingLogReady)   {
+        readingLog.SetReplayRate(REPLAY_BATCH_SIZE, REPLAY_INTERVAL_MS);
+        Serial.print("Reading log ready, ");
+        Serial.print(readingLog.Pending());
+        Serial.println(" readings waiting to be replayed");
+    }
+    else    {
+        Serial.println("Reading log unavailable, undelivered readings will be lost");
+    }
+
+    // Blocks that no longer fit in RAM go to flash, where they also survive a reboot
+    historyLock = xSemaphoreCreateMutex();
+    if(HISTORY_SPILL_SIZE > 0 && (!historyFlash.Begin(READING_LOG_MAX_SIZE, HISTORY_SPILL_SIZE) || !history.BeginSpill(historyFlash)))  {
+        Serial.println("History spill unavailable, only the history in RAM is kept");
+    }
+
     SetLEDColor(CRGB::Green);
     Serial.println("Waiting for plant packets...");
     timer = millis();
+
+    // Reception and upload run in separate tasks so a slow server never stalls the radio.
+    // The receive task gets the higher priority so the RX FIFO is always drained first
+    xTaskCreate(UploadTask, "upload", UPLOAD_TASK_STACK, NULL, UPLOAD_TASK_PRIORITY, &uploadTaskHandle);
+    xTaskCreate(ReceiveTask, "receive", RECEIVE_TASK_STACK, NULL, RECEIVE_TASK_PRIORITY, &receiveTaskHandle);
+
+    // The IRQ line is active low and only RX_DR is unmasked, so a falling edge means a payload arrived
+    pinMode(NRF24L01_IRQ_PIN, INPUT);
+    attachInterrupt(digitalPinToInterrupt(NRF24L01_IRQ_PIN), OnRadioInterrupt, FALLING);
+
+    if(StartHttpServer())   {
+        Serial.print("Metrics and history at http://");
+        Serial.print(WiFi.localIP());
+        Serial.print(':');
+        Serial.print(HTTP_SERVER_PORT);
+        Serial.println("/metrics and /history");
+    }
+    else    {
+        Serial.println("Failed to start the HTTP server");
+    }
 }
 
 void loop() {
-  
-    if(radio.available()) {
-        
-        GetPlantPacket();
-        UpdateMoistureDatabase(packet.plantName, (int)packet.percentSoilLevel);
-        UpdatePushNotifications(packet.plantName, (int)packet.percentSoilLevel);
 
-        Serial.println("Waiting for plant packets...");
+    // Everything runs in ReceiveTask and UploadTask, the loop task is not needed
+    vTaskDelete(NULL);
+}
+
+void IRAM_ATTR OnRadioInterrupt()   {
+
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+    receiver.OnInterrupt();
+    vTaskNotifyGiveFromISR(receiveTaskHandle, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+void ReceiveTask(void *parameter)   {
+
+    for(;;) {
+        // Sleep until the radio interrupts. The timeout only guards against a missed edge,
+        // in between the CPU is left to the idle task instead of polling the radio
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RADIO_IRQ_TIMEOUT_MS));
+        unsigned long busyStart = millis();
+
+        // Only this task touches the radio, packets are handed over through packetRing
+        if(receiver.Drain((uint32_t)time(NULL)) > 0)    {
+            xTaskNotifyGive(uploadTaskHandle);
+        }
+
+        // Lost sensors listen on the discovery channel, a short hop there tells them where to find us
+        if(millis() - lastBeaconMs >= BEACON_PERIOD_MS) {
+            SendBeacon();
+            lastBeaconMs = millis();
+        }
+
+        // The config queue and the radio are only touched by this task, so commands are read here too
+        ReadConsoleCommand();
+
+        PublishReceiveMetrics();
+        metrics.receiveBusy.Observe(millis() - busyStart);
+        metrics.receiveLoopMs.Set(millis());
+    }
+}
+
+void ReadConsoleCommand()   {
+
+    static char line[CONSOLE_LINE_LENGTH];
+    static uint8_t lineLength = 0;
+
+    while(Serial.available() > 0)   {
+        char c = Serial.read();
+        if(c != '\n' && c != '\r') {
+            if(lineLength < CONSOLE_LINE_LENGTH - 1)    {
+                line[lineLength++] = c;
+            }
+            continue;
+        }
+        if(lineLength == 0) {
+            continue;
+        }
+        line[lineLength] = '\0';
+        lineLength = 0;
+
+        if(strcmp(line, "survey") == 0) {
+            SurveyChannels();
+        }
+        else if(strcmp(line, "nodes") == 0) {
+            PrintNodeTable();
+        }
+        else if(strncmp(line, "config", 6) == 0)    {
+            ParseConfigCommand(line);
+        }
+        else if(strcmp(line, "restart") == 0)   {
+            RestartStation();
+        }
+        else    {
+            Serial.println("Commands: survey, nodes, config, restart");
+        }
     }
-    
-    if(timer - millis() >= UPDATE_PERIOD_MS)   { 
-        (void) IsWiFiReady();
-        timer = millis();
+}
+
+void RestartStation()   {
+
+    // The history in RAM is lost on a reboot, so it goes to the spill first. The lock is kept so nothing is added after
+    xSemaphoreTake(historyLock, portMAX_DELAY);
+    if(history.Flush()) {
+        Serial.println("History written to flash, restarting");
     }
-    if(timer > millis())    {
-        timer = millis();
+    else    {
+        Serial.println("History could not all be written to flash, restarting anyway");
     }
+    Serial.flush();
+    ESP.restart();
+}
 
+void ParseConfigCommand(const char *line)   {
+
+    // config <node> <sleep floor s> <sleep ceiling s> <min raw> <max raw> <water start %> <water stop %> <alert %>
+    // A 0 leaves that setting as it is on the sensor
+    unsigned node, floorSeconds, ceilingSeconds, minMoisture, maxMoisture, start, shutoff, alert;
+    if(sscanf(line, "config %u %u %u %u %u %u %u %u", &node, &floorSeconds, &ceilingSeconds,
+              &minMoisture, &maxMoisture, &start, &shutoff, &alert) != 8
+       || floorSeconds > UINT16_MAX || ceilingSeconds > UINT16_MAX || minMoisture > UINT16_MAX
+       || maxMoisture > UINT16_MAX || start > 100 || shutoff > 100 || alert > 100)  {
+        Serial.println("Usage: config <node> <floor s> <ceiling s> <min raw> <max raw> <start %> <stop %> <alert %>");
+        return;
+    }
+
+    PlantPacketConfig config = {(uint16_t)floorSeconds, (uint16_t)ceilingSeconds,
+                                (uint16_t)minMoisture, (uint16_t)maxMoisture,
+                                (uint8_t)start, (uint8_t)shutoff, (uint8_t)alert};
+    if(!PlantPacket::IsConfigValid(config)) {
+        Serial.println("Config not queued, the sleep floor is above the ceiling or min and max raw are the same");
+        return;
+    }
+    if(configQueue.Set(node, config))   {
+        Serial.print("Config queued for node ");
+        Serial.print(node);
+        Serial.println(", it is sent with the ack to its next packet");
+    }
+    else    {
+        Serial.println("Config queue full");
+    }
+}
+
+void SurveyChannels()   {
+
+    uint8_t wifiChannel = WiFi.status() == WL_CONNECTED ? WiFi.channel() : 0;
+    uint8_t previousChannel = radioChannel;
+
+    // Several passes spread over about a second catch bursty WiFi traffic that one look per channel would miss.
+    // The radio is deaf meanwhile, sensors sending now retry or keep their readings for the next wake
+    channelSurvey.Reset();
+    for(uint8_t pass=0; pass<CHANNEL_SURVEY_PASSES; pass++) {
+        for(uint8_t channel=0; channel<CHANNEL_SURVEY_COUNT; channel++) {
+            radio.setChannel(channel);
+            radio.startListening();
+            delayMicroseconds(CHANNEL_SETTLE_US);
+            channelSurvey.AddSample(channel, radio.testRPD());
+            radio.stopListening();
+        }
+    }
+
+    radioChannel = channelSurvey.PickChannel(wifiChannel, radioChannel);
+    radio.setChannel(radioChannel);
+    radio.startListening();
+    receiver.ReloadAckPayloads();
+
+    Serial.print("Channel survey, WiFi on ");
+    Serial.print(wifiChannel);
+    Serial.print(": radio on channel ");
+    Serial.print(radioChannel);
+    Serial.print(" (score ");
+    Serial.print(channelSurvey.Score(radioChannel));
+    Serial.print(", was ");
+    Serial.print(previousChannel);
+    Serial.print(" scoring ");
+    Serial.print(channelSurvey.Score(previousChannel));
+    Serial.println(")");
+}
+
+void SendBeacon()   {
+
+    uint8_t address[ADDRESS_WIDTH];
+    uint8_t buffer[PLANT_PACKET_LENGTH];
+
+    // Sensors that lost us are already on the right channel
+    if(radioChannel == ADDRESS_PLAN_DISCOVERY_CHANNEL)  {
+        return;
+    }
+
+    // Sent without an ack since any number of sensors may be listening. The beacon address is
+    // pipe 0's, so opening it for writing leaves the reading pipes as they were
+    addressPlan.AddressForBeacon(address);
+    beaconPacket.sequence++;
+    radio.stopListening();
+    radio.setChannel(ADDRESS_PLAN_DISCOVERY_CHANNEL);
+    radio.openWritingPipe(address);
+    (void) radio.write(buffer, beaconPacket.CreateBeaconPacket(buffer, radioChannel), true);
+    radio.setChannel(radioChannel);
+    radio.startListening();
+
+    // stopListening() flushes the TX FIFO, and with it any config loaded as an ack payload. This runs every
+    // BEACON_PERIOD_MS, so without loading them again a config would only go out if the sensor sent a
+    // second packet in the same wake after its first had told us its version
+    receiver.ReloadAckPayloads();
+}
+
+void PrintNodeTable()   {
+
+    NodeTable &nodes = receiver.Nodes();
+    uint32_t now = (uint32_t)time(NULL);
+
+    Serial.print(nodes.Count());
+    Serial.print(" nodes, ");
+    Serial.print(nodes.evictions);
+    Serial.println(" evicted");
+
+    // Runs on the receive task, the only one that writes the table
+    for(uint16_t slot=0; slot<NODE_TABLE_SLOTS; slot++) {
+        const NodeState *node = nodes.Slot(slot);
+        if(node == NULL)    {
+            continue;
+        }
+        Serial.print("node ");
+        Serial.print(node->nodeId);
+        Serial.print(' ');
+        Serial.write((const uint8_t *)node->plantName, strnlen(node->plantName, PLANT_NAME_LENGTH));
+        Serial.print(": pipe ");
+        Serial.print(node->pipe);
+        Serial.print(", seen ");
+        Serial.print(now - node->lastSeen);
+        Serial.print("s ago, reports every ");
+        Serial.print(node->reportIntervalSeconds);
+        Serial.print("s, ");
+        Serial.print(node->readings);
+        Serial.print(" readings, ");
+        Serial.print(node->duplicates);
+        Serial.print(" duplicates, ");
+        Serial.print(node->lost);
+        Serial.print(" lost (");
+        Serial.print(NodeTable::LossPerMille(*node) / 10.0, 1);
+        Serial.print("%), ");
+        Serial.print(node->restarts);
+        Serial.println(" restarts");
+
+        // Sensors send a summary with each transmission, covering every wake since the last one
+        if(node->traces > 0)    {
+            char text[WAKE_TRACE_TEXT_LENGTH];
+            WakeTrace::Describe(node->lastTrace, text, sizeof(text));
+            Serial.print("    last trace: ");
+            Serial.println(text);
+        }
+    }
+}
+
+void UploadTask(void *parameter)    {
+
+    PlantPacket reading;
+
+    for(;;) {
+        // Wake on a new packet, or after UPLOAD_POLL_MS to check the upload window
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(UPLOAD_POLL_MS));
+        unsigned long busyStart = millis();
+
+        while(packetRing.Pop(reading))  {
+            Serial.print(reading.plantName);
+            Serial.print(" node ");
+            Serial.print(reading.nodeId);
+            Serial.print(" seq ");
+            Serial.print(reading.sequence);
+            Serial.print(" pipe ");
+            Serial.print(reading.pipe);
+            Serial.print(" v");
+            Serial.print(reading.version);
+            Serial.print(": ");
+            Serial.print(reading.percentSoilLevel);
+            Serial.print("% raw ");
+            Serial.print(reading.rawSoilLevel);
+            Serial.print(" battery ");
+            Serial.print(reading.batteryMillivolts);
+            Serial.println("mV");
+
+            // Make room by sending what is queued if the batch is somehow still full
+            if(!uploadQueue.Add(reading, millis())) {
+                UpdateMoistureDatabase();
+                (void) uploadQueue.Add(reading, millis());
+            }
+            UpdatePushNotifications(reading.plantName, (int)reading.percentSoilLevel, reading.receivedTime);
+
+            xSemaphoreTake(historyLock, portMAX_DELAY);
+            history.Add(reading.plantName, reading.receivedTime, reading.percentSoilLevel, reading.rawSoilLevel);
+            xSemaphoreGive(historyLock);
+
+            // A backlog in the ring goes out UPLOAD_BATCH_SIZE readings at a time, not as one oversized batch
+            if(uploadQueue.IsFlushDue(millis()))    {
+                UpdateMoistureDatabase();
+            }
+
+            Serial.println("Waiting for plant packets...");
+        }
+
+        if(uploadQueue.IsFlushDue(millis()))    {
+            UpdateMoistureDatabase();
+        }
+        SendNotificationDigest();
+
+        // Live readings go first, but steady traffic must not hold the log back for good
+        bool isIdle = packetRing.Count() == 0 && uploadQueue.Count() == 0;
+        if(isIdle || millis() - lastReplayMs >= REPLAY_MAX_WAIT_MS)    {
+            ReplayReadingLog();
+        }
+
+        if(millis() - timer >= UPDATE_PERIOD_MS)   { 
+            (void) IsWiFiReady();
+            timer = millis();
+        }
+
+        PublishUploadMetrics();
+        metrics.uploadBusy.Observe(millis() - busyStart);
+        metrics.uploadLoopMs.Set(millis());
+    }
 }
 
 bool InitializeRadio()  {
@@ -128,8 +653,27 @@ bool InitializeRadio()  {
 
     radio.setPALevel(RF24_PA_LOW);
     radio.setDataRate(RF24_250KBPS);
-    radio.openReadingPipe(1, baseStationAddress);
-    radio.setPayloadSize(sizeof(buffer));
+    // Dynamic payloads carry v2 readings, the legacy pipe is set back to the legacy static width below
+    radio.enableDynamicPayloads();
+    // Configs for sleeping sensors ride back on the auto-ack, beacons go out with no ack at all
+    radio.enableAckPayload();
+    radio.enableDynamicAck();
+    radio.setChannel(radioChannel);
+
+    // Listen on all six pipes, sensors are spread over them by node id and legacy nodes stay on pipe 1.
+    // That pipe is set to the legacy static width after enableAckPayload(), which turns pipes 0 and 1
+    // dynamic again. No node with an id is sent there, so it never needs an ack payload
+    if(!addressPlan.IsValid())  {
+        Serial.println("Address plan has repeated or preamble-like first bytes");
+    }
+    for(uint8_t pipe=0; pipe<ADDRESS_PLAN_PIPES; pipe++)    {
+        uint8_t address[ADDRESS_WIDTH];
+        addressPlan.AddressForPipe(pipe, address);
+        radio.openReadingPipe(pipe, address);
+    }
+    radio.SetStaticPipe(ADDRESS_PLAN_LEGACY_PIPE, PLANT_PACKET_LEGACY_LENGTH);
+    // Only interrupt on received payloads, ack payloads going out are not waited on
+    radio.maskIRQ(true, true, false);
     radio.flush_rx();
     radio.startListening();
 
@@ -163,37 +707,220 @@ bool InitializeWifi() {
     return true;
 }
 
-void UpdateMoistureDatabase(const char* plant, int percentMoisture) {
-  
+void UpdateMoistureDatabase() {
+
+    unsigned long flushStart = millis();
+    uint8_t batchSize = uploadQueue.Count();
+
+    if(batchSize == 0)  {
+        return;
+    }
+
     if(!IsWiFiReady())  {
         Serial.println("Database updated aborted, wifi is not connected!");
+        StoreReadings(&uploadQueue.Get(0), batchSize);
+        uploadQueue.Discard();
         return;
     }
 
-    HTTPClient http;
-    http.begin(*client, serverName);
-    http.addHeader("Content-Type","application/x-www-form-urlencoded");
+    int httpResponseCode = PostReadings(&uploadQueue.Get(0), batchSize);
+    if(!IsDelivered(httpResponseCode))  {
+        StoreReadings(&uploadQueue.Get(0), batchSize);
+    }
+
+    uploadQueue.CompleteFlush(flushStart, millis());
+    metrics.batchAge.Observe(uploadQueue.stats.lastBatchAgeMs);
+    PrintUploadStats();
+    PrintConnectionStats("Database", databaseLink);
+}
+
+int PostReadings(const PlantPacket *readings, uint8_t count)    {
 
-    String httpRequestData = "api_key=" +  apiKeyValue + "&moisture=" + percentMoisture + "%&plantname=" + plant + "";
+    // Every reading in the batch goes into one request as parallel form arrays
+    uint16_t length = uplinkEncoder.EncodeBatch(apiKeyValue.c_str(), readings, count);
+    if(length == 0) {
+        Serial.println("Database request data does not fit UPLINK_BODY_LENGTH!");
+        return -1;
+    }
     Serial.print("Database request data:: ");
-    Serial.println(httpRequestData);
+    Serial.println(requestBody);
 
-    int httpResponseCode = http.POST(httpRequestData);
+    unsigned long postStart = millis();
+    int httpResponseCode = databaseLink.POST(serverName, "application/x-www-form-urlencoded", requestBody, length);
+    metrics.uploadLatency.Observe(millis() - postStart);
+    metrics.uploads.Add(httpResponseCode);
 
     if (httpResponseCode==200) {
         Serial.println("Database updated successfully!");
-        http.end();
     }
     else if (httpResponseCode>0) {
         Serial.print("Unknown database update result, http response code: ");
         Serial.println(httpResponseCode);
-        http.end();
     }
     else {
         Serial.print("Database update failed, http response code: ");
         Serial.println(httpResponseCode);
-        http.end();
     }
+
+    return httpResponseCode;
+}
+
+bool IsDelivered(int httpResponseCode)  {
+
+    // Connection errors and server errors are worth retrying later, a rejected request is not
+    return httpResponseCode > 0 && httpResponseCode < 500;
+}
+
+void StoreReadings(const PlantPacket *readings, uint8_t count)  {
+
+    if(!isReadingLogReady)  {
+        return;
+    }
+
+    for(uint8_t i=0; i<count; i++)  {
+        if(!readingLog.Append(readings[i])) {
+            Serial.println("Failed to write reading to the log!");
+            return;
+        }
+    }
+
+    Serial.print("Stored ");
+    Serial.print(count);
+    Serial.print(" readings in the log, ");
+    Serial.print(readingLog.Pending());
+    Serial.print(" waiting, ");
+    Serial.print(readingLog.stats.dropped);
+    Serial.println(" dropped since boot");
+}
+
+void ReplayReadingLog() {
+
+    PlantPacket readings[REPLAY_BATCH_SIZE];
+
+    if(!isReadingLogReady || readingLog.Pending() == 0 || WiFi.status() != WL_CONNECTED)  {
+        lastReplayMs = millis();
+        return;
+    }
+
+    // The log paces itself to one batch per REPLAY_INTERVAL_MS so replay never crowds out live uploads
+    uint8_t count = readingLog.NextReplayBatch(readings, REPLAY_BATCH_SIZE, millis());
+    if(count == 0)  {
+        return;
+    }
+    lastReplayMs = millis();
+
+    Serial.print("Replaying ");
+    Serial.print(count);
+    Serial.println(" logged readings");
+
+    if(IsDelivered(PostReadings(readings, count)))  {
+        readingLog.MarkDelivered(count);
+    }
+
+    Serial.print(readingLog.Pending());
+    Serial.println(" logged readings left to replay");
+}
+
+void PrintUploadStats()  {
+
+    Serial.print("Upload batch: ");
+    Serial.print(uploadQueue.stats.lastBatchSize);
+    Serial.print(" readings, waited ");
+    Serial.print(uploadQueue.stats.lastBatchAgeMs);
+    Serial.print("ms, flush took ");
+    Serial.print(uploadQueue.stats.lastFlushLatencyMs);
+    Serial.print("ms (max batch ");
+    Serial.print(uploadQueue.stats.maxBatchSize);
+    Serial.print(", max flush ");
+    Serial.print(uploadQueue.stats.maxFlushLatencyMs);
+    Serial.print("ms, ");
+    Serial.print(uploadQueue.stats.readingsFlushed);
+    Serial.print(" readings in ");
+    Serial.print(uploadQueue.stats.flushCount);
+    Serial.println(" batches)");
+
+    Serial.print("Request bodies: ");
+    Serial.print(uplinkEncoder.stats.bodies);
+    Serial.print(" encoded, ");
+    Serial.print(uplinkEncoder.stats.bytes);
+    Serial.print(" bytes, ");
+    Serial.print(uplinkEncoder.stats.overflows);
+    Serial.print(" too long for ");
+    Serial.println(UPLINK_BODY_LENGTH);
+
+    Serial.print("Packet ring: ");
+    Serial.print(packetRing.Count());
+    Serial.print(" waiting, high water mark ");
+    Serial.print(packetRing.HighWaterMark());
+    Serial.print(" of ");
+    Serial.print(PACKET_RING_CAPACITY);
+    Serial.print(", ");
+    Serial.print(packetRing.Drops());
+    Serial.println(" dropped");
+
+    RadioReceiverStats radioStats = receiver.Stats();
+    Serial.print("Radio: ");
+    Serial.print(radioStats.interrupts);
+    Serial.print(" interrupts, ");
+    Serial.print(radioStats.packets);
+    Serial.print(" packets in ");
+    Serial.print(radioStats.drains);
+    Serial.print(" drains (");
+    Serial.print(radioStats.emptyDrains);
+    Serial.print(" empty, max ");
+    Serial.print(radioStats.maxPacketsPerDrain);
+    Serial.print(" per drain), ");
+    Serial.print(radioStats.parseFailures);
+    Serial.print(" parse failures, ");
+    Serial.print(radioStats.duplicates);
+    Serial.print(" duplicates dropped, ");
+    Serial.print(radioStats.traces);
+    Serial.println(" wake traces");
+
+    Serial.print("Channel ");
+    Serial.print(radioChannel);
+    Serial.print(", packets per pipe:");
+    for(uint8_t pipe=0; pipe<RADIO_PIPES; pipe++)   {
+        Serial.print(' ');
+        Serial.print(radioStats.pipePackets[pipe]);
+    }
+    Serial.println();
+
+    Serial.print("Configs: ");
+    Serial.print(configQueue.Pending());
+    Serial.print(" waiting, ");
+    Serial.print(radioStats.ackPayloads);
+    Serial.print(" ack payloads loaded, ");
+    Serial.print(configQueue.stats.confirmed);
+    Serial.println(" confirmed");
+
+    Serial.print("Notifications: ");
+    Serial.print(notifications.stats.sent);
+    Serial.print(" sent (");
+    Serial.print(notifications.stats.digests);
+    Serial.print(" digests), ");
+    Serial.print(notifications.stats.suppressed);
+    Serial.print(" low readings held back, ");
+    Serial.print(notifications.Alerting());
+    Serial.println(" plants need water");
+}
+
+void PrintConnectionStats(const char* name, UplinkConnection &link)  {
+
+    Serial.print(name);
+    Serial.print(" connection: ");
+    Serial.print(link.RequestsOnConnection());
+    Serial.print(" requests on this connection, ");
+    Serial.print(link.RequestsPerConnection());
+    Serial.print(" requests per connection (");
+    Serial.print(link.stats.connectionsOpened);
+    Serial.print(" opened, ");
+    Serial.print(link.stats.serverCloses);
+    Serial.print(" dropped by server, ");
+    Serial.print(link.stats.retries);
+    Serial.print(" retries, ");
+    Serial.print(link.stats.dnsLookups);
+    Serial.println(" dns lookups)");
 }
 
 void SendPushNotification(const char* notification, const char* topic)    {
@@ -203,48 +930,44 @@ void SendPushNotification(const char* notification, const char* topic)    {
         return;
     }
 
-    HTTPClient http;
     char address[64] = "";
-    sprintf(address, "%s:8080/%s", ntfyServer, topic);  
-    http.begin(*client, address);
-    http.addHeader("Content-Type","text/plain");
+    sprintf(address, "%s:%d/%s", ntfyServer, NTFY_PORT, topic);  
 
     Serial.print("Push notification request data: ");
     Serial.println(notification);
 
-    int httpResponseCode = http.POST(notification);
-
+    int httpResponseCode = ntfyLink.POST(address, "text/plain", notification, strlen(notification));
 
     if (httpResponseCode==200) {
         Serial.println("Push notification sent successfully!");
-        http.end();
     }
     else if (httpResponseCode>0) {
         Serial.print("Unknown notification result, http response code: ");
         Serial.println(httpResponseCode);
-        http.end();
     }
     else {
         Serial.print("Push notifcation failed, http response code: ");
         Serial.println(httpResponseCode);
-        http.end();
     }
+    PrintConnectionStats("Ntfy", ntfyLink);
 } 
 
-void UpdatePushNotifications(const char* plantName, int percentMoisture)   {
+void UpdatePushNotifications(const char* plantName, int percentMoisture, uint32_t receivedTime)   {
 
-    if(percentMoisture <= 50)   {
-        SendPushNotification("Soil moisture is below 50%, water soon!", plantName);
-    }
-    else if(percentMoisture <= 40)   {
-        SendPushNotification("Soil moisture is below 40%, water now!", plantName);
+    char message[NOTIFY_MESSAGE_LENGTH];
+
+    // Only a plant getting drier or going unwatered for DEFAULT_RENOTIFY_SECONDS is notified
+    if(notifications.Update(plantName, constrain(percentMoisture, 0, 100), receivedTime, message, sizeof(message)))  {
+        SendPushNotification(message, plantName);
     }
 }
 
-void ClearBuffer(uint8_t *buffer, int bufferLength) {
+void SendNotificationDigest()   {
 
-    for(int i=0; i<bufferLength; i++) {
-        buffer[i] = '\0';
+    char message[NOTIFY_MESSAGE_LENGTH];
+
+    if(notifications.TakeDigest((uint32_t)time(NULL), message, sizeof(message)))   {
+        SendPushNotification(message, NTFY_DIGEST_TOPIC);
     }
 }
 
@@ -260,10 +983,12 @@ bool IsWiFiReady()  {
 
     if(WiFi.status() != WL_CONNECTED) {
         Serial.print("Problem with wifi connection, attempting to reconnect... ");
+        metrics.wifiReconnects.Add();
         WiFi.disconnect();
         WiFi.begin(ssid, password);
 
         if(WiFi.waitForConnectResult(WIFI_TIMEOUT_MS)!=WL_CONNECTED)  {
+            metrics.wifiReconnectFailures.Add();
             SetLEDColor(CRGB::Red);
             WiFi.disconnect(true,true);
             Serial.println("reconnect failed!");
@@ -278,11 +1003,243 @@ bool IsWiFiReady()  {
     return true;
 }
 
-void GetPlantPacket()   {
+bool StartHttpServer()  {
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    httpd_uri_t metricsUri = {};
+    httpd_uri_t historyUri = {};
+
+    // The server runs its own task, so a scrape only costs the loads that read each metric
+    config.server_port = HTTP_SERVER_PORT;
+    config.stack_size = HTTP_SERVER_STACK;
+    config.task_priority = HTTP_SERVER_PRIORITY;
+    metricsUri.uri = "/metrics";
+    metricsUri.method = HTTP_GET;
+    metricsUri.handler = HandleMetrics;
+    historyUri.uri = "/history";
+    historyUri.method = HTTP_GET;
+    historyUri.handler = HandleHistory;
+
+    return httpd_start(&httpServer, &config) == ESP_OK
+        && httpd_register_uri_handler(httpServer, &metricsUri) == ESP_OK
+        && httpd_register_uri_handler(httpServer, &historyUri) == ESP_OK;
+}
+
+esp_err_t HandleMetrics(httpd_req_t *request)   {
+
+    // The server handles one request at a time, so the page buffer is never shared
+    MetricsWriter page(metricsPage, sizeof(metricsPage));
+
+    metrics.scrapes.Add();
+    metrics.Write(page, millis(), ESP.getFreeHeap(), ESP.getMinFreeHeap());
+    if(page.Length() == 0)  {
+        Serial.println("Metrics page does not fit STATION_METRICS_PAGE_LENGTH!");
+        return httpd_resp_send_500(request);
+    }
+    httpd_resp_set_type(request, METRICS_CONTENT_TYPE);
+    return httpd_resp_send(request, metricsPage, page.Length());
+}
+
+// GET /history lists the plants with a history. With plant=<name> it returns that plant's readings,
+// limited with from=<unix time> and to=<unix time>, or with step=<seconds> one point per step
+esp_err_t HandleHistory(httpd_req_t *request)   {
+
+    char query[HISTORY_QUERY_LENGTH];
+    char value[12];
+    char plantName[PLANT_NAME_LENGTH + 1] = "";
+    uint32_t from = 0;
+    uint32_t to = UINT32_MAX;
+    uint32_t step = 0;
+
+    if(httpd_req_get_url_query_str(request, query, sizeof(query)) == ESP_OK)  {
+        if(httpd_query_key_value(query, "plant", plantName, sizeof(plantName)) == ESP_OK)  {
+            DecodeQueryValue(plantName);
+        }
+        if(httpd_query_key_value(query, "from", value, sizeof(value)) == ESP_OK)   {
+            from = strtoul(value, NULL, 10);
+        }
+        if(httpd_query_key_value(query, "to", value, sizeof(value)) == ESP_OK) {
+            to = strtoul(value, NULL, 10);
+        }
+        if(httpd_query_key_value(query, "step", value, sizeof(value)) == ESP_OK)   {
+            step = strtoul(value, NULL, 10);
+        }
+    }
+
+    httpd_resp_set_type(request, "application/json");
+    if(plantName[0] == '\0')    {
+        return SendHistoryPlants(request);
+    }
+    if(step > 0)    {
+        // A view always ends now unless told otherwise, so only its start needs picking
+        if(to == UINT32_MAX)    {
+            to = time(NULL);
+        }
+        if(from > to || (to - from) / step >= HISTORY_MAX_POINTS)  {
+            return httpd_resp_send_err(request, HTTPD_400_BAD_REQUEST, "Too many points, use a larger step or a shorter range");
+        }
+        return SendHistoryView(request, plantName, from, to, step);
+    }
+    return SendHistoryRange(request, plantName, from, to);
+}
+
+esp_err_t SendHistoryPlants(httpd_req_t *request)   {
+
+    static char chunk[HISTORY_CHUNK_LENGTH];
+    char name[2 * PLANT_NAME_LENGTH + 1];
+    ReadingHistorySummary summary;
+    bool isFirst = true;
+
+    httpd_resp_send_chunk(request, "{\"plants\":[", HTTPD_RESP_USE_STRLEN);
+    for(uint8_t i=0; i<history.SeriesCount(); i++)  {
+        xSemaphoreTake(historyLock, portMAX_DELAY);
+        bool isUsed = history.Summarize(i, summary);
+        xSemaphoreGive(historyLock);
+        if(!isUsed) {
+            continue;
+        }
+
+        CopyJsonString(name, sizeof(name), summary.plantName);
+        snprintf(chunk, sizeof(chunk), "%s{\"plant\":\"%s\",\"readings\":%lu,\"first\":%lu,\"last\":%lu,\"bytes\":%u}",
+                 isFirst ? "" : ",", name, (unsigned long)summary.samples, (unsigned long)summary.firstTime,
+                 (unsigned long)summary.lastTime, (unsigned)(summary.blocks * sizeof(ReadingHistoryBlock)));
+        httpd_resp_send_chunk(request, chunk, HTTPD_RESP_USE_STRLEN);
+        isFirst = false;
+    }
+    httpd_resp_send_chunk(request, "]}", HTTPD_RESP_USE_STRLEN);
+    return httpd_resp_send_chunk(request, NULL, 0);
+}
+
+esp_err_t SendHistoryRange(httpd_req_t *request, const char *plantName, uint32_t from, uint32_t to)   {
+
+    // The server handles one request at a time, so these are never shared
+    static ReadingHistorySample page[HISTORY_PAGE];
+    static char chunk[HISTORY_CHUNK_LENGTH];
+    char name[2 * PLANT_NAME_LENGTH + 1];
+    ReadingHistoryCursor cursor = {};
+    bool isFirst = true;
+    uint16_t count;
+
+    CopyJsonString(name, sizeof(name), plantName);
+    snprintf(chunk, sizeof(chunk), "{\"plant\":\"%s\",\"readings\":[", name);
+    httpd_resp_send_chunk(request, chunk, HTTPD_RESP_USE_STRLEN);
+
+    // The lock is only held to decode a page, never while sending, so a slow client does not hold up uploads
+    do  {
+        xSemaphoreTake(historyLock, portMAX_DELAY);
+        count = history.Query(plantName, from, to, page, HISTORY_PAGE, cursor);
+        xSemaphoreGive(historyLock);
+
+        int length = 0;
+        for(uint16_t i=0; i<count; i++) {
+            length += snprintf(&chunk[length], sizeof(chunk) - length, "%s[%lu,%u,%u]", isFirst ? "" : ",",
+                               (unsigned long)page[i].time, page[i].percentSoilLevel, page[i].rawSoilLevel);
+            isFirst = false;
+        }
+        if(count > 0)   {
+            httpd_resp_send_chunk(request, chunk, length);
+        }
+    } while(count == HISTORY_PAGE);
+
+    httpd_resp_send_chunk(request, "]}", HTTPD_RESP_USE_STRLEN);
+    return httpd_resp_send_chunk(request, NULL, 0);
+}
+
+esp_err_t SendHistoryView(httpd_req_t *request, const char *plantName, uint32_t from, uint32_t to, uint32_t step)   {
+
+    static ReadingHistoryBucket buckets[HISTORY_MAX_POINTS];
+    static char chunk[HISTORY_CHUNK_LENGTH];
+    char name[2 * PLANT_NAME_LENGTH + 1];
+    uint16_t bucketCount = (to - from) / step + 1;
+    bool isFirst = true;
+
+    xSemaphoreTake(historyLock, portMAX_DELAY);
+    (void) history.Downsample(plantName, from, step, buckets, bucketCount);
+    xSemaphoreGive(historyLock);
+
+    CopyJsonString(name, sizeof(name), plantName);
+    snprintf(chunk, sizeof(chunk), "{\"plant\":\"%s\",\"step\":%lu,\"points\":[", name, (unsigned long)step);
+    httpd_resp_send_chunk(request, chunk, HTTPD_RESP_USE_STRLEN);
+
+    // Each point is [start, readings, average %, min %, max %], steps with no readings are left out
+    int length = 0;
+    for(uint16_t i=0; i<bucketCount; i++)   {
+        const ReadingHistoryBucket &bucket = buckets[i];
+        if(bucket.count == 0)   {
+            continue;
+        }
+        length += snprintf(&chunk[length], sizeof(chunk) - length, "%s[%lu,%u,%lu,%u,%u]", isFirst ? "" : ",",
+                           (unsigned long)bucket.time, bucket.count, (unsigned long)((bucket.percentSum + bucket.count / 2) / bucket.count),
+                           bucket.minPercent, bucket.maxPercent);
+        isFirst = false;
+        if(length > HISTORY_CHUNK_LENGTH - 48)  {
+            httpd_resp_send_chunk(request, chunk, length);
+            length = 0;
+        }
+    }
+    if(length > 0)  {
+        httpd_resp_send_chunk(request, chunk, length);
+    }
+    httpd_resp_send_chunk(request, "]}", HTTPD_RESP_USE_STRLEN);
+    return httpd_resp_send_chunk(request, NULL, 0);
+}
+
+// Query values arrive form encoded, so a plant name with spaces comes as + or %20
+void DecodeQueryValue(char *text)   {
+
+    char *out = text;
+
+    for(; *text != '\0'; text++)    {
+        if(*text == '+')    {
+            *out++ = ' ';
+        }
+        else if(*text == '%' && isxdigit((unsigned char)text[1]) && isxdigit((unsigned char)text[2]))    {
+            char hex[3] = {text[1], text[2], '\0'};
+            *out++ = (char)strtoul(hex, NULL, 16);
+            text += 2;
+        }
+        else    {
+            *out++ = *text;
+        }
+    }
+    *out = '\0';
+}
+
+// Plant names are at most PLANT_NAME_LENGTH characters and may not be terminated at full length
+void CopyJsonString(char *json, uint16_t size, const char *text)  {
+
+    uint16_t length = 0;
+
+    for(uint8_t i=0; i<PLANT_NAME_LENGTH && text[i] != '\0' && length + 2 < size; i++)    {
+        if(text[i] == '"' || text[i] == '\\')   {
+            json[length++] = '\\';
+        }
+        if((unsigned char)text[i] >= ' ')   {
+            json[length++] = text[i];
+        }
+    }
+    json[length] = '\0';
+}
+
+void PublishReceiveMetrics()    {
+
+    RadioReceiverStats radioStats = receiver.Stats();
+
+    metrics.interrupts.Set(radioStats.interrupts);
+    metrics.packets.Set(radioStats.packets);
+    metrics.parseFailures.Set(radioStats.parseFailures);
+    metrics.duplicates.Set(radioStats.duplicates);
+    metrics.burstReadings.Set(radioStats.burstReadings);
+    metrics.traces.Set(radioStats.traces);
+    metrics.ringDrops.Set(packetRing.Drops());
+    metrics.ringDepth.Set(packetRing.Count());
+    metrics.ringHighWater.Set(packetRing.HighWaterMark());
+    metrics.nodes.Set(receiver.Nodes().Count());
+}
+
+void PublishUploadMetrics() {
 
-        radio.read(&buffer, sizeof(buffer));
-        packet.ParsePlantPacket(&buffer[0]);
-        ClearBuffer(&buffer[0], BUFFER_LENGTH);
-        Serial.print(packet.plantName);
-        Serial.println(packet.percentSoilLevel); 
+    metrics.readingsFlushed.Set(uploadQueue.stats.readingsFlushed);
+    metrics.queueDepth.Set(uploadQueue.Count());
+    metrics.logPending.Set(isReadingLogReady ? readingLog.Pending() : 0);
 }
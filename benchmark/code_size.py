@@ -0,0 +1,40 @@
+# Prints the size of each benchmarked function in the built firmware as JSON lines,
+# so code size can be compared between runs alongside the timings
+
+Import("env")
+
+import json
+import re
+import subprocess
+
+SYMBOLS = [
+    "PlantPacket::CreatePlantPacket",
+    "PlantPacket::ParsePlantPacket",
+    "PlantPacket::ParseBurstPacket",
+    "PlantPacket::Crc16",
+    "SoilMonitor::ConvertSoilLevel",
+    "SoilCalibrationPercent",
+    "SoilMonitor::PollSoilReading",
+    "BuildBodyString",
+    "UplinkEncoder::EncodeBatch",
+    "MetricsWriter::Samples",
+]
+
+
+def print_code_size(source, target, env):
+    # nm sits next to the compiler in every toolchain, e.g. avr-gcc and avr-nm
+    nm = env.subst("$CC")[:-len("gcc")] + "nm"
+    output = subprocess.run([nm, "-S", "-C", str(target[0])], capture_output=True, text=True).stdout
+    sizes = {}
+    for line in output.splitlines():
+        fields = line.split(None, 3)
+        if len(fields) == 4 and fields[2].lower() in ("t", "w"):
+            name = re.sub(r"\[abi:[^\]]*\]", "", fields[3]).split("(")[0]
+            if name in SYMBOLS:
+                sizes[name] = sizes.get(name, 0) + int(fields[1], 16)
+    for name in SYMBOLS:
+        if name in sizes:
+            print(json.dumps({"target": env["PIOENV"], "symbol": name, "bytes": sizes[name]}))
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}${PROGSUFFIX}", print_code_size)
@@ -0,0 +1,171 @@
+/*
+ *  Bench, timing and allocation counting for the benchmarks on
+ *  the Linux host, the AVR sensor and the ESP32 base station
+ */
+
+#include <stdlib.h>
+#include "Bench.h"
+
+static volatile uint32_t allocations = 0;
+
+uint32_t BenchAllocations() {
+
+    return allocations;
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+// Boards are linked with --wrap=malloc and --wrap=realloc so every heap call, including String's, lands here
+extern "C" void *__real_malloc(size_t size);
+extern "C" void *__real_realloc(void *pointer, size_t size);
+
+extern "C" void *__wrap_malloc(size_t size)  {
+
+    allocations++;
+    return __real_malloc(size);
+}
+
+extern "C" void *__wrap_realloc(void *pointer, size_t size)  {
+
+    allocations++;
+    return __real_realloc(pointer, size);
+}
+
+void BenchBegin()   {
+
+    Serial.begin(115200);
+    delay(1000); // Give the monitor time to attach
+}
+
+void BenchPrint(const char *line)   {
+
+    Serial.println(line);
+    Serial.flush();
+}
+
+#else
+
+#include <stdio.h>
+#include <chrono>
+#include <new>
+
+static std::chrono::steady_clock::time_point timerStart;
+
+// std::string allocates through operator new on the host
+void *operator new(size_t size)  {
+
+    allocations++;
+    void *pointer = malloc(size);
+    if(pointer == NULL) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void *pointer) noexcept    {
+
+    free(pointer);
+}
+
+void operator delete(void *pointer, size_t size) noexcept   {
+
+    free(pointer);
+}
+
+void BenchBegin()   {
+
+}
+
+void BenchPrint(const char *line)   {
+
+    puts(line);
+}
+
+void BenchTimerStart()  {
+
+    timerStart = std::chrono::steady_clock::now();
+}
+
+uint64_t BenchTimerStop()   {
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - timerStart).count();
+}
+
+uint32_t BenchCpuMhz()  {
+
+    return 0;
+}
+
+#endif
+
+#if defined(ARDUINO_ARCH_AVR)
+
+static volatile uint16_t timerOverflows;
+static uint8_t savedTimer0Mask;
+
+ISR(TIMER1_OVF_vect)    {
+
+    timerOverflows++;
+}
+
+void BenchTimerStart()  {
+
+    // Timer0 keeps millis() going, its interrupt would be counted against the code under test
+    savedTimer0Mask = TIMSK0;
+    TIMSK0 = 0;
+
+    // Timer1 with no prescaler counts CPU cycles, overflows extend it to 32 bits
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    timerOverflows = 0;
+    TIFR1 = _BV(TOV1);
+    TIMSK1 = _BV(TOIE1);
+    TCCR1B = _BV(CS10);
+}
+
+uint64_t BenchTimerStop()   {
+
+    TCCR1B = 0;
+    noInterrupts();
+    uint16_t count = TCNT1;
+    // An overflow can be pending if the timer wrapped just before it was stopped
+    if(TIFR1 & _BV(TOV1))   {
+        timerOverflows++;
+        TIFR1 = _BV(TOV1);
+    }
+    TIMSK1 = 0;
+    interrupts();
+
+    TIMSK0 = savedTimer0Mask;
+    return ((uint32_t)timerOverflows << 16) | count;
+}
+
+uint32_t BenchCpuMhz()  {
+
+    return F_CPU / 1000000UL;
+}
+
+#elif defined(ESP32)
+
+static uint32_t cycleStart;
+
+void BenchTimerStart()  {
+
+    cycleStart = ESP.getCycleCount();
+}
+
+uint64_t BenchTimerStop()   {
+
+    // 32-bit counter, wraps after about 26s at 160MHz which is far longer than any benchmark
+    return ESP.getCycleCount() - cycleStart;
+}
+
+uint32_t BenchCpuMhz()  {
+
+    return getCpuFrequencyMhz();
+}
+
+#endif
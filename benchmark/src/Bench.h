@@ -0,0 +1,32 @@
+/*
+ *  Bench, timing and allocation counting for the benchmarks on
+ *  the Linux host, the AVR sensor and the ESP32 base station
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#if defined(ARDUINO_ARCH_AVR)
+#define BENCH_TARGET                        "avr"
+#define BENCH_HAS_CYCLES                    (1)                                             // Timer1 counts CPU cycles
+#define BENCH_ITERATIONS                    (1000UL)
+#elif defined(ESP32)
+#define BENCH_TARGET                        "esp32c3"
+#define BENCH_HAS_CYCLES                    (1)                                             // CPU cycle counter
+#define BENCH_ITERATIONS                    (20000UL)
+#else
+#define BENCH_TARGET                        "native"
+#define BENCH_HAS_CYCLES                    (0)                                             // Timed in nanoseconds with the steady clock
+#define BENCH_ITERATIONS                    (1000000UL)
+#endif
+
+void BenchBegin();                                                                          //  Sets up the serial port on boards
+void BenchPrint(const char *line);
+void BenchTimerStart();
+uint64_t BenchTimerStop();                                                                  //  Cycles on boards, nanoseconds on the host
+uint32_t BenchCpuMhz();
+uint32_t BenchAllocations();                                                                //  Heap allocations and reallocations so far
+
+#endif
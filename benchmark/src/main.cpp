@@ -0,0 +1,293 @@
+/*
+ *  Micro-benchmarks for the code that runs once per reading
+ *  Prints one JSON object per benchmark so runs can be compared
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "Bench.h"
+#include "PlantPacket.h"
+#include "SoilMonitor.h"
+#include "UplinkEncoder.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+typedef String BenchString;
+#define BENCH_TO_STRING(value)  String(value)
+#else
+#include <string>
+typedef std::string BenchString;
+#define BENCH_TO_STRING(value)  std::to_string(value)
+#endif
+
+#if defined(ARDUINO_ARCH_AVR)
+#define SOIL_SENSOR_PWR_PIN     (5)
+#define SOIL_SENSOR_DATA_PIN    (A0)
+#define BENCH_BODY              (0)                                                         // Request bodies are only built on the base station
+#elif defined(ESP32)
+#define SOIL_SENSOR_PWR_PIN     (18)
+#define SOIL_SENSOR_DATA_PIN    (3)
+#define BENCH_BODY              (1)
+#else
+#define SOIL_SENSOR_PWR_PIN     (5)
+#define SOIL_SENSOR_DATA_PIN    (14)
+#define BENCH_BODY              (1)
+#endif
+
+#define BENCH_BATCH             (8)                                                         // Readings per request, UPLOAD_BATCH_SIZE on the base station
+#define BENCH_BODY_DIVIDER      (50)                                                        // Request bodies run this many times fewer iterations
+#define BENCH_LINE_LENGTH       (192)
+#define BENCH_CURVE_EXPONENT    (1.8)                                                       // soilCurveCapacitive was sampled from this curve
+#define BENCH_METRIC_BOUNDS     (9)                                                         // The base station's task busy histogram
+
+// Metrics needs <atomic>, which the AVR toolchain does not have
+#if BENCH_BODY
+#include "Metrics.h"
+#endif
+
+typedef void (*BenchFunction)();
+
+BenchString apiKeyValue = "0123456789abcdef";
+PlantPacket packet;
+PlantPacket burst[PLANT_PACKET_BURST_ENTRIES];
+PlantPacket readings[BENCH_BATCH];
+SoilMonitor *soilMonitor;
+SoilMonitor *curveMonitor;
+constexpr auto capacitiveTable = SoilCalibrate(soilCurveCapacitive);
+uint16_t mapDry = DEFAULT_MIN_MOISTURE;                                                    //  Not constants, the old calibration was set at run time
+uint16_t mapWet = DEFAULT_MAX_MOISTURE;
+uint8_t frame[PLANT_PACKET_LENGTH];
+uint8_t legacyFrame[PLANT_PACKET_LEGACY_LENGTH];
+uint8_t burstFrame[PLANT_PACKET_LENGTH];
+uint8_t burstLength;
+uint16_t sampleSum;
+char bodyBuffer[UPLINK_BODY_LENGTH];
+UplinkEncoder encoder(bodyBuffer, sizeof(bodyBuffer));
+#if BENCH_BODY
+const uint32_t metricBounds[BENCH_METRIC_BOUNDS] = {1, 5, 10, 50, 100, 500, 1000, 5000, 10000};
+MetricsHistogram histogram(metricBounds, BENCH_METRIC_BOUNDS);
+MetricsCounter counter;
+#endif
+volatile uint32_t sink;                                                                     //  Keeps results alive so nothing is optimized away
+
+void RunBenchmarks();
+void RunBench(const char *name, BenchFunction function, uint32_t iterations);
+BenchString BuildBodyString(const PlantPacket *readings, uint8_t count);
+void PrintEncoderStats();
+long MapRange(long value, long fromLow, long fromHigh, long toLow, long toHigh);
+void PrintCalibrationError(const char *curveName, const char *method, SoilMonitor *monitor, bool isCapacitive);
+
+void BenchEmpty()           { sink++; }
+void BenchPacketCreate()    { sink += packet.CreatePlantPacket(frame); }
+void BenchPacketParse()     { sink += packet.ParsePlantPacket(frame, PLANT_PACKET_LENGTH); }
+void BenchPacketLegacy()    { sink += packet.ParsePlantPacket(legacyFrame, PLANT_PACKET_LEGACY_LENGTH); }
+void BenchBurstParse()      { sink += PlantPacket::ParseBurstPacket(burstFrame, burstLength, burst, PLANT_PACKET_BURST_ENTRIES); }
+void BenchCrc16()           { sink += PlantPacket::Crc16(frame, PLANT_PACKET_LENGTH - 2); }
+void BenchBodyString()      { sink += BuildBodyString(readings, BENCH_BATCH).length(); }
+void BenchBodyEncoder()     { sink += encoder.EncodeBatch(apiKeyValue.c_str(), readings, BENCH_BATCH); }
+#if BENCH_BODY
+void BenchMetricCounter()   { counter.Add(); }
+void BenchMetricObserve()   { histogram.Observe(sink++ & 0x3FFF); }                        //  Spread over every bucket, +Inf included
+#endif
+
+void BenchSoilConvert()    {
+
+    // Walk the input across the calibrated range so every branch of the math is exercised
+    soilMonitor->ConvertSoilLevel(sampleSum);
+    sink += soilMonitor->percentSoilLevel;
+    sampleSum = sampleSum >= 5 * DEFAULT_MIN_MOISTURE ? 5 * DEFAULT_MAX_MOISTURE : sampleSum + 7;
+}
+
+void BenchSoilMap()    {
+
+    // The conversion as ConvertSoilLevel() did it with map(), a 16-bit and a 32-bit division per reading
+    uint16_t raw = sampleSum / SAMPLE_QUANTITY;
+    sink += (uint8_t)MapRange(raw, mapDry, mapWet, 0, 100);
+    sampleSum = sampleSum >= 5 * DEFAULT_MIN_MOISTURE ? 5 * DEFAULT_MAX_MOISTURE : sampleSum + 7;
+}
+
+void BenchSoilCurve()    {
+
+    // Eight points, so later segments are found after a longer search
+    curveMonitor->ConvertSoilLevel(sampleSum);
+    sink += curveMonitor->percentSoilLevel;
+    sampleSum = sampleSum >= 5 * DEFAULT_MIN_MOISTURE ? 5 * DEFAULT_MAX_MOISTURE : sampleSum + 7;
+}
+
+void BenchSoilReading()    {
+
+    // Whole state machine with the waits skipped, includes the ADC conversions on a board
+    for(uint16_t wait = soilMonitor->StartSoilReading(); wait > 0; wait = soilMonitor->PollSoilReading())  {
+    }
+    sink += soilMonitor->percentSoilLevel;
+}
+
+#ifdef ARDUINO
+void setup()    {
+
+    BenchBegin();
+    RunBenchmarks();
+}
+
+void loop() {
+
+}
+#else
+int main()  {
+
+    BenchBegin();
+    RunBenchmarks();
+    return 0;
+}
+#endif
+
+void RunBenchmarks()    {
+
+    PlantPacketBurstEntry entries[PLANT_PACKET_BURST_ENTRIES - 1];
+    SoilMonitor monitor(SOIL_SENSOR_PWR_PIN, SOIL_SENSOR_DATA_PIN);
+    SoilMonitor capacitiveMonitor(SOIL_SENSOR_PWR_PIN, SOIL_SENSOR_DATA_PIN);
+    soilMonitor = &monitor;
+    curveMonitor = &capacitiveMonitor;
+    capacitiveMonitor.SetCalibration(capacitiveTable);
+    sampleSum = 5 * DEFAULT_MAX_MOISTURE;
+
+    packet.SetPlantPacketName("oliver");
+    packet.nodeId = 7;
+    packet.sequence = 1234;
+    packet.percentSoilLevel = 45;
+    packet.rawSoilLevel = 690;
+    packet.batteryMillivolts = 3280;
+    packet.CreatePlantPacket(frame);
+
+    memset(legacyFrame, 0, sizeof(legacyFrame));
+    memcpy(legacyFrame, "phineas", 7);
+    legacyFrame[PLANT_NAME_LENGTH] = 62;
+
+    for(uint8_t i=0; i<PLANT_PACKET_BURST_ENTRIES - 1; i++) {
+        entries[i].ageSeconds = (i + 1) * 14400;
+        entries[i].rawSoilLevel = 680 + i;
+        entries[i].percentSoilLevel = 47 + i;
+    }
+    burstLength = packet.CreateBurstPacket(burstFrame, entries, PLANT_PACKET_BURST_ENTRIES - 1);
+
+    for(uint8_t i=0; i<BENCH_BATCH; i++)    {
+        readings[i] = packet;
+        readings[i].receivedTime = 1700000000UL + i * 60;
+    }
+
+    RunBench("empty", BenchEmpty, BENCH_ITERATIONS);
+    RunBench("packet_create", BenchPacketCreate, BENCH_ITERATIONS);
+    RunBench("packet_parse", BenchPacketParse, BENCH_ITERATIONS);
+    RunBench("packet_parse_legacy", BenchPacketLegacy, BENCH_ITERATIONS);
+    RunBench("burst_parse", BenchBurstParse, BENCH_ITERATIONS);
+    RunBench("crc16_30b", BenchCrc16, BENCH_ITERATIONS);
+    RunBench("soil_convert", BenchSoilConvert, BENCH_ITERATIONS);
+    RunBench("soil_convert_map", BenchSoilMap, BENCH_ITERATIONS);
+    RunBench("soil_convert_curve", BenchSoilCurve, BENCH_ITERATIONS);
+    PrintCalibrationError("linear", "map", NULL, false);
+    PrintCalibrationError("linear", "table", &monitor, false);
+    PrintCalibrationError("capacitive", "map", NULL, true);
+    PrintCalibrationError("capacitive", "table", &capacitiveMonitor, true);
+    RunBench("soil_reading", BenchSoilReading, BENCH_ITERATIONS / BENCH_BODY_DIVIDER);
+#if BENCH_BODY
+    RunBench("body_string_8", BenchBodyString, BENCH_ITERATIONS / BENCH_BODY_DIVIDER);
+    encoder.SetAllocationCounter(BenchAllocations);
+    RunBench("body_encoder_8", BenchBodyEncoder, BENCH_ITERATIONS / BENCH_BODY_DIVIDER);
+    PrintEncoderStats();
+    RunBench("metric_counter", BenchMetricCounter, BENCH_ITERATIONS);
+    RunBench("metric_observe", BenchMetricObserve, BENCH_ITERATIONS);
+#endif
+}
+
+void RunBench(const char *name, BenchFunction function, uint32_t iterations)   {
+
+    char line[BENCH_LINE_LENGTH];
+
+    // One untimed call so first-use allocations and cache misses are not counted
+    function();
+
+    uint32_t allocationsBefore = BenchAllocations();
+    BenchTimerStart();
+    for(uint32_t i=0; i<iterations; i++)    {
+        function();
+    }
+    uint64_t ticks = BenchTimerStop();
+    uint32_t allocations = BenchAllocations() - allocationsBefore;
+
+    // Hundredths, printed as fixed point since printf on the AVR has no floats or 64-bit integers
+    uint32_t cyclesPerOp = BENCH_HAS_CYCLES ? (uint32_t)(ticks * 100 / iterations) : 0;
+    uint32_t nsPerOp = BENCH_HAS_CYCLES ? (uint32_t)(ticks * 100000 / BenchCpuMhz() / iterations) : (uint32_t)(ticks * 100 / iterations);
+    uint32_t allocationsPerOp = (uint32_t)((uint64_t)allocations * 100 / iterations);
+
+    snprintf(line, sizeof(line),
+             "{\"target\":\"%s\",\"bench\":\"%s\",\"iterations\":%lu,\"ns_per_op\":%lu.%02lu,\"cycles_per_op\":%lu.%02lu,\"allocs_per_op\":%lu.%02lu}",
+             BENCH_TARGET, name, (unsigned long)iterations,
+             (unsigned long)(nsPerOp / 100), (unsigned long)(nsPerOp % 100),
+             (unsigned long)(cyclesPerOp / 100), (unsigned long)(cyclesPerOp % 100),
+             (unsigned long)(allocationsPerOp / 100), (unsigned long)(allocationsPerOp % 100));
+    BenchPrint(line);
+}
+
+BenchString BuildBodyString(const PlantPacket *readings, uint8_t count)  {
+
+    // Same concatenations as PostReadings() on the base station before UplinkEncoder
+    BenchString httpRequestData = "api_key=" + apiKeyValue + "&count=" + BENCH_TO_STRING((int)count);
+    for(uint8_t i=0; i<count; i++)  {
+        httpRequestData += "&moisture[]=" + BENCH_TO_STRING((int)readings[i].percentSoilLevel) + "%&plantname[]=" + readings[i].plantName
+                         + "&timestamp[]=" + BENCH_TO_STRING((unsigned long)readings[i].receivedTime)
+                         + "&rawmoisture[]=" + BENCH_TO_STRING((int)readings[i].rawSoilLevel)
+                         + "&battery[]=" + BENCH_TO_STRING((int)readings[i].batteryMillivolts);
+    }
+    return httpRequestData;
+}
+
+void PrintEncoderStats()    {
+
+    char line[BENCH_LINE_LENGTH];
+
+    // The encoder's own count of heap calls made while it was writing a body
+    snprintf(line, sizeof(line), "{\"target\":\"%s\",\"encoder_bodies\":%lu,\"encoder_overflows\":%lu,\"encoder_allocations\":%lu}",
+             BENCH_TARGET, (unsigned long)encoder.stats.bodies, (unsigned long)encoder.stats.overflows,
+             (unsigned long)encoder.stats.allocations);
+    BenchPrint(line);
+}
+
+// Arduino's map(), which SoilMonitor used before its calibration tables
+long MapRange(long value, long fromLow, long fromHigh, long toLow, long toHigh)    {
+
+    return (value - fromLow) * (toHigh - toLow) / (fromHigh - fromLow) + toLow;
+}
+
+void PrintCalibrationError(const char *curveName, const char *method, SoilMonitor *monitor, bool isCapacitive)    {
+
+    char line[BENCH_LINE_LENGTH];
+    uint32_t maxError = 0;
+    uint32_t errorSum = 0;
+    uint16_t count = 0;
+
+    // Every reading across the calibrated range against the curve the sensor really follows, in hundredths of a percent
+    for(uint16_t raw=DEFAULT_MAX_MOISTURE; raw<=DEFAULT_MIN_MOISTURE; raw++)  {
+        double dryness = (double)(raw - DEFAULT_MAX_MOISTURE) / (DEFAULT_MIN_MOISTURE - DEFAULT_MAX_MOISTURE);
+        double reference = 100.0 * (isCapacitive ? pow(1.0 - dryness, BENCH_CURVE_EXPONENT) : 1.0 - dryness);
+        long percent;
+        if(monitor != NULL) {
+            monitor->ConvertSoilLevel(raw * SAMPLE_QUANTITY);
+            percent = monitor->percentSoilLevel;
+        }
+        else    {
+            percent = MapRange(raw, DEFAULT_MIN_MOISTURE, DEFAULT_MAX_MOISTURE, 0, 100);
+        }
+        uint32_t error = (uint32_t)(fabs(percent - reference) * 100.0 + 0.5);
+        maxError = error > maxError ? error : maxError;
+        errorSum += error;
+        count++;
+    }
+
+    // Hundredths again, as fixed point
+    uint32_t meanError = errorSum / count;
+    snprintf(line, sizeof(line), "{\"target\":\"%s\",\"curve\":\"%s\",\"method\":\"%s\",\"max_error_percent\":%lu.%02lu,\"mean_error_percent\":%lu.%02lu}",
+             BENCH_TARGET, curveName, method, (unsigned long)(maxError / 100), (unsigned long)(maxError % 100),
+             (unsigned long)(meanError / 100), (unsigned long)(meanError % 100));
+    BenchPrint(line);
+}
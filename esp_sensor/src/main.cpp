@@ -14,7 +14,20 @@
 #include <HTTPClient.h>
 // wifiFix needed to fix a bug with the WiFi library
 #include "wifiFix.h"
+// UplinkConnection keeps keep-alive connections open to the database and ntfy
+#include "UplinkConnection.h"
+// UplinkEncoder builds request bodies in a fixed buffer
+#include "UplinkEncoder.h"
+// SampleScheduler picks how long to sleep from how fast the soil is drying
+#include "SampleScheduler.h"
+// NotificationEngine decides which readings are worth a push notification
+#include "NotificationEngine.h"
+// WakeLog keeps readings in RTC memory until enough are waiting to be worth connecting
+#include "WakeLog.h"
+// WakeTrace times each phase of a wake, the summary goes up with the readings
+#include "WakeTrace.h"
 #include "esp_sleep.h"
+#include <time.h>
 // serverName, ssid, password, ntfyServer, and apiKey are all defined in credentials.h
 #include "credentials.h"
 
@@ -25,11 +38,82 @@
 
 #define SOIL_RX_PIN             (3) 
 #define SOIL_PWR_PIN            (18) 
-#define SLEEP_TIME_MS           (14400000000)
+#define SLEEP_FLOOR_S           (1800)
+#define SLEEP_CEILING_S         (28800)
+#define FIRST_SLEEP_S           (14400)
+#define ALERT_PERCENT           (40)
+#define WARN_PERCENT            (50)
+#define US_PER_S                (1000000ULL)
 #define WIFI_TIMEOUT_MS         (10000)
+#define WIFI_FAST_TIMEOUT_MS    (2000)          // Directed connect to the cached access point, a scan follows if it fails
+#define WIFI_POLL_MS            (10)
+#define WIFI_LEASE_REUSE_S      (43200)         // Go back to DHCP at least this often so the cached address does not outlive its lease
 #define MS_PER_S                (1000)
-
-WiFiClient* client = new WiFiClientFixed();
+#define NTFY_PORT               (8080)
+#define NTP_SERVER              "pool.ntp.org"
+#define NTP_TIMEOUT_MS          (3000)          // Only waited for while the clock has never been set
+#define CLOCK_VALID_AFTER       (1700000000UL)  // time() below this has not been set from NTP yet
+#define ACTIVE_MA               (25)            // Rough ESP32-C3 draw awake with the radio off, for the energy estimate
+#define RADIO_MA                (85)            // Rough average draw while WiFi is connecting and sending
+#define SUPPLY_MV               (3300)
+
+#ifndef UPLOAD_EVERY_WAKES
+#define UPLOAD_EVERY_WAKES      (4)             // Set to 1 with a build flag to upload on every wake as before
+#endif
+
+UplinkConnection databaseLink(serverName);
+UplinkConnection ntfyLink(ntfyServer, NTFY_PORT);
+
+// Scheduler history lives in RTC memory so it survives deep sleep, it is zeroed on power up
+RTC_DATA_ATTR SampleSchedulerState schedulerState;
+SampleScheduler scheduler(schedulerState);
+
+// The last good connection, so the next wake can join without a scan or DHCP
+struct WifiCache {
+    uint8_t isValid;
+    uint8_t channel;
+    uint8_t bssid[6];
+    uint32_t localIP;
+    uint32_t gatewayIP;
+    uint32_t subnetMask;
+    uint32_t dnsIP;
+    uint32_t leaseTime;                         // time() when the address came from DHCP, the RTC clock runs through deep sleep
+};
+
+struct WifiConnectStats {
+    uint32_t fastConnects;
+    uint32_t scanConnects;
+    uint32_t fallbacks;                         // Fast connects that failed and went on to a scan
+    uint32_t failures;
+    uint32_t lastConnectMs;
+    uint32_t totalConnectMs;                    // Over every successful connect, for the average
+};
+
+// Where the awake time goes, for the time and energy per reading
+struct WakeStats {
+    uint32_t wakes;                             // One reading per wake
+    uint32_t uploads;                           // Wakes that brought the radio up
+    uint32_t uploadFailures;                    // Uploads that left the readings in the wake log
+    uint32_t lastUploadWake;                    // Value of wakes when the radio last came up
+    uint32_t awakeMs;                           // From app start to deep sleep, the boot ROM is not counted
+    uint32_t radioMs;                           // Part of awakeMs with WiFi on
+};
+
+RTC_DATA_ATTR WifiCache wifiCache;
+RTC_DATA_ATTR WifiConnectStats wifiStats;
+RTC_DATA_ATTR WakeStats wakeStats;
+
+// Readings waiting to be uploaded, committed so a brownout mid-upload never leaves them half written
+RTC_DATA_ATTR WakeLogState wakeLogState;
+WakeLog wakeLog(wakeLogState);
+
+// Alert state is kept the same way, the RTC clock keeps running through deep sleep for the re-notify interval
+RTC_DATA_ATTR NotifyPlantState notifyState;
+NotificationEngine notifications(&notifyState, 1);
+
+// Phase totals add up across wakes until an upload delivers them
+RTC_DATA_ATTR WakeTraceState traceState;
+WakeTrace wakeTrace(traceState);
 
 const char* plantName           = STR(PLANT_NAME); 
 const int air_moisture          = 1024;
@@ -37,59 +121,226 @@ const int water_moisture        = 500;
 
 int ReadSoilLevel();
 bool InitializeWifi();
+bool WaitForWifi(unsigned long timeoutMs, bool isFailureFinal);
+bool IsWifiCacheUsable();
+void SaveWifiCache();
+void PrintWifiStats(bool isFast);
 bool IsWiFiReady();  
-void UpdateMoistureDatabase(const char* plantName, int percentMoisture);
-void SendPushNotification(const char* notification, const char* topic);
-void UpdatePushNotifications(const char* plantName, int percentMoisture);
+void UploadReadings(const char* alert, uint32_t wakeTime);
+bool UpdateMoistureDatabase(uint32_t wakeTime, const PlantPacketTrace &trace);
+void SyncClock();
+bool SendPushNotification(const char* notification, const char* topic);
+void PrintWakeStats();
+void PrintConnectionStats(const char* name, UplinkConnection &link);
+uint32_t ScheduleNextWake(int percentMoisture);
 
 void setup() {
     
+    wakeTrace.BeginWake();
     Serial.begin(115200);
     analogReadResolution(10);
     pinMode(SOIL_PWR_PIN, OUTPUT);
-    esp_sleep_enable_timer_wakeup(SLEEP_TIME_MS);
+    scheduler.Configure(SLEEP_FLOOR_S, SLEEP_CEILING_S, ALERT_PERCENT,
+                        DEFAULT_TARGET_CHANGE_PERCENT, DEFAULT_WATERING_JUMP_PERCENT);
+    notifications.Configure(WARN_PERCENT, ALERT_PERCENT, DEFAULT_HYSTERESIS_PERCENT, DEFAULT_RENOTIFY_SECONDS, 0);
 
-    if(!InitializeWifi()) {
-        Serial.println("Failed to initialize WiFi");
-        delay(WIFI_TIMEOUT_MS); 
-        Serial.println("Returning to sleep"); 
-        esp_deep_sleep_start();
-    }
+    // Until a reading is taken, sleep for the same length as last time
+    uint32_t sleepSeconds = schedulerState.lastIntervalSeconds > 0 ? schedulerState.lastIntervalSeconds : FIRST_SLEEP_S;
+    esp_sleep_enable_timer_wakeup(sleepSeconds * US_PER_S);
 
+    if(!wakeLog.Begin())    {
+        Serial.println("Wake log was corrupted, waiting readings were lost");
+    }
 }
 
 void loop() {
 
-    int soilLevel = ReadSoilLevel();
-    UpdateMoistureDatabase(plantName, soilLevel);
-    UpdatePushNotifications(plantName, soilLevel);
+    char message[NOTIFY_MESSAGE_LENGTH];
+    uint32_t wakeTime = (uint32_t)time(NULL);
+    int soilLevel = constrain(ReadSoilLevel(), 0, 100);
 
+    wakeLog.Add(wakeTime, soilLevel);
+    wakeStats.wakes++;
+
+    // The radio only comes up for an alert or once UPLOAD_EVERY_WAKES readings are waiting. After a failed
+    // upload the log stays that full, so the next try waits another UPLOAD_EVERY_WAKES wakes instead of
+    // paying for a connect that will likely time out on every wake
+    bool isAlert = notifications.Update(plantName, soilLevel, wakeTime, message, sizeof(message));
+    bool isUploadDue = wakeLog.Count() >= UPLOAD_EVERY_WAKES && wakeStats.wakes - wakeStats.lastUploadWake >= UPLOAD_EVERY_WAKES;
+    if(isAlert || isUploadDue)  {
+        UploadReadings(isAlert ? message : NULL, wakeTime);
+    }
+    ScheduleNextWake(soilLevel);
+
+    wakeStats.awakeMs += millis();
+    PrintWakeStats();
     Serial.println("Going to sleep...");
+    wakeTrace.EndWake();
     esp_deep_sleep_start();
 }
 
+void UploadReadings(const char* alert, uint32_t wakeTime)   {
+
+    unsigned long radioStart = millis();
+    char text[WAKE_TRACE_TEXT_LENGTH];
+    PlantPacketTrace summary;
+    bool isDelivered = false;
+    bool isAlertSent = false;
+
+    wakeStats.uploads++;
+    wakeStats.lastUploadWake = wakeStats.wakes;
+    wakeTrace.Begin(WAKE_PHASE_WIFI);
+    if(InitializeWifi())    {
+        wakeTrace.Begin(WAKE_PHASE_CLOCK);
+        SyncClock();
+        // A scan connect saves the cache before the clock is synced. Right after power up that stamps the
+        // lease near 0, which the next wake would take as long expired and scan again
+        if(wifiCache.isValid && wifiCache.leaseTime < CLOCK_VALID_AFTER)    {
+            wifiCache.leaseTime = (uint32_t)time(NULL);
+        }
+        wakeTrace.Begin(WAKE_PHASE_HTTP);
+
+        // Every wake since the last delivered upload, up to the start of this request
+        wakeTrace.Summarize(summary);
+        WakeTrace::Describe(summary, text, sizeof(text));
+        Serial.print("Wake trace: ");
+        Serial.println(text);
+        isDelivered = UpdateMoistureDatabase(wakeTime, summary);
+        isAlertSent = alert != NULL && SendPushNotification(alert, plantName);
+    }
+    else    {
+        Serial.println("Failed to initialize WiFi");
+    }
+    wakeTrace.End();
+
+    // Readings stay in RTC memory until the server has them, a brownout before this just sends them again
+    if(isDelivered) {
+        wakeLog.Clear();
+        wakeTrace.Clear(summary);
+    }
+    else    {
+        wakeStats.uploadFailures++;
+    }
+
+    // The engine took the alert as sent, so it is due again on the next wake
+    if(alert != NULL && !isAlertSent)   {
+        notifyState.notifiedLevel = NOTIFY_OK;
+    }
+
+    WiFi.disconnect(true, true);
+    wakeStats.radioMs += millis() - radioStart;
+}
+
 bool InitializeWifi() {
 
+    unsigned long start = millis();
+    bool isFast = false;
+
+    // Nothing is read back from NVS, so skip the flash write on every begin()
+    WiFi.persistent(false);
     WiFi.mode(WIFI_STA);
-    WiFi.begin(ssid, password);
-    Serial.print("Connecting to WiFi ..");
 
-    for (int i=0; WiFi.status() != WL_CONNECTED && i<=(WIFI_TIMEOUT_MS/MS_PER_S); i++) {
-        Serial.print('.');
-        delay(1000);
+    if(IsWifiCacheUsable()) {
+        // Straight to the last access point on its channel with the last address, no scan and no DHCP
+        Serial.print("Connecting to cached WiFi access point ..");
+        WiFi.config(IPAddress(wifiCache.localIP), IPAddress(wifiCache.gatewayIP), IPAddress(wifiCache.subnetMask), IPAddress(wifiCache.dnsIP));
+        WiFi.begin(ssid, password, wifiCache.channel, wifiCache.bssid);
+        isFast = WaitForWifi(WIFI_FAST_TIMEOUT_MS, true);
+
+        if(!isFast) {
+            Serial.println(" failed, scanning");
+            wifiCache.isValid = 0;
+            wifiStats.fallbacks++;
+            WiFi.disconnect();
+            WiFi.config(IPAddress(), IPAddress(), IPAddress());
+        }
+    }
 
-        if(i==(WIFI_TIMEOUT_MS/MS_PER_S)) {
+    if(!isFast) {
+        Serial.print("Connecting to WiFi ..");
+        WiFi.begin(ssid, password);
+        if(!WaitForWifi(WIFI_TIMEOUT_MS, false))    {
             Serial.println(" connection timed out!");
+            wifiStats.failures++;
             WiFi.disconnect(true, true);
             return false;
         }
+        SaveWifiCache();
+    }
+
+    wifiStats.lastConnectMs = millis() - start;
+    wifiStats.totalConnectMs += wifiStats.lastConnectMs;
+    if(isFast)  {
+        wifiStats.fastConnects++;
+    }
+    else    {
+        wifiStats.scanConnects++;
     }
 
     Serial.print(" connected! IP address: ");
     Serial.println(WiFi.localIP());
+    PrintWifiStats(isFast);
     return true;
 }
 
+bool WaitForWifi(unsigned long timeoutMs, bool isFailureFinal)  {
+
+    unsigned long start = millis();
+
+    // Short polls so the radio is not left on for up to a second after the connection is up
+    while(millis() - start < timeoutMs) {
+        wl_status_t status = WiFi.status();
+        if(status == WL_CONNECTED)  {
+            return true;
+        }
+        // A directed connect that is refused or cannot see the access point will not recover in time
+        if(isFailureFinal && (status == WL_CONNECT_FAILED || status == WL_NO_SSID_AVAIL))   {
+            return false;
+        }
+        delay(WIFI_POLL_MS);
+    }
+    return WiFi.status() == WL_CONNECTED;
+}
+
+bool IsWifiCacheUsable()    {
+
+    return wifiCache.isValid && (uint32_t)time(NULL) - wifiCache.leaseTime < WIFI_LEASE_REUSE_S;
+}
+
+void SaveWifiCache()    {
+
+    memcpy(wifiCache.bssid, WiFi.BSSID(), sizeof(wifiCache.bssid));
+    wifiCache.channel = WiFi.channel();
+    wifiCache.localIP = WiFi.localIP();
+    wifiCache.gatewayIP = WiFi.gatewayIP();
+    wifiCache.subnetMask = WiFi.subnetMask();
+    wifiCache.dnsIP = WiFi.dnsIP();
+    wifiCache.leaseTime = (uint32_t)time(NULL);
+    wifiCache.isValid = 1;
+}
+
+void PrintWifiStats(bool isFast)    {
+
+    uint32_t connects = wifiStats.fastConnects + wifiStats.scanConnects;
+
+    Serial.print("WiFi: ");
+    Serial.print(isFast ? "fast connect in " : "scan connect in ");
+    Serial.print(wifiStats.lastConnectMs);
+    Serial.print("ms, wake ");
+    Serial.print(wakeStats.wakes);
+    Serial.print(" (");
+    Serial.print(wifiStats.fastConnects);
+    Serial.print(" fast, ");
+    Serial.print(wifiStats.scanConnects);
+    Serial.print(" scans, ");
+    Serial.print(wifiStats.fallbacks);
+    Serial.print(" fallbacks, ");
+    Serial.print(wifiStats.failures);
+    Serial.print(" failures, average ");
+    Serial.print(connects > 0 ? wifiStats.totalConnectMs / connects : 0);
+    Serial.println("ms)");
+}
+
 bool IsWiFiReady()  {
 
     if(WiFi.status() != WL_CONNECTED) {
@@ -112,88 +363,160 @@ bool IsWiFiReady()  {
 
 int ReadSoilLevel()    {
 
+    wakeTrace.Begin(WAKE_PHASE_SENSOR);
     digitalWrite(SOIL_PWR_PIN, HIGH);
     delay(250);
     int rawSoilMoisture = analogRead(SOIL_RX_PIN);
     digitalWrite(SOIL_PWR_PIN, LOW);
+    wakeTrace.End();
 
     return map(rawSoilMoisture, air_moisture, water_moisture, 0, 100);
 }
 
-void UpdateMoistureDatabase(const char* plant, int percentMoisture) {
+bool UpdateMoistureDatabase(uint32_t wakeTime, const PlantPacketTrace &trace) {
   
     if(!IsWiFiReady())  {
         Serial.println("Database updated aborted, wifi is not connected!");
-        return;
+        return false;
     }
 
-    HTTPClient http;
-    http.begin(*client, serverName);
-    http.addHeader("Content-Type","application/x-www-form-urlencoded");
+    // Readings were stamped with time() before NTP may have moved the clock, so they are placed
+    // by their age at wakeTime, which was taken just after the app started
+    uint32_t now = (uint32_t)time(NULL) - millis() / MS_PER_S;
+    PlantPacket readings[WAKE_LOG_CAPACITY];
+    uint8_t count = wakeLog.Count();
+    for(uint8_t i=0; i<count; i++)  {
+        const WakeLogEntry &entry = wakeLog.Get(i);
+        readings[i].SetPlantPacketName(plantName);
+        readings[i].percentSoilLevel = entry.percent;
+        readings[i].rawSoilLevel = 0;
+        readings[i].batteryMillivolts = 0;
+        readings[i].receivedTime = now - (wakeTime - entry.time);
+    }
 
-    String httpRequestData = "api_key=" +  apiKeyValue + "&moisture=" + percentMoisture + "%&plantname=" + plant + "";
+    // Static, a body is larger than is comfortable on the loop task's stack
+    static char body[UPLINK_BODY_LENGTH];
+    UplinkEncoder encoder(body, sizeof(body));
+    uint16_t length = encoder.EncodeBatch(apiKeyValue.c_str(), readings, count, &trace);
+    if(length == 0) {
+        Serial.println("Database request data does not fit UPLINK_BODY_LENGTH!");
+        return false;
+    }
     Serial.print("Database request data: ");
-    Serial.println(httpRequestData);
+    Serial.println(body);
 
-    int httpResponseCode = http.POST(httpRequestData);
+    int httpResponseCode = databaseLink.POST(serverName, "application/x-www-form-urlencoded", body, length);
 
     if (httpResponseCode==200) {
         Serial.println("Database updated successfully!");
-        http.end();
     }
     else if (httpResponseCode>0) {
         Serial.print("Unknown database update result, http response code: ");
         Serial.println(httpResponseCode);
-        http.end();
     }
     else {
         Serial.print("Database update failed, http response code: ");
         Serial.println(httpResponseCode);
-        http.end();
+        // The cached address may have been handed to someone else, take a fresh lease next wake
+        wifiCache.isValid = 0;
     }
+    PrintConnectionStats("Database", databaseLink);
+
+    // Connection errors and server errors are worth retrying next time, a rejected request is not
+    return httpResponseCode > 0 && httpResponseCode < 500;
 }
 
-void SendPushNotification(const char* notification, const char* topic)    {
+void SyncClock()    {
+
+    // The RTC keeps the time through deep sleep, so after the first sync this never waits
+    configTime(0, 0, NTP_SERVER);
+    unsigned long start = millis();
+    while((uint32_t)time(NULL) < CLOCK_VALID_AFTER && millis() - start < NTP_TIMEOUT_MS)  {
+        delay(WIFI_POLL_MS);
+    }
+}
+
+bool SendPushNotification(const char* notification, const char* topic)    {
 
     if(!IsWiFiReady())  {
         Serial.println("Push notification aborted, wifi is not connected!");
-        return;
+        return false;
     }
 
-    HTTPClient http;
     char address[64] = "";
-    sprintf(address, "%s:8080/%s", ntfyServer, topic);  
-    http.begin(*client, address);
-    http.addHeader("Content-Type","text/plain");
+    sprintf(address, "%s:%d/%s", ntfyServer, NTFY_PORT, topic);  
 
     Serial.print("Push notification request data: ");
     Serial.println(notification);
 
-    int httpResponseCode = http.POST(notification);
-
+    int httpResponseCode = ntfyLink.POST(address, "text/plain", notification, strlen(notification));
 
     if (httpResponseCode==200) {
         Serial.println("Push notification sent successfully!");
-        http.end();
     }
     else if (httpResponseCode>0) {
         Serial.print("Unknown notification result, http response code: ");
         Serial.println(httpResponseCode);
-        http.end();
     }
     else {
         Serial.print("Push notifcation failed, http response code: ");
         Serial.println(httpResponseCode);
-        http.end();
     }
-} 
+    PrintConnectionStats("Ntfy", ntfyLink);
+    return httpResponseCode > 0;
+}
 
-void UpdatePushNotifications(const char* plantName, int percentMoisture)   {
+uint32_t ScheduleNextWake(int percentMoisture)  {
 
-    if(percentMoisture <= 50)   {
-        SendPushNotification("Soil moisture is below 50%, water soon!", plantName);
-    }
-    else if(percentMoisture <= 40)   {
-        SendPushNotification("Soil moisture is below 40%, water now!", plantName);
-    }
+    // The last interval is how long ago the previous reading was taken
+    uint32_t lastSeconds = schedulerState.lastIntervalSeconds > 0 ? schedulerState.lastIntervalSeconds : FIRST_SLEEP_S;
+    uint32_t sleepSeconds = scheduler.NextInterval(constrain(percentMoisture, 0, 100), lastSeconds);
+    esp_sleep_enable_timer_wakeup(sleepSeconds * US_PER_S);
+
+    Serial.print("Next reading in ");
+    Serial.print(sleepSeconds);
+    Serial.println("s");
+    return sleepSeconds;
+}
+
+void PrintConnectionStats(const char* name, UplinkConnection &link)  {
+
+    Serial.print(name);
+    Serial.print(" connection: ");
+    Serial.print(link.RequestsOnConnection());
+    Serial.print(" requests on this connection, ");
+    Serial.print(link.RequestsPerConnection());
+    Serial.print(" requests per connection (");
+    Serial.print(link.stats.connectionsOpened);
+    Serial.print(" opened, ");
+    Serial.print(link.stats.serverCloses);
+    Serial.print(" dropped by server, ");
+    Serial.print(link.stats.retries);
+    Serial.print(" retries, ");
+    Serial.print(link.stats.dnsLookups);
+    Serial.println(" dns lookups)");
+}
+
+void PrintWakeStats()   {
+
+    // Energy is estimated from the time awake and with the radio on, deep sleep current is left out
+    float radioSeconds = wakeStats.radioMs / (float)MS_PER_S;
+    float activeSeconds = (wakeStats.awakeMs - wakeStats.radioMs) / (float)MS_PER_S;
+    float millijoules = (activeSeconds * ACTIVE_MA + radioSeconds * RADIO_MA) * SUPPLY_MV / MS_PER_S;
+
+    Serial.print("Wake ");
+    Serial.print(wakeStats.wakes);
+    Serial.print(": awake ");
+    Serial.print(millis());
+    Serial.print("ms, ");
+    Serial.print(wakeLog.Count());
+    Serial.print(" readings waiting, ");
+    Serial.print(wakeStats.uploads);
+    Serial.print(" uploads (");
+    Serial.print(wakeStats.uploadFailures);
+    Serial.print(" failed), ");
+    Serial.print(wakeStats.awakeMs / wakeStats.wakes);
+    Serial.print("ms and ");
+    Serial.print(millijoules / wakeStats.wakes);
+    Serial.println("mJ per reading");
 }
@@ -0,0 +1,506 @@
+/*
+ *  FleetSim, discrete event simulation of many sensor nodes
+ *  sharing one channel into the base station receive and upload path
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "FleetSim.h"
+
+#define US_PER_S                            (1000000ULL)
+#define US_PER_MS                           (1000ULL)
+#define AIR_OVERHEAD_BYTES                  (8)                                             // Preamble, 5 byte address and 2 byte CRC
+#define AIR_PCF_BITS                        (9)
+#define AIR_US_PER_BIT                      (4)                                             // 250kbps
+#define RANDOM_RETRY_MIN_US                 (250)
+#define RANDOM_RETRY_MAX_US                 (4000)
+
+bool SimFifo::Available()   {
+
+    return !payloads.empty();
+}
+
+uint8_t SimFifo::Read(uint8_t *buffer, uint8_t length, uint8_t &pipe)  {
+
+    if(payloads.empty())    {
+        return 0;
+    }
+
+    std::vector<uint8_t> &payload = payloads.front();
+    uint8_t copied = payload.size() - 1 < length ? payload.size() - 1 : length;
+    pipe = payload[0];
+    memcpy(buffer, &payload[1], copied);
+    payloads.pop_front();
+    beingRead++;
+    reads++;
+    return copied;
+}
+
+void SimFifo::ClearInterrupt()  {
+
+}
+
+bool SimFifo::Push(const uint8_t *payload, uint8_t length, uint8_t pipe)  {
+
+    if(Occupied() >= FLEET_FIFO_DEPTH)  {
+        return false;
+    }
+    payloads.emplace_back(1, pipe);
+    payloads.back().insert(payloads.back().end(), payload, payload + length);
+    return true;
+}
+
+uint8_t SimFifo::Occupied() {
+
+    return payloads.size() + beingRead;
+}
+
+void SimFifo::ReleaseRead() {
+
+    beingRead = 0;
+}
+
+FleetSim::FleetSim(const FleetConfig &fleetConfig) : config(fleetConfig), receiver(fifo, ring), uploadQueue(fleetConfig.batchSize, fleetConfig.windowMs),
+                                                    notifyPlants(std::min<uint32_t>(fleetConfig.nodes * 2, UINT16_MAX)), notifications(notifyPlants.data(), notifyPlants.size()),
+                                                    encoder(body, sizeof(body))  {
+
+    report = {};
+    nowUs = 0;
+    eventOrder = 0;
+    randomState = config.seed ? config.seed : 1;
+    fifo.reads = 0;
+    isReceiveBusy = false;
+    isUploadBusy = false;
+    isFlushing = false;
+    isFlushFailed = false;
+    isHoldingReading = false;
+    flushStartUs = 0;
+    uploadBusyUs = 0;
+    receivedPerSecond.assign(config.durationSeconds + 1, 0);
+    notifications.Configure(config.notifyPercent, std::min<uint8_t>(config.notifyPercent, DEFAULT_CRITICAL_PERCENT),
+                            DEFAULT_HYSTERESIS_PERCENT, config.renotifySeconds, config.digestSeconds);
+
+    nodes.resize(config.nodes);
+    for(uint32_t i=0; i<config.nodes; i++)  {
+        Node &node = nodes[i];
+        uint32_t share = Random() % 100;
+
+        node.id = i + 1;
+        node.format = share < config.legacyPercent ? FLEET_FORMAT_LEGACY
+                    : share < config.legacyPercent + config.burstPercent ? FLEET_FORMAT_BURST : FLEET_FORMAT_READING;
+        // Legacy firmware predates the address plan and always writes to "base\0"
+        node.pipe = node.format == FLEET_FORMAT_LEGACY ? ADDRESS_PLAN_LEGACY_PIPE : addressPlan.PipeForNode(node.id);
+        node.driftPpm = config.driftPpm ? (int32_t)(Random() % (2 * config.driftPpm + 1)) - config.driftPpm : 0;
+        node.retryDelayUs = config.isRetryDelayRandom
+                          ? RANDOM_RETRY_MIN_US + Random() % (RANDOM_RETRY_MAX_US - RANDOM_RETRY_MIN_US + 1)
+                          : config.retryDelayUs;
+        node.sequence = Random();
+        node.percent = 30 + Random() % 60;
+        node.stored = Random() % FLEET_BURST_CYCLES;
+        node.frameIndex = 0;
+        node.attempts = 0;
+        node.isCorrupted = false;
+
+        // Nodes were switched on at random times so their wakes are spread over one interval
+        Schedule(Random() % (config.intervalSeconds * US_PER_S), NODE_WAKE, i);
+    }
+}
+
+FleetReport FleetSim::Run() {
+
+    uint64_t endUs = config.durationSeconds * US_PER_S;
+
+    Schedule(0, UPLOAD_POLL);
+    while(!events.empty() && events.top().timeUs <= endUs)  {
+        Event event = events.top();
+        events.pop();
+        nowUs = event.timeUs;
+
+        switch(event.type)  {
+            case NODE_WAKE:     OnNodeWake(nodes[event.target]); break;
+            case TX_START:      OnTxStart(nodes[event.target]); break;
+            case TX_END:        OnTxEnd(nodes[event.target]); break;
+            case DRAIN:         OnDrain(); break;
+            case DRAIN_DONE:    OnDrainDone(); break;
+            case UPLOAD_STEP:   OnUploadStep(); break;
+            case UPLOAD_POLL:
+                Schedule(nowUs + FLEET_UPLOAD_POLL_MS * US_PER_MS, UPLOAD_POLL);
+                if(!isUploadBusy)   {
+                    isUploadBusy = true;
+                    Schedule(nowUs, UPLOAD_STEP);
+                }
+                break;
+        }
+    }
+
+    RadioReceiverStats receiverStats = receiver.Stats();
+    report.ringDrops = ring.Drops();
+    report.ringHighWaterMark = ring.HighWaterMark();
+    report.parseFailures = receiverStats.parseFailures;
+    report.duplicates = receiverStats.duplicates;
+    report.notifications = notifications.stats.sent;
+    report.digests = notifications.stats.digests;
+    NodeTable &nodeTable = receiver.Nodes();
+    report.nodesTracked = nodeTable.Count();
+    for(uint16_t slot=0; slot<NODE_TABLE_SLOTS; slot++) {
+        if(nodeTable.Slot(slot) != NULL)    {
+            report.estimatedLost += nodeTable.Slot(slot)->lost;
+        }
+    }
+    for(uint8_t pipe=0; pipe<RADIO_PIPES; pipe++)   {
+        report.pipePackets[pipe] = receiverStats.pipePackets[pipe];
+    }
+    report.maxBatch = uploadQueue.stats.maxBatchSize;
+    report.packetsPerSecond = (double)report.framesReceived / config.durationSeconds;
+    report.readingsPerSecond = (double)report.readingsUploaded / config.durationSeconds;
+    report.uploadBusyPercent = 100.0 * uploadBusyUs / endUs;
+    report.peakPacketsPerSecond = *std::max_element(receivedPerSecond.begin(), receivedPerSecond.end());
+
+    if(!latenciesMs.empty())    {
+        std::sort(latenciesMs.begin(), latenciesMs.end());
+        size_t last = latenciesMs.size() - 1;
+        report.latencyP50Ms = latenciesMs[last * 50 / 100];
+        report.latencyP90Ms = latenciesMs[last * 90 / 100];
+        report.latencyP99Ms = latenciesMs[last * 99 / 100];
+        report.latencyMaxMs = latenciesMs[last];
+    }
+    return report;
+}
+
+void FleetSim::Schedule(uint64_t timeUs, EventType type, uint32_t target) {
+
+    events.push({timeUs, eventOrder++, type, target});
+}
+
+uint32_t FleetSim::Random() {
+
+    // xorshift32, the same seed always gives the same run
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+void FleetSim::OnNodeWake(Node &node)   {
+
+    report.wakes++;
+
+    // Soil dries a little each wake and gets watered once it is dry
+    node.percent = node.percent > 20 ? node.percent - Random() % 3 : 85 + Random() % 10;
+
+    if(node.frames.empty()) {
+        BuildFrames(node);
+        if(!node.frames.empty())    {
+            node.frameIndex = 0;
+            node.attempts = 0;
+            node.firstAttemptUs = nowUs;
+            Schedule(nowUs, TX_START, node.id - 1);
+        }
+    }
+
+    // Clock drift and wake jitter move each node's next wake
+    double interval = config.intervalSeconds * US_PER_S * (1.0 + node.driftPpm / 1e6);
+    if(config.jitterPercent > 0)    {
+        int32_t jitter = (int32_t)(Random() % (2 * config.jitterPercent * 100 + 1)) - config.jitterPercent * 100;
+        interval *= 1.0 + jitter / 10000.0;
+    }
+    Schedule(nowUs + (uint64_t)interval, NODE_WAKE, node.id - 1);
+}
+
+void FleetSim::BuildFrames(Node &node)  {
+
+    Frame frame = {};
+    PlantPacket packet;
+    char name[PLANT_NAME_LENGTH + 1];
+
+    if(node.format == FLEET_FORMAT_LEGACY)  {
+        snprintf(name, sizeof(name), "L%u", (unsigned)node.id);
+        memcpy(frame.data, name, strlen(name));
+        frame.data[PLANT_NAME_LENGTH] = node.percent;
+        frame.length = PLANT_PACKET_LEGACY_LENGTH;
+        frame.readings = 1;
+        node.frames.push_back(frame);
+        report.framesSent++;
+        return;
+    }
+
+    // Burst nodes only transmit every FLEET_BURST_CYCLES wakes, like the Arduino sensor
+    if(node.format == FLEET_FORMAT_BURST && ++node.stored < FLEET_BURST_CYCLES)    {
+        return;
+    }
+
+    snprintf(name, sizeof(name), "plant%u", (unsigned)node.id);
+    packet.SetPlantPacketName(name);
+    packet.nodeId = node.id;
+    packet.percentSoilLevel = node.percent;
+    packet.rawSoilLevel = 855 - node.percent * 365 / 100;
+    packet.batteryMillivolts = 3300;
+    // Readings are numbered as they are taken, the stored ones first and the newest last
+    uint8_t older = node.format == FLEET_FORMAT_BURST ? node.stored - 1 : 0;
+    uint16_t firstSequence = node.sequence;
+    node.sequence += older + 1;
+    packet.sequence = firstSequence + older;
+    frame.length = packet.CreatePlantPacket(frame.data);
+    frame.readings = 1;
+    node.frames.push_back(frame);
+    report.framesSent++;
+
+    if(node.format == FLEET_FORMAT_BURST)   {
+        PlantPacketBurstEntry entries[PLANT_PACKET_BURST_ENTRIES];
+        uint8_t count = node.stored - 1;
+        for(uint8_t i=0; i<count; i++)  {
+            entries[i].ageSeconds = (count - i) * config.intervalSeconds;
+            entries[i].percentSoilLevel = node.percent + count - i;
+            entries[i].rawSoilLevel = packet.rawSoilLevel;
+        }
+        packet.sequence = firstSequence;
+        frame.length = packet.CreateBurstPacket(frame.data, entries, count);
+        frame.readings = count;
+        node.frames.push_back(frame);
+        report.framesSent++;
+        node.stored = 0;
+    }
+}
+
+void FleetSim::OnTxStart(Node &node)    {
+
+    const Frame &frame = node.frames[node.frameIndex];
+
+    node.attempts++;
+    node.isCorrupted = false;
+    node.airEndUs = nowUs + ((AIR_OVERHEAD_BYTES + frame.length) * 8 + AIR_PCF_BITS) * AIR_US_PER_BIT;
+    report.attempts++;
+
+    // Anything already on air overlaps this attempt. With capture the receiver stays locked on the first frame
+    for(uint32_t other : onAir) {
+        node.isCorrupted = true;
+        if(!config.isCaptureEnabled)    {
+            nodes[other].isCorrupted = true;
+        }
+    }
+    onAir.push_back(node.id - 1);
+    Schedule(node.airEndUs, TX_END, node.id - 1);
+}
+
+void FleetSim::OnTxEnd(Node &node)  {
+
+    const Frame &frame = node.frames[node.frameIndex];
+
+    onAir.erase(std::find(onAir.begin(), onAir.end(), (uint32_t)(node.id - 1)));
+
+    bool isDelivered = false;
+    if(node.isCorrupted)    {
+        report.collisions++;
+    }
+    else if(!fifo.Push(frame.data, frame.length, node.pipe))   {
+        report.fifoRejects++;                                                               // No ACK is sent when the RX FIFO is full
+    }
+    else    {
+        isDelivered = true;
+    }
+    report.maxFifo = std::max<uint32_t>(report.maxFifo, fifo.Occupied());
+
+    if(!isDelivered)    {
+        if(node.attempts <= config.retries) {
+            Schedule(nowUs + node.retryDelayUs, TX_START, node.id - 1);
+            return;
+        }
+
+        // The sensor gives up on the rest of the transmission once a frame runs out of retries
+        report.framesLost += node.frames.size() - node.frameIndex;
+        node.frames.clear();
+        return;
+    }
+
+    report.framesReceived++;
+    receivedPerSecond[nowUs / US_PER_S]++;
+    if(frame.length == PLANT_PACKET_LEGACY_LENGTH)  {
+        sentLegacy[node.id].push_back(node.firstAttemptUs);
+    }
+    else    {
+        uint16_t sequence = ((const PlantPacketFrame *)frame.data)->header.sequence;
+        for(uint8_t i=0; i<frame.readings; i++) {
+            sentReadings[((uint32_t)node.id << 16) | (uint16_t)(sequence + i)] = node.firstAttemptUs;
+        }
+    }
+
+    // RX_DR pulls the IRQ line low, the receive task runs once the interrupt has been serviced
+    if(!isReceiveBusy)  {
+        isReceiveBusy = true;
+        Schedule(nowUs + config.irqLatencyUs, DRAIN);
+    }
+
+    FinishFrame(node);
+}
+
+void FleetSim::FinishFrame(Node &node)  {
+
+    node.frameIndex++;
+    if(node.frameIndex < node.frames.size())    {
+        node.attempts = 0;
+        node.firstAttemptUs = nowUs + FLEET_FRAME_GAP_US;
+        Schedule(node.firstAttemptUs, TX_START, node.id - 1);
+        return;
+    }
+    node.frames.clear();
+}
+
+void FleetSim::OnDrain()    {
+
+    uint8_t count = receiver.Drain(nowUs / US_PER_S);
+    Schedule(nowUs + std::max<uint64_t>(1, count * config.readUs), DRAIN_DONE);
+}
+
+void FleetSim::OnDrainDone()    {
+
+    fifo.ReleaseRead();
+
+    // The IRQ line stays low while payloads are waiting, so the task drains again straight away
+    if(fifo.Available())    {
+        Schedule(nowUs, DRAIN);
+    }
+    else    {
+        isReceiveBusy = false;
+    }
+
+    if(!isUploadBusy)   {
+        isUploadBusy = true;
+        Schedule(nowUs, UPLOAD_STEP);
+    }
+}
+
+void FleetSim::OnUploadStep()   {
+
+    PlantPacket reading;
+    char message[NOTIFY_MESSAGE_LENGTH];
+    uint32_t nowMs = nowUs / US_PER_MS;
+
+    if(isFlushing)  {
+        CompleteFlush();
+    }
+
+    // Same as the base station, a batch that is due goes out before the next reading is taken, so a backlog
+    // in the ring is sent a batch at a time
+    if(uploadQueue.Count() > 0 && uploadQueue.IsFlushDue(nowMs)) {
+        StartFlush();
+        return;
+    }
+
+    // One reading per step so the ring keeps filling while the task works through it
+    if(ring.Pop(reading))   {
+        uint64_t costUs = config.readingUs;
+
+        // Same as the base station, a full queue is sent before the reading is added
+        if(!uploadQueue.Add(reading, nowMs))    {
+            heldReading = reading;
+            isHoldingReading = true;
+            StartFlush();
+            return;
+        }
+        if(reading.percentSoilLevel <= config.notifyPercent)    {
+            report.lowReadings++;
+        }
+        if(notifications.Update(reading.plantName, reading.percentSoilLevel, nowUs / US_PER_S, message, sizeof(message)))   {
+            costUs += UploadMs() * US_PER_MS;
+        }
+        uploadBusyUs += costUs;
+        Schedule(nowUs + costUs, UPLOAD_STEP);
+        return;
+    }
+
+    if(notifications.TakeDigest(nowUs / US_PER_S, message, sizeof(message)))    {
+        uint64_t costUs = UploadMs() * US_PER_MS;
+        uploadBusyUs += costUs;
+        Schedule(nowUs + costUs, UPLOAD_STEP);
+        return;
+    }
+
+    if(uploadQueue.Count() > 0 && uploadQueue.IsFlushDue(nowMs)) {
+        StartFlush();
+        return;
+    }
+    isUploadBusy = false;
+}
+
+void FleetSim::StartFlush() {
+
+    uint32_t length = FlushBody();
+    uint64_t latencyUs = UploadMs() * US_PER_MS;
+
+    // PostReadings() fails a batch that does not encode without sending anything
+    if(length == 0) {
+        report.encoderOverflows++;
+        isFlushFailed = true;
+        latencyUs = 0;
+    }
+    else    {
+        isFlushFailed = http.POST("http://localhost/post-data.php", "application/x-www-form-urlencoded", body, length) != 200;
+    }
+    isFlushing = true;
+    flushStartUs = nowUs;
+    uploadBusyUs += latencyUs;
+    Schedule(nowUs + latencyUs, UPLOAD_STEP);
+}
+
+void FleetSim::CompleteFlush()  {
+
+    uint64_t sendUs;
+
+    for(uint8_t i=0; i<uploadQueue.Count() && !isFlushFailed; i++)    {
+        const PlantPacket &reading = uploadQueue.Get(i);
+        if(LookUpSendTime(reading, sendUs)) {
+            latenciesMs.push_back((nowUs - sendUs) / US_PER_MS);
+        }
+        if(reading.ageSeconds > 0 && strncmp(reading.plantName, "node", 4) == 0)   {
+            report.unnamedReadings++;
+        }
+    }
+
+    if(isFlushFailed)   {
+        report.failedFlushes++;
+    }
+    else    {
+        report.readingsUploaded += uploadQueue.Count();
+    }
+    report.flushes++;
+    uploadQueue.CompleteFlush(flushStartUs / US_PER_MS, nowUs / US_PER_MS);
+    isFlushing = false;
+
+    if(isHoldingReading)    {
+        (void) uploadQueue.Add(heldReading, nowUs / US_PER_MS);
+        isHoldingReading = false;
+    }
+}
+
+uint32_t FleetSim::FlushBody()  {
+
+    return encoder.EncodeBatch("sim", &uploadQueue.Get(0), uploadQueue.Count());
+}
+
+uint32_t FleetSim::UploadMs()   {
+
+    return config.httpMs + (config.httpJitterMs ? Random() % (config.httpJitterMs + 1) : 0);
+}
+
+bool FleetSim::LookUpSendTime(const PlantPacket &reading, uint64_t &sendUs)   {
+
+    if(reading.version == PLANT_PACKET_LEGACY_VERSION)  {
+        unsigned id = 0;
+        if(sscanf(reading.plantName, "L%u", &id) != 1 || sentLegacy[id].empty())  {
+            return false;
+        }
+        // Frames dropped by a full ring never come out, so match the newest send and forget the rest
+        sendUs = sentLegacy[id].back();
+        sentLegacy[id].clear();
+        return true;
+    }
+
+    auto sent = sentReadings.find(((uint32_t)reading.nodeId << 16) | reading.sequence);
+    if(sent == sentReadings.end())    {
+        return false;
+    }
+    sendUs = sent->second;
+    sentReadings.erase(sent);
+    return true;
+}
@@ -0,0 +1,195 @@
+/*
+ *  FleetSim, discrete event simulation of many sensor nodes
+ *  sharing one channel into the base station receive and upload path
+ */
+
+#ifndef FLEETSIM_H
+#define FLEETSIM_H
+
+#define FLEET_FIFO_DEPTH                    (3)                                             // nRF24 RX FIFO
+#define FLEET_BURST_CYCLES                  (4)                                             // Wakes per transmission for burst nodes, as on the Arduino sensor
+#define FLEET_UPLOAD_POLL_MS                (100)                                           // Matches UPLOAD_POLL_MS on the base station
+#define FLEET_FRAME_GAP_US                  (200)                                           // Reading packet to burst packet
+#define FLEET_BODY_LENGTH                   (UPLINK_BODY_LENGTH)                            // Same buffer as the base station, so the sim overflows where it would
+
+#define FLEET_FORMAT_READING                (0)
+#define FLEET_FORMAT_LEGACY                 (1)
+#define FLEET_FORMAT_BURST                  (2)
+
+#include <stdint.h>
+#include <deque>
+#include <queue>
+#include <vector>
+#include <unordered_map>
+#include "HalHttp.h"
+#include "PlantPacket.h"
+#include "PacketRing.h"
+#include "RadioReceiver.h"
+#include "UploadQueue.h"
+#include "AddressPlan.h"
+#include "NotificationEngine.h"
+#include "UplinkEncoder.h"
+
+struct FleetConfig {
+    uint32_t nodes = 1000;
+    uint32_t durationSeconds = 3600;
+    uint32_t intervalSeconds = 300;                                                         //  Nominal time between readings on each node
+    uint8_t jitterPercent = 10;                                                             //  Each wake is moved by up to this much either way
+    uint16_t driftPpm = 100;                                                                //  Each node's clock is off by up to this much
+    uint8_t legacyPercent = 10;                                                             //  Share of nodes sending 16-byte v1 packets
+    uint8_t burstPercent = 30;                                                              //  Share of nodes batching readings into bursts
+    uint8_t retries = 15;                                                                   //  nRF24 auto retransmit count
+    uint16_t retryDelayUs = 1500;                                                           //  nRF24 auto retransmit delay
+    bool isRetryDelayRandom = false;                                                        //  Gives each node its own delay between 250us and 4000us
+    bool isCaptureEnabled = false;                                                          //  Keeps the first frame when two overlap instead of losing both
+    uint16_t irqLatencyUs = 50;                                                             //  IRQ edge to the receive task running
+    uint16_t readUs = 80;                                                                   //  SPI time to read one payload
+    uint32_t readingUs = 7000;                                                              //  Upload task time per reading, mostly the serial log
+    uint32_t httpMs = 150;
+    uint32_t httpJitterMs = 100;
+    uint8_t notifyPercent = DEFAULT_WARN_PERCENT;                                           //  Warning level, critical is DEFAULT_CRITICAL_PERCENT or this if lower
+    uint32_t renotifySeconds = DEFAULT_RENOTIFY_SECONDS;
+    uint32_t digestSeconds = 0;                                                             //  Gathers due plants into one ntfy request at most this often
+    uint8_t batchSize = 8;
+    uint32_t windowMs = 5000;
+    uint32_t seed = 1;
+};
+
+struct FleetReport {
+    uint64_t wakes;
+    uint64_t framesSent;
+    uint64_t attempts;                                                                      //  Including retransmissions
+    uint64_t collisions;                                                                    //  Attempts lost to another frame on air
+    uint64_t fifoRejects;                                                                   //  Attempts not acknowledged because the RX FIFO was full
+    uint64_t framesLost;                                                                    //  Frames that ran out of retries
+    uint64_t framesReceived;
+    uint64_t ringDrops;
+    uint64_t parseFailures;
+    uint64_t pipePackets[RADIO_PIPES];
+    uint64_t readingsUploaded;
+    uint64_t unnamedReadings;                                                               //  Burst readings uploaded with a fallback name
+    uint64_t duplicates;                                                                    //  Readings the node table dropped as already seen
+    uint64_t estimatedLost;                                                                 //  Readings the node table counted lost from sequence gaps
+    uint32_t nodesTracked;
+    uint64_t flushes;
+    uint64_t failedFlushes;                                                                 //  Batches not posted, the base station would log them to flash
+    uint64_t encoderOverflows;                                                              //  Failed batches whose body did not fit FLEET_BODY_LENGTH
+    uint64_t notifications;                                                                 //  ntfy requests, a digest counts once
+    uint64_t digests;
+    uint64_t lowReadings;                                                                   //  Readings at or below the warning level, each was a request before
+    uint32_t maxFifo;
+    uint32_t ringHighWaterMark;
+    uint32_t maxBatch;
+    uint32_t peakPacketsPerSecond;
+    double packetsPerSecond;
+    double readingsPerSecond;
+    double uploadBusyPercent;
+    uint32_t latencyP50Ms;
+    uint32_t latencyP90Ms;
+    uint32_t latencyP99Ms;
+    uint32_t latencyMaxMs;
+};
+
+// The radio's RX FIFO as the receive path sees it. A slot stays taken until the payload has been clocked out
+class SimFifo : public RadioSource  {
+    public:
+        bool Available() override;
+        uint8_t Read(uint8_t *buffer, uint8_t length, uint8_t &pipe) override;
+        void ClearInterrupt() override;
+        bool Push(const uint8_t *payload, uint8_t length, uint8_t pipe);
+        uint8_t Occupied();
+        void ReleaseRead();                                                                 //  Frees the slots of payloads already read
+        uint32_t reads;
+
+    private:
+        std::deque<std::vector<uint8_t>> payloads;                                          //  Pipe number first, then the payload
+        uint8_t beingRead = 0;
+};
+
+class FleetSim  {
+    public:
+        FleetSim(const FleetConfig &config);
+        FleetReport Run();
+
+    private:
+        enum EventType : uint8_t { NODE_WAKE, TX_START, TX_END, DRAIN, DRAIN_DONE, UPLOAD_POLL, UPLOAD_STEP };
+        struct Event {
+            uint64_t timeUs;
+            uint64_t order;                                                                 //  Keeps ties in scheduling order so runs repeat exactly
+            EventType type;
+            uint32_t target;
+            bool operator>(const Event &other) const  {
+                return timeUs != other.timeUs ? timeUs > other.timeUs : order > other.order;
+            }
+        };
+        struct Frame {
+            uint8_t data[PLANT_PACKET_LENGTH];
+            uint8_t length;
+            uint8_t readings;
+        };
+        struct Node {
+            uint16_t id;
+            uint8_t format;
+            uint8_t pipe;
+            int32_t driftPpm;
+            uint16_t retryDelayUs;
+            uint16_t sequence;
+            uint8_t percent;
+            uint8_t stored;                                                                 //  Burst nodes only
+            std::vector<Frame> frames;
+            uint8_t frameIndex;
+            uint8_t attempts;
+            uint64_t firstAttemptUs;
+            bool isCorrupted;
+            uint64_t airEndUs;
+        };
+
+        void Schedule(uint64_t timeUs, EventType type, uint32_t target = 0);
+        uint32_t Random();
+        void OnNodeWake(Node &node);
+        void BuildFrames(Node &node);
+        void OnTxStart(Node &node);
+        void OnTxEnd(Node &node);
+        void FinishFrame(Node &node);
+        void OnDrain();
+        void OnDrainDone();
+        void OnUploadStep();
+        void StartFlush();
+        void CompleteFlush();
+        uint32_t FlushBody();
+        uint32_t UploadMs();
+        bool LookUpSendTime(const PlantPacket &reading, uint64_t &sendUs);
+
+        FleetConfig config;
+        FleetReport report;
+        uint64_t nowUs;
+        uint64_t eventOrder;
+        uint32_t randomState;
+        std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+        std::vector<Node> nodes;
+        std::vector<uint32_t> onAir;                                                        //  Nodes whose current attempt is on air
+        std::unordered_map<uint32_t, uint64_t> sentReadings;                                //  First attempt of each v2 reading, keyed by node id and sequence
+        std::unordered_map<uint32_t, std::deque<uint64_t>> sentLegacy;                      //  v1 frames carry no sequence, kept in order per node
+        std::vector<uint32_t> latenciesMs;
+        std::vector<uint32_t> receivedPerSecond;
+        SimFifo fifo;
+        AddressPlan addressPlan;
+        PacketRing ring;
+        RadioReceiver receiver;
+        UploadQueue uploadQueue;
+        std::vector<NotifyPlantState> notifyPlants;                                         //  Two per node, a burst node goes by a fallback name until it is named
+        NotificationEngine notifications;
+        SimHttpTransport http;
+        bool isReceiveBusy;
+        bool isUploadBusy;
+        bool isFlushing;
+        bool isFlushFailed;
+        bool isHoldingReading;
+        PlantPacket heldReading;                                                            //  Popped while the queue was full, added once the flush is done
+        uint64_t flushStartUs;
+        uint64_t uploadBusyUs;
+        char body[FLEET_BODY_LENGTH];
+        UplinkEncoder encoder;
+};
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ *  Fleet simulator for the base station pipeline
+ *  Runs thousands of virtual sensors through RadioReceiver, PacketRing and
+ *  UploadQueue with in-process radio and HTTP stand-ins
+ *
+ *  pio run -e fleet -t exec -a "--nodes 2000 --interval 120"
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FleetSim.h"
+
+static void PrintUsage()    {
+
+    printf("usage: fleet [options]\n"
+           "  --nodes N           virtual sensors (1000)\n"
+           "  --seconds N         simulated time (3600)\n"
+           "  --interval N        seconds between readings per node (300)\n"
+           "  --jitter PCT        wake jitter either way (10)\n"
+           "  --drift PPM         clock drift either way (100)\n"
+           "  --legacy PCT        nodes sending 16-byte v1 packets (10)\n"
+           "  --burst PCT         nodes sending bursts every 4 wakes (30)\n"
+           "  --retries N         nRF24 auto retransmits (15)\n"
+           "  --retry-us N        nRF24 auto retransmit delay (1500)\n"
+           "  --random-retry      per-node retransmit delay between 250 and 4000us\n"
+           "  --capture           first frame on air survives a collision\n"
+           "  --irq-us N          IRQ to receive task latency (50)\n"
+           "  --read-us N         SPI time per payload (80)\n"
+           "  --reading-us N      upload task time per reading (7000)\n"
+           "  --http-ms N         request latency (150)\n"
+           "  --http-jitter-ms N  extra random latency (100)\n"
+           "  --notify PCT        warning level for notifications (50)\n"
+           "  --renotify N        seconds before a plant still dry is notified again (43200)\n"
+           "  --digest N          one digest of all dry plants at most every N seconds (off)\n"
+           "  --batch N           upload batch size (8)\n"
+           "  --window-ms N       upload window (5000)\n"
+           "  --seed N            random seed (1)\n");
+}
+
+int main(int argc, char **argv) {
+
+    FleetConfig config;
+
+    for(int i=1; i<argc; i++)   {
+        const char *option = argv[i];
+        bool hasValue = i + 1 < argc;
+        unsigned long value = hasValue ? strtoul(argv[i + 1], NULL, 10) : 0;
+
+        if(strcmp(option, "--random-retry") == 0)  { config.isRetryDelayRandom = true; continue; }
+        if(strcmp(option, "--capture") == 0)       { config.isCaptureEnabled = true; continue; }
+        if(!hasValue)   {
+            PrintUsage();
+            return 1;
+        }
+        i++;
+
+        if(strcmp(option, "--nodes") == 0)                  config.nodes = value;
+        else if(strcmp(option, "--seconds") == 0)           config.durationSeconds = value;
+        else if(strcmp(option, "--interval") == 0)          config.intervalSeconds = value;
+        else if(strcmp(option, "--jitter") == 0)            config.jitterPercent = value;
+        else if(strcmp(option, "--drift") == 0)             config.driftPpm = value;
+        else if(strcmp(option, "--legacy") == 0)            config.legacyPercent = value;
+        else if(strcmp(option, "--burst") == 0)             config.burstPercent = value;
+        else if(strcmp(option, "--retries") == 0)           config.retries = value;
+        else if(strcmp(option, "--retry-us") == 0)          config.retryDelayUs = value;
+        else if(strcmp(option, "--irq-us") == 0)            config.irqLatencyUs = value;
+        else if(strcmp(option, "--read-us") == 0)           config.readUs = value;
+        else if(strcmp(option, "--reading-us") == 0)        config.readingUs = value;
+        else if(strcmp(option, "--http-ms") == 0)           config.httpMs = value;
+        else if(strcmp(option, "--http-jitter-ms") == 0)    config.httpJitterMs = value;
+        else if(strcmp(option, "--notify") == 0)            config.notifyPercent = value;
+        else if(strcmp(option, "--renotify") == 0)          config.renotifySeconds = value;
+        else if(strcmp(option, "--digest") == 0)            config.digestSeconds = value;
+        else if(strcmp(option, "--batch") == 0)             config.batchSize = value;
+        else if(strcmp(option, "--window-ms") == 0)         config.windowMs = value;
+        else if(strcmp(option, "--seed") == 0)              config.seed = value;
+        else    {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if(config.nodes == 0 || config.nodes > 65535 || config.intervalSeconds == 0 || config.durationSeconds == 0
+       || config.legacyPercent + config.burstPercent > 100)   {
+        PrintUsage();
+        return 1;
+    }
+
+    FleetSim sim(config);
+    FleetReport report = sim.Run();
+
+    printf("nodes %u, interval %us, %us simulated\n", (unsigned)config.nodes, (unsigned)config.intervalSeconds, (unsigned)config.durationSeconds);
+    printf("radio:   %llu wakes, %llu frames, %llu attempts, %llu collisions, %llu fifo full, %llu frames lost\n",
+           (unsigned long long)report.wakes, (unsigned long long)report.framesSent, (unsigned long long)report.attempts,
+           (unsigned long long)report.collisions, (unsigned long long)report.fifoRejects, (unsigned long long)report.framesLost);
+    printf("receive: %llu packets, %.2f/s sustained, %u/s peak, max fifo %u, %llu parse failures\n",
+           (unsigned long long)report.framesReceived, report.packetsPerSecond, (unsigned)report.peakPacketsPerSecond,
+           (unsigned)report.maxFifo, (unsigned long long)report.parseFailures);
+    printf("pipes:  ");
+    for(uint8_t pipe=0; pipe<RADIO_PIPES; pipe++)   {
+        printf(" %llu", (unsigned long long)report.pipePackets[pipe]);
+    }
+    printf(" packets\n");
+    printf("ring:    high water %u of %u, %llu drops\n",
+           (unsigned)report.ringHighWaterMark, (unsigned)PACKET_RING_CAPACITY, (unsigned long long)report.ringDrops);
+    printf("upload:  %llu readings, %.2f/s, %llu flushes, %llu failed (%llu encoder overflows), max batch %u, task busy %.1f%%\n",
+           (unsigned long long)report.readingsUploaded, report.readingsPerSecond, (unsigned long long)report.flushes,
+           (unsigned long long)report.failedFlushes, (unsigned long long)report.encoderOverflows, (unsigned)report.maxBatch,
+           report.uploadBusyPercent);
+    printf("notify:  %llu requests (%llu digests) for %llu readings at or below %u%%\n",
+           (unsigned long long)report.notifications, (unsigned long long)report.digests,
+           (unsigned long long)report.lowReadings, (unsigned)config.notifyPercent);
+    printf("latency: p50 %ums, p90 %ums, p99 %ums, max %ums\n",
+           (unsigned)report.latencyP50Ms, (unsigned)report.latencyP90Ms, (unsigned)report.latencyP99Ms, (unsigned)report.latencyMaxMs);
+    printf("names:   %llu burst readings uploaded without a name\n", (unsigned long long)report.unnamedReadings);
+    printf("nodes:   %u tracked, %llu duplicates dropped, %llu readings lost by sequence gaps\n",
+           (unsigned)report.nodesTracked, (unsigned long long)report.duplicates, (unsigned long long)report.estimatedLost);
+    return 0;
+}
@@ -0,0 +1,1119 @@
+/*
+ *  Host build of the soil monitor libraries
+ *  Checks the address plan, runs the sample scheduler over moisture traces and the watering
+ *  controller against a simulated pot, then one sensor wake, one base station upload, a config push, a resent reading, a channel survey, two days of
+ *  notifications, a wake log through a brownout, a traced burst cycle and the store-and-forward log through
+ *  a wrap and a torn write against the simulated HAL
+ *  so the shared code can be checked and timed on Linux.
+ *  Every result is checked as well as printed, and the run exits non-zero if any check fails
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "Hal.h"
+#include "HalRadio.h"
+#include "HalHttp.h"
+#include "SoilMonitor.h"
+#include "PlantPacket.h"
+#include "PacketRing.h"
+#include "RadioReceiver.h"
+#include "UploadQueue.h"
+#include "AddressPlan.h"
+#include "ConfigQueue.h"
+#include "ChannelSurvey.h"
+#include "NotificationEngine.h"
+#include "NodeTable.h"
+#include "UplinkEncoder.h"
+#include "WakeLog.h"
+#include "WakeTrace.h"
+#include "Metrics.h"
+#include "StationMetrics.h"
+#include "ReadingHistory.h"
+#include "ReadingLog.h"
+#include "SampleScheduler.h"
+#include "WateringController.h"
+
+#define SOIL_SENSOR_PWR_PIN     (5)
+#define SOIL_SENSOR_DATA_PIN    (14)
+#define SIM_RAW_MOISTURE        (700)
+#define NODE_ID                 (1)
+#define BODY_LENGTH             (256)
+#define CONFIG_ALERT_PERCENT    (30)
+#define SIM_WIFI_CHANNEL        (13)
+#define SIM_NOISY_CHANNEL       (60)                                                        // Another network's traffic the survey should avoid
+#define SIM_SURVEY_PASSES       (40)
+#define SIM_NOTIFY_PLANTS       (4)
+#define SIM_NOTIFY_STEP_S       (1800)                                                      // A reading every half hour for two days
+#define SIM_NOTIFY_STEPS        (96)
+#define SIM_DIGEST_S            (3600)
+#define SIM_WAKES               (10)
+#define SIM_TRACE_WAKES         (4)                                                         // One burst cycle of the Arduino sensor
+#define SIM_RADIO_POWER_UP_US   (5000)                                                      // RF24 waits this long in powerUp()
+#define SIM_UPLOADS             (20)
+#define SIM_HISTORY_PLANTS      (16)
+#define SIM_HISTORY_DAYS        (21)
+#define SIM_HISTORY_STEP_S      (1800)                                                      // A reading every half hour per plant
+#define SIM_HISTORY_BLOCKS      (768)                                                       // Same as the base station's HISTORY_BLOCKS
+#define SIM_HISTORY_SPILL_SIZE  (64 * 1024)                                                 // Same as the base station's HISTORY_SPILL_SIZE
+#define SIM_HISTORY_SECTOR_SIZE (4096)
+#define SIM_HISTORY_PAGE        (64)
+#define SIM_HISTORY_POINTS      (24)
+#define SIM_HISTORY_SEND_EVERY  (4)                                                         // Readings per send, the arduino sensor's BURST_CYCLES
+#define SIM_PLAN_NODES          (1000)
+#define SIM_SCHEDULE_DAYS       (28)
+#define SIM_SCHEDULE_STEP_S     (60)
+#define SIM_FIXED_SLEEP_S       (14400)                                                     // The Arduino sensor's TIME_TO_SLEEP_SECONDS before the scheduler
+#define SIM_POT_SOIL_ML         (600)
+#define SIM_POT_SHUTOFF_PERCENT (80)
+#define SIM_LOG_SECTORS         (4)
+#define SIM_LOG_SECTOR_SIZE     (256)                                                       // Eight records per sector, so a few dozen readings wrap the log
+#define SIM_LOG_READINGS        (20)
+#define SIM_HTTP_READ_TIMEOUT   (-11)                                                       // HTTPClient's HTTPC_ERROR_READ_TIMEOUT
+
+// Records a failed check with its line, the run carries on so one failure does not hide the rest
+#define CHECK(condition)        Check((condition), #condition, __LINE__)
+
+AddressPlan addressPlan;
+
+// Flash that loses power between writing a record and committing its state byte
+class TornFlashStore : public RamFlashStore  {
+    public:
+        TornFlashStore(uint8_t *memory, uint32_t size, uint32_t sectorSize, uint32_t *eraseCounts)
+            : RamFlashStore(memory, size, sectorSize, eraseCounts), isTearing(false) {}
+        bool Write(uint32_t address, const void *data, size_t length) override  {
+            return (isTearing && length == 1) ? false : RamFlashStore::Write(address, data, length);
+        }
+        bool isTearing;
+};
+
+// Receive side of the simulated link as the base station's RadioReceiver sees it
+class SimRadioSource : public RadioSource   {
+    public:
+        SimRadioSource(SimRadio &simRadio) : radio(simRadio) {}
+        bool Available() override   { return radio.Available(); }
+        uint8_t Read(uint8_t *buffer, uint8_t length, uint8_t &pipe) override  {
+            pipe = addressPlan.PipeForNode(NODE_ID);
+            return radio.Read(buffer, length);
+        }
+        void ClearInterrupt() override  {}
+        bool WriteAckPayload(uint8_t pipe, const uint8_t *payload, uint8_t length) override    {
+            return radio.LoadAckPayload(payload, length);
+        }
+    private:
+        SimRadio &radio;
+};
+
+SimRadio radio;
+SimRadioSource radioSource(radio);
+PacketRing packetRing;
+RadioReceiver receiver(radioSource, packetRing);
+ConfigQueue configQueue;
+UploadQueue uploadQueue(1, 0);
+SimHttpTransport http;
+uint32_t checks = 0;
+uint32_t checkFailures = 0;
+
+bool Check(bool isPassed, const char *condition, int line);
+void RunAddressPlan();
+void RunScheduler();
+void RunWatering();
+void RunSensorWake();
+void RunBaseStation();
+void RunUplinkEncoder();
+void RunConfigRoundTrip();
+void RunResend();
+void RunNodeTable();
+void RunChannelSurvey();
+void RunNotifications();
+void RunWakeLog();
+void RunWakeTrace();
+void RunReadingLog();
+void RunMetrics();
+void RunHistory();
+
+int main()  {
+
+    HalSimReset();
+    receiver.SetConfigQueue(&configQueue);
+    RunAddressPlan();
+    RunScheduler();
+    RunWatering();
+    RunSensorWake();
+    RunBaseStation();
+    RunUplinkEncoder();
+    RunConfigRoundTrip();
+    RunResend();
+    RunNodeTable();
+    RunChannelSurvey();
+    RunNotifications();
+    RunWakeLog();
+    RunWakeTrace();
+    RunReadingLog();
+    RunMetrics();
+    RunHistory();
+
+    printf("checks: %lu passed, %lu failed\n", (unsigned long)(checks - checkFailures), (unsigned long)checkFailures);
+    return checkFailures == 0 ? 0 : 1;
+}
+
+bool Check(bool isPassed, const char *condition, int line)  {
+
+    checks++;
+    if(!isPassed)   {
+        checkFailures++;
+        printf("FAILED line %d: %s\n", line, condition);
+    }
+    return isPassed;
+}
+
+void RunAddressPlan()   {
+
+    const uint8_t legacyAddress[ADDRESS_WIDTH] = {'b', 'a', 's', 'e', '\0'};
+    const uint8_t prefix[ADDRESS_PREFIX_WIDTH] = {0xC3, 0x5A, 0x96, 0x2D};
+    const uint8_t rejected[] = {0x00, 0xFF, 0x55, 0xAA};
+    uint8_t addresses[ADDRESS_PLAN_PIPES][ADDRESS_WIDTH];
+    uint8_t address[ADDRESS_WIDTH];
+    uint16_t perPipe[ADDRESS_PLAN_PIPES] = {};
+
+    // Pipe 1 is still the address every sensor used before the plan, the others differ only in the first byte
+    CHECK(addressPlan.IsValid());
+    for(uint8_t pipe=0; pipe<ADDRESS_PLAN_PIPES; pipe++)    {
+        addressPlan.AddressForPipe(pipe, addresses[pipe]);
+        CHECK(memcmp(&addresses[pipe][1], &legacyAddress[1], ADDRESS_PREFIX_WIDTH) == 0);
+        for(uint8_t other=0; other<pipe; other++)   {
+            CHECK(addresses[pipe][0] != addresses[other][0]);
+        }
+    }
+    CHECK(memcmp(addresses[ADDRESS_PLAN_LEGACY_PIPE], legacyAddress, ADDRESS_WIDTH) == 0);
+    addressPlan.AddressForPipe(ADDRESS_PLAN_PIPES, address);
+    CHECK(memcmp(address, legacyAddress, ADDRESS_WIDTH) == 0);
+    addressPlan.AddressForBeacon(address);
+    CHECK(memcmp(address, addresses[ADDRESS_PLAN_BEACON_PIPE], ADDRESS_WIDTH) == 0);
+
+    // Node 0 alone gets the legacy pipe, nodes numbered in order share the rest evenly
+    CHECK(addressPlan.PipeForNode(0) == ADDRESS_PLAN_LEGACY_PIPE);
+    for(uint16_t node=1; node<=SIM_PLAN_NODES; node++)  {
+        uint8_t pipe = addressPlan.PipeForNode(node);
+        addressPlan.AddressForNode(node, address);
+        CHECK(pipe < ADDRESS_PLAN_PIPES && memcmp(address, addresses[pipe], ADDRESS_WIDTH) == 0);
+        perPipe[pipe < ADDRESS_PLAN_PIPES ? pipe : ADDRESS_PLAN_LEGACY_PIPE]++;
+    }
+    CHECK(perPipe[ADDRESS_PLAN_LEGACY_PIPE] == 0);
+    for(uint8_t pipe=0; pipe<ADDRESS_PLAN_PIPES; pipe++)    {
+        if(pipe != ADDRESS_PLAN_LEGACY_PIPE)    {
+            CHECK(perPipe[pipe] == SIM_PLAN_NODES / ADDRESS_PLAN_NODE_PIPES);
+        }
+    }
+
+    // A first byte that is flat or alternating, on any pipe, or one used twice makes a plan invalid
+    uint8_t firstBytes[ADDRESS_PLAN_PIPES] = {0x11, 0x22, 0x33, 0x44, 0x66, 0x77};
+    CHECK(AddressPlan(prefix, firstBytes).IsValid());
+    uint8_t invalid = 0;
+    for(uint8_t pipe=0; pipe<ADDRESS_PLAN_PIPES; pipe++)    {
+        uint8_t original = firstBytes[pipe];
+        for(uint8_t i=0; i<sizeof(rejected); i++)   {
+            firstBytes[pipe] = rejected[i];
+            invalid += !AddressPlan(prefix, firstBytes).IsValid();
+        }
+        firstBytes[pipe] = firstBytes[(pipe + 1) % ADDRESS_PLAN_PIPES];
+        invalid += !AddressPlan(prefix, firstBytes).IsValid();
+        firstBytes[pipe] = original;
+    }
+    CHECK(invalid == ADDRESS_PLAN_PIPES * (sizeof(rejected) + 1));
+
+    AddressPlan custom(prefix, firstBytes);
+    custom.AddressForPipe(4, address);
+    CHECK(address[0] == firstBytes[4] && memcmp(&address[1], prefix, ADDRESS_PREFIX_WIDTH) == 0);
+
+    printf("address plan: %u nodes over pipes 0/2/3/4/5 as %u/%u/%u/%u/%u, legacy pipe %u, %u bad plans rejected\n", SIM_PLAN_NODES,
+           perPipe[0], perPipe[2], perPipe[3], perPipe[4], perPipe[5], perPipe[ADDRESS_PLAN_LEGACY_PIPE], invalid);
+}
+
+// A pot watered back up to wateredPercent every wateredEveryHours and drying at a steady rate in between
+struct SimMoistureTrace {
+    const char *name;
+    double dryingPerHour;
+    uint16_t wateredEveryHours;
+    uint8_t wateredPercent;
+};
+
+struct SimScheduleResult    {
+    uint32_t wakes;
+    uint32_t alertDelayS;                                                                   //  Longest the soil sat at or below the alert level before a wake read it
+    uint32_t alertWakes;
+    uint32_t alertWakesOffFloor;                                                            //  Wakes at or below the alert level that slept longer than the floor
+};
+
+SimScheduleResult SimulateSchedule(const SimMoistureTrace &trace, bool isAdaptive)    {
+
+    SampleSchedulerState state = {};
+    SampleScheduler scheduler(state);
+    SimScheduleResult result = {};
+    uint32_t seed = 1;
+    uint32_t nextWake = 0;
+    uint32_t lastWake = 0;
+    uint32_t alertStart = 0;
+    bool isAlert = false;
+    bool isAlertSeen = false;
+
+    // The same trace and sensor noise for both schedules, checked a minute at a time
+    for(uint32_t now=0; now<SIM_SCHEDULE_DAYS * 86400UL; now+=SIM_SCHEDULE_STEP_S) {
+        double hours = now / 3600.0;
+        double percent = trace.wateredPercent;
+        if(trace.wateredEveryHours > 0) {
+            percent -= trace.dryingPerHour * fmod(hours, trace.wateredEveryHours);
+        }
+        percent = percent < 20 ? 20 : percent;
+        if(percent <= DEFAULT_ALERT_PERCENT && !isAlert)    {
+            isAlert = true;
+            isAlertSeen = false;
+            alertStart = now;
+        }
+        else if(percent > DEFAULT_ALERT_PERCENT)    {
+            isAlert = false;
+        }
+        if(now < nextWake)  {
+            continue;
+        }
+
+        seed = seed * 1103515245 + 12345;
+        uint8_t reading = (uint8_t)lround(percent) + (seed >> 16) % 3 - 1;
+        uint32_t interval = SIM_FIXED_SLEEP_S;
+        if(isAdaptive)  {
+            interval = scheduler.NextInterval(reading, now > 0 ? now - lastWake : SIM_FIXED_SLEEP_S);
+        }
+        if(reading <= DEFAULT_ALERT_PERCENT)    {
+            result.alertWakes++;
+            result.alertWakesOffFloor += interval != DEFAULT_FLOOR_SECONDS;
+        }
+        if(isAlert && !isAlertSeen && reading <= DEFAULT_ALERT_PERCENT)    {
+            isAlertSeen = true;
+            result.alertDelayS = now - alertStart > result.alertDelayS ? now - alertStart : result.alertDelayS;
+        }
+        result.wakes++;
+        lastWake = now;
+        nextWake = now + interval;
+    }
+    return result;
+}
+
+void RunScheduler() {
+
+    // Drying rates from a few percent a day to nearly one percent an hour, one pot left to dry out
+    const SimMoistureTrace traces[] = {
+        {"stable", 0.0, 0, 62},
+        {"weekly", 0.25, 7 * 24, 85},
+        {"hot", 0.8, 48, 80},
+        {"forgotten", 0.35, 6 * 24, 85},
+    };
+    uint32_t adaptiveWakes = 0;
+    uint32_t fixedWakes = 0;
+
+    for(const SimMoistureTrace &trace : traces) {
+        SimScheduleResult adaptive = SimulateSchedule(trace, true);
+        SimScheduleResult fixed = SimulateSchedule(trace, false);
+        adaptiveWakes += adaptive.wakes;
+        fixedWakes += fixed.wakes;
+        printf("scheduler: %s, %u wakes vs %u fixed", trace.name, (unsigned)adaptive.wakes, (unsigned)fixed.wakes);
+        if(fixed.alertWakes > 0)    {
+            printf(", alert band read after %u min vs %u min", (unsigned)(adaptive.alertDelayS / 60), (unsigned)(fixed.alertDelayS / 60));
+        }
+        printf("\n");
+        CHECK(adaptive.alertWakesOffFloor == 0);
+        CHECK(adaptive.alertDelayS <= fixed.alertDelayS);
+    }
+
+    // A pot drying by more than the target change per fixed period is sampled more often than the fixed
+    // schedule on purpose, the saving has to come from the rest
+    printf("scheduler: %u wakes vs %u on the fixed %u s schedule over %u days of %u traces\n", (unsigned)adaptiveWakes, (unsigned)fixedWakes,
+           SIM_FIXED_SLEEP_S, SIM_SCHEDULE_DAYS, (unsigned)(sizeof(traces) / sizeof(traces[0])));
+    CHECK(SimulateSchedule(traces[0], true).wakes * 2 <= SimulateSchedule(traces[0], false).wakes);
+    CHECK(adaptiveWakes <= fixedWakes);
+}
+
+// Runs the controller against the pot the way the Arduino sensor does. A pump fault is a tick where the
+// pump is on while the float reads overflowing, or where it restarts before the float has read clear long enough
+WateringStats SimulateWatering(SimulatedPot &pot, uint32_t &pumpFaults)    {
+
+    WateringController controller(pot);
+    uint16_t threshold = DEFAULT_MIN_MOISTURE - (uint32_t)(DEFAULT_MIN_MOISTURE - DEFAULT_MAX_MOISTURE) * SIM_POT_SHUTOFF_PERCENT / 100;
+    uint32_t clearMs = 0;
+    bool wasPumpOn;
+
+    pumpFaults = 0;
+    controller.Start(threshold);
+    wasPumpOn = controller.IsPumpOn();
+    for(uint16_t wait = WATERING_TICK_MS; wait > 0; )   {
+        pot.Advance(wait);
+        clearMs = pot.IsOverflowing() ? 0 : clearMs + wait;
+        wait = controller.Tick(wait);
+        pumpFaults += pot.IsOverflowing() && controller.IsPumpOn();
+        pumpFaults += !wasPumpOn && controller.IsPumpOn() && clearMs < DEFAULT_OVERFLOW_CLEAR_MS;
+        wasPumpOn = controller.IsPumpOn();
+    }
+    return controller.stats;
+}
+
+void RunWatering()  {
+
+    uint32_t pumpFaults;
+
+    // Soil takes the pump's full flow, so the run ends on the reading and the estimate matches the flow
+    SimulatedPot pot(DEFAULT_MIN_MOISTURE, DEFAULT_MAX_MOISTURE, SIM_POT_SOIL_ML, 100, DEFAULT_PUMP_ML_PER_MINUTE,
+                     2 * DEFAULT_PUMP_ML_PER_MINUTE, 2000);
+    WateringStats reached = SimulateWatering(pot, pumpFaults);
+    printf("watering: %s after %lu ms, %lu ml estimated, %lu ml delivered, soil %lu of %u ml\n",
+           reached.lastResult == WATERING_REACHED_TARGET ? "target reached" : "no target", (unsigned long)reached.lastRunMs,
+           (unsigned long)reached.lastMillilitres, (unsigned long)pot.DeliveredMl(), (unsigned long)pot.SoilMl(), SIM_POT_SOIL_ML);
+    CHECK(reached.lastResult == WATERING_REACHED_TARGET);
+    CHECK(pot.SoilMl() * 100 >= SIM_POT_SOIL_ML * SIM_POT_SHUTOFF_PERCENT);
+    CHECK(reached.lastMillilitres + 1 >= pot.DeliveredMl() && reached.lastMillilitres <= pot.DeliveredMl() + 1);
+    CHECK(reached.lastSamples == reached.lastRunMs / DEFAULT_SAMPLE_PERIOD_MS);
+    CHECK(reached.lastOverflowPauses == 0 && pumpFaults == 0);
+
+    // An empty reservoir never wets the soil, the pump gives up after its maximum time
+    SimulatedPot empty(DEFAULT_MIN_MOISTURE, DEFAULT_MAX_MOISTURE, SIM_POT_SOIL_ML, 100, DEFAULT_PUMP_ML_PER_MINUTE,
+                       2 * DEFAULT_PUMP_ML_PER_MINUTE, 50);
+    WateringStats timeout = SimulateWatering(empty, pumpFaults);
+    printf("watering: empty reservoir %s after %lu ms of pumping, %lu ml delivered\n",
+           timeout.lastResult == WATERING_PUMP_TIMEOUT ? "timed out" : "did not time out", (unsigned long)timeout.lastPumpMs,
+           (unsigned long)empty.DeliveredMl());
+    CHECK(timeout.lastResult == WATERING_PUMP_TIMEOUT);
+    CHECK(timeout.lastPumpMs == DEFAULT_MAX_PUMP_MS);
+    CHECK(empty.ReservoirMl() == 0 && empty.DeliveredMl() == 50);
+
+    // Compacted soil soaks in far slower than the pump, so the saucer fills and the pump waits for it
+    SimulatedPot slow(DEFAULT_MIN_MOISTURE, DEFAULT_MAX_MOISTURE, SIM_POT_SOIL_ML, 100, DEFAULT_PUMP_ML_PER_MINUTE, 300, 2000);
+    WateringStats paused = SimulateWatering(slow, pumpFaults);
+    printf("watering: slow soak %s after %lu ms with %u overflow pause(s), pump on %lu ms\n",
+           paused.lastResult == WATERING_REACHED_TARGET ? "reached target" : "did not reach target", (unsigned long)paused.lastRunMs,
+           paused.lastOverflowPauses, (unsigned long)paused.lastPumpMs);
+    CHECK(paused.lastResult == WATERING_REACHED_TARGET);
+    CHECK(paused.lastOverflowPauses > 0);
+    CHECK(paused.lastRunMs > paused.lastPumpMs);
+    CHECK(pumpFaults == 0);
+
+    // Flow rates below a microlitre per millisecond still move water
+    SimulatedPot trickle(DEFAULT_MIN_MOISTURE, DEFAULT_MAX_MOISTURE, SIM_POT_SOIL_ML, 100, 30, 45, 2000);
+    trickle.SetPump(true);
+    for(uint16_t i=0; i<600; i++)   {
+        trickle.Advance(WATERING_TICK_MS);
+    }
+    CHECK(trickle.DeliveredMl() == 30 && trickle.SoilMl() == 30);
+}
+
+void RunSensorWake()    {
+
+    SoilMonitor soilMonitor(SOIL_SENSOR_PWR_PIN, SOIL_SENSOR_DATA_PIN);
+    PlantPacket packet;
+    uint8_t buffer[PLANT_PACKET_LENGTH];
+
+    // Sleep through each wait the way the Arduino sensor does, HalDelay() only moves the simulated clock
+    HalSimSetAnalog(SOIL_SENSOR_DATA_PIN, SIM_RAW_MOISTURE);
+    uint32_t start = HalMicros();
+    for(uint16_t wait = soilMonitor.StartSoilReading(); wait > 0; wait = soilMonitor.PollSoilReading())  {
+        HalDelay(wait);
+    }
+    uint32_t elapsed = HalMicros() - start;
+
+    printf("sensor: raw %u, %u%%, awake %u us of %u us, %u adc reads\n",
+           soilMonitor.rawSoilLevel, soilMonitor.percentSoilLevel,
+           (unsigned)soilMonitor.awakeMicros, (unsigned)elapsed, (unsigned)HalSimAnalogReads());
+    int expectedPercent = (DEFAULT_MIN_MOISTURE - SIM_RAW_MOISTURE) * 100 / (DEFAULT_MIN_MOISTURE - DEFAULT_MAX_MOISTURE);
+    CHECK(soilMonitor.rawSoilLevel == SIM_RAW_MOISTURE);
+    CHECK(soilMonitor.percentSoilLevel >= expectedPercent - 1 && soilMonitor.percentSoilLevel <= expectedPercent + 1);
+    CHECK(HalSimAnalogReads() == SAMPLE_QUANTITY);
+    CHECK(soilMonitor.awakeMicros < elapsed);
+
+    packet.SetPlantPacketName("oliver");
+    packet.nodeId = NODE_ID;
+    packet.sequence = 0;
+    packet.configVersion = 0;
+    packet.percentSoilLevel = soilMonitor.percentSoilLevel;
+    packet.rawSoilLevel = soilMonitor.rawSoilLevel;
+    packet.batteryMillivolts = 3300;
+
+    radio.PowerUp();
+    start = HalMicros();
+    bool isSent = radio.Write(buffer, packet.CreatePlantPacket(buffer));
+    radio.PowerDown();
+    printf("sensor: packet %s, %u us on air\n", isSent ? "sent" : "lost", (unsigned)(HalMicros() - start));
+    CHECK(isSent);
+}
+
+void RunBaseStation()   {
+
+    PlantPacket reading;
+    char body[BODY_LENGTH];
+    UplinkEncoder encoder(body, sizeof(body));
+
+    receiver.OnInterrupt();
+    receiver.Drain(HalMillis() / 1000);
+    while(packetRing.Pop(reading))  {
+        uploadQueue.Add(reading, HalMillis());
+    }
+
+    CHECK(uploadQueue.IsFlushDue(HalMillis()) && uploadQueue.Count() == 1);
+    if(uploadQueue.IsFlushDue(HalMillis()) && uploadQueue.Count() > 0)  {
+        uint16_t length = encoder.EncodeBatch("sim", &uploadQueue.Get(0), uploadQueue.Count());
+        uint32_t start = HalMillis();
+        int code = http.POST("http://localhost/post-data.php", "application/x-www-form-urlencoded", body, length);
+        uploadQueue.CompleteFlush(start, HalMillis());
+        printf("base: posted %u reading(s), response %d, body %s\n", (unsigned)uploadQueue.stats.readingsFlushed, code, http.lastBody);
+        CHECK(code == 200);
+        CHECK(uploadQueue.stats.readingsFlushed == 1);
+        CHECK(strstr(http.lastBody, "&plantname[]=oliver&") != NULL);
+    }
+
+    RadioReceiverStats stats = receiver.Stats();
+    printf("base: %u packet(s), %u parse failure(s), pipe %u\n", (unsigned)stats.packets, (unsigned)stats.parseFailures, reading.pipe);
+    CHECK(stats.packets == 1);
+    CHECK(stats.parseFailures == 0);
+    CHECK(reading.pipe == addressPlan.PipeForNode(NODE_ID));
+}
+
+void RunUplinkEncoder() {
+
+    static char body[UPLINK_BODY_LENGTH];
+    PlantPacket readings[UPLOAD_QUEUE_CAPACITY];
+    PlantPacketTrace trace;
+    UplinkEncoder encoder(body, sizeof(body));
+    char key[65];
+
+    // A full upload queue at the widest numbers, with a key and names that are escaped byte for byte
+    memset(key, '&', sizeof(key) - 1);
+    key[sizeof(key) - 1] = '\0';
+    for(uint8_t i=0; i<UPLOAD_QUEUE_CAPACITY; i++)  {
+        readings[i].SetPlantPacketName("%%%%%%%%%%%%%%%");
+        readings[i].percentSoilLevel = 100;
+        readings[i].rawSoilLevel = UINT16_MAX;
+        readings[i].batteryMillivolts = UINT16_MAX;
+        readings[i].receivedTime = UINT32_MAX;
+    }
+    memset(&trace, 0xFF, sizeof(trace));
+    uint16_t length = encoder.EncodeBatch(key, readings, UPLOAD_QUEUE_CAPACITY, &trace);
+    printf("encoder: widest batch of %u readings and a trace is %u of %u bytes\n", UPLOAD_QUEUE_CAPACITY, length, (unsigned)sizeof(body));
+    CHECK(length > 0);
+    CHECK(encoder.stats.overflows == 0);
+
+    // Spaces become +, anything outside the unreserved set is %XX, the percent sign after moisture included
+    length = encoder.EncodeReading("k&y=1", "Monstera d/l&%", 45);
+    printf("encoder: %s\n", body);
+    CHECK(length == strlen(body));
+    CHECK(strcmp(body, "api_key=k%26y%3D1&moisture=45%25&plantname=Monstera+d%2Fl%26%25") == 0);
+    readings[0].SetPlantPacketName("a-b_c.d~e f");
+    CHECK(encoder.EncodeBatch("sim", readings, 1) > 0);
+    CHECK(strstr(body, "&plantname[]=a-b_c.d~e+f&") != NULL);
+
+    // A body that does not fit is not sent cut short: nothing comes back and the overflow is counted
+    char small[64];
+    UplinkEncoder smallEncoder(small, sizeof(small));
+    CHECK(smallEncoder.EncodeReading("sim", "oliver", 45) > 0);
+    CHECK(smallEncoder.EncodeBatch("sim", readings, 2) == 0);
+    CHECK(smallEncoder.Length() == 0 && small[0] == '\0');
+    CHECK(smallEncoder.stats.overflows == 1 && smallEncoder.stats.bodies == 1);
+
+    // The last byte is kept for the terminator, so a body one byte short of the buffer is the longest that fits
+    char exact[36];
+    UplinkEncoder exactEncoder(exact, sizeof(exact));
+    CHECK(exactEncoder.EncodeReading("", "abc", 5) == 0);
+    CHECK(exactEncoder.EncodeReading("", "ab", 5) == sizeof(exact) - 1);
+    CHECK(exactEncoder.stats.overflows == 1);
+}
+
+void RunConfigRoundTrip()   {
+
+    PlantPacket packet;
+    PlantPacket reading;
+    PlantPacketConfig config = {0, 0, 0, 0, 0, 0, CONFIG_ALERT_PERCENT};
+    PlantPacketConfig received;
+    uint8_t buffer[PLANT_PACKET_LENGTH];
+    uint8_t version;
+    uint8_t applied = 0;
+
+    // The base station learns the node's version from its first packet, loads the config for the
+    // second packet's ack and sees it confirmed in the third
+    configQueue.Set(NODE_ID, config);
+    packet.SetPlantPacketName("oliver");
+    packet.nodeId = NODE_ID;
+    packet.configVersion = 0;
+    packet.percentSoilLevel = 50;
+    packet.rawSoilLevel = SIM_RAW_MOISTURE;
+    packet.batteryMillivolts = 3300;
+
+    radio.PowerUp();
+    for(uint16_t i=0; i<3; i++) {
+        packet.sequence = 1 + i;
+        (void) radio.Write(buffer, packet.CreatePlantPacket(buffer));
+        uint8_t length = radio.ReadAckPayload(buffer, sizeof(buffer));
+        if(PlantPacket::ParseConfigPacket(buffer, length, NODE_ID, version, received) && version != packet.configVersion)  {
+            packet.configVersion = version;
+            applied++;
+            CHECK(received.alertPercent == CONFIG_ALERT_PERCENT);
+            printf("sensor: applied config version %u, alert %u%%\n", version, received.alertPercent);
+        }
+
+        receiver.Drain(HalMillis() / 1000);
+        while(packetRing.Pop(reading))  {}
+
+        // A beacon goes out between the first two packets. Leaving RX mode for it flushes the loaded config
+        if(i == 0)  {
+            radio.FlushAckPayload();
+            receiver.ReloadAckPayloads();
+        }
+    }
+    radio.PowerDown();
+
+    printf("base: %u config(s) waiting, %u ack payload(s) loaded, %u confirmed\n", configQueue.Pending(),
+           (unsigned)receiver.Stats().ackPayloads, (unsigned)configQueue.stats.confirmed);
+    CHECK(applied == 1);
+    CHECK(configQueue.Pending() == 0);
+    CHECK(configQueue.stats.confirmed == 1);
+
+    // Settings a sensor cannot use are refused when queued, and by the sensor if a frame carries them anyway
+    const PlantPacketConfig rejected[] = {{3600, 600, 0, 0, 0, 0, 0}, {0, 0, 700, 700, 0, 0, 0}, {0, 0, 0, 0, 101, 0, 0}};
+    for(const PlantPacketConfig &bad : rejected)    {
+        CHECK(!configQueue.Set(NODE_ID, bad));
+        packet.configVersion = 2;
+        CHECK(!PlantPacket::ParseConfigPacket(buffer, packet.CreateConfigPacket(buffer, bad), NODE_ID, version, received));
+    }
+    const PlantPacketConfig partial = {3600, 0, 0, 490, 0, 0, 0};
+    CHECK(PlantPacket::ParseConfigPacket(buffer, packet.CreateConfigPacket(buffer, partial), NODE_ID, version, received));
+    CHECK(configQueue.Pending() == 0);
+}
+
+void RunResend()    {
+
+    PlantPacket packet;
+    PlantPacket reading;
+    uint8_t buffer[PLANT_PACKET_LENGTH];
+    uint8_t uploaded = 0;
+
+    // The base station got the packet but the ack was lost, so the sensor sends the same reading next wake
+    packet.SetPlantPacketName("oliver");
+    packet.nodeId = NODE_ID;
+    packet.sequence = 4;
+    packet.configVersion = 1;
+    packet.percentSoilLevel = 50;
+    packet.rawSoilLevel = SIM_RAW_MOISTURE;
+    packet.batteryMillivolts = 3300;
+
+    radio.PowerUp();
+    for(uint8_t i=0; i<2; i++)  {
+        (void) radio.Write(buffer, packet.CreatePlantPacket(buffer));
+        receiver.Drain(HalMillis() / 1000);
+        while(packetRing.Pop(reading))  {
+            uploaded++;
+        }
+    }
+    radio.PowerDown();
+
+    const NodeState *node = receiver.Nodes().Find(NODE_ID);
+    printf("base: sent twice, %u uploaded, node %u has %u reading(s), %u duplicate(s), %u packet(s)\n", uploaded, NODE_ID,
+           (unsigned)node->readings, (unsigned)node->duplicates, (unsigned)node->packets);
+    CHECK(uploaded == 1);
+    CHECK(node->duplicates == 1);
+}
+
+// Feeds one node's reading sequences in arrival order, returns how many were accepted
+uint8_t FeedSequences(NodeTable &table, uint16_t nodeId, const uint16_t *sequences, uint8_t count) {
+
+    uint8_t accepted = 0;
+
+    for(uint8_t i=0; i<count; i++)  {
+        NodeState *node = table.Record(nodeId, 1000 + i, addressPlan.PipeForNode(nodeId), true);
+        accepted += table.AcceptReading(*node, sequences[i]) ? 1 : 0;
+    }
+    return accepted;
+}
+
+void RunNodeTable() {
+
+    static NodeTable table;
+
+    // A burst sends the newest reading first and the older ones after it
+    const uint16_t outOfOrder[] = {5, 8, 7, 6, 7};
+    const uint16_t reachBack[] = {20, 17, 18, 19, 16};
+    const uint16_t gap[] = {1, 2, 5, 3, 4, 9};
+    const uint16_t restart[] = {100, 101, 3000, 3001, 0, 1};
+    const uint16_t wrap[] = {65534, 65535, 0, 1};
+
+    // 6 and 7 are counted lost when 8 arrives and given back when they do, the second 7 is a duplicate
+    CHECK(FeedSequences(table, 10, outOfOrder, 5) == 4);
+    const NodeState *node = table.Find(10);
+    CHECK(node->lost == 0 && node->duplicates == 1 && node->restarts == 0 && node->readings == 4);
+
+    // A node's first burst can reach back before the first sequence seen, that is not loss
+    CHECK(FeedSequences(table, 11, reachBack, 5) == 5);
+    node = table.Find(11);
+    CHECK(node->lost == 0 && node->duplicates == 0 && node->restarts == 0 && node->readings == 5);
+
+    // 3 and 4 are missing until they come in late, 6 to 8 never do
+    CHECK(FeedSequences(table, 12, gap, 3) == 3);
+    node = table.Find(12);
+    CHECK(node->lost == 2);
+    CHECK(FeedSequences(table, 12, &gap[3], 3) == 3);
+    CHECK(node->lost == 3 && node->duplicates == 0 && node->restarts == 0 && node->readings == 6);
+    CHECK(NodeTable::LossPerMille(*node) == 333);
+
+    // A jump far ahead and one far back are both a restarted count, not thousands lost or duplicates
+    CHECK(FeedSequences(table, 13, restart, 6) == 6);
+    node = table.Find(13);
+    CHECK(node->lost == 0 && node->duplicates == 0 && node->restarts == 2 && node->readings == 6);
+
+    // The sequence wraps from 65535 to 0 without a restart
+    CHECK(FeedSequences(table, 14, wrap, 4) == 4);
+    node = table.Find(14);
+    CHECK(node->lost == 0 && node->duplicates == 0 && node->restarts == 0);
+
+    printf("node table: %u nodes, loss %u per mille on the node with a gap\n", (unsigned)table.Count(),
+           NodeTable::LossPerMille(*table.Find(12)));
+    CHECK(table.Count() == 5);
+}
+
+void RunChannelSurvey() {
+
+    ChannelSurvey survey;
+
+    // Carrier detect is busy on a third of the samples across our WiFi channel and another network's,
+    // and now and then anywhere else
+    for(uint8_t pass=0; pass<SIM_SURVEY_PASSES; pass++) {
+        for(uint8_t channel=0; channel<CHANNEL_SURVEY_COUNT; channel++) {
+            bool isWifi = ChannelSurvey::OverlapsWifi(channel, SIM_WIFI_CHANNEL) || (channel >= SIM_NOISY_CHANNEL - 10 && channel <= SIM_NOISY_CHANNEL + 10);
+            survey.AddSample(channel, isWifi ? pass % 3 == 0 : (pass * 7 + channel) % 53 == 0);
+        }
+    }
+
+    uint8_t channel = survey.PickChannel(SIM_WIFI_CHANNEL, ADDRESS_PLAN_DISCOVERY_CHANNEL);
+    printf("base: channel %u picked over %u, score %u vs %u\n", channel, ADDRESS_PLAN_DISCOVERY_CHANNEL,
+           survey.Score(channel), survey.Score(ADDRESS_PLAN_DISCOVERY_CHANNEL));
+    CHECK(!ChannelSurvey::OverlapsWifi(channel, SIM_WIFI_CHANNEL));
+    CHECK(channel < SIM_NOISY_CHANNEL - 10 || channel > SIM_NOISY_CHANNEL + 10);
+    CHECK(survey.Score(channel) < survey.Score(ADDRESS_PLAN_DISCOVERY_CHANNEL));
+}
+
+void RunNotifications() {
+
+    NotifyPlantState plants[SIM_NOTIFY_PLANTS] = {};
+    NotificationEngine notifications(plants, SIM_NOTIFY_PLANTS);
+    NotifyPlantState digestPlants[SIM_NOTIFY_PLANTS] = {};
+    NotificationEngine digest(digestPlants, SIM_NOTIFY_PLANTS);
+    const char *names[SIM_NOTIFY_PLANTS] = {"oliver", "phineas", "charlotte", "fern"};
+    char message[NOTIFY_MESSAGE_LENGTH];
+    uint32_t lowReadings = 0;
+
+    digest.Configure(DEFAULT_WARN_PERCENT, DEFAULT_CRITICAL_PERCENT, DEFAULT_HYSTERESIS_PERCENT,
+                     DEFAULT_RENOTIFY_SECONDS, SIM_DIGEST_S);
+
+    // Each plant dries by about a percent an hour with a few percent of noise, oliver is watered after a day
+    for(uint16_t step=0; step<SIM_NOTIFY_STEPS; step++) {
+        uint32_t now = step * SIM_NOTIFY_STEP_S;
+        for(uint8_t plant=0; plant<SIM_NOTIFY_PLANTS; plant++)  {
+            int percent = 60 + plant * 3 - step / 2 + (step * 7 + plant * 3) % 5 - 2;
+            if(plant == 0 && step >= SIM_NOTIFY_STEPS / 2) {
+                percent = 80 - (step - SIM_NOTIFY_STEPS / 2) / 2;
+            }
+            percent = percent < 0 ? 0 : percent;
+            lowReadings += percent <= DEFAULT_WARN_PERCENT;
+
+            if(notifications.Update(names[plant], percent, now, message, sizeof(message)) && plant == 0)   {
+                printf("notify: %s at %uh: %s\n", names[plant], (unsigned)(now / 3600), message);
+            }
+            (void) digest.Update(names[plant], percent, now, message, sizeof(message));
+        }
+        if(digest.TakeDigest(now, message, sizeof(message)) && digest.stats.digests == 1) {
+            printf("notify: first digest at %uh: %s\n", (unsigned)(now / 3600), message);
+        }
+    }
+
+    printf("notify: %u readings at or below %u%%, %u notifications, %u digests\n", (unsigned)lowReadings,
+           DEFAULT_WARN_PERCENT, (unsigned)notifications.stats.sent, (unsigned)digest.stats.digests);
+    CHECK(notifications.stats.sent > 0 && notifications.stats.sent < lowReadings);
+    CHECK(digest.stats.digests > 0 && digest.stats.digests <= SIM_NOTIFY_STEPS * SIM_NOTIFY_STEP_S / SIM_DIGEST_S);
+    CHECK(digest.stats.sent == digest.stats.digests);
+}
+
+void RunWakeLog()   {
+
+    WakeLogState state = {};
+    WakeLog wakeLog(state);
+    bool isPowerUpClean = wakeLog.Begin();
+
+    for(uint8_t wake=0; wake<SIM_WAKES; wake++) {
+        wakeLog.Add(wake * SIM_NOTIFY_STEP_S, 60 - wake);
+    }
+
+    // Power fails while the next reading is being written, before it is committed
+    uint8_t first = &wakeLog.Get(0) - state.entries;
+    WakeLogState torn = state;
+    torn.entries[(first + WAKE_LOG_CAPACITY) % WAKE_LOG_SLOTS].percent = 0xFF;
+    WakeLog afterTear(torn);
+    bool isTornIntact = afterTear.Begin();
+
+    // Power fails hard enough to flip a bit in a committed reading
+    WakeLogState corrupted = state;
+    corrupted.entries[first].percent ^= 0x10;
+    WakeLog afterCorruption(corrupted);
+    bool isCorruptedIntact = afterCorruption.Begin();
+
+    printf("wake log: %u of %u readings kept, oldest %u%%, power up %s, torn write %s with %u, bit flip %s with %u\n",
+           wakeLog.Count(), SIM_WAKES, wakeLog.Get(0).percent, isPowerUpClean ? "clean" : "corrupt",
+           isTornIntact ? "intact" : "corrupt", afterTear.Count(), isCorruptedIntact ? "intact" : "corrupt", afterCorruption.Count());
+    CHECK(isPowerUpClean);
+    CHECK(wakeLog.Count() == WAKE_LOG_CAPACITY);
+    CHECK(wakeLog.Get(0).percent == 60 - (SIM_WAKES - WAKE_LOG_CAPACITY));
+    CHECK(isTornIntact && afterTear.Count() == WAKE_LOG_CAPACITY);
+    CHECK(!isCorruptedIntact && afterCorruption.Count() == 0);
+}
+
+void RunWakeTrace() {
+
+    WakeTraceState state = {};
+    WakeTrace wakeTrace(state);
+    SoilMonitor soilMonitor(SOIL_SENSOR_PWR_PIN, SOIL_SENSOR_DATA_PIN);
+    PlantPacket packet;
+    PlantPacketTrace summary;
+    uint8_t buffer[PLANT_PACKET_LENGTH];
+    char text[WAKE_TRACE_TEXT_LENGTH];
+
+    packet.SetPlantPacketName("oliver");
+    packet.nodeId = NODE_ID;
+    packet.sequence = 20;
+    packet.configVersion = 1;
+    packet.batteryMillivolts = 3300;
+
+    // The simulated clock runs through HalDelay(), where micros() stops on a sleeping AVR, so settling counts as awake here
+    for(uint8_t wake=0; wake<SIM_TRACE_WAKES; wake++)   {
+        wakeTrace.BeginWake();
+        wakeTrace.Begin(WAKE_PHASE_SENSOR);
+        for(uint16_t wait = soilMonitor.StartSoilReading(); wait > 0; wait = soilMonitor.PollSoilReading())  {
+            HalDelay(wait);
+        }
+        wakeTrace.End();
+
+        if(wake + 1 == SIM_TRACE_WAKES) {
+            wakeTrace.Begin(WAKE_PHASE_RADIO_UP);
+            radio.PowerUp();
+            HalSimAdvanceMicros(SIM_RADIO_POWER_UP_US);
+
+            // The first write is lost and sent again, the trace follows the reading that gets through
+            radio.SetLossInterval(radio.writes + 1);
+            packet.percentSoilLevel = soilMonitor.percentSoilLevel;
+            packet.rawSoilLevel = soilMonitor.rawSoilLevel;
+            bool isSent = false;
+            for(uint8_t attempt=0; attempt<2 && !isSent; attempt++) {
+                wakeTrace.Begin(WAKE_PHASE_RADIO_TX);
+                isSent = radio.Write(buffer, packet.CreatePlantPacket(buffer));
+                wakeTrace.End();
+                wakeTrace.AddRetries(radio.LastRetries());
+            }
+            radio.SetLossInterval(0);
+
+            wakeTrace.Summarize(summary);
+            wakeTrace.Begin(WAKE_PHASE_RADIO_TX);
+            if(radio.Write(buffer, packet.CreateTracePacket(buffer, summary)))   {
+                wakeTrace.Clear(summary);
+            }
+            wakeTrace.End();
+            radio.PowerDown();
+        }
+        wakeTrace.EndWake();
+    }
+
+    PlantPacket reading;
+    receiver.Drain(HalMillis() / 1000);
+    while(packetRing.Pop(reading))  {
+    }
+
+    const NodeState *node = receiver.Nodes().Find(NODE_ID);
+    WakeTrace::Describe(node->lastTrace, text, sizeof(text));
+    printf("trace: base has %u trace(s), %u wake(s) left for the next one, last %s\n",
+           (unsigned)node->traces, (unsigned)state.wakes, text);
+    CHECK(node->traces == 1);
+    CHECK(state.wakes == 0);
+    CHECK(node->lastTrace.wakes == SIM_TRACE_WAKES);
+    CHECK(node->lastTrace.retries > 0);
+}
+
+void RunReadingLog()    {
+
+    static uint8_t flashMemory[SIM_LOG_SECTORS * SIM_LOG_SECTOR_SIZE];
+    uint32_t eraseCounts[SIM_LOG_SECTORS] = {};
+    TornFlashStore flash(flashMemory, sizeof(flashMemory), SIM_LOG_SECTOR_SIZE, eraseCounts);
+    uint32_t slots = sizeof(flashMemory) / READING_LOG_RECORD_SIZE;
+    PlantPacket readings[DEFAULT_REPLAY_BATCH_SIZE];
+    PlantPacket reading;
+    uint16_t next = 0;
+    bool isInOrder = true;
+
+    // The index goes in rawSoilLevel so replay order can be checked against append order
+    memset(flashMemory, 0xFF, sizeof(flashMemory));
+    memset(&reading, 0, sizeof(reading));
+    strcpy(reading.plantName, "Log");
+    ReadingLog log(flash);
+    bool isBegun = log.Begin();
+    for(; next<SIM_LOG_READINGS; next++)    {
+        reading.rawSoilLevel = next;
+        reading.receivedTime = 1700000000UL + next;
+        (void) log.Append(reading);
+    }
+    uint32_t appended = log.Pending();
+
+    // One paced batch, then nothing until the interval has passed
+    log.SetReplayRate(DEFAULT_REPLAY_BATCH_SIZE, DEFAULT_REPLAY_INTERVAL_MS);
+    uint8_t firstBatch = log.NextReplayBatch(readings, DEFAULT_REPLAY_BATCH_SIZE, 0);
+    for(uint8_t i=0; i<firstBatch; i++) {
+        isInOrder = isInOrder && readings[i].rawSoilLevel == i && readings[i].receivedTime == 1700000000UL + i;
+    }
+    log.MarkDelivered(firstBatch);
+    uint8_t earlyBatch = log.NextReplayBatch(readings, DEFAULT_REPLAY_BATCH_SIZE, DEFAULT_REPLAY_INTERVAL_MS - 1);
+    uint8_t dueBatch = log.NextReplayBatch(readings, DEFAULT_REPLAY_BATCH_SIZE, DEFAULT_REPLAY_INTERVAL_MS);
+    bool isDueInOrder = dueBatch > 0 && readings[0].rawSoilLevel == firstBatch;
+
+    // Power fails while the next reading is written, then the station reboots
+    reading.rawSoilLevel = next;
+    flash.isTearing = true;
+    bool isTornAppended = log.Append(reading);
+    flash.isTearing = false;
+    ReadingLog recovered(flash);
+    bool isRecovered = recovered.Begin();
+    uint32_t recoveredPending = recovered.Pending();
+    uint8_t oldest = recovered.Peek(readings, 1);
+    bool isOldestKept = oldest == 1 && readings[0].rawSoilLevel == firstBatch;
+
+    // Keep appending across the torn slot until the log laps the undelivered readings
+    for(next++; next<SIM_LOG_READINGS + 1 + 2 * slots; next++)  {
+        reading.rawSoilLevel = next;
+        (void) recovered.Append(reading);
+    }
+    uint16_t newest = next - 1;
+    uint32_t pending = recovered.Pending();
+    uint16_t expected = newest - pending + 1;
+    while(recovered.Pending() > 0)  {
+        uint8_t count = recovered.Peek(readings, DEFAULT_REPLAY_BATCH_SIZE);
+        for(uint8_t i=0; i<count; i++)  {
+            isInOrder = isInOrder && readings[i].rawSoilLevel == expected++;
+        }
+        if(count == 0)  {
+            break;
+        }
+        recovered.MarkDelivered(count);
+    }
+    uint32_t minErases = eraseCounts[0];
+    uint32_t maxErases = eraseCounts[0];
+    for(uint8_t s=1; s<SIM_LOG_SECTORS; s++)    {
+        minErases = eraseCounts[s] < minErases ? eraseCounts[s] : minErases;
+        maxErases = eraseCounts[s] > maxErases ? eraseCounts[s] : maxErases;
+    }
+
+    printf("reading log: %u appended, torn write %s, %u pending after reboot, %u dropped on wrap, %u replayed, erases %u to %u per sector\n",
+           (unsigned)appended, isTornAppended ? "committed" : "lost", (unsigned)recoveredPending, (unsigned)recovered.stats.dropped,
+           (unsigned)recovered.stats.replayed, (unsigned)minErases, (unsigned)maxErases);
+    CHECK(isBegun && appended == SIM_LOG_READINGS);
+    CHECK(firstBatch == DEFAULT_REPLAY_BATCH_SIZE && earlyBatch == 0 && isDueInOrder);
+    CHECK(!isTornAppended);
+    CHECK(isRecovered && recoveredPending == SIM_LOG_READINGS - firstBatch + 0U && isOldestKept);
+    CHECK(recovered.stats.corrupt == 0);
+    // A full log only gives up the sector it is rewriting
+    CHECK(pending > slots - slots / SIM_LOG_SECTORS && pending < slots);
+    CHECK(recovered.stats.dropped > 0 && recovered.stats.dropped + recovered.stats.replayed == recoveredPending + recovered.stats.appended);
+    CHECK(expected == newest + 1 && isInOrder);
+    CHECK(maxErases - minErases <= 1 && maxErases > 0);
+}
+
+void RunMetrics()   {
+
+    static StationMetrics station;
+    static char page[STATION_METRICS_PAGE_LENGTH];
+    const int16_t codes[METRICS_CODES + 1] = {200, 201, 400, 404, 500, 503, -1, SIM_HTTP_READ_TIMEOUT, -4};
+    uint32_t now = HalMillis();
+
+    // The page the base station serves at boot, before anything has been counted
+    MetricsWriter boot(page, sizeof(page));
+    station.Write(boot, now, UINT32_MAX, UINT32_MAX);
+    uint16_t bootLength = boot.Length();
+
+    // Every fifth upload times out, the rest take longer as the server gets busier
+    for(uint8_t i=0; i<SIM_UPLOADS; i++) {
+        bool isTimeout = i % 5 == 4;
+        station.uploads.Add(isTimeout ? SIM_HTTP_READ_TIMEOUT : 200);
+        station.uploadLatency.Observe(isTimeout ? 5000 : 40 + i * 50);
+    }
+    station.packets.Set(receiver.Stats().packets);
+    MetricsWriter writer(page, sizeof(page));
+    station.Write(writer, now, UINT32_MAX, UINT32_MAX);
+    const char *line = strstr(page, "soil_upload_latency_ms_bucket{le=\"1000\"}");
+    printf("metrics: %u byte page at boot, %u after %u uploads with %u codes, %.*s\n", (unsigned)bootLength, (unsigned)writer.Length(),
+           SIM_UPLOADS, (unsigned)station.uploads.Count(), line != NULL ? (int)strcspn(line, "\n") : 0, line != NULL ? line : "");
+    CHECK(bootLength > 0);
+    CHECK(writer.Length() > 0);
+    CHECK(station.uploads.Count() == 2);
+    CHECK(strstr(page, "soil_upload_latency_ms_bucket{le=\"1000\"} 16\n") != NULL);
+
+    // The longest the page can get: every code slot taken, every total at 10 digits and every histogram
+    // bucket used. Histogram counts only reach 10 digits after billions of observations, which the
+    // headroom left below covers
+    for(uint8_t i=0; i<sizeof(codes) / sizeof(codes[0]); i++)   {
+        station.uploads.Add(codes[i]);
+    }
+    MetricsCounter *totals[] = {&station.interrupts, &station.packets, &station.parseFailures, &station.duplicates,
+                                &station.burstReadings, &station.traces, &station.ringDrops, &station.ringDepth,
+                                &station.ringHighWater, &station.nodes, &station.readingsFlushed, &station.queueDepth,
+                                &station.logPending, &station.wifiReconnects, &station.wifiReconnectFailures, &station.scrapes};
+    for(MetricsCounter *total : totals) {
+        total->Set(UINT32_MAX);
+    }
+    MetricsHistogram *histograms[] = {&station.receiveBusy, &station.uploadLatency, &station.batchAge, &station.uploadBusy};
+    for(MetricsHistogram *histogram : histograms)   {
+        for(uint8_t i=0; i<=histogram->BoundCount(); i++)  {
+            histogram->Observe(i < histogram->BoundCount() ? histogram->Bound(i) : UINT32_MAX);
+        }
+    }
+    MetricsWriter full(page, sizeof(page));
+    station.Write(full, UINT32_MAX, UINT32_MAX, UINT32_MAX);
+    uint16_t histogramLines = 0;
+    for(const char *at = strstr(page, "_bucket{"); at != NULL; at = strstr(at + 1, "_bucket{"))  {
+        histogramLines++;
+    }
+
+    // The same writer on a buffer too small must serve nothing rather than a cut off page
+    char small[64];
+    MetricsWriter tooSmall(small, sizeof(small));
+    station.Write(tooSmall, now, 0, 0);
+
+    printf("metrics: %u byte page with every counter full, %u histogram lines, %u of %u bytes spare, overflow length %u\n",
+           (unsigned)full.Length(), (unsigned)histogramLines, (unsigned)(sizeof(page) - full.Length()), (unsigned)sizeof(page),
+           (unsigned)tooSmall.Length());
+    CHECK(full.Length() > 0);
+    CHECK(full.Length() + histogramLines * 9U < sizeof(page));
+    CHECK(tooSmall.Length() == 0);
+}
+
+void RunHistory()   {
+
+    static ReadingHistoryBlock blocks[SIM_HISTORY_BLOCKS];
+    static ReadingHistorySeries plants[SIM_HISTORY_PLANTS];
+    static uint8_t flashMemory[SIM_HISTORY_SPILL_SIZE];
+    static ReadingHistorySample expected[SIM_HISTORY_DAYS * 86400 / SIM_HISTORY_STEP_S];
+    ReadingHistorySample page[SIM_HISTORY_PAGE];
+    ReadingHistorySample held[SIM_HISTORY_PLANTS][SIM_HISTORY_SEND_EVERY];
+    ReadingHistoryBucket buckets[SIM_HISTORY_POINTS];
+    ReadingHistorySummary summary;
+    RamFlashStore flash(flashMemory, sizeof(flashMemory), SIM_HISTORY_SECTOR_SIZE, NULL);
+    ReadingHistory history(blocks, SIM_HISTORY_BLOCKS, plants, SIM_HISTORY_PLANTS);
+    uint8_t percent[SIM_HISTORY_PLANTS];
+    uint32_t seed = 1;
+    uint32_t start = 1700000000UL;
+    uint32_t steps = sizeof(expected) / sizeof(expected[0]);
+    char name[PLANT_NAME_LENGTH];
+
+    memset(flashMemory, 0xFF, sizeof(flashMemory));
+    (void) history.BeginSpill(flash);
+
+    // Each plant dries a percent every few hours until it is watered back up, and its sensor reads a little
+    // noisy. Wakes drift off the half hour by up to two minutes
+    for(uint8_t p=0; p<SIM_HISTORY_PLANTS; p++) {
+        percent[p] = 90 - p * 3;
+    }
+    for(uint32_t step=0; step<steps; step++)    {
+        for(uint8_t p=0; p<SIM_HISTORY_PLANTS; p++) {
+            seed = seed * 1103515245 + 12345;
+            if((seed >> 16) % 6 == 0)   {
+                percent[p] = percent[p] <= 30 ? 95 : percent[p] - 1;
+            }
+            ReadingHistorySample &sample = held[p][step % SIM_HISTORY_SEND_EVERY];
+            sample.time = start + step * SIM_HISTORY_STEP_S + p * 7 + (seed >> 8) % 120;
+            sample.percentSoilLevel = percent[p];
+            sample.rawSoilLevel = DEFAULT_MIN_MOISTURE - percent[p] * (DEFAULT_MIN_MOISTURE - DEFAULT_MAX_MOISTURE) / 100
+                                + (seed >> 20) % 7 - 3;
+            if(p == 0)  {
+                expected[step] = sample;
+            }
+
+            // Sensors hold their readings and send the newest as a reading packet, then the older ones as a burst
+            uint8_t gathered = step % SIM_HISTORY_SEND_EVERY + 1;
+            if(gathered < SIM_HISTORY_SEND_EVERY && step < steps - 1)   {
+                continue;
+            }
+            snprintf(name, sizeof(name), "plant %u", (unsigned)p);
+            history.Add(name, sample.time, sample.percentSoilLevel, sample.rawSoilLevel);
+            for(uint8_t i=0; i+1<gathered; i++) {
+                history.Add(name, held[p][i].time, held[p][i].percentSoilLevel, held[p][i].rawSoilLevel);
+            }
+        }
+    }
+
+    // Read plant 0 back a page at a time, as the HTTP API does, and line it up with the end of what went in
+    // The oldest readings are the ones evicted, so what is left should be the tail of what went in
+    uint32_t kept = 0;
+    uint32_t mismatches = 0;
+    uint32_t offset = 0;
+    uint32_t backwards = 0;
+    uint32_t previous = 0;
+    ReadingHistoryCursor cursor = {};
+    for(;;) {
+        uint16_t count = history.Query("plant 0", 0, UINT32_MAX, page, SIM_HISTORY_PAGE, cursor);
+        for(uint16_t i=0; i<count; i++) {
+            backwards += page[i].time < previous;
+            previous = page[i].time;
+            while(kept == 0 && offset < steps - 1 && expected[offset].time != page[i].time)   {
+                offset++;
+            }
+            const ReadingHistorySample &want = expected[(offset + kept) % steps];
+            if(offset + kept >= steps || page[i].time != want.time || page[i].percentSoilLevel != want.percentSoilLevel
+               || page[i].rawSoilLevel != want.rawSoilLevel)  {
+                mismatches++;
+            }
+            kept++;
+        }
+        if(count < SIM_HISTORY_PAGE)    {
+            break;
+        }
+    }
+
+    (void) history.Summarize(0, summary);
+    double ramDays = (summary.lastTime - summary.firstTime) / 86400.0;
+    double bytesPerReading = (double)history.stats.bytes / history.stats.samples;
+    double bytesPerDay = summary.blocks * sizeof(ReadingHistoryBlock) / ramDays;
+    double totalDays = (expected[steps - 1].time - expected[offset].time) / 86400.0;
+    uint32_t viewSamples = history.Downsample("plant 0", expected[steps - 1].time - 86400 + 1, 3600, buckets, SIM_HISTORY_POINTS);
+
+    printf("history: %.1f bytes per reading encoded, %u byte blocks, %.0f bytes of RAM per plant per day, %.1f days of %u plants in %u bytes, %.1f days with the flash spill\n",
+           bytesPerReading, (unsigned)sizeof(ReadingHistoryBlock), bytesPerDay, ramDays, SIM_HISTORY_PLANTS, (unsigned)sizeof(blocks), totalDays);
+    printf("history: %lu of the last %lu readings of plant 0 read back, %lu wrong, %lu out of time order, last day in %u hourly points from %u readings, %u%% to %u%% in the last hour\n",
+           (unsigned long)kept, (unsigned long)(steps - offset), (unsigned long)mismatches, (unsigned long)backwards, SIM_HISTORY_POINTS,
+           (unsigned)viewSamples, buckets[SIM_HISTORY_POINTS - 1].minPercent, buckets[SIM_HISTORY_POINTS - 1].maxPercent);
+
+    // Sent newest first, the readings still pack as densely as the README says and come back in time order
+    CHECK(bytesPerReading < 4.6);
+    CHECK(bytesPerDay < 260);
+    CHECK(ramDays > 8.5);
+    CHECK(backwards == 0);
+    CHECK(mismatches == 0);
+    CHECK(kept == steps - offset);
+    CHECK(totalDays > ramDays);
+    CHECK(viewSamples == 86400 / SIM_HISTORY_STEP_S);
+
+    // A planned restart flushes RAM to the spill, so the newest reading is still there after the reboot
+    static ReadingHistoryBlock rebootBlocks[SIM_HISTORY_BLOCKS];
+    static ReadingHistorySeries rebootPlants[SIM_HISTORY_PLANTS];
+    ReadingHistory rebooted(rebootBlocks, SIM_HISTORY_BLOCKS, rebootPlants, SIM_HISTORY_PLANTS);
+    ReadingHistorySample newest = {};
+    uint32_t restored = 0;
+    bool isFlushed = history.Flush();
+    (void) rebooted.BeginSpill(flash);
+    cursor = {};
+    for(uint16_t count=SIM_HISTORY_PAGE; count == SIM_HISTORY_PAGE; )   {
+        count = rebooted.Query("plant 0", 0, UINT32_MAX, page, SIM_HISTORY_PAGE, cursor);
+        if(count > 0)   {
+            newest = page[count - 1];
+        }
+        restored += count;
+    }
+    printf("history: flushed before a restart, %lu readings of plant 0 back after it, newest %s\n",
+           (unsigned long)restored, newest.time == expected[steps - 1].time ? "kept" : "lost");
+    CHECK(isFlushed);
+    CHECK(restored > 0);
+    CHECK(newest.time == expected[steps - 1].time && newest.percentSoilLevel == expected[steps - 1].percentSoilLevel);
+}
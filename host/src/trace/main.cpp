@@ -0,0 +1,240 @@
+/*
+ *  Wake trace decoder
+ *  Reads sensor serial logs and turns the wake trace summaries in them into
+ *  a per-node breakdown of where the awake time went. Arduino sensors log each
+ *  trace frame as it is sent, ESP sensors log the request body it rides in.
+ *  Only summaries that were delivered are counted, a failed one is resent later
+ *
+ *  pio run -e tracedecode -t exec -a "node1.log node2.log"
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PlantPacket.h"
+#include "WakeTrace.h"
+
+#define TRACE_MAX_NODES         (256)
+#define TRACE_LINE_LENGTH       (2048)                                                      // Longer than an UPLINK_BODY_LENGTH body and its label
+#define TRACE_NAME_LENGTH       (PLANT_NAME_LENGTH + 1)
+#define FRAME_LABEL             "Buffer contents: "
+#define BODY_LABEL              "Database request data: "
+
+struct NodeBreakdown {
+    char name[TRACE_NAME_LENGTH];                                                           //  "node N" for radio sensors, the plant name for ESP sensors
+    uint32_t summaries;
+    uint32_t wakes;
+    uint32_t retries;
+    uint64_t awakeMs;
+    uint64_t phaseMs[WAKE_TRACE_PHASES];
+};
+
+static NodeBreakdown nodes[TRACE_MAX_NODES];
+static uint16_t nodeCount = 0;
+static uint32_t droppedSummaries = 0;
+
+// A summary waits for the log to say whether it was delivered
+static bool isPending = false;
+static char pendingName[TRACE_NAME_LENGTH];
+static PlantPacketTrace pendingTrace;
+
+static NodeBreakdown *FindNode(const char *name)   {
+
+    for(uint16_t i=0; i<nodeCount; i++) {
+        if(strcmp(nodes[i].name, name) == 0)    {
+            return &nodes[i];
+        }
+    }
+    if(nodeCount == TRACE_MAX_NODES)    {
+        return NULL;
+    }
+    NodeBreakdown *node = &nodes[nodeCount++];
+    memset(node, 0, sizeof(NodeBreakdown));
+    snprintf(node->name, sizeof(node->name), "%s", name);
+    return node;
+}
+
+static void Commit()    {
+
+    NodeBreakdown *node = isPending ? FindNode(pendingName) : NULL;
+
+    isPending = false;
+    if(node == NULL)    {
+        return;
+    }
+    node->summaries++;
+    node->wakes += pendingTrace.wakes;
+    node->retries += pendingTrace.retries;
+    node->awakeMs += pendingTrace.awakeMs;
+    for(uint8_t i=0; i<WAKE_TRACE_PHASES; i++)  {
+        node->phaseMs[i] += pendingTrace.phaseMs[i];
+    }
+}
+
+static void Drop()  {
+
+    if(isPending)   {
+        droppedSummaries++;
+    }
+    isPending = false;
+}
+
+// Arduino sensors print each frame as space separated hex bytes before writing it
+static void ParseFrame(const char *text)   {
+
+    uint8_t frame[PLANT_PACKET_LENGTH];
+    uint8_t length = 0;
+    char *end;
+    uint16_t nodeId;
+
+    for(unsigned long value = strtoul(text, &end, 16); end != text && length < PLANT_PACKET_LENGTH;
+        value = strtoul(text, &end, 16))  {
+        frame[length++] = (uint8_t)value;
+        text = end;
+    }
+
+    // Readings and bursts are logged the same way, only trace frames are kept
+    if(PlantPacket::ParseTracePacket(frame, length, nodeId, pendingTrace))  {
+        snprintf(pendingName, sizeof(pendingName), "node %u", (unsigned)nodeId);
+        isPending = true;
+    }
+}
+
+static const char *FindField(const char *body, const char *name)  {
+
+    const char *field = strstr(body, name);
+    return field != NULL ? field + strlen(name) : NULL;
+}
+
+// ESP sensors print the form body, the summary follows the readings as wakes=&awake_ms=&retries=&phase_ms[]=
+static void ParseBody(const char *body)   {
+
+    const char *wakes = FindField(body, "&wakes=");
+    const char *awake = FindField(body, "&awake_ms=");
+    const char *retries = FindField(body, "&retries=");
+    const char *name = FindField(body, "plantname[]=");
+    const char *phase = awake;
+
+    if(wakes == NULL || awake == NULL || retries == NULL || name == NULL)  {
+        return;
+    }
+
+    pendingTrace.wakes = (uint8_t)strtoul(wakes, NULL, 10);
+    pendingTrace.awakeMs = (uint16_t)strtoul(awake, NULL, 10);
+    pendingTrace.retries = (uint8_t)strtoul(retries, NULL, 10);
+    for(uint8_t i=0; i<WAKE_TRACE_PHASES; i++)  {
+        phase = phase != NULL ? FindField(phase, "&phase_ms[]=") : NULL;
+        pendingTrace.phaseMs[i] = phase != NULL ? (uint16_t)strtoul(phase, NULL, 10) : 0;
+    }
+
+    // Names are form encoded, undo the escaping so they match what the sensor was built with
+    uint8_t length = 0;
+    for(; *name != '\0' && *name != '&' && length < TRACE_NAME_LENGTH - 1; name++)   {
+        if(*name == '%' && name[1] != '\0' && name[2] != '\0')  {
+            char hex[3] = {name[1], name[2], '\0'};
+            pendingName[length++] = (char)strtoul(hex, NULL, 16);
+            name += 2;
+        }
+        else    {
+            pendingName[length++] = *name == '+' ? ' ' : *name;
+        }
+    }
+    pendingName[length] = '\0';
+    isPending = true;
+}
+
+static void ParseLine(const char *line)    {
+
+    const char *found;
+
+    if((found = strstr(line, FRAME_LABEL)) != NULL) {
+        Drop();
+        ParseFrame(found + strlen(FRAME_LABEL));
+    }
+    else if((found = strstr(line, BODY_LABEL)) != NULL) {
+        Drop();
+        ParseBody(found + strlen(BODY_LABEL));
+    }
+    else if(strstr(line, "Transmission successful") != NULL || strstr(line, "Database updated successfully") != NULL)  {
+        Commit();
+    }
+    else if((found = strstr(line, "Unknown database update result, http response code: ")) != NULL)  {
+        // The ESP sensor keeps its readings and summary for anything but a server error
+        if(atoi(strchr(found, ':') + 1) < 500)    {
+            Commit();
+        }
+        else    {
+            Drop();
+        }
+    }
+    else if(strstr(line, "Transmission failed") != NULL || strstr(line, "Database update failed") != NULL)  {
+        Drop();
+    }
+}
+
+static void PrintNode(const NodeBreakdown &node)  {
+
+    uint32_t wakes = node.wakes > 0 ? node.wakes : 1;
+    uint64_t awake = node.awakeMs > 0 ? node.awakeMs : 1;
+    uint64_t traced = 0;
+
+    printf("%s: %u summaries, %u wakes, %.1fms awake per wake, %.2f retries per wake\n", node.name,
+           (unsigned)node.summaries, (unsigned)node.wakes, (double)node.awakeMs / wakes, (double)node.retries / wakes);
+    for(uint8_t i=0; i<WAKE_TRACE_PHASES; i++)  {
+        traced += node.phaseMs[i];
+        if(node.phaseMs[i] > 0) {
+            printf("    %-10s %8.1fms per wake %5.1f%%\n", WakeTrace::PhaseName(i),
+                   (double)node.phaseMs[i] / wakes, 100.0 * node.phaseMs[i] / awake);
+        }
+    }
+    uint64_t untraced = traced < node.awakeMs ? node.awakeMs - traced : 0;
+    printf("    %-10s %8.1fms per wake %5.1f%%\n", "untraced", (double)untraced / wakes, 100.0 * untraced / awake);
+}
+
+static bool DecodeFile(FILE *file)   {
+
+    static char line[TRACE_LINE_LENGTH];
+
+    // A summary still waiting at the end of a log was never confirmed either way
+    while(fgets(line, sizeof(line), file) != NULL)  {
+        ParseLine(line);
+    }
+    Drop();
+    return !ferror(file);
+}
+
+int main(int argc, char **argv) {
+
+    NodeBreakdown fleet;
+
+    // Logs are read from stdin when none are named
+    if(argc < 2 && !DecodeFile(stdin))  {
+        return 1;
+    }
+    for(int i=1; i<argc; i++)   {
+        FILE *file = fopen(argv[i], "r");
+        if(file == NULL || !DecodeFile(file))   {
+            fprintf(stderr, "tracedecode: cannot read %s\n", argv[i]);
+            return 1;
+        }
+        fclose(file);
+    }
+
+    memset(&fleet, 0, sizeof(fleet));
+    snprintf(fleet.name, sizeof(fleet.name), "all nodes");
+    for(uint16_t i=0; i<nodeCount; i++) {
+        PrintNode(nodes[i]);
+        fleet.summaries += nodes[i].summaries;
+        fleet.wakes += nodes[i].wakes;
+        fleet.retries += nodes[i].retries;
+        fleet.awakeMs += nodes[i].awakeMs;
+        for(uint8_t phase=0; phase<WAKE_TRACE_PHASES; phase++)  {
+            fleet.phaseMs[phase] += nodes[i].phaseMs[phase];
+        }
+    }
+    if(nodeCount > 1)   {
+        PrintNode(fleet);
+    }
+    printf("%u nodes, %u summaries not delivered and left out\n", nodeCount, (unsigned)droppedSummaries);
+    return 0;
+}
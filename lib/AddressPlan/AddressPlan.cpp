@@ -0,0 +1,66 @@
+/*
+ *  AddressPlan library to give each nRF24 reading pipe an address
+ *  and spread sensor nodes across the six pipes
+ */
+
+#include <string.h>
+#include "AddressPlan.h"
+
+// "base" followed by a null, the address every sensor used before there was more than one pipe
+static const uint8_t defaultPrefix[ADDRESS_PREFIX_WIDTH] = {'a', 's', 'e', '\0'};
+static const uint8_t defaultFirstBytes[ADDRESS_PLAN_PIPES] = {'c', 'b', 'd', 'f', 'g', 'h'};
+
+AddressPlan::AddressPlan()  {
+
+    memcpy(prefix, defaultPrefix, ADDRESS_PREFIX_WIDTH);
+    memcpy(firstBytes, defaultFirstBytes, ADDRESS_PLAN_PIPES);
+}
+
+AddressPlan::AddressPlan(const uint8_t *addressPrefix, const uint8_t *pipeFirstBytes)   {
+
+    memcpy(prefix, addressPrefix, ADDRESS_PREFIX_WIDTH);
+    memcpy(firstBytes, pipeFirstBytes, ADDRESS_PLAN_PIPES);
+}
+
+bool AddressPlan::IsValid() {
+
+    for(uint8_t i=0; i<ADDRESS_PLAN_PIPES; i++) {
+        // Alternating bits right after the preamble, or a flat level, make false address matches likely
+        if(firstBytes[i] == 0x00 || firstBytes[i] == 0xFF || firstBytes[i] == 0x55 || firstBytes[i] == 0xAA)  {
+            return false;
+        }
+        for(uint8_t j=i+1; j<ADDRESS_PLAN_PIPES; j++)   {
+            if(firstBytes[i] == firstBytes[j])  {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+uint8_t AddressPlan::PipeForNode(uint16_t nodeId)   {
+
+    // Node ids are handed out in order, so the remainder spreads them evenly over the pipes left
+    // once the legacy pipe is skipped
+    if(nodeId == 0) {
+        return ADDRESS_PLAN_LEGACY_PIPE;
+    }
+    uint8_t pipe = nodeId % ADDRESS_PLAN_NODE_PIPES;
+    return pipe < ADDRESS_PLAN_LEGACY_PIPE ? pipe : pipe + 1;
+}
+
+void AddressPlan::AddressForPipe(uint8_t pipe, uint8_t *address)    {
+
+    address[0] = firstBytes[pipe < ADDRESS_PLAN_PIPES ? pipe : ADDRESS_PLAN_LEGACY_PIPE];
+    memcpy(&address[1], prefix, ADDRESS_PREFIX_WIDTH);
+}
+
+void AddressPlan::AddressForNode(uint16_t nodeId, uint8_t *address) {
+
+    AddressForPipe(PipeForNode(nodeId), address);
+}
+
+void AddressPlan::AddressForBeacon(uint8_t *address)    {
+
+    AddressForPipe(ADDRESS_PLAN_BEACON_PIPE, address);
+}
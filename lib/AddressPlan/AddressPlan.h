@@ -0,0 +1,35 @@
+/*
+ *  AddressPlan library to give each nRF24 reading pipe an address
+ *  and spread sensor nodes across the six pipes
+ */
+
+#ifndef ADDRESSPLAN_H
+#define ADDRESSPLAN_H
+
+#define ADDRESS_PLAN_PIPES                  (6)                                             // Reading pipes on the nRF24
+#define ADDRESS_WIDTH                       (5)
+#define ADDRESS_PREFIX_WIDTH                (ADDRESS_WIDTH - 1)                             // Pipes 2-5 share every byte but the first with pipe 1
+#define ADDRESS_PLAN_LEGACY_PIPE            (1)                                             // Keeps the original "base" address so unmigrated nodes are still heard
+#define ADDRESS_PLAN_NODE_PIPES             (ADDRESS_PLAN_PIPES - 1)                        // Every pipe but the legacy one, which stays at the legacy static payload width
+#define ADDRESS_PLAN_DISCOVERY_CHANNEL      (76)                                            // RF24 default channel, the base station beacons its channel here for lost sensors
+#define ADDRESS_PLAN_BEACON_PIPE            (0)                                             // Beacons are sent to this pipe's address
+
+#include <stdint.h>
+
+class AddressPlan   {
+    public:
+        AddressPlan();                                                                      //  "base" on pipe 1, the other pipes differ in the first byte
+        AddressPlan(const uint8_t *prefix,                                                  //  ADDRESS_PREFIX_WIDTH bytes shared by every pipe
+                    const uint8_t *firstBytes);                                             //  One first byte per pipe
+        bool IsValid();                                                                     //  First bytes are distinct and none look like the preamble
+        uint8_t PipeForNode(uint16_t nodeId);                                               //  Node 0, an unknown or legacy node, always gets the legacy pipe and no other node does
+        void AddressForPipe(uint8_t pipe, uint8_t *address);                                //  ADDRESS_WIDTH bytes, first byte first as RF24 expects
+        void AddressForNode(uint16_t nodeId, uint8_t *address);                             //  Address a sensor writes to
+        void AddressForBeacon(uint8_t *address);                                            //  Address a lost sensor listens on for beacons
+
+    private:
+        uint8_t prefix[ADDRESS_PREFIX_WIDTH];
+        uint8_t firstBytes[ADDRESS_PLAN_PIPES];
+};
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ *  ChannelSurvey library to score nRF24 channels from carrier
+ *  detect samples and pick the quietest one clear of WiFi
+ */
+
+#include <string.h>
+#include "ChannelSurvey.h"
+
+ChannelSurvey::ChannelSurvey()  {
+
+    Reset();
+}
+
+void ChannelSurvey::Reset() {
+
+    memset(busy, 0, sizeof(busy));
+    memset(samples, 0, sizeof(samples));
+}
+
+void ChannelSurvey::AddSample(uint8_t channel, bool isBusy) {
+
+    if(channel >= CHANNEL_SURVEY_COUNT || samples[channel] == UINT16_MAX) {
+        return;
+    }
+    samples[channel]++;
+    if(isBusy)  {
+        busy[channel]++;
+    }
+}
+
+uint16_t ChannelSurvey::Score(uint8_t channel)  {
+
+    // A 250kbps signal is about 1 MHz wide, so a busy neighbour still costs some retries
+    uint32_t score = 2 * BusyPerMille(channel);
+    uint8_t weight = 2;
+    if(channel > 0 && samples[channel - 1] > 0) {
+        score += BusyPerMille(channel - 1);
+        weight++;
+    }
+    if(channel + 1 < CHANNEL_SURVEY_COUNT && samples[channel + 1] > 0)  {
+        score += BusyPerMille(channel + 1);
+        weight++;
+    }
+    return score / weight;
+}
+
+uint8_t ChannelSurvey::PickChannel(uint8_t wifiChannel, uint8_t currentChannel) {
+
+    uint8_t best = 0;
+    uint16_t bestScore = UINT16_MAX;
+
+    for(uint8_t channel=CHANNEL_SURVEY_LOWEST; channel<=CHANNEL_SURVEY_HIGHEST; channel++)  {
+        if(samples[channel] == 0 || OverlapsWifi(channel, wifiChannel))  {
+            continue;
+        }
+        uint16_t score = Score(channel);
+        if(score < bestScore)   {
+            best = channel;
+            bestScore = score;
+        }
+    }
+
+    // Every move strands sensors until they hear a beacon, so only move for a clear gain
+    if(best == 0)   {
+        return currentChannel;
+    }
+    if(currentChannel >= CHANNEL_SURVEY_LOWEST && currentChannel <= CHANNEL_SURVEY_HIGHEST
+       && !OverlapsWifi(currentChannel, wifiChannel) && Score(currentChannel) <= bestScore + CHANNEL_SWITCH_MARGIN)  {
+        return currentChannel;
+    }
+    return best;
+}
+
+bool ChannelSurvey::OverlapsWifi(uint8_t channel, uint8_t wifiChannel)  {
+
+    if(wifiChannel == 0)    {
+        return false;
+    }
+
+    // WiFi channels 1-13 are centred on 2407 + 5n MHz, channel 14 on 2484 MHz. nRF24 channel n is 2400 + n MHz
+    int16_t centre = wifiChannel == 14 ? 84 : 7 + 5 * wifiChannel;
+    int16_t offset = (int16_t)channel - centre;
+    return offset >= -CHANNEL_WIFI_HALF_WIDTH_MHZ && offset <= CHANNEL_WIFI_HALF_WIDTH_MHZ;
+}
+
+uint16_t ChannelSurvey::BusyPerMille(uint8_t channel)   {
+
+    return samples[channel] > 0 ? (uint32_t)busy[channel] * 1000 / samples[channel] : 0;
+}
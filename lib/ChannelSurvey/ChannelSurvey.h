@@ -0,0 +1,33 @@
+/*
+ *  ChannelSurvey library to score nRF24 channels from carrier
+ *  detect samples and pick the quietest one clear of WiFi
+ */
+
+#ifndef CHANNELSURVEY_H
+#define CHANNELSURVEY_H
+
+#define CHANNEL_SURVEY_LOWEST               (1)                                             // 2401 MHz
+#define CHANNEL_SURVEY_HIGHEST              (83)                                            // 2483 MHz, the top of the 2.4 GHz ISM band
+#define CHANNEL_SURVEY_COUNT                (CHANNEL_SURVEY_HIGHEST + 1)
+#define CHANNEL_WIFI_HALF_WIDTH_MHZ         (12)                                            // Half of a 22 MHz WiFi channel plus 1 MHz of guard
+#define CHANNEL_SWITCH_MARGIN               (50)                                            // Per mille a new channel must beat the current one by
+
+#include <stdint.h>
+
+class ChannelSurvey {
+    public:
+        ChannelSurvey();
+        void Reset();
+        void AddSample(uint8_t channel, bool isBusy);                                       //  One carrier detect reading on a channel
+        uint16_t Score(uint8_t channel);                                                    //  Busy samples per mille, counting half of each neighbour. Lower is quieter
+        uint8_t PickChannel(uint8_t wifiChannel,                                            //  Quietest sampled channel clear of the WiFi channel, 0 if WiFi is down.
+                            uint8_t currentChannel);                                        //  The current channel is kept unless beaten by CHANNEL_SWITCH_MARGIN
+        static bool OverlapsWifi(uint8_t channel, uint8_t wifiChannel);
+
+    private:
+        uint16_t BusyPerMille(uint8_t channel);
+        uint16_t busy[CHANNEL_SURVEY_COUNT];
+        uint16_t samples[CHANNEL_SURVEY_COUNT];
+};
+
+#endif
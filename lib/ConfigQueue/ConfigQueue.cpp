@@ -0,0 +1,93 @@
+/*
+ *  ConfigQueue library to hold settings for sleeping sensors
+ *  until they are delivered in an ack payload and confirmed
+ */
+
+#include <stddef.h>
+#include "ConfigQueue.h"
+
+ConfigQueue::ConfigQueue()  {
+
+    for(uint8_t i=0; i<CONFIG_QUEUE_SIZE; i++)  {
+        entries[i].isUsed = false;
+    }
+    frameBuilder.sequence = 0;
+    stats = {};
+}
+
+bool ConfigQueue::Set(uint16_t nodeId, const PlantPacketConfig &config)   {
+
+    Entry *entry = Find(nodeId);
+
+    // The sensor would refuse it, so it would be sent with every ack and never confirmed
+    if(!PlantPacket::IsConfigValid(config)) {
+        return false;
+    }
+
+    if(entry != NULL)   {
+        // A new version is needed in case the node has already applied the old config
+        if(entry->version != 0) {
+            entry->version = entry->version == UINT8_MAX ? 1 : entry->version + 1;
+        }
+        entry->config = config;
+        stats.replaced++;
+        return true;
+    }
+
+    for(uint8_t i=0; i<CONFIG_QUEUE_SIZE; i++)  {
+        if(!entries[i].isUsed)  {
+            entries[i].nodeId = nodeId;
+            entries[i].version = 0;
+            entries[i].isUsed = true;
+            entries[i].config = config;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t ConfigQueue::OnPacket(uint16_t nodeId, uint8_t configVersion, uint8_t *frame)   {
+
+    Entry *entry = Find(nodeId);
+
+    if(entry == NULL)   {
+        return 0;
+    }
+
+    if(entry->version != 0 && entry->version == configVersion)  {
+        entry->isUsed = false;
+        stats.confirmed++;
+        return 0;
+    }
+
+    // The first packet heard tells us the node's version, the config goes out as the next one up
+    if(entry->version == 0) {
+        entry->version = configVersion == UINT8_MAX ? 1 : configVersion + 1;
+    }
+
+    frameBuilder.nodeId = nodeId;
+    frameBuilder.configVersion = entry->version;
+    stats.framesBuilt++;
+    return frameBuilder.CreateConfigPacket(frame, entry->config);
+}
+
+uint8_t ConfigQueue::Pending()  {
+
+    uint8_t count = 0;
+    for(uint8_t i=0; i<CONFIG_QUEUE_SIZE; i++)  {
+        if(entries[i].isUsed)   {
+            count++;
+        }
+    }
+    return count;
+}
+
+ConfigQueue::Entry *ConfigQueue::Find(uint16_t nodeId)  {
+
+    for(uint8_t i=0; i<CONFIG_QUEUE_SIZE; i++)  {
+        if(entries[i].isUsed && entries[i].nodeId == nodeId)    {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,42 @@
+/*
+ *  ConfigQueue library to hold settings for sleeping sensors
+ *  until they are delivered in an ack payload and confirmed
+ */
+
+#ifndef CONFIGQUEUE_H
+#define CONFIGQUEUE_H
+
+#define CONFIG_QUEUE_SIZE                   (8)                                             // Nodes that can have a config waiting at once
+
+#include <stdint.h>
+#include "PlantPacket.h"
+
+struct ConfigQueueStats {
+    uint32_t framesBuilt;                                                                   //  Config frames handed out to be loaded as ack payloads
+    uint32_t confirmed;                                                                     //  Configs a node reported back as applied
+    uint32_t replaced;                                                                      //  Configs overwritten by Set() before they were confirmed
+};
+
+class ConfigQueue   {
+    public:
+        ConfigQueue();
+        bool Set(uint16_t nodeId, const PlantPacketConfig &config);                         //  Queues a config, replacing one still waiting for the node. False if the queue is full
+                                                                                            //  or the config fails PlantPacket::IsConfigValid()
+        uint8_t OnPacket(uint16_t nodeId, uint8_t configVersion, uint8_t *frame);           //  Called for every v2 packet with the version the node has applied. Drops a confirmed
+                                                                                            //  config, otherwise writes the node's config frame and returns its length, 0 if none
+        uint8_t Pending();
+        ConfigQueueStats stats;
+
+    private:
+        struct Entry {
+            uint16_t nodeId;
+            uint8_t version;                                                                //  0 until the node's current version is known
+            bool isUsed;
+            PlantPacketConfig config;
+        };
+        Entry *Find(uint16_t nodeId);
+        Entry entries[CONFIG_QUEUE_SIZE];
+        PlantPacket frameBuilder;
+};
+
+#endif
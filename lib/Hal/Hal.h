@@ -0,0 +1,38 @@
+/*
+ *  Hal library, thin layer over the pins, ADC and clock so the
+ *  libraries build on a board or on a Linux host
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#define HAL_LOW                             (0)
+#define HAL_HIGH                            (1)
+#define HAL_INPUT                           (0)
+#define HAL_OUTPUT                          (1)
+#define HAL_INPUT_PULLUP                    (2)
+
+#include <stdint.h>
+
+// Board builds forward these to the Arduino core, host builds use the simulation in HalNative.cpp
+void HalPinMode(uint8_t pin, uint8_t mode);
+void HalDigitalWrite(uint8_t pin, uint8_t level);
+uint8_t HalDigitalRead(uint8_t pin);
+uint16_t HalAnalogRead(uint8_t pin);
+uint32_t HalMillis();
+uint32_t HalMicros();
+void HalDelay(uint32_t milliseconds);                                                       //  On a host this only moves the simulated clock
+
+#ifndef ARDUINO
+// Simulation controls, only on host builds. Time starts at zero and only moves when told to so runs repeat exactly
+void HalSimReset();                                                                         //  Clock back to zero, pins low, analog inputs at 0
+void HalSimAdvanceMicros(uint32_t microseconds);                                            //  Stands in for time spent doing work
+void HalSimSetAnalog(uint8_t pin, uint16_t value);
+void HalSimSetDigital(uint8_t pin, uint8_t level);                                          //  Level seen by HalDigitalRead() on an input pin
+uint8_t HalSimPinLevel(uint8_t pin);                                                        //  Level last written by the code under test
+uint32_t HalSimAnalogReads();                                                               //  ADC reads since the last reset
+uint16_t HalSimAnalogReadMicros();                                                          //  Simulated time each ADC read takes
+void HalSimSetAnalogReadMicros(uint16_t microseconds);
+#endif
+
+#endif
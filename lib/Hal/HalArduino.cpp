@@ -0,0 +1,46 @@
+/*
+ *  Hal library, thin layer over the pins, ADC and clock so the
+ *  libraries build on a board or on a Linux host
+ */
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include "Hal.h"
+
+void HalPinMode(uint8_t pin, uint8_t mode)  {
+
+    pinMode(pin, mode == HAL_OUTPUT ? OUTPUT : mode == HAL_INPUT_PULLUP ? INPUT_PULLUP : INPUT);
+}
+
+void HalDigitalWrite(uint8_t pin, uint8_t level)    {
+
+    digitalWrite(pin, level == HAL_HIGH ? HIGH : LOW);
+}
+
+uint8_t HalDigitalRead(uint8_t pin)  {
+
+    return digitalRead(pin) == HIGH ? HAL_HIGH : HAL_LOW;
+}
+
+uint16_t HalAnalogRead(uint8_t pin) {
+
+    return analogRead(pin);
+}
+
+uint32_t HalMillis()    {
+
+    return millis();
+}
+
+uint32_t HalMicros()    {
+
+    return micros();
+}
+
+void HalDelay(uint32_t milliseconds)    {
+
+    delay(milliseconds);
+}
+
+#endif
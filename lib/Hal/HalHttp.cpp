@@ -0,0 +1,29 @@
+/*
+ *  HttpTransport interface for posting to a server, with a
+ *  recording stand-in for host builds
+ */
+
+#include <string.h>
+#include "Hal.h"
+#include "HalHttp.h"
+
+SimHttpTransport::SimHttpTransport()    {
+
+    responseCode = 200;
+    latencyMs = 0;
+    requests = 0;
+    bytesSent = 0;
+    lastBody[0] = '\0';
+}
+
+int SimHttpTransport::POST(const char *url, const char *contentType, const char *body, size_t length)    {
+
+    size_t kept = length < HAL_SIM_HTTP_BODY_LENGTH - 1 ? length : HAL_SIM_HTTP_BODY_LENGTH - 1;
+    memcpy(lastBody, body, kept);
+    lastBody[kept] = '\0';
+
+    requests++;
+    bytesSent += length;
+    HalDelay(latencyMs);
+    return responseCode;
+}
@@ -0,0 +1,35 @@
+/*
+ *  HttpTransport interface for posting to a server, with a
+ *  recording stand-in for host builds
+ */
+
+#ifndef HALHTTP_H
+#define HALHTTP_H
+
+#define HAL_SIM_HTTP_BODY_LENGTH            (1024)                                          // Bytes of the last request kept for inspection
+
+#include <stdint.h>
+#include <stddef.h>
+
+class HttpTransport {
+    public:
+        virtual ~HttpTransport() {}
+        virtual int POST(const char *url,                                                   //  Returns the http response code, or a negative
+                         const char *contentType,                                           //  number if no response was received
+                         const char *body,
+                         size_t length) = 0;
+};
+
+// Answers every request with responseCode after latencyMs of simulated time and keeps the last body
+class SimHttpTransport : public HttpTransport   {
+    public:
+        SimHttpTransport();
+        int POST(const char *url, const char *contentType, const char *body, size_t length) override;
+        int responseCode;
+        uint32_t latencyMs;
+        uint32_t requests;
+        uint32_t bytesSent;
+        char lastBody[HAL_SIM_HTTP_BODY_LENGTH];                                            //  Null terminated, cut short if the body was longer
+};
+
+#endif
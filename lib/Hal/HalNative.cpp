@@ -0,0 +1,120 @@
+/*
+ *  Hal library, thin layer over the pins, ADC and clock so the
+ *  libraries build on a board or on a Linux host
+ */
+
+#ifndef ARDUINO
+
+#include <string.h>
+#include "Hal.h"
+
+#define HAL_SIM_PINS                        (32)
+#define HAL_SIM_ANALOG_READ_MICROS          (112)                                           // 13 ADC clocks at 125kHz, as on a 8MHz AVR with the default prescaler
+
+static uint64_t simMicros = 0;
+static uint8_t pinModes[HAL_SIM_PINS];
+static uint8_t outputLevels[HAL_SIM_PINS];
+static uint8_t inputLevels[HAL_SIM_PINS];
+static uint16_t analogValues[HAL_SIM_PINS];
+static uint32_t analogReads = 0;
+static uint16_t analogReadMicros = HAL_SIM_ANALOG_READ_MICROS;
+
+void HalPinMode(uint8_t pin, uint8_t mode)  {
+
+    if(pin < HAL_SIM_PINS)  {
+        pinModes[pin] = mode;
+        // A pulled up input floats high until something pulls it low
+        if(mode == HAL_INPUT_PULLUP)    {
+            inputLevels[pin] = HAL_HIGH;
+        }
+    }
+}
+
+void HalDigitalWrite(uint8_t pin, uint8_t level)    {
+
+    if(pin < HAL_SIM_PINS)  {
+        outputLevels[pin] = level;
+    }
+}
+
+uint8_t HalDigitalRead(uint8_t pin)  {
+
+    if(pin >= HAL_SIM_PINS)  {
+        return HAL_LOW;
+    }
+    return pinModes[pin] == HAL_OUTPUT ? outputLevels[pin] : inputLevels[pin];
+}
+
+uint16_t HalAnalogRead(uint8_t pin) {
+
+    analogReads++;
+    simMicros += analogReadMicros;
+    return pin < HAL_SIM_PINS ? analogValues[pin] : 0;
+}
+
+uint32_t HalMillis()    {
+
+    return (uint32_t)(simMicros / 1000);
+}
+
+uint32_t HalMicros()    {
+
+    return (uint32_t)simMicros;
+}
+
+void HalDelay(uint32_t milliseconds)    {
+
+    simMicros += (uint64_t)milliseconds * 1000;
+}
+
+void HalSimReset()  {
+
+    simMicros = 0;
+    memset(pinModes, HAL_INPUT, sizeof(pinModes));
+    memset(outputLevels, HAL_LOW, sizeof(outputLevels));
+    memset(inputLevels, HAL_LOW, sizeof(inputLevels));
+    memset(analogValues, 0, sizeof(analogValues));
+    analogReads = 0;
+    analogReadMicros = HAL_SIM_ANALOG_READ_MICROS;
+}
+
+void HalSimAdvanceMicros(uint32_t microseconds)  {
+
+    simMicros += microseconds;
+}
+
+void HalSimSetAnalog(uint8_t pin, uint16_t value)   {
+
+    if(pin < HAL_SIM_PINS)  {
+        analogValues[pin] = value;
+    }
+}
+
+void HalSimSetDigital(uint8_t pin, uint8_t level)   {
+
+    if(pin < HAL_SIM_PINS)  {
+        inputLevels[pin] = level;
+    }
+}
+
+uint8_t HalSimPinLevel(uint8_t pin)  {
+
+    return pin < HAL_SIM_PINS ? outputLevels[pin] : HAL_LOW;
+}
+
+uint32_t HalSimAnalogReads()    {
+
+    return analogReads;
+}
+
+uint16_t HalSimAnalogReadMicros()   {
+
+    return analogReadMicros;
+}
+
+void HalSimSetAnalogReadMicros(uint16_t microseconds)   {
+
+    analogReadMicros = microseconds;
+}
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ *  HalRadio interface for sending payloads, with a simulated
+ *  link for host builds
+ */
+
+#include <string.h>
+#include "Hal.h"
+#include "HalRadio.h"
+
+#define SIM_RADIO_OVERHEAD_BYTES            (8)                                             // Preamble, 5 byte address and 2 byte CRC
+#define SIM_RADIO_PCF_BITS                  (9)                                             // Packet control field
+#define SIM_RADIO_MICROS_PER_BIT            (4)                                             // 250kbps
+
+SimRadio::SimRadio()    {
+
+    head = 0;
+    count = 0;
+    lossInterval = 0;
+    lastRetries = 0;
+    ackLength = 0;
+    receivedAckLength = 0;
+    isPoweredUp = false;
+    writes = 0;
+    lost = 0;
+    poweredUps = 0;
+}
+
+void SimRadio::PowerUp()    {
+
+    if(!isPoweredUp)    {
+        isPoweredUp = true;
+        poweredUps++;
+    }
+}
+
+void SimRadio::PowerDown()  {
+
+    isPoweredUp = false;
+}
+
+bool SimRadio::Write(const void *data, uint8_t length)  {
+
+    if(!isPoweredUp || length > HAL_RADIO_PAYLOAD_LENGTH)    {
+        return false;
+    }
+    writes++;
+    receivedAckLength = 0;
+    lastRetries = 0;
+#ifndef ARDUINO
+    HalSimAdvanceMicros(((SIM_RADIO_OVERHEAD_BYTES + length) * 8 + SIM_RADIO_PCF_BITS) * SIM_RADIO_MICROS_PER_BIT);
+#endif
+
+    if((lossInterval > 0 && writes % lossInterval == 0) || count == HAL_SIM_RADIO_QUEUE)  {
+        lost++;
+        lastRetries = HAL_SIM_RADIO_RETRIES;
+        return false;
+    }
+
+    uint8_t slot = (head + count) % HAL_SIM_RADIO_QUEUE;
+    memcpy(payloads[slot], data, length);
+    lengths[slot] = length;
+    count++;
+
+    if(ackLength > 0)   {
+        memcpy(receivedAck, ackPayload, ackLength);
+        receivedAckLength = ackLength;
+        ackLength = 0;
+    }
+    return true;
+}
+
+uint8_t SimRadio::ReadAckPayload(uint8_t *data, uint8_t length) {
+
+    uint8_t copied = receivedAckLength < length ? receivedAckLength : length;
+    memcpy(data, receivedAck, copied);
+    receivedAckLength = 0;
+    return copied;
+}
+
+uint8_t SimRadio::LastRetries() {
+
+    return lastRetries;
+}
+
+bool SimRadio::LoadAckPayload(const uint8_t *data, uint8_t length)    {
+
+    if(ackLength > 0 || length == 0 || length > HAL_RADIO_PAYLOAD_LENGTH)   {
+        return false;
+    }
+    memcpy(ackPayload, data, length);
+    ackLength = length;
+    return true;
+}
+
+void SimRadio::FlushAckPayload()    {
+
+    ackLength = 0;
+}
+
+void SimRadio::SetLossInterval(uint16_t interval)   {
+
+    lossInterval = interval;
+}
+
+bool SimRadio::Available()  {
+
+    return count > 0;
+}
+
+uint8_t SimRadio::Read(uint8_t *data, uint8_t length)    {
+
+    if(count == 0)  {
+        return 0;
+    }
+
+    uint8_t copied = lengths[head] < length ? lengths[head] : length;
+    memcpy(data, payloads[head], copied);
+    head = (head + 1) % HAL_SIM_RADIO_QUEUE;
+    count--;
+    return copied;
+}
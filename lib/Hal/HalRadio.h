@@ -0,0 +1,60 @@
+/*
+ *  HalRadio interface for sending payloads, with a simulated
+ *  link for host builds
+ */
+
+#ifndef HALRADIO_H
+#define HALRADIO_H
+
+#define HAL_RADIO_PAYLOAD_LENGTH            (32)                                            // Largest nRF24 payload
+#define HAL_SIM_RADIO_QUEUE                 (32)                                            // Payloads in flight before the simulated link drops them
+#define HAL_SIM_RADIO_RETRIES               (15)                                            // Auto retransmits a lost write is given up after
+
+#include <stdint.h>
+
+// Transmit side of a radio, powered down between transmissions
+class HalRadio  {
+    public:
+        virtual ~HalRadio() {}
+        virtual void PowerUp() = 0;
+        virtual void PowerDown() = 0;
+        virtual bool Write(const void *data, uint8_t length) = 0;                           //  True once the receiver acknowledged the payload
+        virtual uint8_t ReadAckPayload(uint8_t *data, uint8_t length) = 0;                  //  Payload the receiver sent back with the last ack, 0 if there was none
+        virtual uint8_t LastRetries()   { return 0; }                                       //  Auto retransmits the last Write() took, radios that do not count them leave this as is
+};
+
+// Link to a simulated receiver. Written payloads queue up for Read(), every lossInterval'th write is lost
+// and each write takes the simulated clock forward by its air time at 250kbps. A payload loaded with
+// LoadAckPayload() goes back with the next write that gets through
+class SimRadio : public HalRadio    {
+    public:
+        SimRadio();
+        void PowerUp() override;
+        void PowerDown() override;
+        bool Write(const void *data, uint8_t length) override;
+        uint8_t ReadAckPayload(uint8_t *data, uint8_t length) override;
+        uint8_t LastRetries() override;                                                     //  Every retry on a lost write, none otherwise
+        void SetLossInterval(uint16_t interval);                                            //  0 means no loss
+        bool Available();                                                                   //  Receive side of the link
+        uint8_t Read(uint8_t *data, uint8_t length);
+        bool LoadAckPayload(const uint8_t *data, uint8_t length);                           //  False if a payload is already loaded
+        void FlushAckPayload();                                                             //  Drops a loaded payload, as leaving RX mode flushes the nRF24's TX FIFO
+        uint32_t writes;
+        uint32_t lost;
+        uint32_t poweredUps;
+
+    private:
+        uint8_t payloads[HAL_SIM_RADIO_QUEUE][HAL_RADIO_PAYLOAD_LENGTH];
+        uint8_t lengths[HAL_SIM_RADIO_QUEUE];
+        uint8_t head;
+        uint8_t count;
+        uint8_t ackPayload[HAL_RADIO_PAYLOAD_LENGTH];
+        uint8_t ackLength;                                                                  //  Loaded and waiting for a write
+        uint8_t receivedAck[HAL_RADIO_PAYLOAD_LENGTH];
+        uint8_t receivedAckLength;                                                          //  Came back with the last write
+        uint16_t lossInterval;
+        uint8_t lastRetries;
+        bool isPoweredUp;
+};
+
+#endif
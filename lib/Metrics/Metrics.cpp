@@ -0,0 +1,189 @@
+/*
+ *  Metrics library for counters and fixed-bucket histograms that
+ *  tasks update without locks and a Prometheus text page built from them
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include "Metrics.h"
+
+MetricsHistogram::MetricsHistogram(const uint32_t *upperBounds, uint8_t upperBoundCount) : bounds(upperBounds)  {
+
+    boundCount = upperBoundCount < METRICS_MAX_BUCKETS ? upperBoundCount : METRICS_MAX_BUCKETS;
+    for(uint8_t i=0; i<=METRICS_MAX_BUCKETS; i++)   {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    sum.store(0, std::memory_order_relaxed);
+}
+
+uint8_t MetricsHistogram::BoundCount() const    {
+
+    return boundCount;
+}
+
+uint32_t MetricsHistogram::Bound(uint8_t index) const   {
+
+    return index < boundCount ? bounds[index] : UINT32_MAX;
+}
+
+uint32_t MetricsHistogram::BucketCount(uint8_t index) const {
+
+    return index <= boundCount ? buckets[index].load(std::memory_order_relaxed) : 0;
+}
+
+uint32_t MetricsHistogram::Sum() const  {
+
+    return sum.load(std::memory_order_relaxed);
+}
+
+MetricsCodeCounter::MetricsCodeCounter()    {
+
+    for(uint8_t i=0; i<METRICS_CODES; i++)  {
+        codes[i].store(METRICS_OTHER_CODE, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+}
+
+void MetricsCodeCounter::Add(int16_t code)  {
+
+    uint8_t used = count.load(std::memory_order_relaxed);
+    uint8_t slot = 0;
+
+    while(slot < used && codes[slot].load(std::memory_order_relaxed) != code)  {
+        slot++;
+    }
+
+    // Once every slot is taken the last one counts everything else. A new code is stored before
+    // the count that makes it visible, so a reader never sees a slot half claimed
+    if(slot == METRICS_CODES)   {
+        slot = METRICS_CODES - 1;
+    }
+    else if(slot == used)   {
+        codes[slot].store(slot == METRICS_CODES - 1 ? METRICS_OTHER_CODE : code, std::memory_order_relaxed);
+        count.store(used + 1, std::memory_order_release);
+    }
+    totals[slot].Add();
+}
+
+uint8_t MetricsCodeCounter::Count() const   {
+
+    return count.load(std::memory_order_acquire);
+}
+
+int16_t MetricsCodeCounter::Code(uint8_t index) const   {
+
+    return index < METRICS_CODES ? codes[index].load(std::memory_order_relaxed) : METRICS_OTHER_CODE;
+}
+
+uint32_t MetricsCodeCounter::Total(uint8_t index) const {
+
+    return index < METRICS_CODES ? totals[index].Get() : 0;
+}
+
+MetricsWriter::MetricsWriter(char *pageBuffer, uint16_t pageSize) : buffer(pageBuffer), size(pageSize)  {
+
+    length = 0;
+    isOverflow = size == 0;
+    if(size > 0)    {
+        buffer[0] = '\0';
+    }
+}
+
+void MetricsWriter::Family(const char *name, const char *type, const char *help)  {
+
+    Append("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void MetricsWriter::Sample(const char *name, const char *labels, uint32_t value)   {
+
+    if(labels != NULL)  {
+        Append("%s{%s} %lu\n", name, labels, (unsigned long)value);
+    }
+    else    {
+        Append("%s %lu\n", name, (unsigned long)value);
+    }
+}
+
+void MetricsWriter::Samples(const char *name, const char *labels, const MetricsHistogram &histogram)  {
+
+    const char *separator = labels != NULL ? "," : "";
+    uint32_t cumulative = 0;
+
+    if(labels == NULL)  {
+        labels = "";
+    }
+
+    // Buckets are read once each, so the page stays consistent even if a value lands while it is written
+    for(uint8_t i=0; i<=histogram.BoundCount(); i++)    {
+        cumulative += histogram.BucketCount(i);
+        if(i < histogram.BoundCount())  {
+            Append("%s_bucket{%s%sle=\"%lu\"} %lu\n", name, labels, separator,
+                   (unsigned long)histogram.Bound(i), (unsigned long)cumulative);
+        }
+        else    {
+            Append("%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, separator, (unsigned long)cumulative);
+        }
+    }
+    Append(*labels != '\0' ? "%s_sum{%s} %lu\n" : "%s_sum%s %lu\n", name, labels, (unsigned long)histogram.Sum());
+    Append(*labels != '\0' ? "%s_count{%s} %lu\n" : "%s_count%s %lu\n", name, labels, (unsigned long)cumulative);
+}
+
+void MetricsWriter::Counter(const char *name, const char *help, uint32_t value)    {
+
+    Family(name, "counter", help);
+    Sample(name, NULL, value);
+}
+
+void MetricsWriter::Gauge(const char *name, const char *help, uint32_t value)  {
+
+    Family(name, "gauge", help);
+    Sample(name, NULL, value);
+}
+
+void MetricsWriter::Histogram(const char *name, const char *help, const MetricsHistogram &histogram)  {
+
+    Family(name, "histogram", help);
+    Samples(name, NULL, histogram);
+}
+
+void MetricsWriter::Codes(const char *name, const char *help, const char *label, const MetricsCodeCounter &codes)   {
+
+    char labels[32];
+
+    Family(name, "counter", help);
+    for(uint8_t i=0; i<codes.Count(); i++)  {
+        if(codes.Code(i) == METRICS_OTHER_CODE) {
+            snprintf(labels, sizeof(labels), "%s=\"other\"", label);
+        }
+        else    {
+            snprintf(labels, sizeof(labels), "%s=\"%d\"", label, (int)codes.Code(i));
+        }
+        Sample(name, labels, codes.Total(i));
+    }
+}
+
+uint16_t MetricsWriter::Length()    {
+
+    return isOverflow ? 0 : length;
+}
+
+void MetricsWriter::Append(const char *format, ...)  {
+
+    va_list arguments;
+
+    if(isOverflow)  {
+        return;
+    }
+
+    va_start(arguments, format);
+    int written = vsnprintf(&buffer[length], size - length, format, arguments);
+    va_end(arguments);
+
+    if(written < 0 || length + written >= size)  {
+        isOverflow = true;
+        buffer[length] = '\0';
+        return;
+    }
+    length += written;
+}
@@ -0,0 +1,98 @@
+/*
+ *  Metrics library for counters and fixed-bucket histograms that
+ *  tasks update without locks and a Prometheus text page built from them
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#define METRICS_MAX_BUCKETS                 (10)                                            // Most upper bounds a histogram can have, +Inf is added after them
+#define METRICS_CODES                       (8)                                             // Result codes counted apart, the rest share the last slot
+#define METRICS_OTHER_CODE                  (0)                                             // Code reported for the shared slot
+#define METRICS_CONTENT_TYPE                "text/plain; version=0.0.4"                     // Prometheus text exposition format
+
+#include <stdint.h>
+#include <atomic>
+
+// Every metric has a single task that writes it, so an update is a relaxed load and store with no
+// read-modify-write or lock. Other tasks, e.g. the one serving the page, only ever load
+class MetricsCounter    {
+    public:
+        MetricsCounter() : value(0) {}
+        inline void Add(uint32_t amount = 1)   {
+            value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+        inline void Set(uint32_t newValue)  {                                               //  For totals another library keeps, copied over by the task that owns them
+            value.store(newValue, std::memory_order_relaxed);
+        }
+        inline uint32_t Get() const    {
+            return value.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<uint32_t> value;
+};
+
+class MetricsHistogram  {
+    public:
+        MetricsHistogram(const uint32_t *upperBounds, uint8_t boundCount);                  //  Bounds in increasing order, kept by the caller
+        inline void Observe(uint32_t value) {
+            uint8_t bucket = 0;
+            while(bucket < boundCount && value > bounds[bucket])    {
+                bucket++;
+            }
+            buckets[bucket].store(buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+        uint8_t BoundCount() const;
+        uint32_t Bound(uint8_t index) const;
+        uint32_t BucketCount(uint8_t index) const;                                          //  Values in this bucket alone, index BoundCount() is the +Inf bucket
+        uint32_t Sum() const;                                                               //  Wraps at 2^32, which Prometheus takes as a counter reset
+
+    private:
+        const uint32_t *bounds;
+        uint8_t boundCount;
+        std::atomic<uint32_t> buckets[METRICS_MAX_BUCKETS + 1];
+        std::atomic<uint32_t> sum;
+};
+
+// Counts per result code, e.g. HTTP status, without knowing the codes up front
+class MetricsCodeCounter    {
+    public:
+        MetricsCodeCounter();
+        void Add(int16_t code);                                                             //  A new code takes a free slot, past METRICS_CODES - 1 codes they go in the last
+        uint8_t Count() const;                                                              //  Slots in use
+        int16_t Code(uint8_t index) const;
+        uint32_t Total(uint8_t index) const;
+
+    private:
+        std::atomic<int16_t> codes[METRICS_CODES];
+        MetricsCounter totals[METRICS_CODES];
+        std::atomic<uint8_t> count;
+};
+
+// Writes the text exposition format into a fixed buffer. Each metric family gets its HELP and TYPE
+// lines once, followed by one sample per label set
+class MetricsWriter {
+    public:
+        MetricsWriter(char *buffer, uint16_t size);
+        void Family(const char *name, const char *type, const char *help);                  //  type is counter, gauge or histogram
+        void Sample(const char *name, const char *labels, uint32_t value);                  //  labels like task="receive", or NULL
+        void Samples(const char *name, const char *labels,                                  //  _bucket, _sum and _count lines, buckets are cumulative and
+                     const MetricsHistogram &histogram);                                    //  the count is taken from them so +Inf always matches it
+        void Counter(const char *name, const char *help, uint32_t value);                   //  Family and sample in one, for metrics with no labels
+        void Gauge(const char *name, const char *help, uint32_t value);
+        void Histogram(const char *name, const char *help, const MetricsHistogram &histogram);
+        void Codes(const char *name, const char *help, const char *label,                   //  One counter sample per code seen
+                   const MetricsCodeCounter &codes);
+        uint16_t Length();                                                                  //  0 if the page did not fit, so a cut off page is never served
+
+    private:
+        void Append(const char *format, ...);
+        char *buffer;
+        uint16_t size;
+        uint16_t length;
+        bool isOverflow;
+};
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ *  StationMetrics, the base station's metrics and the /metrics
+ *  page built from them, shared so the host build writes the same page
+ */
+
+#include "StationMetrics.h"
+
+const uint32_t stationLatencyBoundsMs[STATION_METRICS_LATENCY_BOUNDS] = {50, 100, 250, 500, 1000, 2500, 5000, 10000};
+const uint32_t stationBusyBoundsMs[STATION_METRICS_BUSY_BOUNDS]       = {1, 5, 10, 50, 100, 500, 1000, 5000, 10000};
+
+void StationMetrics::Write(MetricsWriter &page, uint32_t nowMs, uint32_t heapFree, uint32_t heapMinFree) const {
+
+    page.Counter("soil_radio_interrupts_total", "Radio IRQ interrupts", interrupts.Get());
+    page.Counter("soil_packets_received_total", "Payloads read from the radio", packets.Get());
+    page.Counter("soil_packet_parse_failures_total", "Payloads dropped for a bad length, version or CRC", parseFailures.Get());
+    page.Counter("soil_duplicate_readings_total", "Readings already seen from the node and not uploaded again", duplicates.Get());
+    page.Counter("soil_burst_readings_total", "Readings unpacked from burst packets", burstReadings.Get());
+    page.Counter("soil_wake_traces_total", "Wake trace summaries received from sensors", traces.Get());
+    page.Counter("soil_packet_ring_drops_total", "Packets lost because the packet ring was full", ringDrops.Get());
+    page.Gauge("soil_packet_ring_depth", "Packets waiting for the upload task", ringDepth.Get());
+    page.Gauge("soil_packet_ring_high_water", "Most packets that have waited at once", ringHighWater.Get());
+    page.Gauge("soil_nodes", "Nodes in the node table", nodes.Get());
+
+    page.Codes("soil_uploads_total", "Database uploads by HTTP status, negative for connection errors", "code", uploads);
+    page.Histogram("soil_upload_latency_ms", "Time to post one batch to the database", uploadLatency);
+    page.Histogram("soil_batch_age_ms", "How long the oldest reading in a batch waited before it was sent", batchAge);
+    page.Counter("soil_readings_flushed_total", "Readings sent in batches", readingsFlushed.Get());
+    page.Gauge("soil_upload_queue_depth", "Readings waiting for the next batch", queueDepth.Get());
+    page.Gauge("soil_reading_log_pending", "Undelivered readings waiting in flash to be replayed", logPending.Get());
+    page.Counter("soil_wifi_reconnects_total", "Times the WiFi connection was found down and rejoined", wifiReconnects.Get());
+    page.Counter("soil_wifi_reconnect_failures_total", "Rejoins that timed out", wifiReconnectFailures.Get());
+
+    // A stalled task stops updating its loop time, so the age keeps growing while the process still answers
+    page.Family("soil_task_busy_ms", "histogram", "Time each task loop spent working between waits");
+    page.Samples("soil_task_busy_ms", "task=\"receive\"", receiveBusy);
+    page.Samples("soil_task_busy_ms", "task=\"upload\"", uploadBusy);
+    page.Family("soil_task_loop_age_ms", "gauge", "Time since the task last finished a loop");
+    page.Sample("soil_task_loop_age_ms", "task=\"receive\"", nowMs - receiveLoopMs.Get());
+    page.Sample("soil_task_loop_age_ms", "task=\"upload\"", nowMs - uploadLoopMs.Get());
+
+    page.Gauge("soil_heap_free_bytes", "Free heap", heapFree);
+    page.Gauge("soil_heap_min_free_bytes", "Lowest free heap since boot", heapMinFree);
+    page.Gauge("soil_uptime_seconds", "Time since boot", nowMs / 1000);
+    page.Counter("soil_metrics_scrapes_total", "Requests for this page", scrapes.Get());
+}
@@ -0,0 +1,53 @@
+/*
+ *  StationMetrics, the base station's metrics and the /metrics
+ *  page built from them, shared so the host build writes the same page
+ */
+
+#ifndef STATIONMETRICS_H
+#define STATIONMETRICS_H
+
+#define STATION_METRICS_PAGE_LENGTH         (8192)                                          // The page is about 5.7 KB with every code slot in use and 10 digit totals
+#define STATION_METRICS_LATENCY_BOUNDS      (8)
+#define STATION_METRICS_BUSY_BOUNDS         (9)
+
+#include <stdint.h>
+#include "Metrics.h"
+
+extern const uint32_t stationLatencyBoundsMs[STATION_METRICS_LATENCY_BOUNDS];
+extern const uint32_t stationBusyBoundsMs[STATION_METRICS_BUSY_BOUNDS];
+
+// Each metric is written by one task only, see Metrics.h, and read by the HTTP server's task.
+// Totals the libraries already keep are copied over by the task that owns them once per loop
+struct StationMetrics   {
+    // Receive task
+    MetricsCounter interrupts;
+    MetricsCounter packets;
+    MetricsCounter parseFailures;
+    MetricsCounter duplicates;
+    MetricsCounter burstReadings;
+    MetricsCounter traces;
+    MetricsCounter ringDrops;
+    MetricsCounter ringDepth;                                                               //  Gauges are set the same way as totals
+    MetricsCounter ringHighWater;
+    MetricsCounter nodes;
+    MetricsCounter receiveLoopMs;                                                           //  millis() at the end of the last loop, a stalled task stops moving it
+    MetricsHistogram receiveBusy{stationBusyBoundsMs, STATION_METRICS_BUSY_BOUNDS};
+    // Upload task
+    MetricsCodeCounter uploads;                                                             //  By HTTP status, HTTPClient errors are negative
+    MetricsHistogram uploadLatency{stationLatencyBoundsMs, STATION_METRICS_LATENCY_BOUNDS};
+    MetricsHistogram batchAge{stationBusyBoundsMs, STATION_METRICS_BUSY_BOUNDS};
+    MetricsCounter readingsFlushed;
+    MetricsCounter queueDepth;
+    MetricsCounter logPending;
+    MetricsCounter wifiReconnects;
+    MetricsCounter wifiReconnectFailures;
+    MetricsCounter uploadLoopMs;
+    MetricsHistogram uploadBusy{stationBusyBoundsMs, STATION_METRICS_BUSY_BOUNDS};
+    // Metrics server
+    MetricsCounter scrapes;
+
+    void Write(MetricsWriter &page, uint32_t nowMs,                                         //  The heap is passed in since only the board can read it
+               uint32_t heapFree, uint32_t heapMinFree) const;
+};
+
+#endif
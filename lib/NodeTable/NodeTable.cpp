@@ -0,0 +1,169 @@
+/*
+ *  NodeTable library to keep per-node state on the base station,
+ *  drop duplicate readings and estimate each node's packet loss
+ */
+
+#include <string.h>
+#include "NodeTable.h"
+
+#define NODE_TABLE_MASK                     (NODE_TABLE_SLOTS - 1)
+
+NodeTable::NodeTable()  {
+
+    memset(nodes, 0, sizeof(nodes));
+    count = 0;
+    evictions = 0;
+}
+
+NodeState *NodeTable::Find(uint16_t nodeId) {
+
+    if(nodeId == 0) {
+        return NULL;
+    }
+
+    // Linear probing, the load limit guarantees an empty slot ends the search
+    for(uint16_t slot = Home(nodeId); nodes[slot].nodeId != 0; slot = (slot + 1) & NODE_TABLE_MASK)  {
+        if(nodes[slot].nodeId == nodeId)    {
+            return &nodes[slot];
+        }
+    }
+    return NULL;
+}
+
+NodeState *NodeTable::Record(uint16_t nodeId, uint32_t receivedTime, uint8_t pipe, bool isReadingPacket)  {
+
+    NodeState *node = Find(nodeId);
+
+    if(node == NULL && nodeId != 0) {
+        if(count >= NODE_TABLE_MAX_NODES)   {
+            Evict();
+        }
+        uint16_t slot = Home(nodeId);
+        while(nodes[slot].nodeId != 0)  {
+            slot = (slot + 1) & NODE_TABLE_MASK;
+        }
+        node = &nodes[slot];
+        memset(node, 0, sizeof(NodeState));
+        node->nodeId = nodeId;
+        count++;
+    }
+    if(node == NULL)    {
+        return NULL;
+    }
+
+    node->packets++;
+    node->pipe = pipe;
+    node->lastSeen = receivedTime;
+
+    // Bursts follow straight after their reading packet, only reading packets mark a report
+    if(isReadingPacket) {
+        if(node->lastReport != 0)   {
+            uint32_t interval = receivedTime - node->lastReport;
+            node->reportIntervalSeconds = node->reportIntervalSeconds == 0 ? interval
+                                        : (3 * node->reportIntervalSeconds + interval) / 4;
+        }
+        node->lastReport = receivedTime;
+    }
+    return node;
+}
+
+bool NodeTable::AcceptReading(NodeState &node, uint16_t sequence)   {
+
+    int16_t ahead = (int16_t)(sequence - node.highestSequence);
+
+    // A sequence far behind the window, or far ahead of it, means the node restarted its count
+    bool isRestart = node.windowFill > 0 && (ahead <= -NODE_SEQUENCE_WINDOW || ahead > NODE_SEQUENCE_MAX_JUMP);
+    if(node.windowFill == 0 || isRestart)   {
+        if(isRestart)   {
+            node.restarts++;
+        }
+        node.highestSequence = sequence;
+        node.sequenceWindow = 1;
+        node.windowFill = 1;
+        node.readings++;
+        return true;
+    }
+
+    if(ahead > 0)   {
+        // Skipped sequences count as lost straight away, one arriving late is given back below
+        node.lost += ahead - 1;
+        node.sequenceWindow = ahead >= NODE_SEQUENCE_WINDOW ? 1 : (node.sequenceWindow << ahead) | 1;
+        node.windowFill = node.windowFill + ahead < NODE_SEQUENCE_WINDOW ? node.windowFill + ahead : NODE_SEQUENCE_WINDOW;
+        node.highestSequence = sequence;
+        node.readings++;
+        return true;
+    }
+
+    uint8_t behind = -ahead;
+    if(node.sequenceWindow & (1UL << behind))   {
+        node.duplicates++;
+        return false;
+    }
+
+    // Older readings arrive in the burst after the newest one. Within the window they were counted lost when
+    // the newest arrived, a node's first burst can also reach back before its first sequence
+    node.sequenceWindow |= 1UL << behind;
+    if(behind < node.windowFill)    {
+        node.lost--;
+    }
+    else    {
+        node.lost += behind - node.windowFill;
+        node.windowFill = behind + 1;
+    }
+    node.readings++;
+    return true;
+}
+
+uint16_t NodeTable::LossPerMille(const NodeState &node) {
+
+    uint32_t total = node.readings + node.lost;
+    return total > 0 ? (uint64_t)node.lost * 1000 / total : 0;
+}
+
+const NodeState *NodeTable::Slot(uint16_t slot) {
+
+    return slot < NODE_TABLE_SLOTS && nodes[slot].nodeId != 0 ? &nodes[slot] : NULL;
+}
+
+uint16_t NodeTable::Count() {
+
+    return count;
+}
+
+uint16_t NodeTable::Home(uint16_t nodeId)   {
+
+    // Fibonacci hashing, node ids are handed out in order and would otherwise cluster
+    return (uint16_t)(nodeId * 40503U) >> (16 - NODE_TABLE_BITS);
+}
+
+void NodeTable::Remove(uint16_t slot)   {
+
+    // Backward shift keeps every probe chain unbroken without tombstones
+    uint16_t hole = slot;
+    for(uint16_t next = (slot + 1) & NODE_TABLE_MASK; nodes[next].nodeId != 0; next = (next + 1) & NODE_TABLE_MASK)  {
+        uint16_t home = Home(nodes[next].nodeId);
+        if(((next - home) & NODE_TABLE_MASK) >= ((next - hole) & NODE_TABLE_MASK))  {
+            nodes[hole] = nodes[next];
+            hole = next;
+        }
+    }
+    nodes[hole].nodeId = 0;
+    count--;
+}
+
+void NodeTable::Evict() {
+
+    uint16_t oldest = 0;
+    bool isFound = false;
+
+    for(uint16_t slot=0; slot<NODE_TABLE_SLOTS; slot++) {
+        if(nodes[slot].nodeId != 0 && (!isFound || nodes[slot].lastSeen < nodes[oldest].lastSeen))  {
+            oldest = slot;
+            isFound = true;
+        }
+    }
+    if(isFound) {
+        Remove(oldest);
+        evictions++;
+    }
+}
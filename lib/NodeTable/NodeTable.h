@@ -0,0 +1,60 @@
+/*
+ *  NodeTable library to keep per-node state on the base station,
+ *  drop duplicate readings and estimate each node's packet loss
+ */
+
+#ifndef NODETABLE_H
+#define NODETABLE_H
+
+#ifndef NODE_TABLE_BITS
+#define NODE_TABLE_BITS                     (7)                                             // Can be raised with a build flag for bigger fleets
+#endif
+#define NODE_TABLE_SLOTS                    (1 << NODE_TABLE_BITS)                          // Open addressed, always a power of two
+#define NODE_TABLE_MAX_NODES                (NODE_TABLE_SLOTS * 3 / 4)                      // Least recently seen node is evicted past this load
+#define NODE_SEQUENCE_WINDOW                (32)                                            // Readings remembered per node to spot duplicates
+#define NODE_SEQUENCE_MAX_JUMP              (1024)                                          // A bigger jump ahead is taken as a restarted node
+
+#include <stdint.h>
+#include "PlantPacket.h"
+
+struct NodeState {
+    uint16_t nodeId;                                                                        //  0 marks an empty slot, legacy nodes are never stored
+    uint16_t highestSequence;                                                               //  Newest reading sequence seen
+    uint32_t sequenceWindow;                                                                //  Bit n is set once highestSequence - n has been seen
+    uint8_t windowFill;                                                                     //  Window positions at or after the first sequence seen
+    uint8_t pipe;                                                                           //  Pipe of the last packet
+    bool isNamed;                                                                           //  plantName has come in a reading packet
+    char plantName[PLANT_NAME_LENGTH];
+    uint32_t lastSeen;                                                                      //  Receive time of the last packet
+    uint32_t lastReport;                                                                    //  Receive time of the last reading packet
+    uint32_t reportIntervalSeconds;                                                         //  Smoothed time between reading packets
+    uint32_t packets;
+    uint32_t readings;                                                                      //  Unique readings accepted
+    uint32_t duplicates;                                                                    //  Readings dropped as already seen
+    uint32_t lost;                                                                          //  Sequences skipped and not seen since
+    uint16_t restarts;                                                                      //  Times the sequence jumped back, e.g. a battery change
+    uint16_t traces;                                                                        //  Wake trace summaries received
+    PlantPacketTrace lastTrace;                                                             //  Where the node's awake time went, see WakeTrace::Describe()
+};
+
+class NodeTable {
+    public:
+        NodeTable();
+        NodeState *Find(uint16_t nodeId);                                                   //  NULL if the node is not in the table
+        NodeState *Record(uint16_t nodeId, uint32_t receivedTime,                           //  Looks up or adds the node for a packet that just arrived, evicting
+                          uint8_t pipe, bool isReadingPacket);                              //  the least recently seen node if the table is full. NULL for node 0
+        bool AcceptReading(NodeState &node, uint16_t sequence);                             //  False if the reading was already seen and should not be uploaded again
+        static uint16_t LossPerMille(const NodeState &node);
+        const NodeState *Slot(uint16_t slot);                                               //  For walking the table, NULL for an empty slot
+        uint16_t Count();
+        uint32_t evictions;
+
+    private:
+        uint16_t Home(uint16_t nodeId);
+        void Remove(uint16_t slot);
+        void Evict();
+        NodeState nodes[NODE_TABLE_SLOTS];
+        uint16_t count;
+};
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ *  NotificationEngine library to decide when a plant's moisture is
+ *  worth a push notification
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include "NotificationEngine.h"
+
+NotificationEngine::NotificationEngine(NotifyPlantState *plantStates, uint16_t plantCount) : plants(plantStates), count(plantCount)  {
+
+    Configure(DEFAULT_WARN_PERCENT, DEFAULT_CRITICAL_PERCENT, DEFAULT_HYSTERESIS_PERCENT,
+              DEFAULT_RENOTIFY_SECONDS, DEFAULT_DIGEST_SECONDS);
+    lastDigest = 0;
+    hasDigested = false;
+    stats = {};
+}
+
+void NotificationEngine::Configure(uint8_t warn, uint8_t critical, uint8_t hysteresis, uint32_t renotify, uint32_t digest)  {
+
+    warnPercent = warn;
+    criticalPercent = critical < warn ? critical : warn;
+    hysteresisPercent = hysteresis;
+    renotifySeconds = renotify;
+    digestSeconds = digest;
+}
+
+bool NotificationEngine::Update(const char *plantName, uint8_t percent, uint32_t now, char *message, uint16_t size) {
+
+    stats.readings++;
+
+    NotifyPlantState *plant = Find(plantName, now);
+    plant->percent = percent;
+    plant->lastSeen = now;
+    plant->level = LevelFor(plant->level, percent);
+
+    // A plant that has been watered starts over, so the next drop is notified straight away
+    if(plant->level < plant->notifiedLevel) {
+        plant->notifiedLevel = plant->level;
+    }
+    if(plant->level == NOTIFY_OK)   {
+        plant->isDue = 0;
+    }
+
+    if(!IsDue(*plant, now) || plant->isDue)  {
+        if(percent <= warnPercent)  {
+            stats.suppressed++;
+        }
+        return false;
+    }
+
+    if(digestSeconds > 0)   {
+        plant->isDue = 1;
+        return false;
+    }
+
+    plant->notifiedLevel = plant->level;
+    plant->lastNotified = now;
+    stats.sent++;
+    snprintf(message, size, "Soil moisture is down to %u%%, water %s!",
+             (unsigned)percent, plant->level == NOTIFY_CRITICAL ? "now" : "soon");
+    return true;
+}
+
+bool NotificationEngine::TakeDigest(uint32_t now, char *message, uint16_t size) {
+
+    if(digestSeconds == 0 || (hasDigested && now - lastDigest < digestSeconds))  {
+        return false;
+    }
+
+    bool isAnyDue = false;
+    for(uint16_t i=0; i<count && !isAnyDue; i++)  {
+        isAnyDue = plants[i].isDue;
+    }
+    if(!isAnyDue)   {
+        return false;
+    }
+
+    // Every plant that needs water goes in, not just the ones that are due, so their reminders restart together
+    bool isFirst = true;
+    uint16_t alerting = Alerting();
+    int length = snprintf(message, size, "%u plant%s need%s water:",
+                          (unsigned)alerting, alerting == 1 ? "" : "s", alerting == 1 ? "s" : "");
+    for(uint16_t i=0; i<count && length < size; i++)  {
+        NotifyPlantState &plant = plants[i];
+        if(plant.plantName[0] == '\0' || plant.level == NOTIFY_OK) {
+            continue;
+        }
+
+        // A plant that does not fit stays due and goes in the next digest
+        int added = snprintf(&message[length], size - length, "%s %.15s %u%% %s",
+                             isFirst ? "" : ",", plant.plantName,
+                             (unsigned)plant.percent, plant.level == NOTIFY_CRITICAL ? "now" : "soon");
+        if(length + added >= size) {
+            message[length] = '\0';
+            break;
+        }
+        length += added;
+        isFirst = false;
+        plant.notifiedLevel = plant.level;
+        plant.lastNotified = now;
+        plant.isDue = 0;
+    }
+
+    lastDigest = now;
+    hasDigested = true;
+    stats.sent++;
+    stats.digests++;
+    return true;
+}
+
+uint16_t NotificationEngine::Alerting()  {
+
+    uint16_t alerting = 0;
+    for(uint16_t i=0; i<count; i++)  {
+        if(plants[i].plantName[0] != '\0' && plants[i].level != NOTIFY_OK)    {
+            alerting++;
+        }
+    }
+    return alerting;
+}
+
+NotifyPlantState *NotificationEngine::Find(const char *plantName, uint32_t now)  {
+
+    NotifyPlantState *empty = NULL;
+    NotifyPlantState *oldest = &plants[0];
+
+    for(uint16_t i=0; i<count; i++)  {
+        if(plants[i].plantName[0] == '\0')  {
+            if(empty == NULL)   {
+                empty = &plants[i];
+            }
+            continue;
+        }
+        if(strncmp(plants[i].plantName, plantName, NOTIFY_NAME_LENGTH - 1) == 0)  {
+            return &plants[i];
+        }
+        if(now - plants[i].lastSeen > now - oldest->lastSeen)    {
+            oldest = &plants[i];
+        }
+    }
+
+    if(empty == NULL)   {
+        empty = oldest;
+        stats.evictions++;
+    }
+    memset(empty, 0, sizeof(NotifyPlantState));
+    strncpy(empty->plantName, plantName, NOTIFY_NAME_LENGTH - 1);
+    return empty;
+}
+
+uint8_t NotificationEngine::LevelFor(uint8_t current, uint8_t percent)  {
+
+    uint8_t level = NOTIFY_OK;
+    if(percent <= criticalPercent)  {
+        level = NOTIFY_CRITICAL;
+    }
+    else if(percent <= warnPercent) {
+        level = NOTIFY_WARN;
+    }
+
+    // Only drop a level once the reading is clear of its threshold, so a plant sitting on it does not flap
+    while(level < current)  {
+        uint8_t threshold = level + 1 == NOTIFY_CRITICAL ? criticalPercent : warnPercent;
+        if(percent > threshold + hysteresisPercent) {
+            break;
+        }
+        level++;
+    }
+    return level;
+}
+
+bool NotificationEngine::IsDue(const NotifyPlantState &plant, uint32_t now)   {
+
+    if(plant.level == NOTIFY_OK)    {
+        return false;
+    }
+    return plant.level > plant.notifiedLevel || now - plant.lastNotified >= renotifySeconds;
+}
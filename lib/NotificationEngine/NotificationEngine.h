@@ -0,0 +1,73 @@
+/*
+ *  NotificationEngine library to decide when a plant's moisture is
+ *  worth a push notification
+ */
+
+#ifndef NOTIFICATIONENGINE_H
+#define NOTIFICATIONENGINE_H
+
+#define DEFAULT_WARN_PERCENT                (50)                                            // Default value can be changed with Configure()
+#define DEFAULT_CRITICAL_PERCENT            (40)                                            // Default value can be changed with Configure()
+#define DEFAULT_HYSTERESIS_PERCENT          (5)                                             // Default value can be changed with Configure()
+#define DEFAULT_RENOTIFY_SECONDS            (43200)                                         // Default value can be changed with Configure()
+#define DEFAULT_DIGEST_SECONDS              (0)                                             // Default value can be changed with Configure(), 0 turns digests off
+#define NOTIFY_NAME_LENGTH                  (16)                                            // Plant names are cut to 15 characters, as in a PlantPacket
+#define NOTIFY_MESSAGE_LENGTH               (192)                                           // Room for a digest of about ten plants
+
+#include <stdint.h>
+
+enum NotifyLevel : uint8_t  {
+    NOTIFY_OK,
+    NOTIFY_WARN,
+    NOTIFY_CRITICAL
+};
+
+// Everything remembered about one plant. Plain data so the ESP can keep it in RTC memory
+struct NotifyPlantState {
+    char plantName[NOTIFY_NAME_LENGTH];                                                     //  Empty for an unused slot
+    uint8_t level;                                                                          //  Current NotifyLevel, with hysteresis applied
+    uint8_t notifiedLevel;                                                                  //  Level last notified, follows the plant back down as it recovers
+    uint8_t percent;                                                                        //  Latest reading
+    uint8_t isDue;                                                                          //  Waiting for the next digest
+    uint32_t lastNotified;
+    uint32_t lastSeen;                                                                      //  Used to pick a plant to forget when the table is full
+};
+
+struct NotificationStats {
+    uint32_t readings;
+    uint32_t sent;                                                                          //  Notifications handed out, a digest counts once
+    uint32_t suppressed;                                                                    //  Readings at or below the warning level that did not notify
+    uint32_t digests;
+    uint32_t evictions;                                                                     //  Plants forgotten to make room for a new one
+};
+
+class NotificationEngine    {
+    public:
+        NotificationEngine(NotifyPlantState *plants, uint16_t count);                       //  State is kept by the caller so it can survive deep sleep
+        void Configure(uint8_t warnPercent,                                                 //  Readings at or below warnPercent and criticalPercent raise the level,
+                       uint8_t criticalPercent,                                             //  which only drops again once a reading is hysteresisPercent clear of
+                       uint8_t hysteresisPercent,                                           //  the threshold. A plant is notified when its level rises and again
+                       uint32_t renotifySeconds,                                            //  every renotifySeconds while it stays up. With digestSeconds set, due
+                       uint32_t digestSeconds);                                             //  plants are gathered into one digest at most that often
+        bool Update(const char *plantName, uint8_t percent, uint32_t now,                   //  Feeds in a reading, true if message holds a notification to send
+                    char *message, uint16_t size);                                          //  now on the plant's topic. Times are in seconds
+        bool TakeDigest(uint32_t now, char *message, uint16_t size);                        //  True if message holds a digest of every plant needing water
+        uint16_t Alerting();                                                                //  Plants currently above NOTIFY_OK
+        NotificationStats stats;
+
+    private:
+        NotifyPlantState *Find(const char *plantName, uint32_t now);
+        uint8_t LevelFor(uint8_t current, uint8_t percent);
+        bool IsDue(const NotifyPlantState &plant, uint32_t now);
+        NotifyPlantState *plants;
+        uint16_t count;
+        uint8_t warnPercent;
+        uint8_t criticalPercent;
+        uint8_t hysteresisPercent;
+        uint32_t renotifySeconds;
+        uint32_t digestSeconds;
+        uint32_t lastDigest;
+        bool hasDigested;
+};
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ *  PacketRing library, a fixed capacity single producer/single
+ *  consumer ring of plant packets that needs no locks
+ */
+
+#include "PacketRing.h"
+
+PacketRing::PacketRing()    {
+
+    head.store(0);
+    tail.store(0);
+    drops.store(0);
+    highWaterMark.store(0);
+}
+
+bool PacketRing::Push(const PlantPacket &packet)    {
+
+    uint32_t currentHead = head.load(std::memory_order_relaxed);
+    uint32_t waiting = currentHead - tail.load(std::memory_order_acquire);
+
+    if(waiting >= PACKET_RING_CAPACITY) {
+        // Each counter has a single writer so a plain load and store is enough
+        drops.store(drops.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    slots[currentHead & (PACKET_RING_CAPACITY - 1)] = packet;
+    // Release publishes the slot contents before the consumer can see the new head
+    head.store(currentHead + 1, std::memory_order_release);
+
+    if(waiting + 1 > highWaterMark.load(std::memory_order_relaxed)) {
+        highWaterMark.store(waiting + 1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+bool PacketRing::Pop(PlantPacket &packet)   {
+
+    uint32_t currentTail = tail.load(std::memory_order_relaxed);
+
+    if(currentTail == head.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    packet = slots[currentTail & (PACKET_RING_CAPACITY - 1)];
+    // Release hands the slot back to the producer only after it has been copied out
+    tail.store(currentTail + 1, std::memory_order_release);
+    return true;
+}
+
+uint32_t PacketRing::Count()    {
+
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+uint32_t PacketRing::Drops()    {
+
+    return drops.load(std::memory_order_relaxed);
+}
+
+uint32_t PacketRing::HighWaterMark()    {
+
+    return highWaterMark.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,36 @@
+/*
+ *  PacketRing library, a fixed capacity single producer/single
+ *  consumer ring of plant packets that needs no locks
+ */
+
+#ifndef PACKETRING_H
+#define PACKETRING_H
+
+#ifndef PACKET_RING_CAPACITY
+#define PACKET_RING_CAPACITY                (32)                                            // Must be a power of two, can be overridden with a build flag
+#endif
+
+#include <stdint.h>
+#include <atomic>
+#include "PlantPacket.h"
+
+static_assert((PACKET_RING_CAPACITY & (PACKET_RING_CAPACITY - 1)) == 0, "PACKET_RING_CAPACITY must be a power of two");
+
+class PacketRing    {
+    public:
+        PacketRing();
+        bool Push(const PlantPacket &packet);                                               //  Producer side only, returns false and counts a drop when full
+        bool Pop(PlantPacket &packet);                                                      //  Consumer side only, returns false when empty
+        uint32_t Count();                                                                   //  Packets waiting, safe to call from either side
+        uint32_t Drops();                                                                   //  Packets lost because the ring was full
+        uint32_t HighWaterMark();                                                           //  Most packets that have been waiting at once
+
+    private:
+        PlantPacket slots[PACKET_RING_CAPACITY];
+        std::atomic<uint32_t> head;                                                         //  Free running write index, only stored by the producer
+        std::atomic<uint32_t> tail;                                                         //  Free running read index, only stored by the consumer
+        std::atomic<uint32_t> drops;                                                        //  Only stored by the producer
+        std::atomic<uint32_t> highWaterMark;                                                //  Only stored by the producer
+};
+
+#endif
@@ -1,27 +1,243 @@
 #include "PlantPacket.h"
 
-void PlantPacket::SetPlantPacketName(char *plantName)  {
-  for(uint8_t i=0;i<15;i++) {
-    plantName[i] = plantName[i];
+void PlantPacket::SetPlantPacketName(const char *name)  {
+  memset(plantName, 0, PLANT_NAME_LENGTH);
+  memcpy(plantName, name, strnlen(name, PLANT_NAME_LENGTH));
+}
+
+uint8_t PlantPacket::CreatePlantPacket(uint8_t *outputBuffer) {
+
+  PlantPacketFrame *frame = (PlantPacketFrame *)outputBuffer;
+
+  memset(outputBuffer, 0, PLANT_PACKET_LENGTH);
+  frame->header.version = PLANT_PACKET_VERSION;
+  frame->header.type = PLANT_PACKET_TYPE_READING;
+  frame->header.nodeId = nodeId;
+  frame->header.sequence = sequence;
+  frame->header.configVersion = configVersion;
+  frame->reading.rawSoilLevel = rawSoilLevel;
+  frame->reading.percentSoilLevel = percentSoilLevel;
+  frame->reading.batteryMillivolts = batteryMillivolts;
+  memcpy(frame->reading.plantName, plantName, PLANT_NAME_LENGTH);
+  frame->crc = Crc16(outputBuffer, offsetof(PlantPacketFrame, crc));
+
+  return PLANT_PACKET_LENGTH;
+}
+
+uint8_t PlantPacket::CreateBurstPacket(uint8_t *outputBuffer, const PlantPacketBurstEntry *entries, uint8_t count) {
+
+  PlantPacketFrame *frame = (PlantPacketFrame *)outputBuffer;
+
+  if(count > PLANT_PACKET_BURST_ENTRIES)  {
+    count = PLANT_PACKET_BURST_ENTRIES;
   }
+
+  memset(outputBuffer, 0, PLANT_PACKET_LENGTH);
+  frame->header.version = PLANT_PACKET_VERSION;
+  frame->header.type = PLANT_PACKET_TYPE_BURST;
+  frame->header.nodeId = nodeId;
+  frame->header.sequence = sequence;
+  frame->header.configVersion = configVersion;
+  frame->burst.count = count;
+  memcpy(frame->burst.entries, entries, count * sizeof(PlantPacketBurstEntry));
+  frame->crc = Crc16(outputBuffer, offsetof(PlantPacketFrame, crc));
+
+  return PLANT_PACKET_LENGTH;
 }
 
-void PlantPacket::CreatePlantPacket(char* outputBuffer) {
-  for(uint8_t i=0; i<15;i++)  {
-    outputBuffer[i] = plantName[i];
+bool PlantPacket::ParsePlantPacket(const uint8_t *buffer, uint8_t length)  {
+
+  // Legacy nodes send the name followed by the percentage with no header. The first byte of
+  // a legacy packet is a printable name character so it can never be mistaken for a version
+  if(length == PLANT_PACKET_LEGACY_LENGTH)  {
+    memcpy(plantName, buffer, PLANT_NAME_LENGTH);
+    percentSoilLevel = buffer[PLANT_NAME_LENGTH];
+    rawSoilLevel = 0;
+    batteryMillivolts = 0;
+    nodeId = 0;
+    sequence = 0;
+    ageSeconds = 0;
+    configVersion = 0;
+    version = PLANT_PACKET_LEGACY_VERSION;
+    return true;
+  }
+
+  const PlantPacketFrame *frame = (const PlantPacketFrame *)buffer;
+
+  if(PacketType(buffer, length) != PLANT_PACKET_TYPE_READING)  {
+    return false;
   }
-  outputBuffer[15] = (char)percentSoilLevel;
+
+  // Fields are read in place from the receive buffer, only the name needs copying
+  version = frame->header.version;
+  nodeId = frame->header.nodeId;
+  sequence = frame->header.sequence;
+  configVersion = frame->header.configVersion;
+  rawSoilLevel = frame->reading.rawSoilLevel;
+  percentSoilLevel = frame->reading.percentSoilLevel;
+  batteryMillivolts = frame->reading.batteryMillivolts;
+  memcpy(plantName, frame->reading.plantName, PLANT_NAME_LENGTH);
+  ageSeconds = 0;
+
+  return true;
 }
 
-void PlantPacket::ParsePlantPacket(uint8_t *buffer)  {
+uint8_t PlantPacket::PacketType(const uint8_t *buffer, uint8_t length)  {
 
-  // Move plantname from buffer to packet one char at a time
-  for(int i= 0; i < 15; i++)  {
-    plantName[i] = (char)buffer[i];
+  const PlantPacketFrame *frame = (const PlantPacketFrame *)buffer;
+
+  if(length != PLANT_PACKET_LENGTH || frame->header.version != PLANT_PACKET_VERSION
+     || frame->crc != Crc16(buffer, offsetof(PlantPacketFrame, crc)))  {
+    return 0;
   }
+  return frame->header.type;
+}
 
-  // Take the last byte of the buffer and move to the packet for soil level
-  percentSoilLevel = buffer[15];
+uint8_t PlantPacket::ParseBurstPacket(const uint8_t *buffer, uint8_t length, PlantPacket *readings, uint8_t maxReadings)  {
+
+  const PlantPacketFrame *frame = (const PlantPacketFrame *)buffer;
+
+  if(PacketType(buffer, length) != PLANT_PACKET_TYPE_BURST)  {
+    return 0;
+  }
+
+  uint8_t count = frame->burst.count;
+  if(count > PLANT_PACKET_BURST_ENTRIES)  {
+    count = PLANT_PACKET_BURST_ENTRIES;
+  }
+  if(count > maxReadings)  {
+    count = maxReadings;
+  }
+
+  for(uint8_t i=0; i<count; i++)  {
+    const PlantPacketBurstEntry &entry = frame->burst.entries[i];
+    readings[i].version = frame->header.version;
+    readings[i].nodeId = frame->header.nodeId;
+    readings[i].sequence = frame->header.sequence + i;
+    readings[i].configVersion = frame->header.configVersion;
+    readings[i].rawSoilLevel = entry.rawSoilLevel;
+    readings[i].percentSoilLevel = entry.percentSoilLevel;
+    readings[i].ageSeconds = entry.ageSeconds;
+    readings[i].batteryMillivolts = 0;
+  }
+  return count;
+}
+
+uint8_t PlantPacket::CreateConfigPacket(uint8_t *outputBuffer, const PlantPacketConfig &config) {
+
+  PlantPacketFrame *frame = (PlantPacketFrame *)outputBuffer;
+
+  memset(outputBuffer, 0, PLANT_PACKET_LENGTH);
+  frame->header.version = PLANT_PACKET_VERSION;
+  frame->header.type = PLANT_PACKET_TYPE_CONFIG;
+  frame->header.nodeId = nodeId;
+  frame->header.sequence = sequence;
+  frame->header.configVersion = configVersion;
+  frame->config = config;
+  frame->crc = Crc16(outputBuffer, offsetof(PlantPacketFrame, crc));
+
+  return PLANT_PACKET_LENGTH;
+}
+
+bool PlantPacket::ParseConfigPacket(const uint8_t *buffer, uint8_t length, uint16_t nodeId, uint8_t &configVersion, PlantPacketConfig &config)  {
+
+  const PlantPacketFrame *frame = (const PlantPacketFrame *)buffer;
+
+  // Nodes share pipes, so an ack payload can reach a node it was not meant for
+  if(PacketType(buffer, length) != PLANT_PACKET_TYPE_CONFIG || frame->header.nodeId != nodeId
+     || frame->header.configVersion == 0)  {
+    return false;
+  }
 
-  return;
-}
\ No newline at end of file
+  if(!IsConfigValid(frame->config))  {
+    return false;
+  }
+
+  configVersion = frame->header.configVersion;
+  config = frame->config;
+  return true;
+}
+
+bool PlantPacket::IsConfigValid(const PlantPacketConfig &config) {
+
+  if(config.autoWaterStart > 100 || config.autoWaterShutoff > 100 || config.alertPercent > 100)  {
+    return false;
+  }
+
+  // A 0 leaves the sensor's own value, so a pair can only be checked here when both are given
+  if(config.sleepFloorSeconds != 0 && config.sleepCeilingSeconds != 0 && config.sleepFloorSeconds > config.sleepCeilingSeconds)  {
+    return false;
+  }
+  if(config.minMoisture != 0 && config.minMoisture == config.maxMoisture)  {
+    return false;
+  }
+  return true;
+}
+
+uint8_t PlantPacket::CreateBeaconPacket(uint8_t *outputBuffer, uint8_t channel) {
+
+  PlantPacketFrame *frame = (PlantPacketFrame *)outputBuffer;
+
+  memset(outputBuffer, 0, PLANT_PACKET_LENGTH);
+  frame->header.version = PLANT_PACKET_VERSION;
+  frame->header.type = PLANT_PACKET_TYPE_BEACON;
+  frame->header.sequence = sequence;
+  frame->beacon.channel = channel;
+  frame->crc = Crc16(outputBuffer, offsetof(PlantPacketFrame, crc));
+
+  return PLANT_PACKET_LENGTH;
+}
+
+bool PlantPacket::ParseBeaconPacket(const uint8_t *buffer, uint8_t length, uint8_t &channel)  {
+
+  const PlantPacketFrame *frame = (const PlantPacketFrame *)buffer;
+
+  if(PacketType(buffer, length) != PLANT_PACKET_TYPE_BEACON)  {
+    return false;
+  }
+
+  channel = frame->beacon.channel;
+  return true;
+}
+
+uint8_t PlantPacket::CreateTracePacket(uint8_t *outputBuffer, const PlantPacketTrace &trace) {
+
+  PlantPacketFrame *frame = (PlantPacketFrame *)outputBuffer;
+
+  memset(outputBuffer, 0, PLANT_PACKET_LENGTH);
+  frame->header.version = PLANT_PACKET_VERSION;
+  frame->header.type = PLANT_PACKET_TYPE_TRACE;
+  frame->header.nodeId = nodeId;
+  frame->header.sequence = sequence;
+  frame->header.configVersion = configVersion;
+  frame->trace = trace;
+  frame->crc = Crc16(outputBuffer, offsetof(PlantPacketFrame, crc));
+
+  return PLANT_PACKET_LENGTH;
+}
+
+bool PlantPacket::ParseTracePacket(const uint8_t *buffer, uint8_t length, uint16_t &nodeId, PlantPacketTrace &trace)  {
+
+  const PlantPacketFrame *frame = (const PlantPacketFrame *)buffer;
+
+  if(PacketType(buffer, length) != PLANT_PACKET_TYPE_TRACE)  {
+    return false;
+  }
+
+  nodeId = frame->header.nodeId;
+  trace = frame->trace;
+  return true;
+}
+
+uint16_t PlantPacket::Crc16(const uint8_t *data, size_t length)  {
+
+  // CRC-16/CCITT-FALSE, bitwise so it stays small on the AVR
+  uint16_t crc = 0xFFFF;
+  for(size_t i=0; i<length; i++)  {
+    crc ^= (uint16_t)data[i] << 8;
+    for(uint8_t bit=0; bit<8; bit++)  {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
@@ -1,15 +1,134 @@
 #ifndef PLANTPACKET_H
 #define PLANTPACKET_H
-#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define PLANT_NAME_LENGTH           (15)
+#define PLANT_PACKET_LENGTH         (32)    // v2 payload, fills one nRF24 payload
+#define PLANT_PACKET_LEGACY_LENGTH  (16)    // v1 payload, 15 char name followed by the percentage
+#define PLANT_PACKET_VERSION        (2)
+#define PLANT_PACKET_LEGACY_VERSION (1)     // Never sent, used to mark packets parsed from the legacy layout
+#define PLANT_PACKET_TYPE_READING   (1)
+#define PLANT_PACKET_TYPE_BURST     (2)     // Older readings from the same node, sent right after a reading packet
+#define PLANT_PACKET_TYPE_CONFIG    (3)     // Base station to node, sent as the payload of an auto-ack
+#define PLANT_PACKET_TYPE_BEACON    (4)     // Base station to any node on the discovery channel, names the channel in use
+#define PLANT_PACKET_TYPE_TRACE     (5)     // Where a node's awake time went since its last trace, sent after its readings
+#define PLANT_PACKET_BURST_ENTRIES  (4)
+#define PLANT_PACKET_TRACE_PHASES   (8)
+
+// v2 wire layout, little endian. Fields are read straight out of the receive buffer through
+// these structs, the CRC covers every byte before it
+struct __attribute__((packed)) PlantPacketHeader {
+    uint8_t version;
+    uint8_t type;
+    uint16_t nodeId;
+    uint16_t sequence;                      // Increases by one per reading and wraps. A burst carries its first entry's, the rest follow on
+    uint8_t configVersion;                  // Node to base: version of the config last applied, 0 for none. Base to node: version carried
+    uint8_t reserved;
+};
+
+struct __attribute__((packed)) PlantPacketReading {
+    uint16_t rawSoilLevel;                  // Averaged ADC value before calibration
+    uint8_t percentSoilLevel;
+    uint16_t batteryMillivolts;
+    char plantName[PLANT_NAME_LENGTH];
+    uint8_t reserved[2];
+};
+
+struct __attribute__((packed)) PlantPacketBurstEntry {
+    uint16_t ageSeconds;                    // How long before the packet was sent the reading was taken
+    uint16_t rawSoilLevel;
+    uint8_t percentSoilLevel;
+};
+
+struct __attribute__((packed)) PlantPacketBurst {
+    uint8_t count;
+    uint8_t reserved;
+    PlantPacketBurstEntry entries[PLANT_PACKET_BURST_ENTRIES];
+};
+
+// Settings pushed to a node, a field left at 0 keeps the node's current value
+struct __attribute__((packed)) PlantPacketConfig {
+    uint16_t sleepFloorSeconds;             // Shortest sleep between readings
+    uint16_t sleepCeilingSeconds;           // Longest sleep between readings
+    uint16_t minMoisture;                   // Raw reading for dry soil, as given to CalibrateSensor()
+    uint16_t maxMoisture;                   // Raw reading for wet soil
+    uint8_t autoWaterStart;                 // Percentages given to SetAutoWaterThresholds()
+    uint8_t autoWaterShutoff;
+    uint8_t alertPercent;                   // Readings below this are sent straight away
+};
+
+struct __attribute__((packed)) PlantPacketBeacon {
+    uint8_t channel;                        // Channel the base station is listening on
+};
+
+// Totals over every wake since the node's last trace. Times saturate rather than wrap
+struct __attribute__((packed)) PlantPacketTrace {
+    uint8_t wakes;                          // Wakes the totals cover
+    uint8_t retries;                        // Radio retransmits, saturates at 255
+    uint16_t awakeMs;                       // All time awake, traced or not
+    uint16_t phaseMs[PLANT_PACKET_TRACE_PHASES];  // Time in each WakeTracePhase, phases never overlap
+};
+
+struct __attribute__((packed)) PlantPacketFrame {
+    PlantPacketHeader header;
+    union {
+        PlantPacketReading reading;         // PLANT_PACKET_TYPE_READING
+        PlantPacketBurst burst;             // PLANT_PACKET_TYPE_BURST
+        PlantPacketConfig config;           // PLANT_PACKET_TYPE_CONFIG
+        PlantPacketBeacon beacon;           // PLANT_PACKET_TYPE_BEACON
+        PlantPacketTrace trace;             // PLANT_PACKET_TYPE_TRACE
+    };
+    uint16_t crc;                           // CRC-16/CCITT-FALSE
+};
+
+static_assert(sizeof(PlantPacketFrame) == PLANT_PACKET_LENGTH, "PlantPacketFrame must fill exactly one payload");
 
 class PlantPacket   {
     public:
-        char plantName[15];
+        char plantName[PLANT_NAME_LENGTH];
         uint8_t percentSoilLevel;
+        uint16_t rawSoilLevel;
+        uint16_t batteryMillivolts;
+        uint16_t nodeId;
+        uint16_t sequence;
+        uint8_t version;                    // Version the packet was parsed from
+        uint16_t ageSeconds;                // How old the reading was when it was sent, 0 unless it came from a burst
+        uint32_t receivedTime;              // Set by the base station when the packet arrives, not sent over the air
+        uint8_t pipe;                       // Reading pipe the packet arrived on, also set by the base station
+        uint8_t configVersion;              // Version of the config the node has applied
          
-        void SetPlantPacketName(char *plantName);
-        void CreatePlantPacket(char* outputBuffer);
-        void ParsePlantPacket(uint8_t *buffer);
+        void SetPlantPacketName(const char *name);
+        uint8_t CreatePlantPacket(uint8_t *outputBuffer);                   // Writes a v2 packet, returns its length
+        uint8_t CreateBurstPacket(uint8_t *outputBuffer,                    // Writes a burst of older readings using this packet's node id and
+                                  const PlantPacketBurstEntry *entries,     // sequence, returns its length
+                                  uint8_t count);
+        bool ParsePlantPacket(const uint8_t *buffer, uint8_t length);       // Accepts v2 readings and legacy packets, false if the packet is not valid
+        static uint8_t PacketType(const uint8_t *buffer, uint8_t length);   // Checks the frame, returns its type or 0 if it is not a valid v2 packet
+        static uint8_t ParseBurstPacket(const uint8_t *buffer,              // Unpacks a burst into readings, names are left for the caller to fill.
+                                        uint8_t length,                     // Returns the number of readings written
+                                        PlantPacket *readings,
+                                        uint8_t maxReadings);
+        uint8_t CreateConfigPacket(uint8_t *outputBuffer,                   // Writes a config for this packet's node id, carrying configVersion,
+                                   const PlantPacketConfig &config);        // returns its length
+        static bool ParseConfigPacket(const uint8_t *buffer,                // False unless the frame is a valid config addressed to nodeId
+                                      uint8_t length,
+                                      uint16_t nodeId,
+                                      uint8_t &configVersion,
+                                      PlantPacketConfig &config);
+        static bool IsConfigValid(const PlantPacketConfig &config);         // Percentages up to 100, and where both are set, floor not above ceiling and distinct min and max
+        uint8_t CreateBeaconPacket(uint8_t *outputBuffer, uint8_t channel); // Writes a beacon using this packet's sequence, returns its length
+        static bool ParseBeaconPacket(const uint8_t *buffer,                // False unless the frame is a valid beacon
+                                      uint8_t length,
+                                      uint8_t &channel);
+        uint8_t CreateTracePacket(uint8_t *outputBuffer,                    // Writes a trace using this packet's node id and sequence,
+                                  const PlantPacketTrace &trace);           // returns its length
+        static bool ParseTracePacket(const uint8_t *buffer,                 // False unless the frame is a valid trace
+                                     uint8_t length,
+                                     uint16_t &nodeId,
+                                     PlantPacketTrace &trace);
+        static uint16_t Crc16(const uint8_t *data, size_t length);
     private:
 };
-#endif
\ No newline at end of file
+#endif
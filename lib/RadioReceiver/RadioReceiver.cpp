@@ -0,0 +1,169 @@
+/*
+ *  RadioReceiver library to drain every pending payload from
+ *  the radio into a PacketRing each time the radio interrupts
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "RadioReceiver.h"
+
+RadioReceiver::RadioReceiver(RadioSource &radioSource, PacketRing &packetRing)
+    : source(radioSource), ring(packetRing)    {
+
+    interrupts.store(0);
+    stats = {};
+    configQueue = NULL;
+    memset(isAckLoaded, 0, sizeof(isAckLoaded));
+}
+
+uint8_t RadioReceiver::Drain(uint32_t receivedTime)  {
+
+    uint8_t count = 0;
+    uint8_t pipe = 0;
+
+    // Clear RX_DR only once the FIFO is empty, then look again in case a payload
+    // landed in between. Otherwise that payload would never raise a new interrupt
+    do  {
+        while(source.Available())   {
+            uint8_t length = source.Read(buffer, sizeof(buffer), pipe);
+            if(pipe < RADIO_PIPES)  {
+                stats.pipePackets[pipe]++;
+                isAckLoaded[pipe] = false;
+            }
+            HandlePayload(length, pipe, receivedTime);
+            count++;
+        }
+        source.ClearInterrupt();
+    } while(source.Available());
+
+    stats.drains++;
+    stats.packets += count;
+    if(count == 0)  {
+        stats.emptyDrains++;
+    }
+    if(count > stats.maxPacketsPerDrain)    {
+        stats.maxPacketsPerDrain = count;
+    }
+    return count;
+}
+
+RadioReceiverStats RadioReceiver::Stats()   {
+
+    RadioReceiverStats snapshot = stats;
+    snapshot.interrupts = interrupts.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void RadioReceiver::SetConfigQueue(ConfigQueue *queue)  {
+
+    configQueue = queue;
+}
+
+void RadioReceiver::ReloadAckPayloads() {
+
+    // The nRF24 matches an ack payload to its pipe, so the order they go back in does not matter
+    for(uint8_t pipe=0; pipe<RADIO_PIPES; pipe++)   {
+        if(isAckLoaded[pipe])   {
+            isAckLoaded[pipe] = source.WriteAckPayload(pipe, ackFrames[pipe], ackLengths[pipe]);
+        }
+    }
+}
+
+NodeTable &RadioReceiver::Nodes()   {
+
+    return nodes;
+}
+
+void RadioReceiver::HandlePayload(uint8_t length, uint8_t pipe, uint32_t receivedTime)   {
+
+    uint8_t type = PlantPacket::PacketType(buffer, length);
+
+    if(type == PLANT_PACKET_TYPE_TRACE) {
+        uint16_t nodeId;
+        PlantPacketTrace trace;
+        (void) PlantPacket::ParseTracePacket(buffer, length, nodeId, trace);
+
+        // Nothing to upload, the summary only replaces the node's last one. It always follows a
+        // reading packet, which has already offered the node its config
+        NodeState *node = nodes.Record(nodeId, receivedTime, pipe, false);
+        if(node != NULL)    {
+            node->lastTrace = trace;
+            node->traces++;
+        }
+        stats.traces++;
+        return;
+    }
+
+    if(type == PLANT_PACKET_TYPE_BURST)  {
+        uint8_t readings = PlantPacket::ParseBurstPacket(buffer, length, burst, PLANT_PACKET_BURST_ENTRIES);
+        if(readings == 0)   {
+            return;
+        }
+
+        NodeState *node = nodes.Record(burst[0].nodeId, receivedTime, pipe, false);
+        for(uint8_t i=0; i<readings; i++)   {
+            // A resend after a lost ack carries readings the base station already has
+            if(node != NULL && !nodes.AcceptReading(*node, burst[i].sequence))  {
+                stats.duplicates++;
+                continue;
+            }
+
+            // Sensors send a reading packet ahead of every burst, so a missing name means that packet was lost
+            memset(burst[i].plantName, 0, PLANT_NAME_LENGTH);
+            if(node != NULL && node->isNamed)   {
+                memcpy(burst[i].plantName, node->plantName, PLANT_NAME_LENGTH);
+            }
+            else    {
+                snprintf(burst[i].plantName, PLANT_NAME_LENGTH, "node%u", (unsigned)burst[i].nodeId);
+            }
+
+            // Rebuild each reading's time from its offset to the moment the burst arrived
+            burst[i].receivedTime = receivedTime - burst[i].ageSeconds;
+            burst[i].pipe = pipe;
+            (void) ring.Push(burst[i]);
+            stats.burstReadings++;
+        }
+        OfferConfig(burst[0].nodeId, burst[0].configVersion, pipe);
+        return;
+    }
+
+    if(!packet.ParsePlantPacket(buffer, length))    {
+        stats.parseFailures++;
+        return;
+    }
+
+    packet.receivedTime = receivedTime;
+    packet.pipe = pipe;
+
+    // Legacy packets carry no node id or sequence and always go through
+    if(packet.version == PLANT_PACKET_VERSION)  {
+        NodeState *node = nodes.Record(packet.nodeId, receivedTime, pipe, true);
+        OfferConfig(packet.nodeId, packet.configVersion, pipe);
+        if(node != NULL)    {
+            memcpy(node->plantName, packet.plantName, PLANT_NAME_LENGTH);
+            node->isNamed = true;
+            if(!nodes.AcceptReading(*node, packet.sequence))    {
+                stats.duplicates++;
+                return;
+            }
+        }
+    }
+    (void) ring.Push(packet);
+}
+
+void RadioReceiver::OfferConfig(uint16_t nodeId, uint8_t configVersion, uint8_t pipe) {
+
+    if(configQueue == NULL || pipe >= RADIO_PIPES)  {
+        return;
+    }
+
+    // Always called so a confirmation is seen, but only one payload is kept loaded per pipe.
+    // Sensors send their burst right after the reading packet, so the config usually rides on that
+    uint8_t length = configQueue->OnPacket(nodeId, configVersion, ackBuffer);
+    if(length > 0 && !isAckLoaded[pipe] && source.WriteAckPayload(pipe, ackBuffer, length))  {
+        memcpy(ackFrames[pipe], ackBuffer, length);
+        ackLengths[pipe] = length;
+        isAckLoaded[pipe] = true;
+        stats.ackPayloads++;
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ *  RadioReceiver library to drain every pending payload from
+ *  the radio into a PacketRing each time the radio interrupts
+ */
+
+#ifndef RADIORECEIVER_H
+#define RADIORECEIVER_H
+
+#define RADIO_MAX_PAYLOAD_LENGTH            (32)                                            // Largest payload the nRF24 can hold
+#define RADIO_PIPES                         (6)
+
+#include <stdint.h>
+#include <atomic>
+#include "PlantPacket.h"
+#include "PacketRing.h"
+#include "ConfigQueue.h"
+#include "NodeTable.h"
+
+// The few radio operations the receive path needs. The base station wraps RF24 with this,
+// a host build can implement it to feed simulated payloads and interrupts
+class RadioSource   {
+    public:
+        virtual ~RadioSource() {}
+        virtual bool Available() = 0;                                                       //  True while the RX FIFO holds a payload
+        virtual uint8_t Read(uint8_t *buffer, uint8_t length, uint8_t &pipe) = 0;           //  Pops one payload, returns its length and the pipe it arrived on
+        virtual void ClearInterrupt() = 0;                                                  //  Clears RX_DR so the IRQ line is released
+        virtual bool WriteAckPayload(uint8_t pipe, const uint8_t *payload,                  //  Loads a payload to send with the next ack on the pipe,
+                                     uint8_t length)    { return false; }                   //  sources without ack payloads leave this as is
+};
+
+struct RadioReceiverStats {
+    uint32_t interrupts;                                                                    //  Interrupts signalled by the IRQ line
+    uint32_t drains;                                                                        //  Times the FIFO was drained
+    uint32_t emptyDrains;                                                                   //  Drains that found nothing, e.g. timeout wakes
+    uint32_t packets;                                                                       //  Payloads read from the radio
+    uint32_t parseFailures;                                                                 //  Payloads dropped for a bad length, version or CRC
+    uint32_t burstReadings;                                                                 //  Readings unpacked from burst packets
+    uint32_t duplicates;                                                                    //  Readings already seen from the node, not pushed to the ring
+    uint8_t maxPacketsPerDrain;                                                             //  Most payloads read in one drain
+    uint32_t pipePackets[RADIO_PIPES];                                                      //  Payloads read per pipe, shows how evenly nodes are spread
+    uint32_t ackPayloads;                                                                   //  Config frames loaded as ack payloads
+    uint32_t traces;                                                                        //  Wake trace summaries, kept in the node table rather than the ring
+};
+
+class RadioReceiver {
+    public:
+        RadioReceiver(RadioSource &source, PacketRing &ring);
+        inline void OnInterrupt()   {                                                       //  Safe to call from an ISR, only counts the interrupt. Inline so it
+            interrupts.store(interrupts.load(std::memory_order_relaxed) + 1,               //  lands in the IRAM handler and still runs during flash writes
+                             std::memory_order_relaxed);
+        }
+        uint8_t Drain(uint32_t receivedTime);                                               //  Reads every pending payload into the ring stamped with receivedTime, returns how many were read
+        RadioReceiverStats Stats();
+        void SetConfigQueue(ConfigQueue *queue);                                            //  Configs in the queue are loaded as ack payloads for their nodes' pipes
+        void ReloadAckPayloads();                                                           //  Call once the radio's TX FIFO has been flushed, e.g. by leaving RX mode,
+                                                                                            //  to load the payloads that were waiting again
+        NodeTable &Nodes();                                                                 //  Per-node state, only safe to walk from the task calling Drain()
+
+    private:
+        void HandlePayload(uint8_t length, uint8_t pipe, uint32_t receivedTime);
+        void OfferConfig(uint16_t nodeId, uint8_t configVersion, uint8_t pipe);
+        RadioSource &source;
+        PacketRing &ring;
+        PlantPacket packet;
+        PlantPacket burst[PLANT_PACKET_BURST_ENTRIES];
+        NodeTable nodes;                                                                    //  Bursts carry no name, it comes from the node's last reading packet
+        uint8_t buffer[RADIO_MAX_PAYLOAD_LENGTH];
+        ConfigQueue *configQueue;
+        uint8_t ackBuffer[RADIO_MAX_PAYLOAD_LENGTH];
+        uint8_t ackFrames[RADIO_PIPES][RADIO_MAX_PAYLOAD_LENGTH];                           //  Copy of each loaded ack payload, for ReloadAckPayloads()
+        uint8_t ackLengths[RADIO_PIPES];
+        bool isAckLoaded[RADIO_PIPES];                                                      //  A loaded ack payload goes out with the next packet on its pipe, whichever node sends it
+        std::atomic<uint32_t> interrupts;                                                   //  Only stored by the ISR
+        RadioReceiverStats stats;                                                           //  Only written by the task calling Drain()
+};
+
+#endif
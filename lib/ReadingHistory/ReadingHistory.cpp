@@ -0,0 +1,571 @@
+/*
+ *  ReadingHistory library to keep days of readings per plant in
+ *  delta-compressed blocks, with the oldest blocks spilled to flash
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "ReadingHistory.h"
+
+struct QueryContext {
+    uint32_t from;
+    uint32_t to;
+    ReadingHistorySample *samples;
+    uint16_t maxSamples;
+    uint16_t count;
+};
+
+struct DownsampleContext {
+    uint32_t from;
+    uint32_t step;
+    ReadingHistoryBucket *buckets;
+    uint16_t bucketCount;
+    uint32_t samples;
+};
+
+static uint16_t RecordCrc(const ReadingHistoryRecord &record)   {
+
+    const uint8_t *bytes = (const uint8_t *)&record;
+    return PlantPacket::Crc16(&bytes[4], READING_HISTORY_RECORD_SIZE - 4);
+}
+
+static bool IsRecordErased(const ReadingHistoryRecord &record)  {
+
+    const uint8_t *bytes = (const uint8_t *)&record;
+    for(uint8_t i=0; i<READING_HISTORY_RECORD_SIZE; i++)    {
+        if(bytes[i] != 0xFF)    {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Seven bits per byte, low bits first, the top bit set on every byte but the last
+static uint8_t PutVarint(uint8_t *data, uint32_t value)  {
+
+    uint8_t length = 0;
+    while(value >= 0x80)    {
+        data[length++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    data[length++] = (uint8_t)value;
+    return length;
+}
+
+static bool GetVarint(const uint8_t *data, uint8_t length, uint8_t &used, uint32_t &value)   {
+
+    value = 0;
+    for(uint8_t shift=0; used < length && shift < 35; shift += 7)  {
+        uint8_t byte = data[used++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if((byte & 0x80) == 0)  {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Small changes either way stay small: 0, -1, 1, -2 become 0, 1, 2, 3
+static uint32_t ZigZag(int32_t value)   {
+
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t UnZigZag(uint32_t value) {
+
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Each sample after a block's first is the varints of its changes from the one before
+static uint8_t PutSample(uint8_t *data, const ReadingHistorySample &previous, const ReadingHistorySample &sample)  {
+
+    uint8_t length = PutVarint(data, sample.time - previous.time);
+    length += PutVarint(&data[length], ZigZag((int32_t)sample.percentSoilLevel - previous.percentSoilLevel));
+    length += PutVarint(&data[length], ZigZag((int32_t)sample.rawSoilLevel - previous.rawSoilLevel));
+    return length;
+}
+
+// Refills a block from samples in time order until one does not fit, returns how many went in
+static uint8_t Encode(ReadingHistoryBlock &block, const ReadingHistorySample *samples, uint8_t count)  {
+
+    uint8_t sample[READING_HISTORY_SAMPLE_LENGTH];
+
+    block.firstTime = samples[0].time;
+    block.firstRaw = samples[0].rawSoilLevel;
+    block.firstPercent = samples[0].percentSoilLevel;
+    block.count = 1;
+    block.length = 0;
+    for(uint8_t i=1; i<count; i++)  {
+        uint8_t length = PutSample(sample, samples[i - 1], samples[i]);
+        if(block.length + length > READING_HISTORY_DATA_LENGTH) {
+            break;
+        }
+        memcpy(&block.data[block.length], sample, length);
+        block.length += length;
+        block.count++;
+    }
+    return block.count;
+}
+
+static bool CollectSample(const ReadingHistorySample &sample, void *context)    {
+
+    QueryContext &query = *(QueryContext *)context;
+    if(sample.time < query.from || sample.time > query.to)  {
+        return true;
+    }
+    query.samples[query.count++] = sample;
+    return query.count < query.maxSamples;
+}
+
+static bool BucketSample(const ReadingHistorySample &sample, void *context) {
+
+    DownsampleContext &view = *(DownsampleContext *)context;
+    if(sample.time < view.from || (sample.time - view.from) / view.step >= view.bucketCount) {
+        return true;
+    }
+
+    ReadingHistoryBucket &bucket = view.buckets[(sample.time - view.from) / view.step];
+    if(bucket.count == 0 || sample.percentSoilLevel < bucket.minPercent)    {
+        bucket.minPercent = sample.percentSoilLevel;
+    }
+    if(bucket.count == 0 || sample.percentSoilLevel > bucket.maxPercent)    {
+        bucket.maxPercent = sample.percentSoilLevel;
+    }
+    bucket.count++;
+    bucket.percentSum += sample.percentSoilLevel;
+    view.samples++;
+    return true;
+}
+
+ReadingHistory::ReadingHistory(ReadingHistoryBlock *blockPool, uint16_t poolSize, ReadingHistorySeries *seriesTable, uint8_t tableSize)
+    : blocks(blockPool), blockCount(poolSize), series(seriesTable), seriesCount(tableSize)  {
+
+    for(uint16_t i=0; i<blockCount; i++)    {
+        blocks[i].series = READING_HISTORY_NO_SERIES;
+    }
+    for(uint8_t i=0; i<seriesCount; i++)    {
+        memset(&series[i], 0, sizeof(ReadingHistorySeries));
+        series[i].newest = READING_HISTORY_NO_BLOCK;
+    }
+    cursor = 0;
+    spill = NULL;
+    spillSlots = 0;
+    slotsPerSector = 0;
+    spillHead = 0;
+    nextSequence = 0;
+    stats = {};
+}
+
+bool ReadingHistory::BeginSpill(FlashStore &flash)  {
+
+    ReadingHistoryRecord record;
+    bool isAnyWritten = false;
+    uint32_t newestSequence = 0;
+    uint32_t newestSlot = 0;
+
+    spill = NULL;
+    slotsPerSector = flash.SectorSize() / READING_HISTORY_RECORD_SIZE;
+    spillSlots = (flash.Size() / flash.SectorSize()) * slotsPerSector;
+    if(spillSlots == 0) {
+        return false;
+    }
+    spill = &flash;
+
+    // The newest record gives the write position, everything after it is older
+    for(uint32_t slot=0; slot<spillSlots; slot++)   {
+        if(ReadRecord(slot, record) && record.state == READING_HISTORY_STATE_VALID && record.crc == RecordCrc(record)
+           && (!isAnyWritten || record.sequence > newestSequence))  {
+            newestSequence = record.sequence;
+            newestSlot = slot;
+            isAnyWritten = true;
+        }
+    }
+    spillHead = isAnyWritten ? (newestSlot + 1) % spillSlots : 0;
+    nextSequence = isAnyWritten ? newestSequence + 1 : 0;
+    return true;
+}
+
+void ReadingHistory::Add(const char *plantName, uint32_t time, uint8_t percent, uint16_t raw)  {
+
+    if(plantName[0] == '\0' || blockCount == 0 || seriesCount == 0)  {
+        return;
+    }
+
+    uint8_t index = FindOrAdd(plantName, time);
+    ReadingHistorySeries &plant = series[index];
+    ReadingHistorySample added = {time, raw, percent};
+    uint8_t sample[READING_HISTORY_SAMPLE_LENGTH];
+    uint8_t length = 0;
+
+    // Sensors send their newest reading first and the older ones in a burst after it, and a clock stepped
+    // back by NTP does the same. Deltas only go forward, so these are put in place rather than appended
+    if(plant.newest != READING_HISTORY_NO_BLOCK && time < plant.lastTime)  {
+        Insert(index, added);
+        stats.samples++;
+        return;
+    }
+    if(plant.newest != READING_HISTORY_NO_BLOCK)    {
+        ReadingHistorySample last = {plant.lastTime, plant.lastRaw, plant.lastPercent};
+        length = PutSample(sample, last, added);
+    }
+
+    ReadingHistoryBlock *block = length > 0 ? &blocks[plant.newest] : NULL;
+    if(block != NULL && block->length + length <= READING_HISTORY_DATA_LENGTH && block->count < UINT8_MAX)   {
+        memcpy(&block->data[block->length], sample, length);
+        block->length += length;
+        block->count++;
+        stats.bytes += length;
+    }
+    else    {
+        Start(index, time, percent, raw);
+    }
+
+    plant.lastTime = time;
+    plant.lastPercent = percent;
+    plant.lastRaw = raw;
+    stats.samples++;
+}
+
+uint16_t ReadingHistory::Query(const char *plantName, uint32_t from, uint32_t to, ReadingHistorySample *samples, uint16_t maxSamples,
+                               ReadingHistoryCursor &cursor)  {
+
+    QueryContext query = {from, to, samples, maxSamples, 0};
+
+    if(maxSamples > 0)  {
+        Visit(plantName, cursor, CollectSample, &query);
+    }
+    return query.count;
+}
+
+uint32_t ReadingHistory::Downsample(const char *plantName, uint32_t from, uint32_t step, ReadingHistoryBucket *buckets, uint16_t bucketCount)  {
+
+    DownsampleContext view = {from, step, buckets, bucketCount, 0};
+    ReadingHistoryCursor at = {};
+
+    memset(buckets, 0, bucketCount * sizeof(ReadingHistoryBucket));
+    for(uint16_t i=0; i<bucketCount; i++)   {
+        buckets[i].time = from + i * step;
+    }
+    if(step > 0)    {
+        Visit(plantName, at, BucketSample, &view);
+    }
+    return view.samples;
+}
+
+bool ReadingHistory::Flush()    {
+
+    bool isFlushed = true;
+
+    if(spill == NULL)   {
+        return false;
+    }
+
+    // Oldest first, as they would have been evicted, and freed so a station that carries on does not spill them twice
+    for(uint16_t i=0; i<blockCount; i++)    {
+        ReadingHistoryBlock &block = blocks[(cursor + i) % blockCount];
+        if(block.series == READING_HISTORY_NO_SERIES)   {
+            continue;
+        }
+        if(Spill(block, nextSequence - blockCount + i)) {
+            stats.spilled++;
+        }
+        else    {
+            isFlushed = false;
+        }
+        series[block.series].newest = READING_HISTORY_NO_BLOCK;
+        block.series = READING_HISTORY_NO_SERIES;
+    }
+    return isFlushed;
+}
+
+bool ReadingHistory::Summarize(uint8_t index, ReadingHistorySummary &summary)  {
+
+    if(index >= seriesCount || series[index].plantName[0] == '\0')  {
+        return false;
+    }
+
+    memset(&summary, 0, sizeof(summary));
+    memcpy(summary.plantName, series[index].plantName, PLANT_NAME_LENGTH);
+    summary.lastTime = series[index].lastTime;
+
+    // From the cursor the pool is oldest first, so the first block found holds the oldest sample
+    for(uint16_t i=0; i<blockCount; i++)    {
+        const ReadingHistoryBlock &block = blocks[(cursor + i) % blockCount];
+        if(block.series != index)   {
+            continue;
+        }
+        if(summary.blocks == 0) {
+            summary.firstTime = block.firstTime;
+        }
+        summary.blocks++;
+        summary.samples += block.count;
+    }
+    return true;
+}
+
+uint8_t ReadingHistory::SeriesCount()   {
+
+    return seriesCount;
+}
+
+uint8_t ReadingHistory::Find(const char *plantName) {
+
+    for(uint8_t i=0; i<seriesCount; i++)    {
+        if(series[i].plantName[0] != '\0' && strncmp(series[i].plantName, plantName, PLANT_NAME_LENGTH) == 0)  {
+            return i;
+        }
+    }
+    return READING_HISTORY_NO_SERIES;
+}
+
+uint8_t ReadingHistory::FindOrAdd(const char *plantName, uint32_t time)    {
+
+    uint8_t index = Find(plantName);
+    if(index != READING_HISTORY_NO_SERIES)  {
+        return index;
+    }
+
+    // Take a free slot, or the plant heard from longest ago
+    bool isFree = false;
+    index = 0;
+    for(uint8_t i=0; i<seriesCount && !isFree; i++)  {
+        if(series[i].plantName[0] == '\0')  {
+            index = i;
+            isFree = true;
+        }
+        else if(time - series[i].lastTime > time - series[index].lastTime)  {
+            index = i;
+        }
+    }
+
+    if(!isFree) {
+        for(uint16_t i=0; i<blockCount; i++)    {
+            if(blocks[i].series == index)   {
+                blocks[i].series = READING_HISTORY_NO_SERIES;
+            }
+        }
+        stats.forgotten++;
+    }
+    memset(&series[index], 0, sizeof(ReadingHistorySeries));
+    memcpy(series[index].plantName, plantName, strnlen(plantName, PLANT_NAME_LENGTH));
+    series[index].newest = READING_HISTORY_NO_BLOCK;
+    return index;
+}
+
+uint16_t ReadingHistory::Allocate() {
+
+    uint16_t index = cursor;
+    ReadingHistoryBlock &block = blocks[index];
+    cursor = (cursor + 1) % blockCount;
+
+    // Blocks are handed out in turn, so the one under the cursor is the oldest in the pool
+    if(block.series != READING_HISTORY_NO_SERIES)   {
+        if(Spill(block, nextSequence - blockCount))    {
+            stats.spilled++;
+        }
+        if(series[block.series].newest == index)    {
+            series[block.series].newest = READING_HISTORY_NO_BLOCK;
+        }
+        block.series = READING_HISTORY_NO_SERIES;
+        stats.evicted++;
+    }
+    nextSequence++;
+    return index;
+}
+
+void ReadingHistory::Start(uint8_t index, uint32_t time, uint8_t percent, uint16_t raw)  {
+
+    uint16_t blockIndex = Allocate();
+    ReadingHistoryBlock &block = blocks[blockIndex];
+
+    block.firstTime = time;
+    block.firstRaw = raw;
+    block.firstPercent = percent;
+    block.series = index;
+    block.count = 1;
+    block.length = 0;
+    series[index].newest = blockIndex;
+    stats.blocks++;
+    stats.bytes += sizeof(block.firstTime) + sizeof(block.firstRaw) + sizeof(block.firstPercent);
+}
+
+void ReadingHistory::Insert(uint8_t index, const ReadingHistorySample &sample) {
+
+    ReadingHistorySample samples[READING_HISTORY_BLOCK_SAMPLES + 1];
+    ReadingHistoryBlock &block = blocks[series[index].newest];
+    ReadingHistorySample first = {block.firstTime, block.firstRaw, block.firstPercent};
+    QueryContext query = {0, UINT32_MAX, samples, READING_HISTORY_BLOCK_SAMPLES, 0};
+    uint8_t position = 0;
+
+    (void) VisitBlock(first, block.data, block.length, block.count, position, CollectSample, &query);
+
+    // After any sample with the same time, so samples that tie keep the order they came in
+    uint8_t at = query.count;
+    while(at > 0 && samples[at - 1].time > sample.time) {
+        samples[at] = samples[at - 1];
+        at--;
+    }
+    samples[at] = sample;
+    uint8_t count = query.count + 1;
+
+    // What no longer fits goes on in blocks started after this one, so the plant's samples stay in time order.
+    // The newest sample stays the plant's last, so the series carries on appending after it
+    stats.bytes -= block.length;
+    uint8_t used = Encode(block, samples, count);
+    stats.bytes += block.length;
+    while(used < count) {
+        Start(index, samples[used].time, samples[used].percentSoilLevel, samples[used].rawSoilLevel);
+        ReadingHistoryBlock &next = blocks[series[index].newest];
+        used += Encode(next, &samples[used], count - used);
+        stats.bytes += next.length;
+    }
+}
+
+bool ReadingHistory::Spill(const ReadingHistoryBlock &block, uint32_t sequence)    {
+
+    ReadingHistoryRecord record;
+
+    if(spill == NULL)   {
+        return false;
+    }
+
+    // Erase each sector as it is entered, which drops the oldest spilled blocks, and skip anything left by a torn write
+    for(uint32_t attempts=0; attempts<=spillSlots; attempts++)  {
+        if(spillHead % slotsPerSector == 0) {
+            if(!spill->EraseSector((spillHead / slotsPerSector) * spill->SectorSize())) {
+                return false;
+            }
+            break;
+        }
+        if(ReadRecord(spillHead, record) && IsRecordErased(record)) {
+            break;
+        }
+        spillHead = (spillHead + 1) % spillSlots;
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.state = READING_HISTORY_STATE_EMPTY;
+    record.version = READING_HISTORY_RECORD_VERSION;
+    record.sequence = sequence;
+    record.firstTime = block.firstTime;
+    record.firstRaw = block.firstRaw;
+    record.firstPercent = block.firstPercent;
+    record.count = block.count;
+    record.length = block.length;
+    memcpy(record.plantName, series[block.series].plantName, PLANT_NAME_LENGTH);
+    memcpy(record.data, block.data, block.length);
+    record.crc = RecordCrc(record);
+
+    uint32_t address = spillHead * READING_HISTORY_RECORD_SIZE;
+    uint8_t state = READING_HISTORY_STATE_VALID;
+    if(!spill->Write(address, &record, sizeof(record)) || !spill->Write(address, &state, 1))  {
+        return false;
+    }
+
+    spillHead = (spillHead + 1) % spillSlots;
+    return true;
+}
+
+bool ReadingHistory::ReadRecord(uint32_t slot, ReadingHistoryRecord &record)    {
+
+    return spill->Read(slot * READING_HISTORY_RECORD_SIZE, &record, sizeof(record));
+}
+
+bool ReadingHistory::ReadHeader(uint32_t slot, ReadingHistoryRecord &record)    {
+
+    return spill->Read(slot * READING_HISTORY_RECORD_SIZE, &record, offsetof(ReadingHistoryRecord, firstTime));
+}
+
+uint32_t ReadingHistory::FirstSpillSlot(const ReadingHistoryCursor &at, uint32_t &slot) {
+
+    ReadingHistoryRecord record;
+
+    // The block the last page stopped in is usually still where it was
+    if(at.slot < spillSlots && ReadHeader(at.slot, record) && record.state == READING_HISTORY_STATE_VALID
+       && record.sequence == at.block)  {
+        slot = at.slot;
+        uint32_t remaining = (spillHead + spillSlots - slot) % spillSlots;
+        return remaining > 0 ? remaining : spillSlots;
+    }
+
+    // A cursor past the newest spilled block, e.g. one that stopped in RAM, has nothing to scan on flash
+    slot = spillHead;
+    if(ReadHeader((spillHead + spillSlots - 1) % spillSlots, record) && record.state == READING_HISTORY_STATE_VALID
+       && record.sequence < at.block)   {
+        return 0;
+    }
+    return spillSlots;
+}
+
+void ReadingHistory::Visit(const char *plantName, ReadingHistoryCursor &at, ReadingHistoryVisitor visitor, void *context)  {
+
+    ReadingHistoryRecord record;
+    ReadingHistorySample first;
+    uint32_t slot = 0;
+    uint32_t remaining = spill != NULL ? FirstSpillSlot(at, slot) : 0;
+
+    // Spilled blocks are all older than the ones in RAM, and oldest first from the write position. Only the header
+    // is read until a block at or after the cursor turns up, and the CRC is only checked for this plant's blocks
+    for(; remaining > 0; remaining--, slot = (slot + 1) % spillSlots)  {
+        if(!ReadHeader(slot, record) || record.state != READING_HISTORY_STATE_VALID
+           || record.version != READING_HISTORY_RECORD_VERSION || record.sequence < at.block)  {
+            continue;
+        }
+        if(!ReadRecord(slot, record) || strncmp(record.plantName, plantName, PLANT_NAME_LENGTH) != 0
+           || record.crc != RecordCrc(record))  {
+            continue;
+        }
+        first = {record.firstTime, record.firstRaw, record.firstPercent};
+        uint8_t position = record.sequence == at.block ? at.sample : 0;
+        if(!VisitBlock(first, record.data, record.length, record.count, position, visitor, context))  {
+            at = {record.sequence, position, slot};
+            return;
+        }
+    }
+
+    uint8_t index = Find(plantName);
+    for(uint16_t i=0; index != READING_HISTORY_NO_SERIES && i<blockCount; i++)   {
+        const ReadingHistoryBlock &block = blocks[(cursor + i) % blockCount];
+        uint32_t sequence = nextSequence - blockCount + i;
+        if(block.series != index || sequence < at.block)    {
+            continue;
+        }
+        first = {block.firstTime, block.firstRaw, block.firstPercent};
+        uint8_t position = sequence == at.block ? at.sample : 0;
+        if(!VisitBlock(first, block.data, block.length, block.count, position, visitor, context))   {
+            at = {sequence, position, spillHead};
+            return;
+        }
+    }
+}
+
+bool ReadingHistory::VisitBlock(const ReadingHistorySample &first, const uint8_t *data, uint8_t length, uint8_t count,
+                                uint8_t &position, ReadingHistoryVisitor visitor, void *context)  {
+
+    ReadingHistorySample sample = first;
+    uint8_t used = 0;
+    uint32_t delta, percentChange, rawChange;
+
+    if(length > READING_HISTORY_DATA_LENGTH)    {
+        length = READING_HISTORY_DATA_LENGTH;
+    }
+    // Samples before position were visited by an earlier call but still have to be decoded
+    if(position == 0 && !visitor(sample, context))   {
+        position = 1;
+        return false;
+    }
+    for(uint8_t i=1; i<count; i++)  {
+        if(!GetVarint(data, length, used, delta) || !GetVarint(data, length, used, percentChange)
+           || !GetVarint(data, length, used, rawChange))   {
+            break;
+        }
+        sample.time += delta;
+        sample.percentSoilLevel += UnZigZag(percentChange);
+        sample.rawSoilLevel += UnZigZag(rawChange);
+        if(i >= position && !visitor(sample, context))   {
+            position = i + 1;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,146 @@
+/*
+ *  ReadingHistory library to keep days of readings per plant in
+ *  delta-compressed blocks, with the oldest blocks spilled to flash
+ */
+
+#ifndef READINGHISTORY_H
+#define READINGHISTORY_H
+
+#define READING_HISTORY_DATA_LENGTH         (32)                                            // Encoded bytes per block after its first sample
+#define READING_HISTORY_SAMPLE_LENGTH       (10)                                            // Longest encoded sample, 5 bytes of time and 2 and 3 of level changes
+#define READING_HISTORY_BLOCK_SAMPLES       (1 + READING_HISTORY_DATA_LENGTH / 3)           // Most samples a block can hold, each after the first takes at least 3 bytes
+#define READING_HISTORY_RECORD_SIZE         (64)                                            // Bytes per spilled block, sectors must be a multiple of this
+#define READING_HISTORY_RECORD_VERSION      (1)                                             // Bumped if the record layout changes
+#define READING_HISTORY_STATE_EMPTY         (0xFF)                                          // Erased slot
+#define READING_HISTORY_STATE_VALID         (0x7F)                                          // Record written, slots are reclaimed when their sector is erased
+#define READING_HISTORY_NO_SERIES           (0xFF)                                          // Series of a free block
+#define READING_HISTORY_NO_BLOCK            (0xFFFF)
+
+#include <stdint.h>
+#include "FlashStore.h"
+#include "PlantPacket.h"
+
+struct ReadingHistorySample {
+    uint32_t time;
+    uint16_t rawSoilLevel;                                                                  //  Zero for readings from legacy packets
+    uint8_t percentSoilLevel;
+};
+
+// The first sample is kept whole and each later one as varints: seconds since the previous sample, then the
+// zigzag change in percent and in raw level. Blocks stand alone, so the oldest can be dropped without the rest
+struct ReadingHistoryBlock {
+    uint32_t firstTime;
+    uint16_t firstRaw;
+    uint8_t firstPercent;
+    uint8_t series;                                                                         //  Index into the series table, READING_HISTORY_NO_SERIES when free
+    uint8_t count;                                                                          //  Samples, the first included
+    uint8_t length;                                                                         //  Bytes of data used
+    uint8_t data[READING_HISTORY_DATA_LENGTH];
+};
+
+// Where each plant's next sample goes and what it is encoded against
+struct ReadingHistorySeries {
+    char plantName[PLANT_NAME_LENGTH];                                                      //  Not terminated at full length, empty for an unused slot
+    uint8_t lastPercent;
+    uint16_t lastRaw;
+    uint32_t lastTime;
+    uint16_t newest;                                                                        //  Block being appended to, READING_HISTORY_NO_BLOCK to start a new one
+};
+
+// A block as it is spilled to flash. The state byte is programmed last so a torn write never looks valid
+struct __attribute__((packed)) ReadingHistoryRecord {
+    uint8_t state;
+    uint8_t version;
+    uint16_t crc;                                                                           //  CRC-16/CCITT over everything after this field
+    uint32_t sequence;                                                                      //  Increases by one per record, orders the spill
+    uint32_t firstTime;
+    uint16_t firstRaw;
+    uint8_t firstPercent;
+    uint8_t count;
+    uint8_t length;
+    char plantName[PLANT_NAME_LENGTH];
+    uint8_t data[READING_HISTORY_DATA_LENGTH];
+};
+
+static_assert(sizeof(ReadingHistoryRecord) == READING_HISTORY_RECORD_SIZE, "ReadingHistoryRecord must match READING_HISTORY_RECORD_SIZE");
+
+// Where a paged Query() carries on. Blocks are numbered in the order they are started and keep their number
+// when spilled, so the next page starts right after the last sample returned, whatever the sample times
+struct ReadingHistoryCursor {
+    uint32_t block;                                                                         //  Number of the block to carry on in, zero to start at the oldest
+    uint8_t sample;                                                                         //  Samples of that block already visited
+    uint32_t slot;                                                                          //  Spill slot the block was in, checked before it is used
+};
+
+struct ReadingHistoryBucket {
+    uint32_t time;                                                                          //  Start of the bucket
+    uint16_t count;                                                                         //  Samples in the bucket, the rest is only meaningful when this is not zero
+    uint8_t minPercent;
+    uint8_t maxPercent;
+    uint32_t percentSum;                                                                    //  Divided by count for the average
+};
+
+struct ReadingHistorySummary {
+    char plantName[PLANT_NAME_LENGTH + 1];
+    uint32_t samples;                                                                       //  In RAM, spilled samples are not counted
+    uint32_t firstTime;
+    uint32_t lastTime;
+    uint16_t blocks;
+};
+
+struct ReadingHistoryStats {
+    uint32_t samples;
+    uint32_t bytes;                                                                         //  Encoded size of the samples added, a first sample counts as its 7 header bytes
+    uint32_t blocks;                                                                        //  Blocks started
+    uint32_t evicted;                                                                       //  Blocks reused while still holding samples
+    uint32_t spilled;                                                                       //  Evicted blocks written to flash
+    uint32_t forgotten;                                                                     //  Plants dropped, with their blocks, to make room for a new one
+};
+
+typedef bool (*ReadingHistoryVisitor)(const ReadingHistorySample &sample, void *context);
+
+class ReadingHistory    {
+    public:
+        ReadingHistory(ReadingHistoryBlock *blocks, uint16_t blockCount,                    //  Storage is kept by the caller, which sizes it
+                       ReadingHistorySeries *series, uint8_t seriesCount);
+        bool BeginSpill(FlashStore &flash);                                                 //  Evicted blocks are kept on flash, scans it to carry on after a reboot
+        void Add(const char *plantName, uint32_t time, uint8_t percent, uint16_t raw);      //  Evicts the oldest block in the pool once every block is in use.
+                                                                                            //  A sample older than the plant's last goes into its open block in time order
+        uint16_t Query(const char *plantName, uint32_t from, uint32_t to,                   //  Samples from and to inclusive, in time order unless the clock stepped back. When
+                       ReadingHistorySample *samples, uint16_t maxSamples,                  //  maxSamples come back, call again with the same cursor for the rest
+                       ReadingHistoryCursor &cursor);
+        uint32_t Downsample(const char *plantName, uint32_t from, uint32_t step,            //  Fills bucketCount buckets of step seconds starting at from,
+                            ReadingHistoryBucket *buckets, uint16_t bucketCount);           //  returns the samples that fell in one
+        bool Flush();                                                                       //  Spills every block in RAM ahead of a planned restart
+        bool Summarize(uint8_t index, ReadingHistorySummary &summary);                      //  False if the series slot is unused
+        uint8_t SeriesCount();
+        ReadingHistoryStats stats;
+
+    private:
+        uint8_t Find(const char *plantName);
+        uint8_t FindOrAdd(const char *plantName, uint32_t time);
+        uint16_t Allocate();
+        void Start(uint8_t index, uint32_t time, uint8_t percent, uint16_t raw);
+        void Insert(uint8_t index, const ReadingHistorySample &sample);                     //  Rewrites the open block with the sample in place, spilling into new blocks
+        bool Spill(const ReadingHistoryBlock &block, uint32_t sequence);
+        bool ReadRecord(uint32_t slot, ReadingHistoryRecord &record);
+        bool ReadHeader(uint32_t slot, ReadingHistoryRecord &record);                       //  Only the fields up to the sequence
+        uint32_t FirstSpillSlot(const ReadingHistoryCursor &at, uint32_t &slot);            //  Where a scan for the cursor starts, returns the slots to scan
+        void Visit(const char *plantName, ReadingHistoryCursor &at,                         //  Starts at the cursor and leaves it after the last sample visited
+                   ReadingHistoryVisitor visitor, void *context);
+        static bool VisitBlock(const ReadingHistorySample &first, const uint8_t *data,      //  Decodes a block from sample position on, stops early if the visitor
+                               uint8_t length, uint8_t count, uint8_t &position,            //  returns false and leaves position after that sample
+                               ReadingHistoryVisitor visitor, void *context);
+        ReadingHistoryBlock *blocks;
+        uint16_t blockCount;
+        ReadingHistorySeries *series;
+        uint8_t seriesCount;
+        uint16_t cursor;                                                                    //  Next block to use, the oldest in the pool once it has wrapped
+        FlashStore *spill;
+        uint32_t spillSlots;
+        uint32_t slotsPerSector;
+        uint32_t spillHead;                                                                 //  Next slot to write
+        uint32_t nextSequence;                                                              //  Number of the next block started, the pool holds the blockCount before it
+};
+
+#endif
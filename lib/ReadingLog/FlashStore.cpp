@@ -0,0 +1,65 @@
+/*
+ *  FlashStore interface used by ReadingLog, with an in-memory
+ *  stand-in that behaves like NOR flash for host builds
+ */
+
+#include <string.h>
+#include "FlashStore.h"
+
+RamFlashStore::RamFlashStore(uint8_t *flashMemory, uint32_t flashSize, uint32_t flashSectorSize, uint32_t *sectorEraseCounts)  {
+
+    memory = flashMemory;
+    size = flashSize;
+    sectorSize = flashSectorSize;
+    eraseCounts = sectorEraseCounts;
+}
+
+uint32_t RamFlashStore::Size()  {
+
+    return size;
+}
+
+uint32_t RamFlashStore::SectorSize()    {
+
+    return sectorSize;
+}
+
+bool RamFlashStore::Read(uint32_t address, void *data, size_t length)   {
+
+    if(address + length > size) {
+        return false;
+    }
+    memcpy(data, &memory[address], length);
+    return true;
+}
+
+bool RamFlashStore::Write(uint32_t address, const void *data, size_t length)    {
+
+    if(address + length > size) {
+        return false;
+    }
+
+    // Like NOR flash, programming can only clear bits
+    const uint8_t *bytes = (const uint8_t *)data;
+    for(size_t i=0; i<length; i++)  {
+        memory[address + i] &= bytes[i];
+    }
+    return true;
+}
+
+bool RamFlashStore::EraseSector(uint32_t address)   {
+
+    if(address % sectorSize != 0 || address >= size)    {
+        return false;
+    }
+    memset(&memory[address], 0xFF, sectorSize);
+    if(eraseCounts != NULL) {
+        eraseCounts[address / sectorSize]++;
+    }
+    return true;
+}
+
+uint32_t RamFlashStore::EraseCount(uint32_t sector) {
+
+    return eraseCounts != NULL ? eraseCounts[sector] : 0;
+}
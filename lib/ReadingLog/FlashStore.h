@@ -0,0 +1,41 @@
+/*
+ *  FlashStore interface used by ReadingLog, with an in-memory
+ *  stand-in that behaves like NOR flash for host builds
+ */
+
+#ifndef FLASHSTORE_H
+#define FLASHSTORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Raw flash region. Writes can only clear bits and a sector must be erased back to 0xFF before it is rewritten
+class FlashStore    {
+    public:
+        virtual ~FlashStore() {}
+        virtual uint32_t Size() = 0;                                                        //  Bytes available, a whole number of sectors
+        virtual uint32_t SectorSize() = 0;                                                  //  Erase granularity
+        virtual bool Read(uint32_t address, void *data, size_t length) = 0;
+        virtual bool Write(uint32_t address, const void *data, size_t length) = 0;
+        virtual bool EraseSector(uint32_t address) = 0;                                     //  Erases the sector starting at address
+};
+
+// FlashStore over a caller provided buffer, tracks erases per sector so wear levelling can be checked
+class RamFlashStore : public FlashStore  {
+    public:
+        RamFlashStore(uint8_t *memory, uint32_t size, uint32_t sectorSize, uint32_t *eraseCounts);
+        uint32_t Size() override;
+        uint32_t SectorSize() override;
+        bool Read(uint32_t address, void *data, size_t length) override;
+        bool Write(uint32_t address, const void *data, size_t length) override;
+        bool EraseSector(uint32_t address) override;
+        uint32_t EraseCount(uint32_t sector);
+
+    private:
+        uint8_t *memory;
+        uint32_t size;
+        uint32_t sectorSize;
+        uint32_t *eraseCounts;                                                              //  One entry per sector, may be NULL
+};
+
+#endif
@@ -0,0 +1,244 @@
+/*
+ *  ReadingLog library, an append-only store-and-forward log of
+ *  readings that could not be uploaded, kept on raw flash
+ */
+
+#include <string.h>
+#include "ReadingLog.h"
+
+static uint16_t RecordCrc(const ReadingLogRecord &record)   {
+
+    const uint8_t *bytes = (const uint8_t *)&record;
+    return PlantPacket::Crc16(&bytes[4], READING_LOG_RECORD_SIZE - 4);
+}
+
+ReadingLog::ReadingLog(FlashStore &flashStore) : flash(flashStore)    {
+
+    stats = {};
+    slotCount = 0;
+    slotsPerSector = 0;
+    head = 0;
+    tail = 0;
+    pending = 0;
+    nextSequence = 0;
+    lastReplayMs = 0;
+    hasReplayed = false;
+    SetReplayRate(DEFAULT_REPLAY_BATCH_SIZE, DEFAULT_REPLAY_INTERVAL_MS);
+}
+
+bool ReadingLog::Begin()    {
+
+    slotsPerSector = flash.SectorSize() / READING_LOG_RECORD_SIZE;
+    slotCount = (flash.Size() / flash.SectorSize()) * slotsPerSector;
+    if(slotCount == 0)  {
+        return false;
+    }
+
+    bool isAnyWritten = false;
+    bool isAnyPending = false;
+    uint32_t newestSequence = 0;
+    uint32_t newestSlot = 0;
+    uint32_t oldestPendingSequence = 0;
+    uint32_t oldestPendingSlot = 0;
+    ReadingLogRecord record;
+    pending = 0;
+
+    // The newest record gives the write position, the oldest undelivered one the replay position
+    for(uint32_t slot=0; slot<slotCount; slot++)    {
+        if(!ReadRecord(slot, record) || IsSlotErased(record))   {
+            continue;
+        }
+        if(!IsRecordIntact(record)) {
+            stats.corrupt++;
+            continue;
+        }
+
+        if(!isAnyWritten || record.sequence > newestSequence)   {
+            newestSequence = record.sequence;
+            newestSlot = slot;
+            isAnyWritten = true;
+        }
+        if(record.state == READING_LOG_STATE_VALID) {
+            pending++;
+            if(!isAnyPending || record.sequence < oldestPendingSequence)    {
+                oldestPendingSequence = record.sequence;
+                oldestPendingSlot = slot;
+                isAnyPending = true;
+            }
+        }
+    }
+
+    head = isAnyWritten ? (newestSlot + 1) % slotCount : 0;
+    nextSequence = isAnyWritten ? newestSequence + 1 : 0;
+    tail = isAnyPending ? oldestPendingSlot : head;
+    return true;
+}
+
+bool ReadingLog::Append(const PlantPacket &reading) {
+
+    ReadingLogRecord record;
+
+    if(slotCount == 0)  {
+        return false;
+    }
+
+    // Skip anything left by a torn write or foreign data, erasing each sector as it is entered
+    for(uint32_t attempts=0; attempts<=slotCount; attempts++)   {
+        if(head % slotsPerSector == 0)  {
+            DropSector(head / slotsPerSector);
+            if(!flash.EraseSector((head / slotsPerSector) * flash.SectorSize()))    {
+                return false;
+            }
+            stats.erases++;
+            break;
+        }
+        if(ReadRecord(head, record) && IsSlotErased(record))    {
+            break;
+        }
+        head = (head + 1) % slotCount;
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.state = READING_LOG_STATE_EMPTY;
+    record.version = READING_LOG_RECORD_VERSION;
+    record.sequence = nextSequence;
+    record.timestamp = reading.receivedTime;
+    memcpy(record.plantName, reading.plantName, sizeof(record.plantName));
+    record.percentSoilLevel = reading.percentSoilLevel;
+    record.rawSoilLevel = reading.rawSoilLevel;
+    record.batteryMillivolts = reading.batteryMillivolts;
+    record.crc = RecordCrc(record);
+
+    uint32_t address = head * READING_LOG_RECORD_SIZE;
+    uint8_t state = READING_LOG_STATE_VALID;
+    if(!flash.Write(address, &record, sizeof(record)) || !flash.Write(address, &state, 1))  {
+        return false;
+    }
+
+    if(pending == 0)    {
+        tail = head;
+    }
+    pending++;
+    nextSequence++;
+    head = (head + 1) % slotCount;
+    stats.appended++;
+    return true;
+}
+
+uint8_t ReadingLog::Peek(PlantPacket *readings, uint8_t maxReadings)    {
+
+    ReadingLogRecord record;
+    uint8_t count = 0;
+    uint32_t slot = tail;
+
+    for(uint32_t seen=0; count < maxReadings && count < pending && seen < slotCount; seen++)  {
+        if(ReadRecord(slot, record) && record.state == READING_LOG_STATE_VALID && IsRecordIntact(record)) {
+            PlantPacket &reading = readings[count++];
+            memcpy(reading.plantName, record.plantName, sizeof(reading.plantName));
+            reading.percentSoilLevel = record.percentSoilLevel;
+            reading.rawSoilLevel = record.rawSoilLevel;
+            reading.batteryMillivolts = record.batteryMillivolts;
+            reading.receivedTime = record.timestamp;
+        }
+        slot = (slot + 1) % slotCount;
+    }
+    return count;
+}
+
+void ReadingLog::MarkDelivered(uint8_t count)   {
+
+    ReadingLogRecord record;
+    uint8_t state = READING_LOG_STATE_DELIVERED;
+
+    while(count > 0 && pending > 0) {
+        tail = NextValidSlot(tail);
+        if(!ReadRecord(tail, record) || record.state != READING_LOG_STATE_VALID)    {
+            break;
+        }
+        (void) flash.Write(tail * READING_LOG_RECORD_SIZE, &state, 1);
+        tail = (tail + 1) % slotCount;
+        pending--;
+        count--;
+        stats.replayed++;
+    }
+
+    tail = pending > 0 ? NextValidSlot(tail) : head;
+}
+
+uint8_t ReadingLog::NextReplayBatch(PlantPacket *readings, uint8_t maxReadings, uint32_t nowMs)  {
+
+    if(pending == 0 || (hasReplayed && nowMs - lastReplayMs < replayIntervalMs))  {
+        return 0;
+    }
+
+    // Stamp the attempt even if the upload fails so a dead server is not hammered either
+    lastReplayMs = nowMs;
+    hasReplayed = true;
+    return Peek(readings, maxReadings < replayBatchSize ? maxReadings : replayBatchSize);
+}
+
+void ReadingLog::SetReplayRate(uint8_t batchSize, uint32_t intervalMs)  {
+
+    replayBatchSize = batchSize > 0 ? batchSize : 1;
+    replayIntervalMs = intervalMs;
+}
+
+uint32_t ReadingLog::Pending()  {
+
+    return pending;
+}
+
+bool ReadingLog::ReadRecord(uint32_t slot, ReadingLogRecord &record)    {
+
+    return flash.Read(slot * READING_LOG_RECORD_SIZE, &record, sizeof(record));
+}
+
+bool ReadingLog::IsRecordIntact(const ReadingLogRecord &record) {
+
+    return record.version == READING_LOG_RECORD_VERSION && record.crc == RecordCrc(record);
+}
+
+bool ReadingLog::IsSlotErased(const ReadingLogRecord &record)   {
+
+    const uint8_t *bytes = (const uint8_t *)&record;
+    for(uint8_t i=0; i<READING_LOG_RECORD_SIZE; i++)    {
+        if(bytes[i] != 0xFF)    {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ReadingLog::DropSector(uint32_t sector)    {
+
+    ReadingLogRecord record;
+    uint32_t firstSlot = sector * slotsPerSector;
+
+    // Only reached when the log has wrapped onto undelivered readings, the oldest ones are lost
+    for(uint32_t slot=firstSlot; slot<firstSlot + slotsPerSector; slot++)   {
+        if(ReadRecord(slot, record) && record.state == READING_LOG_STATE_VALID && IsRecordIntact(record)) {
+            pending--;
+            stats.dropped++;
+        }
+    }
+
+    if(pending == 0)    {
+        tail = head;
+    }
+    else if(tail / slotsPerSector == sector)    {
+        tail = NextValidSlot((firstSlot + slotsPerSector) % slotCount);
+    }
+}
+
+uint32_t ReadingLog::NextValidSlot(uint32_t slot)   {
+
+    ReadingLogRecord record;
+
+    for(uint32_t seen=0; seen<slotCount && slot != head; seen++)    {
+        if(ReadRecord(slot, record) && record.state == READING_LOG_STATE_VALID && IsRecordIntact(record)) {
+            return slot;
+        }
+        slot = (slot + 1) % slotCount;
+    }
+    return slot;
+}
@@ -0,0 +1,76 @@
+/*
+ *  ReadingLog library, an append-only store-and-forward log of
+ *  readings that could not be uploaded, kept on raw flash
+ */
+
+#ifndef READINGLOG_H
+#define READINGLOG_H
+
+#define READING_LOG_RECORD_SIZE             (32)                                            // Bytes per record, sectors must be a multiple of this
+#define READING_LOG_RECORD_VERSION          (1)                                             // Bumped if the record layout changes
+#define READING_LOG_STATE_EMPTY             (0xFF)                                          // Erased slot
+#define READING_LOG_STATE_VALID             (0x7F)                                          // Record written and waiting to be replayed
+#define READING_LOG_STATE_DELIVERED         (0x00)                                          // Record replayed, slot is reclaimed when its sector is erased
+#define DEFAULT_REPLAY_BATCH_SIZE           (8)                                             // Default value can be changed with SetReplayRate()
+#define DEFAULT_REPLAY_INTERVAL_MS          (10000)                                         // Default value can be changed with SetReplayRate()
+
+#include <stdint.h>
+#include "FlashStore.h"
+#include "PlantPacket.h"
+
+// On-flash layout. The state byte is programmed last so a torn write never looks valid,
+// and every later state only clears bits so no erase is needed until the sector is reused
+struct __attribute__((packed)) ReadingLogRecord {
+    uint8_t state;
+    uint8_t version;
+    uint16_t crc;                                                                           //  CRC-16/CCITT over everything after this field
+    uint32_t sequence;                                                                      //  Increases by one per record, orders replay
+    uint32_t timestamp;                                                                     //  When the base station received the reading
+    char plantName[15];
+    uint8_t percentSoilLevel;
+    uint16_t rawSoilLevel;                                                                  //  Zero for readings from legacy packets
+    uint16_t batteryMillivolts;                                                             //  Zero for readings from legacy packets
+};
+
+static_assert(sizeof(ReadingLogRecord) == READING_LOG_RECORD_SIZE, "ReadingLogRecord must match READING_LOG_RECORD_SIZE");
+
+struct ReadingLogStats {
+    uint32_t appended;                                                                      //  Records written
+    uint32_t replayed;                                                                      //  Records marked delivered
+    uint32_t dropped;                                                                       //  Undelivered records overwritten because the log was full
+    uint32_t erases;                                                                        //  Sector erases, spread evenly because the log is circular
+    uint32_t corrupt;                                                                       //  Records skipped at Begin() because their CRC did not match
+};
+
+class ReadingLog    {
+    public:
+        ReadingLog(FlashStore &flash);
+        bool Begin();                                                                       //  Scans the flash to recover the log after a reboot
+        bool Append(const PlantPacket &reading);                                            //  Stores a reading, dropping the oldest sector if the log is full
+        uint8_t Peek(PlantPacket *readings, uint8_t maxReadings);                           //  Copies the oldest undelivered readings in order, leaves them in the log
+        void MarkDelivered(uint8_t count);                                                  //  Retires the first count readings returned by Peek()
+        uint8_t NextReplayBatch(PlantPacket *readings, uint8_t maxReadings, uint32_t nowMs);//  Like Peek() but returns 0 until the replay interval has passed
+        void SetReplayRate(uint8_t batchSize, uint32_t intervalMs);                         //  Bounds replay to batchSize readings every intervalMs
+        uint32_t Pending();                                                                 //  Readings waiting to be replayed
+        ReadingLogStats stats;
+
+    private:
+        bool ReadRecord(uint32_t slot, ReadingLogRecord &record);
+        bool IsRecordIntact(const ReadingLogRecord &record);
+        bool IsSlotErased(const ReadingLogRecord &record);
+        void DropSector(uint32_t sector);
+        uint32_t NextValidSlot(uint32_t slot);
+        FlashStore &flash;
+        uint32_t slotCount;
+        uint32_t slotsPerSector;
+        uint32_t head;                                                                      //  Next slot to write
+        uint32_t tail;                                                                      //  Oldest undelivered slot, equal to head when empty
+        uint32_t pending;
+        uint32_t nextSequence;
+        uint8_t replayBatchSize;
+        uint32_t replayIntervalMs;
+        uint32_t lastReplayMs;
+        bool hasReplayed;
+};
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ *  SampleScheduler library to pick the next sleep length from how
+ *  fast the soil moisture is changing
+ */
+
+#include "SampleScheduler.h"
+
+SampleScheduler::SampleScheduler(SampleSchedulerState &schedulerState) : state(schedulerState)  {
+
+    Configure(DEFAULT_FLOOR_SECONDS, DEFAULT_CEILING_SECONDS, DEFAULT_ALERT_PERCENT,
+              DEFAULT_TARGET_CHANGE_PERCENT, DEFAULT_WATERING_JUMP_PERCENT);
+}
+
+void SampleScheduler::Configure(uint32_t floor, uint32_t ceiling, uint8_t alert, uint8_t targetChange, uint8_t wateringJump) {
+
+    floorSeconds = floor;
+    ceilingSeconds = ceiling > floor ? ceiling : floor;
+    alertPercent = alert;
+    targetChangePercent = targetChange > 0 ? targetChange : 1;
+    wateringJumpPercent = wateringJump;
+}
+
+uint32_t SampleScheduler::NextInterval(uint8_t percent, uint32_t secondsSinceLast)   {
+
+    bool isWatered = false;
+    uint32_t interval = ceilingSeconds;
+
+    if(state.hasLastPercent && secondsSinceLast > 0)    {
+        uint8_t change = percent > state.lastPercent ? percent - state.lastPercent : state.lastPercent - percent;
+        isWatered = percent >= state.lastPercent + wateringJumpPercent;
+
+        // Smooth the rate so a single noisy reading does not swing the interval. Watering is not drying,
+        // so the jump is left out and the soil is expected to dry at the rate it did before
+        if(!isWatered)  {
+            uint32_t rate = (uint32_t)change * 360000UL / secondsSinceLast;
+            rate = ((uint32_t)state.rateCentiPercentPerHour * 3 + rate) / 4;
+            state.rateCentiPercentPerHour = rate > UINT16_MAX ? UINT16_MAX : (uint16_t)rate;
+        }
+    }
+    state.lastPercent = percent;
+    state.hasLastPercent = 1;
+
+    // Sleep long enough for about targetChangePercent of change at the current rate
+    if(state.rateCentiPercentPerHour > 0)   {
+        interval = (uint32_t)targetChangePercent * 360000UL / state.rateCentiPercentPerHour;
+
+        // Wake about when the soil should reach the alert band rather than up to a whole interval after
+        if(percent > alertPercent && (uint32_t)(percent - alertPercent) * 360000UL / state.rateCentiPercentPerHour < interval)    {
+            interval = (uint32_t)(percent - alertPercent) * 360000UL / state.rateCentiPercentPerHour;
+        }
+    }
+
+    // Back off gradually after a fast period instead of jumping straight to the ceiling
+    if(state.lastIntervalSeconds > 0 && interval > state.lastIntervalSeconds * SCHEDULER_MAX_GROWTH)  {
+        interval = state.lastIntervalSeconds * SCHEDULER_MAX_GROWTH;
+    }
+
+    if(percent <= alertPercent || isWatered || interval < floorSeconds)  {
+        interval = floorSeconds;
+    }
+    if(interval > ceilingSeconds)   {
+        interval = ceilingSeconds;
+    }
+
+    state.lastIntervalSeconds = interval;
+    return interval;
+}
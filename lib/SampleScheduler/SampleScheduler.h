@@ -0,0 +1,45 @@
+/*
+ *  SampleScheduler library to pick the next sleep length from how
+ *  fast the soil moisture is changing
+ */
+
+#ifndef SAMPLESCHEDULER_H
+#define SAMPLESCHEDULER_H
+
+#define DEFAULT_FLOOR_SECONDS               (1800)                                          // Default value can be changed with Configure()
+#define DEFAULT_CEILING_SECONDS             (28800)                                         // Default value can be changed with Configure()
+#define DEFAULT_ALERT_PERCENT               (40)                                            // Default value can be changed with Configure()
+#define DEFAULT_TARGET_CHANGE_PERCENT       (3)                                             // Default value can be changed with Configure()
+#define DEFAULT_WATERING_JUMP_PERCENT       (10)                                            // Default value can be changed with Configure()
+#define SCHEDULER_MAX_GROWTH                (2)                                             // Interval can at most double from one sample to the next
+
+#include <stdint.h>
+
+// Everything the scheduler remembers between samples. Plain data so the ESP can keep it in RTC memory
+struct SampleSchedulerState {
+    uint8_t lastPercent;                                                                    //  Previous reading
+    uint8_t hasLastPercent;                                                                 //  Zero until the first reading
+    uint16_t rateCentiPercentPerHour;                                                       //  Smoothed moisture change, in hundredths of a percent per hour
+    uint32_t lastIntervalSeconds;                                                           //  Sleep length handed out last time
+};
+
+class SampleScheduler   {
+    public:
+        SampleScheduler(SampleSchedulerState &state);                                       //  State is kept by the caller so it can survive deep sleep
+        void Configure(uint32_t floorSeconds,                                               //  Shortest and longest sleep, readings at or below alertPercent always
+                       uint32_t ceilingSeconds,                                             //  use the floor, and the interval aims for targetChangePercent of
+                       uint8_t alertPercent,                                                //  change per sample. A rise of wateringJumpPercent or more is taken as
+                       uint8_t targetChangePercent,                                         //  watering and also drops to the floor
+                       uint8_t wateringJumpPercent);
+        uint32_t NextInterval(uint8_t percent, uint32_t secondsSinceLast);                  //  Feeds in a reading and returns the seconds to sleep before the next one
+        SampleSchedulerState &state;
+
+    private:
+        uint32_t floorSeconds;
+        uint32_t ceilingSeconds;
+        uint8_t alertPercent;
+        uint8_t targetChangePercent;
+        uint8_t wateringJumpPercent;
+};
+
+#endif
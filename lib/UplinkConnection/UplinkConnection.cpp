@@ -0,0 +1,137 @@
+/*
+ *  UplinkConnection library to keep an HTTP/1.1 keep-alive
+ *  connection open to one host on top of WiFiClientFixed
+ */
+
+#include "UplinkConnection.h"
+
+UplinkConnection::UplinkConnection(const char *url, uint16_t defaultPort)  {
+
+    stats = {};
+    isAddressCached = false;
+    requestsOnConnection = 0;
+    port = defaultPort;
+
+    // Skip the scheme, then copy the host up to the port or path
+    const char *start = strstr(url, "://");
+    start = (start != NULL) ? start + 3 : url;
+
+    uint8_t i = 0;
+    while(start[i] != '\0' && start[i] != ':' && start[i] != '/' && i < UPLINK_HOST_LENGTH - 1)   {
+        host[i] = start[i];
+        i++;
+    }
+    host[i] = '\0';
+
+    if(start[i] == ':') {
+        port = (uint16_t)atoi(&start[i + 1]);
+    }
+}
+
+int UplinkConnection::POST(const char *url, const char *contentType, const char *body, size_t length)  {
+
+    // A reused socket can be found dead only once the request is sent, so allow one retry on a fresh connection
+    for(uint8_t attempt = 0; attempt < 2; attempt++)    {
+
+        if(!client.connected()) {
+            if(requestsOnConnection > 0)    {
+                stats.serverCloses++;
+                RecordConnectionClosed();
+            }
+            if(!Connect())  {
+                return HTTPC_ERROR_CONNECTION_REFUSED;
+            }
+        }
+        else    {
+            // Throw away anything left over from the last response before reusing the socket
+            client.flush();
+        }
+
+        bool isReused = requestsOnConnection > 0;
+
+        HTTPClient http;
+        http.setReuse(true);
+        http.begin(client, url);
+        http.addHeader("Content-Type", contentType);
+        int httpResponseCode = http.POST((uint8_t *)body, length);
+        http.end();
+
+        if(httpResponseCode > 0)    {
+            requestsOnConnection++;
+            stats.requests++;
+            return httpResponseCode;
+        }
+
+        // Only a send failure on a reused socket is worth repeating, anything else is returned as is
+        bool isStaleSocket = httpResponseCode == HTTPC_ERROR_SEND_HEADER_FAILED
+                          || httpResponseCode == HTTPC_ERROR_SEND_PAYLOAD_FAILED
+                          || httpResponseCode == HTTPC_ERROR_NOT_CONNECTED
+                          || httpResponseCode == HTTPC_ERROR_CONNECTION_LOST;
+        Close();
+
+        if(!isReused || !isStaleSocket)  {
+            return httpResponseCode;
+        }
+        stats.retries++;
+    }
+
+    return HTTPC_ERROR_CONNECTION_LOST;
+}
+
+void UplinkConnection::Close()  {
+
+    if(requestsOnConnection > 0)    {
+        RecordConnectionClosed();
+    }
+    client.stop();
+}
+
+void UplinkConnection::InvalidateAddress()  {
+
+    isAddressCached = false;
+}
+
+uint32_t UplinkConnection::RequestsOnConnection()   {
+
+    return requestsOnConnection;
+}
+
+float UplinkConnection::RequestsPerConnection() {
+
+    if(stats.connectionsOpened == 0)    {
+        return 0.0f;
+    }
+    return (float)stats.requests / (float)stats.connectionsOpened;
+}
+
+bool UplinkConnection::Connect()    {
+
+    if(!isAddressCached)    {
+        stats.dnsLookups++;
+        if(!WiFi.hostByName(host, address)) {
+            stats.connectFailures++;
+            return false;
+        }
+        isAddressCached = true;
+    }
+
+    if(!client.connect(address, port))  {
+        // The host may have moved, look it up again next time
+        stats.connectFailures++;
+        isAddressCached = false;
+        return false;
+    }
+
+    stats.connectionsOpened++;
+    requestsOnConnection = 0;
+    return true;
+}
+
+void UplinkConnection::RecordConnectionClosed() {
+
+    stats.lastRequestsPerConnection = requestsOnConnection;
+    if(requestsOnConnection > stats.maxRequestsPerConnection)   {
+        stats.maxRequestsPerConnection = requestsOnConnection;
+    }
+    requestsOnConnection = 0;
+}
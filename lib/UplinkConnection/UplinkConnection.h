@@ -0,0 +1,52 @@
+/*
+ *  UplinkConnection library to keep an HTTP/1.1 keep-alive
+ *  connection open to one host on top of WiFiClientFixed
+ */
+
+#ifndef UPLINKCONNECTION_H
+#define UPLINKCONNECTION_H
+
+#define UPLINK_HOST_LENGTH                  (64)                                            // Longest host name that can be cached
+#define UPLINK_DEFAULT_PORT                 (80)                                            // Used when the url does not name a port
+
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include "wifiFix.h"                                                                        // flush() fix is needed to reuse a connection
+#include "HalHttp.h"                                                                        // HttpTransport so upload code can be run against a host stand-in
+
+struct UplinkConnectionStats {
+    uint32_t requests;                                                                      //  Requests that got a response
+    uint32_t connectionsOpened;                                                             //  TCP connections opened
+    uint32_t serverCloses;                                                                  //  Times the server had dropped an idle connection before the next request
+    uint32_t retries;                                                                       //  Requests resent after a reused socket turned out to be dead
+    uint32_t dnsLookups;                                                                    //  Resolutions done, everything else hits the address cache
+    uint32_t connectFailures;                                                               //  Connection attempts that failed
+    uint32_t lastRequestsPerConnection;                                                     //  Requests served by the most recently closed connection
+    uint32_t maxRequestsPerConnection;                                                      //  Most requests any single connection has served
+};
+
+class UplinkConnection : public HttpTransport  {
+    public:
+        UplinkConnection(const char *url, uint16_t defaultPort = UPLINK_DEFAULT_PORT);    //  Host and port are taken from the url, e.g. http://host:8080/path
+        int POST(const char *url,                                                           //  Sends a request on the open connection, reconnecting if the server
+                 const char *contentType,                                                   //  dropped it. Returns the http response code or a negative HTTPClient error
+                 const char *body,
+                 size_t length) override;
+        void Close();                                                                       //  Closes the connection, the cached address is kept
+        void InvalidateAddress();                                                           //  Forces a new DNS lookup on the next connect
+        uint32_t RequestsOnConnection();                                                    //  Requests served by the connection that is currently open
+        float RequestsPerConnection();                                                      //  Average over the lifetime of this object
+        UplinkConnectionStats stats;
+
+    private:
+        bool Connect();
+        void RecordConnectionClosed();
+        WiFiClientFixed client;
+        char host[UPLINK_HOST_LENGTH];
+        uint16_t port;
+        IPAddress address;
+        bool isAddressCached;
+        uint32_t requestsOnConnection;
+};
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ *  UplinkEncoder library to build form encoded request bodies
+ *  in a fixed buffer without touching the heap
+ */
+
+#include <stddef.h>
+#include "UplinkEncoder.h"
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+UplinkEncoder::UplinkEncoder(char *bodyBuffer, uint16_t bodySize) : buffer(bodyBuffer), size(bodySize)  {
+
+    length = 0;
+    isOverflow = false;
+    allocationCounter = NULL;
+    stats = {};
+    if(size > 0)    {
+        buffer[0] = '\0';
+    }
+}
+
+uint16_t UplinkEncoder::EncodeReading(const char *apiKey, const char *plantName, uint8_t percent)  {
+
+    uint32_t allocationsBefore = allocationCounter != NULL ? allocationCounter() : 0;
+
+    Begin();
+    Append("api_key=");
+    AppendEscaped(apiKey, UINT16_MAX);
+    Append("&moisture=");
+    AppendNumber(percent);
+    Append("%25&plantname=");
+    AppendEscaped(plantName, PLANT_NAME_LENGTH);
+    return Finish(allocationsBefore);
+}
+
+uint16_t UplinkEncoder::EncodeBatch(const char *apiKey, const PlantPacket *readings, uint8_t count, const PlantPacketTrace *trace) {
+
+    uint32_t allocationsBefore = allocationCounter != NULL ? allocationCounter() : 0;
+
+    Begin();
+    Append("api_key=");
+    AppendEscaped(apiKey, UINT16_MAX);
+    Append("&count=");
+    AppendNumber(count);
+    for(uint8_t i=0; i<count && !isOverflow; i++)   {
+        Append("&moisture[]=");
+        AppendNumber(readings[i].percentSoilLevel);
+        Append("%25&plantname[]=");
+        AppendEscaped(readings[i].plantName, PLANT_NAME_LENGTH);
+        Append("&timestamp[]=");
+        AppendNumber(readings[i].receivedTime);
+        Append("&rawmoisture[]=");
+        AppendNumber(readings[i].rawSoilLevel);
+        Append("&battery[]=");
+        AppendNumber(readings[i].batteryMillivolts);
+    }
+    if(trace != NULL)   {
+        Append("&wakes=");
+        AppendNumber(trace->wakes);
+        Append("&awake_ms=");
+        AppendNumber(trace->awakeMs);
+        Append("&retries=");
+        AppendNumber(trace->retries);
+        // In WakeTracePhase order
+        for(uint8_t i=0; i<PLANT_PACKET_TRACE_PHASES; i++)  {
+            Append("&phase_ms[]=");
+            AppendNumber(trace->phaseMs[i]);
+        }
+    }
+    return Finish(allocationsBefore);
+}
+
+const char *UplinkEncoder::Body()  {
+
+    return buffer;
+}
+
+uint16_t UplinkEncoder::Length()    {
+
+    return length;
+}
+
+void UplinkEncoder::SetAllocationCounter(uint32_t (*counter)())   {
+
+    allocationCounter = counter;
+}
+
+void UplinkEncoder::Begin() {
+
+    length = 0;
+    isOverflow = size == 0;
+}
+
+uint16_t UplinkEncoder::Finish(uint32_t allocationsBefore)  {
+
+    if(allocationCounter != NULL)   {
+        stats.allocations += allocationCounter() - allocationsBefore;
+    }
+
+    // A body cut short would post a wrong reading, so nothing is sent instead
+    if(isOverflow)  {
+        length = 0;
+        if(size > 0)    {
+            buffer[0] = '\0';
+        }
+        stats.overflows++;
+        return 0;
+    }
+
+    buffer[length] = '\0';
+    stats.bodies++;
+    stats.bytes += length;
+    return length;
+}
+
+void UplinkEncoder::Append(const char *text)    {
+
+    // Locals so the compiler does not reload the members after every byte written through buffer
+    char *out = buffer;
+    uint16_t used = length;
+    uint16_t limit = size - 1;                                                              //  One byte is always kept back for the terminator
+
+    for(; *text != '\0' && !isOverflow; text++) {
+        if(used >= limit)   {
+            isOverflow = true;
+            break;
+        }
+        out[used++] = *text;
+    }
+    length = used;
+}
+
+void UplinkEncoder::AppendEscaped(const char *text, uint16_t maxLength)   {
+
+    char *out = buffer;
+    uint16_t used = length;
+    uint16_t limit = size - 1;
+
+    for(uint16_t i=0; i<maxLength && text[i] != '\0' && !isOverflow; i++)    {
+        char c = text[i];
+        bool isUnreserved = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+                         || c == '-' || c == '_' || c == '.' || c == '~';
+
+        if(used + (isUnreserved || c == ' ' ? 1 : 3) > limit)   {
+            isOverflow = true;
+            break;
+        }
+        if(isUnreserved)    {
+            out[used++] = c;
+        }
+        else if(c == ' ')   {
+            out[used++] = '+';
+        }
+        else    {
+            out[used++] = '%';
+            out[used++] = hexDigits[(uint8_t)c >> 4];
+            out[used++] = hexDigits[(uint8_t)c & 0x0F];
+        }
+    }
+    length = used;
+}
+
+void UplinkEncoder::AppendNumber(uint32_t value)    {
+
+    char digits[10];
+    uint8_t count = 0;
+
+    do  {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while(value > 0);
+
+    if(length + count >= size)  {
+        isOverflow = true;
+        return;
+    }
+    while(count > 0)    {
+        buffer[length++] = digits[--count];
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ *  UplinkEncoder library to build form encoded request bodies
+ *  in a fixed buffer without touching the heap
+ */
+
+#ifndef UPLINKENCODER_H
+#define UPLINKENCODER_H
+
+#define UPLINK_BATCH_READINGS               (16)                                            // Most readings in one body, UPLOAD_QUEUE_CAPACITY on the base station
+#define UPLINK_READING_LENGTH               (135)                                           // One batch entry at the widest numbers with every name character escaped
+#define UPLINK_HEADER_LENGTH                (384)                                           // api_key= with a 64 character key escaped, &count= and a trace summary
+#define UPLINK_BODY_LENGTH                  (UPLINK_HEADER_LENGTH + UPLINK_BATCH_READINGS * UPLINK_READING_LENGTH)
+
+#include <stdint.h>
+#include "PlantPacket.h"
+
+struct UplinkEncoderStats {
+    uint32_t bodies;                                                                        //  Bodies encoded
+    uint32_t bytes;
+    uint32_t overflows;                                                                     //  Bodies that did not fit the buffer and were not sent
+    uint32_t allocations;                                                                   //  Heap calls seen by the allocation counter while encoding, should stay 0
+};
+
+class UplinkEncoder {
+    public:
+        UplinkEncoder(char *buffer, uint16_t size);                                         //  Bodies are written to the caller's buffer, null terminated
+        uint16_t EncodeReading(const char *apiKey,                                          //  api_key=&moisture=&plantname=, the single reading form. No firmware
+                               const char *plantName,                                       //  sends it any more, it is kept for the host checks and benchmark.
+                               uint8_t percent);                                            //  Returns the length, or 0 if the body does not fit
+        uint16_t EncodeBatch(const char *apiKey,                                            //  api_key=&count= followed by parallel form arrays, one entry per
+                             const PlantPacket *readings,                                   //  reading, as sent by the base station and the ESP sensor. Returns
+                             uint8_t count,                                                 //  the length, or 0 if the body does not fit. A sensor's wake trace
+                             const PlantPacketTrace *trace = NULL);                         //  summary, if given, follows as wakes=&awake_ms=&retries=&phase_ms[]=
+        const char *Body();
+        uint16_t Length();
+        void SetAllocationCounter(uint32_t (*counter)());                                   //  Read before and after every body, e.g. a wrapped malloc's call count
+        UplinkEncoderStats stats;
+
+    private:
+        void Begin();
+        uint16_t Finish(uint32_t allocationsBefore);
+        void Append(const char *text);
+        void AppendEscaped(const char *text, uint16_t maxLength);                           //  Stops at maxLength for names that are not null terminated
+        void AppendNumber(uint32_t value);
+        char *buffer;
+        uint16_t size;
+        uint16_t length;
+        bool isOverflow;
+        uint32_t (*allocationCounter)();
+};
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ *  UploadQueue library to gather plant packets and
+ *  flush them to the database as a single request
+ */
+
+#include "UploadQueue.h"
+
+UploadQueue::UploadQueue(uint8_t batchSize, uint32_t windowMs)  {
+
+    count = 0;
+    firstQueuedMs = 0;
+    stats = {};
+    SetBatchSize(batchSize);
+    SetWindow(windowMs);
+}
+
+bool UploadQueue::Add(const PlantPacket &packet, uint32_t nowMs)    {
+
+    if(count >= UPLOAD_QUEUE_CAPACITY)  {
+        return false;
+    }
+
+    // The window starts when the first reading of a batch arrives
+    if(count == 0)  {
+        firstQueuedMs = nowMs;
+    }
+
+    packets[count++] = packet;
+    return true;
+}
+
+bool UploadQueue::IsFlushDue(uint32_t nowMs)    {
+
+    if(count == 0)  {
+        return false;
+    }
+
+    // Unsigned subtraction keeps this correct across millis() rollover
+    return count >= batchSize || (nowMs - firstQueuedMs) >= windowMs;
+}
+
+void UploadQueue::CompleteFlush(uint32_t flushStartMs, uint32_t flushEndMs) {
+
+    uint32_t batchAgeMs = flushEndMs - firstQueuedMs;
+    uint32_t flushLatencyMs = flushEndMs - flushStartMs;
+
+    stats.flushCount++;
+    stats.readingsFlushed += count;
+    stats.lastBatchSize = count;
+    stats.lastBatchAgeMs = batchAgeMs;
+    stats.lastFlushLatencyMs = flushLatencyMs;
+
+    if(count > stats.maxBatchSize)  {
+        stats.maxBatchSize = count;
+    }
+    if(batchAgeMs > stats.maxBatchAgeMs)    {
+        stats.maxBatchAgeMs = batchAgeMs;
+    }
+    if(flushLatencyMs > stats.maxFlushLatencyMs)    {
+        stats.maxFlushLatencyMs = flushLatencyMs;
+    }
+
+    count = 0;
+}
+
+void UploadQueue::Discard()  {
+
+    count = 0;
+}
+
+void UploadQueue::SetBatchSize(uint8_t size)    {
+
+    if(size == 0)   {
+        size = 1;
+    }
+    batchSize = size > UPLOAD_QUEUE_CAPACITY ? UPLOAD_QUEUE_CAPACITY : size;
+}
+
+void UploadQueue::SetWindow(uint32_t window)    {
+
+    windowMs = window;
+}
+
+uint8_t UploadQueue::Count()    {
+
+    return count;
+}
+
+const PlantPacket &UploadQueue::Get(uint8_t index)  {
+
+    return packets[index];
+}
@@ -0,0 +1,46 @@
+/*
+ *  UploadQueue library to gather plant packets and
+ *  flush them to the database as a single request
+ */
+
+#ifndef UPLOADQUEUE_H
+#define UPLOADQUEUE_H
+
+#define UPLOAD_QUEUE_CAPACITY               (16)                                            // Largest batch the queue can hold
+
+#include <stdint.h>
+#include "PlantPacket.h"
+
+struct UploadQueueStats {
+    uint32_t flushCount;                                                                    //  Number of batches flushed
+    uint32_t readingsFlushed;                                                               //  Total readings sent across all batches
+    uint8_t lastBatchSize;                                                                  //  Readings in the most recent batch
+    uint8_t maxBatchSize;                                                                   //  Largest batch flushed so far
+    uint32_t lastBatchAgeMs;                                                                //  How long the oldest reading waited before its batch was flushed
+    uint32_t maxBatchAgeMs;                                                                 //  Longest wait seen for any batch
+    uint32_t lastFlushLatencyMs;                                                            //  Time spent sending the most recent batch
+    uint32_t maxFlushLatencyMs;                                                             //  Longest time spent sending a batch
+};
+
+class UploadQueue   {
+    public:
+        UploadQueue(uint8_t batchSize, uint32_t windowMs);                                  //  Batch is flushed when batchSize readings are queued or windowMs has passed
+        bool Add(const PlantPacket &packet, uint32_t nowMs);                                //  Queues a reading, returns false if the queue is already full
+        bool IsFlushDue(uint32_t nowMs);                                                    //  True once the batch is full or the window has run out
+        void CompleteFlush(uint32_t flushStartMs, uint32_t flushEndMs);                     //  Records the flush in the stats and empties the queue
+        void Discard();                                                                     //  Empties the queue without counting it as a flush
+        void SetBatchSize(uint8_t batchSize);                                               //  Clamped to UPLOAD_QUEUE_CAPACITY
+        void SetWindow(uint32_t windowMs);
+        uint8_t Count();
+        const PlantPacket &Get(uint8_t index);
+        UploadQueueStats stats;
+
+    private:
+        PlantPacket packets[UPLOAD_QUEUE_CAPACITY];
+        uint8_t count;
+        uint8_t batchSize;
+        uint32_t windowMs;
+        uint32_t firstQueuedMs;                                                             //  Arrival time of the oldest reading in the batch
+};
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ *  WakeLog library to hold readings in RTC memory across deep
+ *  sleep until they are uploaded together
+ */
+
+#include <string.h>
+#include "WakeLog.h"
+#include "PlantPacket.h"
+
+WakeLog::WakeLog(WakeLogState &logState) : state(logState)  {
+
+}
+
+bool WakeLog::Begin()   {
+
+    uint8_t first = First();
+    uint8_t count = CommittedCount();
+
+    if(state.commit >> 26 == WAKE_LOG_MAGIC && first < WAKE_LOG_SLOTS && count <= WAKE_LOG_CAPACITY
+       && Commit(first, count) == state.commit)   {
+        return true;
+    }
+
+    // RTC memory is zeroed on power up, anything else means it was corrupted, e.g. by a brownout
+    bool isPowerUp = state.commit == 0;
+    state.commit = Commit(0, 0);
+    return isPowerUp;
+}
+
+void WakeLog::Add(uint32_t time, uint8_t percent)   {
+
+    uint8_t first = First();
+    uint8_t count = CommittedCount();
+
+    // The slot after the last entry is never committed, so a torn write here leaves the log as it was
+    WakeLogEntry &entry = state.entries[(first + count) % WAKE_LOG_SLOTS];
+    entry.time = time;
+    entry.percent = percent;
+    memset(entry.reserved, 0, sizeof(entry.reserved));
+
+    if(count == WAKE_LOG_CAPACITY)  {
+        first = (first + 1) % WAKE_LOG_SLOTS;
+    }
+    else    {
+        count++;
+    }
+    state.commit = Commit(first, count);
+}
+
+uint8_t WakeLog::Count()    {
+
+    return CommittedCount();
+}
+
+const WakeLogEntry &WakeLog::Get(uint8_t index)    {
+
+    return state.entries[(First() + index) % WAKE_LOG_SLOTS];
+}
+
+void WakeLog::Clear()   {
+
+    state.commit = Commit(0, 0);
+}
+
+uint32_t WakeLog::Commit(uint8_t first, uint8_t count)  {
+
+    uint8_t bytes[2 + WAKE_LOG_CAPACITY * sizeof(WakeLogEntry)];
+
+    // The CRC covers the entries in log order along with where they start
+    bytes[0] = first;
+    bytes[1] = count;
+    for(uint8_t i=0; i<count; i++)  {
+        memcpy(&bytes[2 + i * sizeof(WakeLogEntry)], &state.entries[(first + i) % WAKE_LOG_SLOTS], sizeof(WakeLogEntry));
+    }
+    uint16_t crc = PlantPacket::Crc16(bytes, 2 + count * sizeof(WakeLogEntry));
+
+    return (uint32_t)WAKE_LOG_MAGIC << 26 | (uint32_t)first << 21 | (uint32_t)count << 16 | crc;
+}
+
+uint8_t WakeLog::First()    {
+
+    return (state.commit >> 21) & 0x1F;
+}
+
+uint8_t WakeLog::CommittedCount()   {
+
+    return (state.commit >> 16) & 0x1F;
+}
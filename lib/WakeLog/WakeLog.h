@@ -0,0 +1,44 @@
+/*
+ *  WakeLog library to hold readings in RTC memory across deep
+ *  sleep until they are uploaded together
+ */
+
+#ifndef WAKELOG_H
+#define WAKELOG_H
+
+#define WAKE_LOG_CAPACITY                   (8)                                             // Readings held, the oldest is dropped past this. Fits one UPLINK_BODY_LENGTH body
+#define WAKE_LOG_SLOTS                      (WAKE_LOG_CAPACITY + 1)                         // A spare slot so a new entry never overwrites a committed one
+#define WAKE_LOG_MAGIC                      (0x2D)                                          // Top bits of the commit word, 0 after a power on
+
+#include <stdint.h>
+
+struct WakeLogEntry {
+    uint32_t time;                                                                          //  time() when the reading was taken
+    uint8_t percent;
+    uint8_t reserved[3];
+};
+
+// Plain data so the ESP can keep it in RTC memory. Entries are written first and only become part of
+// the log when the commit word is stored, a single aligned 32-bit write that a brownout cannot tear
+struct WakeLogState {
+    uint32_t commit;                                                                        //  Magic, first slot, count and a CRC-16 over the committed entries
+    WakeLogEntry entries[WAKE_LOG_SLOTS];
+};
+
+class WakeLog   {
+    public:
+        WakeLog(WakeLogState &state);                                                       //  State is kept by the caller so it can survive deep sleep
+        bool Begin();                                                                       //  Checks the log after a wake. False if it was not intact, it is then empty
+        void Add(uint32_t time, uint8_t percent);                                           //  Appends a reading, dropping the oldest if the log is full
+        uint8_t Count();
+        const WakeLogEntry &Get(uint8_t index);                                             //  0 is the oldest
+        void Clear();                                                                       //  Called once the readings are uploaded
+        WakeLogState &state;
+
+    private:
+        uint32_t Commit(uint8_t first, uint8_t count);
+        uint8_t First();
+        uint8_t CommittedCount();
+};
+
+#endif
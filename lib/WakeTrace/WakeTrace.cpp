@@ -0,0 +1,147 @@
+/*
+ *  WakeTrace library to time each phase of a sensor's wake
+ *  and sum them up until the summary can ride on an uplink
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "WakeTrace.h"
+#include "Hal.h"
+
+static const char *const phaseNames[WAKE_TRACE_PHASES] = {
+    "sensor", "watering", "radio up", "radio tx", "discovery", "wifi", "clock", "http"
+};
+
+// Summaries carry milliseconds in 16 bits, a total past that is pinned rather than wrapped
+static uint16_t SaturatedMs(uint32_t micros)   {
+
+    uint32_t ms = micros / 1000;
+    return ms > UINT16_MAX ? UINT16_MAX : (uint16_t)ms;
+}
+
+// Micros still to report once the whole ms have been, a saturated total keeps what did not fit
+static uint32_t Remaining(uint32_t micros, uint16_t reportedMs)   {
+
+    uint32_t reported = (uint32_t)reportedMs * 1000;
+    return micros > reported ? micros - reported : 0;
+}
+
+WakeTrace::WakeTrace(WakeTraceState &traceState) : state(traceState)  {
+
+    wakeStart = 0;
+    phaseStart = 0;
+    phase = WAKE_TRACE_NONE;
+}
+
+void WakeTrace::BeginWake() {
+
+    wakeStart = HalMicros();
+    phase = WAKE_TRACE_NONE;
+    if(state.wakes < UINT8_MAX) {
+        state.wakes++;
+    }
+}
+
+void WakeTrace::Begin(uint8_t nextPhase)    {
+
+    uint32_t now = HalMicros();
+
+    Close(now);
+    if(nextPhase < WAKE_TRACE_PHASES)   {
+        phase = nextPhase;
+        phaseStart = now;
+    }
+}
+
+void WakeTrace::End()   {
+
+    Close(HalMicros());
+}
+
+void WakeTrace::AddRetries(uint8_t retries)  {
+
+    state.retries = (uint32_t)state.retries + retries > UINT16_MAX ? UINT16_MAX : state.retries + retries;
+}
+
+void WakeTrace::EndWake()   {
+
+    uint32_t now = HalMicros();
+
+    Close(now);
+    state.awakeMicros += now - wakeStart;
+    wakeStart = now;
+}
+
+void WakeTrace::Summarize(PlantPacketTrace &summary)    {
+
+    uint32_t now = HalMicros();
+    uint8_t inProgress = phase;
+
+    // Bring the wake and phase in progress up to now, they carry on timing from here
+    Close(now);
+    phase = inProgress;
+    phaseStart = now;
+    state.awakeMicros += now - wakeStart;
+    wakeStart = now;
+
+    summary.wakes = state.wakes;
+    summary.retries = state.retries > UINT8_MAX ? UINT8_MAX : (uint8_t)state.retries;
+    summary.awakeMs = SaturatedMs(state.awakeMicros);
+    for(uint8_t i=0; i<WAKE_TRACE_PHASES; i++)  {
+        summary.phaseMs[i] = SaturatedMs(state.phaseMicros[i]);
+    }
+}
+
+void WakeTrace::Clear(const PlantPacketTrace &delivered) {
+
+    // Taking off what was sent rather than zeroing keeps anything since, e.g. the request that carried the summary
+    state.wakes = state.wakes > delivered.wakes ? state.wakes - delivered.wakes : 0;
+    state.retries = state.retries > delivered.retries ? state.retries - delivered.retries : 0;
+    state.awakeMicros = Remaining(state.awakeMicros, delivered.awakeMs);
+    for(uint8_t i=0; i<WAKE_TRACE_PHASES; i++)  {
+        state.phaseMicros[i] = Remaining(state.phaseMicros[i], delivered.phaseMs[i]);
+    }
+}
+
+uint16_t WakeTrace::Describe(const PlantPacketTrace &summary, char *text, uint16_t size)  {
+
+    uint32_t traced = 0;
+    uint16_t awake = summary.awakeMs > 0 ? summary.awakeMs : 1;
+
+    if(size == 0)   {
+        return 0;
+    }
+
+    int length = snprintf(text, size, "%u wakes, awake %ums (%ums per wake), %u retries:",
+                          (unsigned)summary.wakes, (unsigned)summary.awakeMs,
+                          (unsigned)(summary.wakes > 0 ? summary.awakeMs / summary.wakes : 0), (unsigned)summary.retries);
+
+    // Phases that took no time are left out so the line stays short
+    for(uint8_t i=0; i<WAKE_TRACE_PHASES && length < size; i++) {
+        traced += summary.phaseMs[i];
+        if(summary.phaseMs[i] == 0) {
+            continue;
+        }
+        length += snprintf(&text[length], size - length, " %s %ums %u%%,", phaseNames[i],
+                           (unsigned)summary.phaseMs[i], (unsigned)((uint32_t)summary.phaseMs[i] * 100 / awake));
+    }
+    if(length < size)   {
+        uint32_t untraced = traced < summary.awakeMs ? summary.awakeMs - traced : 0;
+        length += snprintf(&text[length], size - length, " untraced %ums %u%%",
+                           (unsigned)untraced, (unsigned)(untraced * 100 / awake));
+    }
+    return length < size ? length : size - 1;
+}
+
+const char *WakeTrace::PhaseName(uint8_t index) {
+
+    return index < WAKE_TRACE_PHASES ? phaseNames[index] : "unknown";
+}
+
+void WakeTrace::Close(uint32_t now) {
+
+    if(phase != WAKE_TRACE_NONE)    {
+        state.phaseMicros[phase] += now - phaseStart;
+        phase = WAKE_TRACE_NONE;
+    }
+}
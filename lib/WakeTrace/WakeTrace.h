@@ -0,0 +1,62 @@
+/*
+ *  WakeTrace library to time each phase of a sensor's wake
+ *  and sum them up until the summary can ride on an uplink
+ */
+
+#ifndef WAKETRACE_H
+#define WAKETRACE_H
+
+#define WAKE_TRACE_PHASES                   (PLANT_PACKET_TRACE_PHASES)                     // One total per WakeTracePhase, all that fits a trace packet
+#define WAKE_TRACE_NONE                     (0xFF)                                          // No phase in progress
+#define WAKE_TRACE_TEXT_LENGTH              (192)                                           // Enough for Describe() to list every phase
+
+#include <stdint.h>
+#include "PlantPacket.h"
+
+// Order is part of the trace packet, add new phases at the end
+enum WakeTracePhase {
+    WAKE_PHASE_SENSOR,                                                                      //  Soil sensor powered and sampling. Awake time only, sleeps between polls are not counted
+    WAKE_PHASE_WATERING,                                                                    //  Running the pump controller
+    WAKE_PHASE_RADIO_UP,                                                                    //  nRF24 power up and oscillator start
+    WAKE_PHASE_RADIO_TX,                                                                    //  radio.write() calls, auto retransmits and waiting for acks
+    WAKE_PHASE_DISCOVERY,                                                                   //  Listening for the base station's beacon
+    WAKE_PHASE_WIFI,                                                                        //  WiFi association and DHCP
+    WAKE_PHASE_CLOCK,                                                                       //  NTP
+    WAKE_PHASE_HTTP,                                                                        //  Building request bodies and posting them
+};
+
+static_assert(WAKE_PHASE_HTTP + 1 == WAKE_TRACE_PHASES, "Every WakeTracePhase needs a place in the trace packet");
+
+// Plain data so the ESP can keep it in RTC memory across deep sleep. Under 50 bytes so it also fits the AVR
+struct WakeTraceState {
+    uint32_t phaseMicros[WAKE_TRACE_PHASES];                                                //  Since the last summary
+    uint32_t awakeMicros;                                                                   //  Every wake since the last summary, traced or not
+    uint16_t retries;                                                                       //  Radio retransmits
+    uint8_t wakes;
+    uint8_t reserved;
+};
+
+class WakeTrace {
+    public:
+        WakeTrace(WakeTraceState &state);                                                   //  State is kept by the caller so it can survive deep sleep
+        void BeginWake();                                                                   //  Call first thing on a wake, the clock is read from HalMicros()
+        void Begin(uint8_t phase);                                                          //  Ends the phase in progress and starts timing this one, so phases never
+        void End();                                                                         //  overlap and add up to at most the awake time
+        void AddRetries(uint8_t retries);
+        void EndWake();                                                                     //  Call just before sleeping
+        void Summarize(PlantPacketTrace &summary);                                          //  Totals so far, the wake and phase in progress are counted up to now
+        void Clear(const PlantPacketTrace &delivered);                                      //  Takes a delivered summary off the totals, time since it was made
+                                                                                            //  is kept for the next one
+        static uint16_t Describe(const PlantPacketTrace &summary,                           //  One line breakdown of a summary for logs and the host decoder,
+                                 char *text, uint16_t size);                                //  returns its length
+        static const char *PhaseName(uint8_t phase);
+        WakeTraceState &state;
+
+    private:
+        void Close(uint32_t now);                                                           //  Adds the phase in progress up to now
+        uint32_t wakeStart;
+        uint32_t phaseStart;
+        uint8_t phase;                                                                      //  WAKE_TRACE_NONE between phases
+};
+
+#endif
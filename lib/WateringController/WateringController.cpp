@@ -0,0 +1,135 @@
+/*
+ *  WateringController library to run the auto water pump from a
+ *  periodic tick instead of a busy loop
+ */
+
+#include "WateringController.h"
+
+WateringController::WateringController(WateringHardware &wateringHardware) : hardware(wateringHardware)  {
+
+    Configure(DEFAULT_SAMPLE_PERIOD_MS, DEFAULT_MAX_PUMP_MS, DEFAULT_MAX_PAUSE_MS,
+              DEFAULT_OVERFLOW_CLEAR_MS, DEFAULT_PUMP_ML_PER_MINUTE);
+    isRunning = false;
+    isPumpOn = false;
+    stats = {};
+}
+
+void WateringController::Configure(uint16_t samplePeriod, uint32_t maxPump, uint32_t maxPause, uint16_t overflowClear, uint16_t mlPerMinute)   {
+
+    samplePeriodMs = samplePeriod;
+    maxPumpMs = maxPump;
+    maxPauseMs = maxPause;
+    overflowClearMs = overflowClear;
+    pumpMlPerMinute = mlPerMinute;
+}
+
+void WateringController::Start(uint16_t rawShutoffThreshold)   {
+
+    shutoffThreshold = rawShutoffThreshold;
+    runMs = 0;
+    pumpMs = 0;
+    pausedMs = 0;
+    clearMs = 0;
+    sinceSampleMs = 0;
+    samples = 0;
+    overflowPauses = 0;
+    isRunning = true;
+
+    // The first reading is taken after one sample period, which also lets the sensor settle
+    hardware.SetSensorPower(true);
+    isPumpOn = !hardware.IsOverflowing();
+    hardware.SetPump(isPumpOn);
+}
+
+uint16_t WateringController::Tick(uint16_t elapsedMs)  {
+
+    if(!isRunning)  {
+        return 0;
+    }
+
+    // Charge the elapsed time to whatever the pump was doing since the last tick
+    runMs += elapsedMs;
+    sinceSampleMs += elapsedMs;
+    if(isPumpOn)    {
+        pumpMs += elapsedMs;
+    }
+    else    {
+        pausedMs += elapsedMs;
+    }
+
+    // Stop straight away on overflow, but only resume once the float has read clear for a while
+    if(hardware.IsOverflowing())    {
+        clearMs = 0;
+        if(isPumpOn)    {
+            isPumpOn = false;
+            hardware.SetPump(false);
+            overflowPauses++;
+        }
+    }
+    else if(!isPumpOn)  {
+        clearMs += elapsedMs;
+        if(clearMs >= overflowClearMs)  {
+            isPumpOn = true;
+            hardware.SetPump(true);
+            pausedMs = 0;
+        }
+    }
+
+    if(pumpMs >= maxPumpMs) {
+        Stop(WATERING_PUMP_TIMEOUT);
+        return 0;
+    }
+    if(pausedMs >= maxPauseMs)  {
+        Stop(WATERING_OVERFLOW_TIMEOUT);
+        return 0;
+    }
+
+    // The reading drops as the soil gets wetter
+    if(sinceSampleMs >= samplePeriodMs) {
+        sinceSampleMs = 0;
+        samples++;
+        if(hardware.ReadMoisture() <= shutoffThreshold)  {
+            Stop(WATERING_REACHED_TARGET);
+            return 0;
+        }
+    }
+
+    return WATERING_TICK_MS;
+}
+
+void WateringController::Stop(uint8_t result)  {
+
+    hardware.SetPump(false);
+    hardware.SetSensorPower(false);
+    isPumpOn = false;
+    if(!isRunning)  {
+        return;
+    }
+    isRunning = false;
+
+    // Volume is worked out in 100ms steps to keep the multiply inside 32 bits
+    uint32_t millilitres = (pumpMs / 100) * pumpMlPerMinute / 600;
+
+    stats.runs++;
+    if(result == WATERING_PUMP_TIMEOUT || result == WATERING_OVERFLOW_TIMEOUT)  {
+        stats.timeouts++;
+    }
+    stats.lastResult = result;
+    stats.lastOverflowPauses = overflowPauses;
+    stats.lastSamples = samples;
+    stats.lastRunMs = runMs;
+    stats.lastPumpMs = pumpMs;
+    stats.lastMillilitres = millilitres;
+    stats.totalPumpMs += pumpMs;
+    stats.totalMillilitres += millilitres;
+}
+
+bool WateringController::IsRunning()    {
+
+    return isRunning;
+}
+
+bool WateringController::IsPumpOn() {
+
+    return isPumpOn;
+}
@@ -0,0 +1,71 @@
+/*
+ *  WateringController library to run the auto water pump from a
+ *  periodic tick instead of a busy loop
+ */
+
+#ifndef WATERINGCONTROLLER_H
+#define WATERINGCONTROLLER_H
+
+#define WATERING_TICK_MS                    (100)                                           // Time between calls to Tick() that the controller asks for
+#define DEFAULT_SAMPLE_PERIOD_MS            (1000)                                          // Default value can be changed with Configure()
+#define DEFAULT_MAX_PUMP_MS                 (60000)                                         // Default value can be changed with Configure()
+#define DEFAULT_MAX_PAUSE_MS                (300000)                                        // Default value can be changed with Configure()
+#define DEFAULT_OVERFLOW_CLEAR_MS           (5000)                                          // Default value can be changed with Configure()
+#define DEFAULT_PUMP_ML_PER_MINUTE          (1200)                                          // Default value can be changed with Configure()
+
+#define WATERING_RUNNING                    (0)
+#define WATERING_REACHED_TARGET             (1)
+#define WATERING_PUMP_TIMEOUT               (2)                                             // Pump ran for the maximum time, reservoir may be empty
+#define WATERING_OVERFLOW_TIMEOUT           (3)                                             // Float sensor stayed tripped for the maximum pause
+
+#include <stdint.h>
+#include "WateringHardware.h"
+
+struct WateringStats {
+    uint16_t runs;
+    uint16_t timeouts;                                                                      //  Runs that ended on a pump or overflow timeout
+    uint8_t lastResult;                                                                     //  One of the WATERING_ results
+    uint8_t lastOverflowPauses;                                                             //  Times the pump was stopped by the float sensor
+    uint16_t lastSamples;                                                                   //  ADC reads during the run
+    uint32_t lastRunMs;                                                                     //  Whole run including pauses
+    uint32_t lastPumpMs;                                                                    //  Time the pump was on
+    uint32_t lastMillilitres;                                                               //  Estimated from pump time and flow rate
+    uint32_t totalPumpMs;
+    uint32_t totalMillilitres;
+};
+
+class WateringController    {
+    public:
+        WateringController(WateringHardware &hardware);
+        void Configure(uint16_t samplePeriodMs,                                             //  Time between soil readings while watering
+                       uint32_t maxPumpMs,                                                  //  Pump time before giving up
+                       uint32_t maxPauseMs,                                                 //  Time overflowing before giving up
+                       uint16_t overflowClearMs,                                            //  Float sensor must read clear this long before pumping resumes
+                       uint16_t pumpMlPerMinute);
+        void Start(uint16_t rawShutoffThreshold);                                           //  Powers the sensor and pump, stops once the reading is at or below the threshold
+        uint16_t Tick(uint16_t elapsedMs);                                                  //  Call after elapsedMs, returns the ms until the next tick or 0 once finished
+        void Stop(uint8_t result);                                                          //  Turns everything off and records the run
+        bool IsRunning();
+        bool IsPumpOn();
+        WateringStats stats;
+
+    private:
+        WateringHardware &hardware;
+        uint16_t samplePeriodMs;
+        uint32_t maxPumpMs;
+        uint32_t maxPauseMs;
+        uint16_t overflowClearMs;
+        uint16_t pumpMlPerMinute;
+        uint16_t shutoffThreshold;
+        bool isRunning;
+        bool isPumpOn;
+        uint32_t runMs;
+        uint32_t pumpMs;
+        uint32_t pausedMs;
+        uint16_t clearMs;                                                                   //  Time the float sensor has read clear while paused
+        uint16_t sinceSampleMs;
+        uint16_t samples;
+        uint8_t overflowPauses;
+};
+
+#endif
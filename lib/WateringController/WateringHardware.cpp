@@ -0,0 +1,96 @@
+/*
+ *  WateringHardware interface used by WateringController, with a
+ *  simulated pot for host builds
+ */
+
+#include "WateringHardware.h"
+
+#define UL_PER_ML   (1000)
+#define MS_PER_MIN  (60000)
+
+SimulatedPot::SimulatedPot(uint16_t dry, uint16_t wet, uint32_t soilCapacityMl, uint32_t saucerCapacityMl,
+                           uint32_t pumpMlPerMinute, uint32_t soakMlPerMinute, uint32_t reservoirMl)  {
+
+    dryRaw = dry;
+    wetRaw = wet;
+    soilCapacity = soilCapacityMl * UL_PER_ML;
+    saucerCapacity = saucerCapacityMl * UL_PER_ML;
+    pumpRate = pumpMlPerMinute * UL_PER_ML;
+    soakRate = soakMlPerMinute * UL_PER_ML;
+    pumpCarry = 0;
+    soakCarry = 0;
+    soil = 0;
+    pooled = 0;
+    reservoir = reservoirMl * UL_PER_ML;
+    delivered = 0;
+    isPumpOn = false;
+    isSensorPowered = false;
+    sensorReads = 0;
+}
+
+void SimulatedPot::Advance(uint32_t elapsedMs)   {
+
+    // Pump moves water from the reservoir until it runs dry
+    if(isPumpOn)    {
+        uint64_t flow = (uint64_t)pumpRate * elapsedMs + pumpCarry;
+        uint32_t pumped = (uint32_t)(flow / MS_PER_MIN);
+        pumpCarry = (uint32_t)(flow % MS_PER_MIN);
+        pumped = pumped < reservoir ? pumped : reservoir;
+        reservoir -= pumped;
+        pooled += pumped;
+        delivered += pumped;
+    }
+
+    // Pooled water soaks in at a limited rate and stops once the soil is saturated
+    uint64_t flow = (uint64_t)soakRate * elapsedMs + soakCarry;
+    uint32_t soaked = (uint32_t)(flow / MS_PER_MIN);
+    soakCarry = (uint32_t)(flow % MS_PER_MIN);
+    soaked = soaked < pooled ? soaked : pooled;
+    soaked = soaked < soilCapacity - soil ? soaked : soilCapacity - soil;
+    pooled -= soaked;
+    soil += soaked;
+}
+
+uint16_t SimulatedPot::ReadMoisture()  {
+
+    sensorReads++;
+    if(!isSensorPowered)    {
+        return dryRaw;
+    }
+    return dryRaw - (uint16_t)((uint64_t)(dryRaw - wetRaw) * soil / soilCapacity);
+}
+
+bool SimulatedPot::IsOverflowing()  {
+
+    return pooled > saucerCapacity;
+}
+
+void SimulatedPot::SetPump(bool isOn)   {
+
+    isPumpOn = isOn;
+}
+
+void SimulatedPot::SetSensorPower(bool isOn)    {
+
+    isSensorPowered = isOn;
+}
+
+uint32_t SimulatedPot::SoilMl()  {
+
+    return soil / UL_PER_ML;
+}
+
+uint32_t SimulatedPot::SaucerMl()    {
+
+    return pooled / UL_PER_ML;
+}
+
+uint32_t SimulatedPot::ReservoirMl() {
+
+    return reservoir / UL_PER_ML;
+}
+
+uint32_t SimulatedPot::DeliveredMl() {
+
+    return delivered / UL_PER_ML;
+}
@@ -0,0 +1,60 @@
+/*
+ *  WateringHardware interface used by WateringController, with a
+ *  simulated pot for host builds
+ */
+
+#ifndef WATERINGHARDWARE_H
+#define WATERINGHARDWARE_H
+
+#include <stdint.h>
+
+// Pump, float sensor and soil sensor as seen by the controller
+class WateringHardware  {
+    public:
+        virtual ~WateringHardware() {}
+        virtual uint16_t ReadMoisture() = 0;                                                //  Raw ADC value, lower is wetter
+        virtual bool IsOverflowing() = 0;                                                   //  Float sensor state
+        virtual void SetPump(bool isOn) = 0;
+        virtual void SetSensorPower(bool isOn) = 0;
+};
+
+// Pot with a soil sensor, a saucer with a float sensor and a pump fed from a reservoir. Water from the
+// pump soaks into the soil at a limited rate, anything faster pools in the saucer and soaks in later
+class SimulatedPot : public WateringHardware  {
+    public:
+        SimulatedPot(uint16_t dryRaw,                                                       //  Raw reading with dry soil
+                     uint16_t wetRaw,                                                       //  Raw reading with saturated soil
+                     uint32_t soilCapacityMl,                                               //  Water the soil holds when saturated
+                     uint32_t saucerCapacityMl,                                             //  Water in the saucer before the float trips
+                     uint32_t pumpMlPerMinute,
+                     uint32_t soakMlPerMinute,                                              //  Rate water moves from the top into the soil
+                     uint32_t reservoirMl);
+        void Advance(uint32_t elapsedMs);                                                   //  Moves water for elapsedMs of simulated time
+        uint16_t ReadMoisture() override;
+        bool IsOverflowing() override;
+        void SetPump(bool isOn) override;
+        void SetSensorPower(bool isOn) override;
+        uint32_t SoilMl();
+        uint32_t SaucerMl();
+        uint32_t ReservoirMl();
+        uint32_t DeliveredMl();                                                             //  Water the pump has actually moved
+        uint32_t sensorReads;                                                               //  ADC reads made by the controller
+
+    private:
+        uint16_t dryRaw;
+        uint16_t wetRaw;
+        uint32_t soilCapacity;                                                              //  Volumes are kept in microlitres
+        uint32_t saucerCapacity;
+        uint32_t pumpRate;                                                                  //  Microlitres per minute, so slow pumps do not round to nothing
+        uint32_t soakRate;
+        uint32_t pumpCarry;                                                                 //  Part of a microlitre left over from the last step, in microlitre ms per minute
+        uint32_t soakCarry;
+        uint32_t soil;
+        uint32_t pooled;                                                                    //  Water on top of the soil and in the saucer
+        uint32_t reservoir;
+        uint32_t delivered;
+        bool isPumpOn;
+        bool isSensorPowered;
+};
+
+#endif